@@ -6,8 +6,20 @@ classdef Firmata < arduinoio.internal.ProtocolBase
     % Built-in add-on library message format        [START_SYSEX; 0x01; sequence_ID; payload_size; libID; cmdID; params; END_SYSEX]
     % Custom add-on library firmata message format  [START_SYSEX; 0x01; sequence_ID; payload_size; libID; msg; END_SYSEX]
     % Server return message format                  [cmdID; payload_size; values]
+    % Tagged server return message format           [0x00; 0x02; sequence_ID; cmdID; payload_size; values] (after enablePipelining)
     % Note: During sending, payload_size isn't used for now and is defaulted to [0x01 0x01]
     %       During receiving, payload_size is the size of the actual returned value
+    % Batch message format                          [START_SYSEX; 0x00; sequence_ID; payload_size; 0x04; N; N x (header; length; cmdID/libID; params); END_SYSEX]
+    % Server return message format                  [0x04; payload_size; numExecuted; numExecuted x (cmdID; payload_size; values)]
+    % Binary framing message format                 [COBS([header; sequence_ID; payload_size; cmdID/libID; params]); 0x00] (after enableBinaryFraming)
+    %       payload_size is the number of bytes after it and trailing data arrays are raw 8-bit values
+    % Server event message format                   [0x00; 0x03; eventID; payload_size; values] (unsolicited, e.g. while streaming)
+    % Stream frame event values                     [frameCounter; numSamples; numOverruns; numSamples x (digitalBits; analog msb/lsb pairs)]
+    % Pin change event values                       [pin; state; timestamp (4 bytes, msb first, microseconds)]
+    % Rule event values                             [ruleID; value (2 bytes, msb first); timestamp (4 bytes, msb first, microseconds)]
+    % Trace drain return values                     [pointerSize; numDropped (2 bytes); N x (length; format address; 4-byte args)] (lsb first)
+    % Memory report return values                   [flags; 7 x 2 bytes; numLibraries; numLibraries x (static; dynamic bytes)] (msb first)
+    % Stats return values                           [3 x 4 bytes; 4 x 2 bytes; numBuckets; N; N x (libID; cmdID; max and total us; numBuckets x 2 bytes)] (msb first)
  
     %   Copyright 2014 The MathWorks, Inc.
 
@@ -15,24 +27,99 @@ classdef Firmata < arduinoio.internal.ProtocolBase
         GET_SERVER_INFO          = hex2dec('01')
         RESET_PINS_STATE         = hex2dec('02')
         GET_AVAILABLE_RAM        = hex2dec('03')
+        BATCH_COMMANDS           = hex2dec('04')
+        CONFIGURE_PROTOCOL       = hex2dec('05')
+        DRAIN_TRACE              = hex2dec('06')
+        GET_TRACE_STRING         = hex2dec('07')
+        GET_MEMORY_REPORT        = hex2dec('08')
+        GET_STATS                = hex2dec('09')
         WRITE_DIGITAL_PIN        = hex2dec('10')
         READ_DIGITAL_PIN         = hex2dec('11')
         CONFIGURE_DIGITAL_PIN    = hex2dec('12')
+        READ_DIGITAL_PORT        = hex2dec('13')
+        WRITE_DIGITAL_PORT       = hex2dec('14')
+        SUBSCRIBE_PIN_CHANGE     = hex2dec('15')
+        UNSUBSCRIBE_PIN_CHANGE   = hex2dec('16')
         WRITE_PWM_VOLTAGE        = hex2dec('20')
         WRITE_PWM_DUTY_CYCLE     = hex2dec('21')
         PLAY_TONE                = hex2dec('22')
         READ_VOLTAGE             = hex2dec('30')
+        SCAN_VOLTAGES            = hex2dec('31')
+        START_STREAMING          = hex2dec('40')
+        STOP_STREAMING           = hex2dec('41')
+        UPLOAD_SCRIPT            = hex2dec('50')
+        RUN_SCRIPT               = hex2dec('51')
+        STOP_SCRIPT              = hex2dec('52')
+        SET_RULE                 = hex2dec('60')
+        CLEAR_RULE               = hex2dec('61')
         SYSEX_START              = hex2dec('F0')
         SYSEX_END                = hex2dec('F7')
         NON_LIB_HEADER           = hex2dec('00')
         LIB_HEADER               = hex2dec('01')
         SCAN_I2C_BUS             = hex2dec('01')
+        CONFIGURE_I2C_BUS        = hex2dec('07')
+        I2C_SCAN_CACHED          = 1
+    end
+    
+    properties(Access = private, Constant = true)
+        MAX_DATA_BYTES           = 32 % max number of bytes between START_SYSEX and END_SYSEX accepted by the server
+    end
+    
+    properties(Access = private, Constant = true)
+        PROTOCOL_TAGGED_RESPONSES = hex2dec('01')
+        PROTOCOL_BINARY_FRAMING  = hex2dec('02')
+    end
+    
+    properties(Access = private, Constant = true)
+        PORT_OPERATIONS          = {'write', 'set', 'clear', 'toggle'} % operation codes 0 to 3 of WRITE_DIGITAL_PORT
+        SCAN_MODES               = {'mean', 'median', 'minmax'} % mode codes 0 to 2 of SCAN_VOLTAGES
+        PIN_CHANGE_EVENT         = hex2dec('15')
+        STREAM_EVENT             = hex2dec('40')
+        RULE_EVENT               = hex2dec('60')
+        STREAM_SAMPLES_PER_FRAME = 8 % reduced by the server to what fits its frame buffer
+    end
+    
+    properties(Access = private, Constant = true)
+        % Script instructions, see MWScript.h
+        SCRIPT_END               = hex2dec('00')
+        SCRIPT_WRITE_DIGITAL     = hex2dec('01')
+        SCRIPT_WRITE_PWM         = hex2dec('02')
+        SCRIPT_WAIT_MS           = hex2dec('03')
+        SCRIPT_WAIT_US           = hex2dec('04')
+        SCRIPT_LOOP              = hex2dec('05')
+        SCRIPT_COMMAND           = hex2dec('06')
+        SCRIPT_CHUNK_SIZE        = 21 % bytecode bytes per UPLOAD_SCRIPT, 24 bytes once 7-bit encoded
+        MAX_SYSEX_DATA_SIZE      = 16 % data bytes of a library command, 19 bytes once 7-bit encoded
+        MAX_FRAME_DATA_SIZE      = struct('small', 48, 'large', 240) % in the 64 and 256 byte binary frames
+    end
+    
+    properties(Access = private, Constant = true)
+        % Rule conditions, flags and actions, see MWRules.h
+        RULE_CONDITIONS          = {'pinEdge', 'analogAbove', 'analogBelow', 'hostTimeout'} % codes 1 to 4
+        RULE_ACTIONS             = {'none', 'writeDigitalPin', 'runScript', 'stopScript', 'command'} % codes 0 to 4
+        RULE_EMIT_EVENT          = 1
+        RULE_ONE_SHOT            = 2
+    end
+    
+    properties(Access = private)
+        Pipelined = false
+        BinaryFraming = false
+        Outstanding = [] % sequence IDs of requests whose responses have not been received
+        MaxOutstanding = 1 % requests in flight, reported by configureProtocol (MAX_OUTSTANDING_REQUESTS in MWArduino.h)
+        StreamChannels = [0 0] % number of digital and analog channels of the running stream
+        Streaming = false
+        PinChangeSubscriptions = [] % pins the server sends pin change events for
+        EventRules = [] % rules the server sends rule events for
+        LibraryEvents = [] % event IDs of add-on libraries whose events are read
+        TraceFormats % trace format strings read from the server, keyed by their hex address
+        DrainingTrace = false
     end
     
 %% Constructor   
     methods (Access = public)
         function obj = Firmata(connectionObj, traceOn)
             obj = obj@arduinoio.internal.ProtocolBase(connectionObj, traceOn);
+            obj.TraceFormats = containers.Map('KeyType', 'char', 'ValueType', 'char');
         end
     end
  
@@ -53,6 +140,46 @@ classdef Firmata < arduinoio.internal.ProtocolBase
             [~] = sendMWMessage(obj, msg);
         end
         
+        function writeDigitalPins(obj, pins, values)
+            cmds = cell(numel(pins), 1);
+            for ii = 1:numel(pins)
+                cmds{ii} = [...
+                    obj.NON_LIB_HEADER;
+                    obj.WRITE_DIGITAL_PIN;
+                    pins(ii);
+                    values(ii)
+                    ];
+            end
+            [~] = sendBatchMessage(obj, cmds);
+        end
+        
+        function value = readDigitalPort(obj, port)
+            msg = [...
+                obj.READ_DIGITAL_PORT;
+                port;
+                ];
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.READ_DIGITAL_PORT
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            value = double(value(4));
+        end
+        
+        function value = writeDigitalPort(obj, port, operation, mask, value)
+            operationID = find(strcmpi(operation, obj.PORT_OPERATIONS)) - 1;
+            msg = [...
+                obj.WRITE_DIGITAL_PORT;
+                port;
+                operationID;
+                encodePayload(obj, uint8([mask; value]));
+                ];
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.WRITE_DIGITAL_PORT
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            value = double(value(4));
+        end
+        
         function value = readDigitalPin(obj, pin)
             msg = [...
                 obj.READ_DIGITAL_PIN;
@@ -128,6 +255,26 @@ classdef Firmata < arduinoio.internal.ProtocolBase
             end
         end
 
+        function values = readVoltages(obj, pins, numSamples, mode, aref)
+            msg = [...
+            obj.SCAN_VOLTAGES;
+            numel(pins);
+            numSamples;
+            find(strcmp(mode, obj.SCAN_MODES)) - 1;
+            pins(:)
+            ];
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.SCAN_VOLTAGES
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            if numel(value) < 4
+                obj.localizedError('MATLAB:arduinoio:general:invalidScanConfiguration');
+            end
+            % results are in 1/16 LSB, min/max returns a min and a max row per pin
+            counts = bitshift(value(4:2:end), 8) + value(5:2:end);
+            values = reshape(counts, [], numel(pins))/16/1024*aref;
+        end
+
         function playTone(obj, pin, frequency, duration)
             duration = round(duration*1000);
             
@@ -140,13 +287,21 @@ classdef Firmata < arduinoio.internal.ProtocolBase
                 arduinoio.BinaryToASCII(frequency);
                 arduinoio.BinaryToASCII(duration);
                 ] ;
-            [~] = sendMWMessage(obj, msg);
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.PLAY_TONE
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            elseif value(4) ~= 0
+                obj.localizedError('MATLAB:arduinoio:general:toneWhileStreaming');
+            end
         end
         
-        function addrs = scanI2CBus(obj, libID, bus)
+        function addrs = scanI2CBus(obj, libID, bus, useCache)
             addrs = {};
             commandID = obj.SCAN_I2C_BUS;
             cmd = [commandID; bus];
+            if nargin > 3 && useCache
+                cmd = [cmd; obj.I2C_SCAN_CACHED];
+            end
             output = sendCustomMessage(obj, libID, cmd);
             if isempty(output) % no return value 
                 obj.localizedError('MATLAB:arduinoio:general:communicationLostI2C', num2str(bus));
@@ -157,6 +312,8 @@ classdef Firmata < arduinoio.internal.ProtocolBase
                 numAddrsFound = bitshift(payLoad(1), 8) + payLoad(2);
                 if returnedCMDId ~= commandID
                     obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                elseif arduinoio.internal.isErrorResponse(output, commandID) % addresses are below 0x80
+                    obj.localizedError('MATLAB:arduinoio:general:commandRejected', 'I2C');
                 elseif numAddrsFound == hex2dec('00') % no devices found
                     % return empty addrs
                 else
@@ -174,6 +331,292 @@ classdef Firmata < arduinoio.internal.ProtocolBase
             end
         end
         
+        function busSpeed = configureI2CBus(obj, libID, bus, busSpeed)
+            commandID = obj.CONFIGURE_I2C_BUS;
+            cmd = [commandID; bus; arduinoio.BinaryToASCII(typecast(uint32(busSpeed), 'uint8'))];
+            output = sendCustomMessage(obj, libID, cmd);
+            if isempty(output) || output(1) ~= commandID
+                obj.localizedError('MATLAB:arduinoio:general:communicationLostI2C', num2str(bus));
+            elseif arduinoio.internal.isErrorResponse(output, commandID)
+                obj.localizedError('MATLAB:arduinoio:general:commandRejected', 'I2C');
+            end
+            speed = double(output(4:7));
+            busSpeed = sum(speed(:)' .* 2.^[24 16 8 0]);
+        end
+
+        function startStreaming(obj, digitalPins, analogPins, samplePeriod)
+            pins = [digitalPins(:); analogPins(:)];
+            types = [zeros(numel(digitalPins), 1); ones(numel(analogPins), 1)];
+            period = typecast(uint32(round(samplePeriod*1e6)), 'uint8');
+            
+            msg = [...
+                obj.START_STREAMING;
+                numel(pins);
+                reshape([pins, types]', [], 1);
+                obj.STREAM_SAMPLES_PER_FRAME;
+                encodePayload(obj, period(:));
+                ];
+            % stream frames may arrive before any later response
+            obj.Streaming = true;
+            updateReceiveEvents(obj);
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.START_STREAMING || value(4) ~= 0
+                obj.Streaming = false;
+                updateReceiveEvents(obj);
+                if isempty(value) || value(1) ~= obj.START_STREAMING
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                obj.localizedError('MATLAB:arduinoio:general:invalidStreamConfiguration');
+            end
+            obj.StreamChannels = [numel(digitalPins), numel(analogPins)];
+        end
+        
+        function [digitalValues, analogValues, numOverruns] = readStream(obj, aref)
+            numDigital = obj.StreamChannels(1);
+            numAnalog = obj.StreamChannels(2);
+            sampleSize = (numDigital > 0) + 2*numAnalog;
+            
+            digitalValues = zeros(0, numDigital);
+            analogValues = zeros(0, numAnalog);
+            numOverruns = 0;
+            frames = readEvents(obj.TransportLayer, obj.STREAM_EVENT);
+            for ii = 1:numel(frames)
+                frame = double(frames{ii});
+                numSamples = frame(2);
+                numOverruns = numOverruns + frame(3);
+                samples = reshape(frame(4:3+numSamples*sampleSize), sampleSize, numSamples)';
+                if numDigital > 0
+                    bits = bitget(repmat(samples(:, 1), 1, numDigital), repmat(1:numDigital, numSamples, 1));
+                    digitalValues = [digitalValues; bits]; %#ok<AGROW>
+                end
+                if numAnalog > 0
+                    first = (numDigital > 0) + 1;
+                    counts = bitshift(samples(:, first:2:end), 8) + samples(:, first+1:2:end);
+                    analogValues = [analogValues; counts/1024*aref]; %#ok<AGROW>
+                end
+            end
+        end
+        
+        function stopStreaming(obj)
+            msg = obj.STOP_STREAMING;
+            [~] = sendMWMessage(obj, msg);
+            obj.Streaming = false;
+            updateReceiveEvents(obj);
+        end
+        
+        function loadScript(obj, slot, steps)
+            % steps: {'writeDigitalPin', pin, value}, {'writePWM', pin, value},
+            % {'pause', seconds}, {'loop', firstStep, count}, {'command', header, msg}
+            code = cell(numel(steps), 1);
+            for ii = 1:numel(steps)
+                step = steps{ii};
+                switch step{1}
+                    case 'writeDigitalPin'
+                        code{ii} = [obj.SCRIPT_WRITE_DIGITAL; step{2}; step{3}];
+                    case 'writePWM'
+                        code{ii} = [obj.SCRIPT_WRITE_PWM; step{2}; step{3}];
+                    case 'pause'
+                        code{ii} = zeros(0, 1);
+                        us = round(step{2}*1e6);
+                        ms = floor(us/1000);
+                        us = us - 1000*ms;
+                        while ms > 0
+                            n = min(ms, 65535);
+                            code{ii} = [code{ii}; obj.SCRIPT_WAIT_MS; bitand(n, 255); bitshift(n, -8)];
+                            ms = ms - n;
+                        end
+                        if us > 0
+                            code{ii} = [code{ii}; obj.SCRIPT_WAIT_US; bitand(us, 255); bitshift(us, -8)];
+                        end
+                    case 'loop'
+                        code{ii} = [obj.SCRIPT_LOOP; 0; step{3}]; % target resolved below
+                    case 'command'
+                        code{ii} = [obj.SCRIPT_COMMAND; step{2}; numel(step{3}); double(step{3}(:))];
+                end
+            end
+            offsets = cumsum([0; cellfun(@numel, code)]);
+            for ii = 1:numel(steps)
+                if strcmp(steps{ii}{1}, 'loop')
+                    code{ii}(2) = offsets(steps{ii}{2});
+                end
+            end
+            bytecode = uint8([vertcat(code{:}); obj.SCRIPT_END]);
+            if offsets(end) > 255
+                obj.localizedError('MATLAB:arduinoio:general:invalidScript');
+            end
+            
+            for offset = 0:obj.SCRIPT_CHUNK_SIZE:numel(bytecode)-1
+                chunk = bytecode(offset+1:min(offset+obj.SCRIPT_CHUNK_SIZE, end));
+                msg = [...
+                    obj.UPLOAD_SCRIPT;
+                    slot;
+                    offset;
+                    numel(chunk);
+                    encodePayload(obj, chunk);
+                    ];
+                value = sendMWMessage(obj, msg);
+                if isempty(value) || value(1) ~= obj.UPLOAD_SCRIPT
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                if value(4) ~= 0
+                    obj.localizedError('MATLAB:arduinoio:general:invalidScript');
+                end
+            end
+        end
+        
+        function runScript(obj, slot)
+            msg = [...
+                obj.RUN_SCRIPT;
+                slot
+                ];
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.RUN_SCRIPT
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            if value(4) ~= 0
+                obj.localizedError('MATLAB:arduinoio:general:scriptNotLoaded', num2str(slot));
+            end
+        end
+        
+        function stopScript(obj, slot)
+            msg = [...
+                obj.STOP_SCRIPT;
+                slot
+                ];
+            [~] = sendMWMessage(obj, msg);
+        end
+        
+        function subscribePinChange(obj, pin, debounceTime)
+            debounce = typecast(uint32(round(debounceTime*1e6)), 'uint8');
+            msg = [...
+                obj.SUBSCRIBE_PIN_CHANGE;
+                pin;
+                encodePayload(obj, debounce(:));
+                ];
+            obj.PinChangeSubscriptions = union(obj.PinChangeSubscriptions, pin);
+            updateReceiveEvents(obj);
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.SUBSCRIBE_PIN_CHANGE || value(4) ~= 0
+                obj.PinChangeSubscriptions = setdiff(obj.PinChangeSubscriptions, pin);
+                updateReceiveEvents(obj);
+                if isempty(value) || value(1) ~= obj.SUBSCRIBE_PIN_CHANGE
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                obj.localizedError('MATLAB:arduinoio:general:tooManyPinChangeSubscriptions');
+            end
+        end
+        
+        function [pins, values, timestamps] = readPinChanges(obj)
+            events = readEvents(obj.TransportLayer, obj.PIN_CHANGE_EVENT);
+            pins = zeros(numel(events), 1);
+            values = zeros(numel(events), 1);
+            timestamps = zeros(numel(events), 1);
+            for ii = 1:numel(events)
+                event = double(events{ii});
+                pins(ii) = event(1);
+                values(ii) = event(2);
+                timestamps(ii) = (bitshift(event(3), 24) + bitshift(event(4), 16) + bitshift(event(5), 8) + event(6))/1e6;
+            end
+        end
+        
+        function unsubscribePinChange(obj, pin)
+            msg = [...
+                obj.UNSUBSCRIBE_PIN_CHANGE;
+                pin
+                ];
+            [~] = sendMWMessage(obj, msg);
+            obj.PinChangeSubscriptions = setdiff(obj.PinChangeSubscriptions, pin);
+            updateReceiveEvents(obj);
+        end
+        
+        function setRule(obj, ruleID, condition, action, emitEvent, oneShot)
+            % condition: {name, pin, option, argument}, action: {name, operands...}
+            flags = emitEvent*obj.RULE_EMIT_EVENT + oneShot*obj.RULE_ONE_SHOT;
+            if isempty(action)
+                action = {'none'};
+            end
+            switch action{1}
+                case 'command'
+                    operands = [action{2}; numel(action{3}); double(action{3}(:))];
+                otherwise
+                    operands = [action{2:end}]';
+            end
+            definition = uint8([...
+                find(strcmp(condition{1}, obj.RULE_CONDITIONS));
+                condition{2};
+                condition{3};
+                bitand(condition{4}, 255);
+                bitshift(condition{4}, -8);
+                flags;
+                find(strcmp(action{1}, obj.RULE_ACTIONS)) - 1;
+                operands(:)
+                ]);
+            msg = [...
+                obj.SET_RULE;
+                ruleID;
+                numel(definition);
+                encodePayload(obj, definition);
+                ];
+            % a rule may fire before the response arrives
+            if emitEvent
+                obj.EventRules = union(obj.EventRules, ruleID);
+            else
+                obj.EventRules = setdiff(obj.EventRules, ruleID);
+            end
+            updateReceiveEvents(obj);
+            value = sendMWMessage(obj, msg);
+            if isempty(value) || value(1) ~= obj.SET_RULE
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            if value(4) ~= 0
+                obj.EventRules = setdiff(obj.EventRules, ruleID);
+                updateReceiveEvents(obj);
+                obj.localizedError('MATLAB:arduinoio:general:invalidRule');
+            end
+        end
+        
+        function [ruleIDs, values, timestamps] = readRuleEvents(obj)
+            events = readEvents(obj.TransportLayer, obj.RULE_EVENT);
+            ruleIDs = zeros(numel(events), 1);
+            values = zeros(numel(events), 1);
+            timestamps = zeros(numel(events), 1);
+            for ii = 1:numel(events)
+                event = double(events{ii});
+                ruleIDs(ii) = event(1);
+                values(ii) = bitshift(event(2), 8) + event(3);
+                timestamps(ii) = (bitshift(event(4), 24) + bitshift(event(5), 16) + bitshift(event(6), 8) + event(7))/1e6;
+            end
+        end
+        
+        function clearRule(obj, ruleID)
+            % ruleID 127 clears all rules
+            msg = [...
+                obj.CLEAR_RULE;
+                ruleID
+                ];
+            [~] = sendMWMessage(obj, msg);
+            if ruleID == 127
+                obj.EventRules = [];
+            else
+                obj.EventRules = setdiff(obj.EventRules, ruleID);
+            end
+            updateReceiveEvents(obj);
+        end
+        
+        function subscribeLibraryEvents(obj, eventID)
+            obj.LibraryEvents = union(obj.LibraryEvents, eventID);
+            updateReceiveEvents(obj);
+        end
+        
+        function events = readLibraryEvents(obj, eventID)
+            events = readEvents(obj.TransportLayer, eventID);
+        end
+        
+        function unsubscribeLibraryEvents(obj, eventID)
+            obj.LibraryEvents = setdiff(obj.LibraryEvents, eventID);
+            updateReceiveEvents(obj);
+        end
+        
         function value = getAvailableRAM(obj)
             msg = obj.GET_AVAILABLE_RAM;
             value = sendMWMessage(obj, msg);
@@ -188,9 +631,75 @@ classdef Firmata < arduinoio.internal.ProtocolBase
             end
         end
         
+        function report = getMemoryReport(obj)
+            value = sendMWMessage(obj, obj.GET_MEMORY_REPORT);
+            if isempty(value) || value(1) ~= obj.GET_MEMORY_REPORT || numel(value) < 19
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            % flags MEMORY_STACK_PAINTED 0x01 and MEMORY_HEAP_LIST 0x02 tell which values the board supports
+            flags = value(4);
+            words = double(value(5:18));
+            words = words(1:2:end) * 256 + words(2:2:end);
+            report.FreeRAM = words(1);
+            report.MaxStackDepth = NaN;
+            report.StackHeadroom = NaN;
+            if bitand(flags, 1)
+                report.MaxStackDepth = words(2);
+                report.StackHeadroom = words(3);
+            end
+            report.HeapSize = NaN;
+            report.HeapFreeBytes = NaN;
+            report.HeapFreeBlocks = NaN;
+            report.LargestFreeBlock = NaN;
+            if bitand(flags, 2)
+                report.HeapSize = words(4);
+                report.HeapFreeBytes = words(5);
+                report.HeapFreeBlocks = words(6);
+                report.LargestFreeBlock = words(7);
+            end
+            numLibraries = value(19);
+            sizes = double(value(20:19+4*numLibraries));
+            sizes = sizes(1:2:end) * 256 + sizes(2:2:end);
+            report.LibraryStaticBytes = sizes(1:2:end)';
+            report.LibraryDynamicBytes = sizes(2:2:end)';
+        end
+        
+        function stats = getStats(obj, reset)
+            value = sendMWMessage(obj, [obj.GET_STATS; double(reset)]);
+            if isempty(value) || value(1) ~= obj.GET_STATS || numel(value) < 25
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            value = double(value(4:end));
+            value = value(:)';
+            stats.ElapsedMillis = value(1:4) * 2.^[24 16 8 0]';
+            stats.NumLoops = value(5:8) * 2.^[24 16 8 0]';
+            stats.MaxLoopMicros = value(9:12) * 2.^[24 16 8 0]';
+            stats.RXPeak = value(13:14) * [256 1]';
+            stats.TXPeak = value(15:16) * [256 1]';
+            stats.TXStalls = value(17:18) * [256 1]';
+            stats.UnrecordedCommands = value(19:20) * [256 1]';
+            numBuckets = value(21);
+            numSlots = value(22);
+            slotSize = 10 + 2*numBuckets;
+            stats.Commands = struct('LibID', {}, 'CmdID', {}, 'MaxMicros', {}, 'TotalMicros', {}, 'Buckets', {});
+            for ii = 1:numSlots
+                slot = value(22 + (ii-1)*slotSize + (1:slotSize));
+                stats.Commands(ii).LibID = slot(1);
+                stats.Commands(ii).CmdID = slot(2);
+                stats.Commands(ii).MaxMicros = slot(3:6) * 2.^[24 16 8 0]';
+                stats.Commands(ii).TotalMicros = slot(7:10) * 2.^[24 16 8 0]';
+                stats.Commands(ii).Buckets = slot(11:2:end) * 256 + slot(12:2:end);
+            end
+        end
+        
         function resetPinsState(obj)        
             msg = obj.RESET_PINS_STATE;
             [~] = sendMWMessage(obj, msg);
+            % the server stops streaming and drops all pin change subscriptions
+            obj.Streaming = false;
+            obj.PinChangeSubscriptions = [];
+            obj.EventRules = [];
+            updateReceiveEvents(obj);
         end
         
         function [getInfoSuccessFlag, libNames, libIDs, board, traceOn] = getServerInfo(obj)
@@ -248,44 +757,265 @@ classdef Firmata < arduinoio.internal.ProtocolBase
             openConnection(obj.TransportLayer);
         end
  
-        function value = sendCustomMessage(obj, libID, cmd, timeout)
-            msg = [...
-                obj.SYSEX_START;
-                obj.LIB_HEADER; % all add-on library commands starts with 0x01
-                obj.SequenceID;
-                uint8(1); % unused payload_size
-                uint8(1);
-                libID;
-                cmd;
-                obj.SYSEX_END];
-            if nargin < 4
-                value = sendMessage(obj.TransportLayer, msg);
+        function enablePipelining(obj)
+        % Switch the server to responses tagged with the request's
+        % sequence ID so that several requests can be in flight at once
+            configureProtocol(obj, true, obj.BinaryFraming);
+        end
+        
+        function enableBinaryFraming(obj)
+        % Switch the server to COBS framed commands carrying raw 8-bit
+        % data arrays instead of 7-bit sysex messages
+            configureProtocol(obj, obj.Pipelined, true);
+        end
+        
+        function output = encodePayload(obj, data)
+        % Encode the trailing data array of a command for the current framing
+            if obj.BinaryFraming
+                output = uint8(data(:));
             else
-                value = sendMessage(obj.TransportLayer, msg, timeout);
+                output = arduinoio.BinaryToASCII(data);
             end
-            % To Do - add logic to check correct return sequence ID 
-            if obj.SequenceID == 127
-                obj.SequenceID = 0;
+        end
+        
+        function count = getMaxDataSize(obj, mcu)
+        % Largest data array of a library command that leaves room for a few parameters
+            if ~obj.BinaryFraming
+                count = obj.MAX_SYSEX_DATA_SIZE;
+            elseif strcmp(mcu, 'atmega328p') % 2KB SRAM, see MAX_FRAME_SIZE in MWArduino.h
+                count = obj.MAX_FRAME_DATA_SIZE.small;
             else
-                obj.SequenceID = obj.SequenceID + 1;
+                count = obj.MAX_FRAME_DATA_SIZE.large;
+            end
+        end
+ 
+        function value = sendCustomMessage(obj, libID, cmd, timeout)
+            msg = buildFrame(obj, obj.LIB_HEADER, [libID; cmd]); % all add-on library commands starts with 0x01
+            if nargin < 4
+                value = sendFrame(obj, msg);
+            else
+                value = sendFrame(obj, msg, timeout);
             end
         end
 
         function value = sendMWMessage(obj, cmd, timeout)
-            msg = [...
-                obj.SYSEX_START;
-                obj.NON_LIB_HEADER; % all arduino and firmata commands starts with 0x00
-                obj.SequenceID;
-                uint8(1); % unused payload_size
-                uint8(1);
-                cmd;
-                obj.SYSEX_END];
+            msg = buildFrame(obj, obj.NON_LIB_HEADER, cmd); % all arduino and firmata commands starts with 0x00
+            if nargin < 3
+                value = sendFrame(obj, msg);
+            else
+                value = sendFrame(obj, msg, timeout);
+            end
+        end
+        
+        function values = sendBatchMessage(obj, cmds, timeout)
+        % Execute the given commands in order with as few round trips as
+        % possible. Each element of cmds is a column vector starting with
+        % the header (0x00 or 0x01) followed by cmdID/libID and params.
+        % Returns one [cmdID; payload_size; values] vector per command.
+        % Each batch goes through sendMWMessage, so it is also answered
+        % with tagged responses and binary framing.
+            values = {};
+            header = 6; % [0x00; sequence_ID; payload_size; 0x04; N]
+            first = 1;
+            while first <= numel(cmds)
+                % pack as many commands as fit into one frame
+                last = first;
+                frameSize = header + numel(cmds{first}) + 1;
+                while last < numel(cmds) && frameSize + numel(cmds{last+1}) + 1 <= obj.MAX_DATA_BYTES
+                    last = last + 1;
+                    frameSize = frameSize + numel(cmds{last}) + 1;
+                end
+                msg = [obj.BATCH_COMMANDS; last-first+1];
+                for ii = first:last
+                    subCmd = cmds{ii};
+                    msg = [msg; subCmd(1); numel(subCmd)-1; subCmd(2:end)]; %#ok<AGROW>
+                end
+                if nargin < 3
+                    output = sendMWMessage(obj, msg);
+                else
+                    output = sendMWMessage(obj, msg, timeout);
+                end
+                if isempty(output) || output(1) ~= obj.BATCH_COMMANDS || numel(output) < 4
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                numExecuted = output(4);
+                index = 5;
+                for ii = 1:numExecuted
+                    if index+2 > numel(output) % reply of a command did not fit into the batch response
+                        obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                    end
+                    valueSize = bitshift(output(index+1), 8) + output(index+2);
+                    values = [values; {output(index:index+2+valueSize)}]; %#ok<AGROW>
+                    index = index + 3 + valueSize;
+                end
+                if numExecuted ~= last-first+1
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                first = last + 1;
+            end
+        end
+        
+        function sequenceID = submitCustomMessage(obj, libID, cmd)
+        % Send an add-on library command without waiting for its response.
+        % Requires enablePipelining; use collectResponse to get the result.
+            msg = buildFrame(obj, obj.LIB_HEADER, [libID; cmd]);
+            sequenceID = submitFrame(obj, msg);
+        end
+        
+        function sequenceID = submitMWMessage(obj, cmd)
+        % Send a built-in command without waiting for its response.
+        % Requires enablePipelining; use collectResponse to get the result.
+            msg = buildFrame(obj, obj.NON_LIB_HEADER, cmd);
+            sequenceID = submitFrame(obj, msg);
+        end
+        
+        function value = collectResponse(obj, sequenceID, timeout)
+        % Return the response to a request sent with submitMWMessage or
+        % submitCustomMessage
             if nargin < 3
-                value = sendMessage(obj.TransportLayer, msg);
+                value = collectResponse(obj.TransportLayer, sequenceID);
+            else
+                value = collectResponse(obj.TransportLayer, sequenceID, timeout);
+            end
+            obj.Outstanding(obj.Outstanding == sequenceID) = [];
+        end
+    end
+    
+    %% Private methods
+    methods (Access = private)
+        function configureProtocol(obj, pipelined, binaryFraming)
+            options = 0;
+            if pipelined
+                options = bitor(options, obj.PROTOCOL_TAGGED_RESPONSES);
+            end
+            if binaryFraming
+                options = bitor(options, obj.PROTOCOL_BINARY_FRAMING);
+            end
+            
+            % tagged responses apply to the reply of this command already
+            oldPipelined = obj.Pipelined;
+            obj.Pipelined = pipelined;
+            obj.TransportLayer.TaggedResponses = pipelined;
+            value = sendMWMessage(obj, [obj.CONFIGURE_PROTOCOL; options]);
+            if numel(value) < 5 || value(1) ~= obj.CONFIGURE_PROTOCOL
+                obj.Pipelined = oldPipelined;
+                obj.TransportLayer.TaggedResponses = oldPipelined;
+                obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+            end
+            obj.MaxOutstanding = value(5);
+            % the new framing applies from the next command on
+            obj.BinaryFraming = binaryFraming;
+        end
+        
+        function updateReceiveEvents(obj)
+            % keep unsolicited events in the receive buffer while any can arrive
+            obj.TransportLayer.ReceiveEvents = obj.Streaming || ~isempty(obj.PinChangeSubscriptions) || ...
+                ~isempty(obj.EventRules) || ~isempty(obj.LibraryEvents);
+        end
+        
+        function msg = buildFrame(obj, header, body)
+            if obj.BinaryFraming
+                payloadSize = numel(body);
+                frame = [header; obj.SequenceID; bitshift(payloadSize, -8); bitand(payloadSize, 255); body];
+                msg = [arduinoio.internal.cobsEncode(frame); 0];
+            else
+                msg = [...
+                    obj.SYSEX_START;
+                    header;
+                    obj.SequenceID;
+                    uint8(1); % unused payload_size
+                    uint8(1);
+                    body;
+                    obj.SYSEX_END];
+            end
+        end
+        
+        function value = sendFrame(obj, msg, timeout)
+            if obj.Pipelined
+                sequenceID = submitFrame(obj, msg);
+                if nargin < 3
+                    value = collectResponse(obj, sequenceID);
+                else
+                    value = collectResponse(obj, sequenceID, timeout);
+                end
             else
-                value = sendMessage(obj.TransportLayer, msg, timeout);
+                if nargin < 3
+                    value = sendMessage(obj.TransportLayer, msg);
+                else
+                    value = sendMessage(obj.TransportLayer, msg, timeout);
+                end
+                incrementSequenceID(obj);
+            end
+            
+            if obj.TransportLayer.Debug && ~obj.DrainingTrace
+                printTrace(obj);
+            end
+        end
+        
+        function printTrace(obj)
+        % Read the binary trace records the server has collected and
+        % print them with their format strings
+            obj.DrainingTrace = true;
+            try
+                while true
+                    value = sendMWMessage(obj, obj.DRAIN_TRACE);
+                    if numel(value) < 6 || value(1) ~= obj.DRAIN_TRACE
+                        break;
+                    end
+                    pointerSize = value(4);
+                    numDropped = bitshift(value(5), 8) + value(6);
+                    if numDropped
+                        fprintf('... %d trace records dropped\n', numDropped);
+                    end
+                    records = uint8(value(7:end));
+                    if isempty(records)
+                        break;
+                    end
+                    index = 1;
+                    while index < numel(records)
+                        recordLength = double(records(index));
+                        address = records(index+1:index+pointerSize);
+                        args = double(typecast(records(index+pointerSize+1:index+recordLength), 'int32'));
+                        fprintf(getTraceFormat(obj, address), args);
+                        index = index + recordLength + 1;
+                    end
+                end
+            catch e
+                obj.DrainingTrace = false;
+                throwAsCaller(e);
             end
-            % To Do - add logic to check correct return sequence ID
+            obj.DrainingTrace = false;
+        end
+        
+        function format = getTraceFormat(obj, address)
+            key = sprintf('%02X', address(end:-1:1));
+            if ~isKey(obj.TraceFormats, key)
+                value = sendMWMessage(obj, [obj.GET_TRACE_STRING; encodePayload(obj, address)]);
+                if isempty(value) || value(1) ~= obj.GET_TRACE_STRING
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                obj.TraceFormats(key) = char(value(4:end))';
+            end
+            format = obj.TraceFormats(key);
+        end
+        
+        function sequenceID = submitFrame(obj, msg)
+            if ~obj.Pipelined
+                obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                    'submitMessage', class(obj));
+            end
+            % keep the number of requests in flight within the window
+            if numel(obj.Outstanding) >= obj.MaxOutstanding
+                receiveResponse(obj.TransportLayer, obj.Outstanding(1));
+                obj.Outstanding(1) = [];
+            end
+            sequenceID = double(obj.SequenceID);
+            submitMessage(obj.TransportLayer, msg, sequenceID);
+            obj.Outstanding = [obj.Outstanding, sequenceID];
+            incrementSequenceID(obj);
+        end
+        
+        function incrementSequenceID(obj)
             if obj.SequenceID == 127
                 obj.SequenceID = 0;
             else
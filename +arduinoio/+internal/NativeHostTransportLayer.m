@@ -0,0 +1,215 @@
+classdef NativeHostTransportLayer < arduinoio.internal.TransportLayerBase
+% Serial transport through the native host client in src/host/client. Its
+% reader thread receives and parses server messages as they arrive, so
+% requests are neither preceded by a flush nor answered by polling. Used
+% instead of SerialHostTransportLayer on Linux once libArduinoClient.so has
+% been built with 'make client' in src/host.
+
+%   Copyright 2014 The MathWorks, Inc.
+
+    properties (Access = private, Constant = true)
+        LIBRARY         = 'libArduinoClient'
+        BANNER_TIMEOUT  = 5000 % ms, as the serial timeout of fread in SerialHostTransportLayer.openConnection
+        MAX_VALUE_SIZE  = 65538 % cmdID, payload_size and the largest payload
+        DEBUG_SIZE      = 4096
+
+        % Status codes of ArduinoClientAPI.h
+        TIMEOUT_STATUS  = -1
+        CONNECTION_LOST_STATUS = -2
+        NO_SERVER_STATUS = -5
+    end
+
+    properties (Access = private)
+        TIMEOUT = 5
+        Handle = []
+    end
+
+    properties (Access = public)
+        % Responses carry the sequence ID of their request, so several
+        % requests can be in flight at once
+        TaggedResponses = false
+
+        % Events are queued by the client whenever they arrive; kept for
+        % the interface of SerialHostTransportLayer
+        ReceiveEvents = false
+    end
+
+    %% Constructor
+    methods (Access = public)
+        function obj = NativeHostTransportLayer(connectionObj, debug)
+            obj.connectionObject = connectionObj;
+            obj.Debug = debug;
+        end
+    end
+
+    %% Destructor
+    methods (Access=protected)
+        function delete(obj)
+            if ~isempty(obj.Handle)
+                closeConnection(obj);
+            end
+        end
+    end
+
+    methods (Static)
+        function flag = isAvailable()
+        % True if the native client library has been built for this host
+            flag = isunix && ~ismac && exist(arduinoio.internal.NativeHostTransportLayer.libraryFile(), 'file') == 2;
+        end
+    end
+
+    methods (Static, Access = private)
+        function file = libraryFile()
+            file = fullfile(arduinoio.SPPKGRoot, 'src', 'host', 'build', 'libArduinoClient.so');
+        end
+
+        function file = headerFile()
+            file = fullfile(arduinoio.SPPKGRoot, 'src', 'host', 'client', 'ArduinoClientAPI.h');
+        end
+    end
+
+    %% Public methods
+    methods (Access = public)
+        function value = sendMessage(obj, msg, timeout)
+            if nargin < 3
+                obj.TIMEOUT = 5;
+            else
+                obj.TIMEOUT = timeout;
+            end
+
+            writeMessage(obj, msg);
+
+            [debugStr, value] = readMessage(obj);
+
+            % print out received strings
+            if obj.Debug
+                fprintf('%s', debugStr);
+				fprintf('%s\n', value);
+            end
+        end
+
+        function submitMessage(obj, msg, ~)
+        % Write a request without waiting for its response; the client
+        % drops a stale response with the same sequence ID itself
+            writeMessage(obj, msg);
+        end
+
+        function value = collectResponse(obj, sequenceID, timeout)
+        % Return the tagged response to the request with the given
+        % sequence ID, waiting for it as needed
+            if nargin < 3
+                obj.TIMEOUT = 5;
+            else
+                obj.TIMEOUT = timeout;
+            end
+
+            [status, ~, value] = calllib(obj.LIBRARY, 'arduinoClientCollectResponse', obj.Handle, ...
+                sequenceID, round(obj.TIMEOUT*1000), zeros(1, obj.MAX_VALUE_SIZE, 'uint8'), obj.MAX_VALUE_SIZE);
+            value = checkValue(obj, status, value);
+            debugStr = readDebug(obj);
+
+            % print out received strings
+            if obj.Debug
+                fprintf('%s', debugStr);
+				fprintf('%s\n', value);
+            end
+        end
+
+        function debugStr = receiveResponse(obj, sequenceID)
+        % Wait until the response with the given sequence ID has arrived
+        % or the timeout expires; it stays pending for collection
+            status = calllib(obj.LIBRARY, 'arduinoClientWaitResponse', obj.Handle, sequenceID, round(obj.TIMEOUT*1000));
+            checkValue(obj, status, []);
+            debugStr = readDebug(obj);
+        end
+
+        function events = readEvents(obj, eventID)
+        % Return the payloads of all event messages with the given event
+        % ID received so far, without waiting for further data
+            events = {};
+            while true
+                [status, ~, event] = calllib(obj.LIBRARY, 'arduinoClientReadEvent', obj.Handle, ...
+                    eventID, zeros(1, obj.MAX_VALUE_SIZE, 'uint8'), obj.MAX_VALUE_SIZE);
+                event = checkValue(obj, status, event);
+                if isempty(event)
+                    break;
+                end
+                events{end+1} = event(2:end); %#ok<AGROW>
+            end
+        end
+
+        function openConnection(obj)
+            if ~libisloaded(obj.LIBRARY)
+                loadlibrary(obj.libraryFile(), obj.headerFile());
+            end
+            [handle, ~, status] = calllib(obj.LIBRARY, 'arduinoClientOpen', obj.connectionObject.Port, ...
+                obj.connectionObject.BaudRate, obj.BANNER_TIMEOUT, 0);
+            if status == obj.NO_SERVER_STATUS
+                arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidServerInitResponse')
+            elseif status < 0
+                arduinoio.internal.localizedError('MATLAB:arduinoio:general:connectionIsLost')
+            end
+            obj.Handle = handle;
+            obj.TaggedResponses = false;
+        end
+
+        function closeConnection(obj)
+            calllib(obj.LIBRARY, 'arduinoClientClose', obj.Handle);
+            obj.Handle = [];
+        end
+
+        function set.TaggedResponses(obj, value)
+            obj.TaggedResponses = value;
+            if ~isempty(obj.Handle) %#ok<MCSUP>
+                calllib(obj.LIBRARY, 'arduinoClientSetTaggedResponses', obj.Handle, value); %#ok<MCSUP>
+            end
+        end
+    end
+
+    %%
+    methods(Access = protected)
+        function writeMessage(obj, msg)
+            status = calllib(obj.LIBRARY, 'arduinoClientWrite', obj.Handle, uint8(msg), numel(msg));
+            checkValue(obj, status, []);
+        end
+
+        function [debugStr, value] = readMessage(obj)
+            if obj.TaggedResponses
+                % the next response is collected by sequence ID
+                debugStr = readDebug(obj);
+                value = [];
+                return;
+            end
+            [status, ~, value] = calllib(obj.LIBRARY, 'arduinoClientReadResponse', obj.Handle, ...
+                round(obj.TIMEOUT*1000), zeros(1, obj.MAX_VALUE_SIZE, 'uint8'), obj.MAX_VALUE_SIZE);
+            value = checkValue(obj, status, value);
+            debugStr = readDebug(obj);
+        end
+    end
+
+    methods(Access = private)
+        function value = checkValue(obj, status, value)
+        % First status bytes of value as a column, empty on a timeout. The
+        % connection is only closed once the client reports it lost; other
+        % failures leave it usable.
+            if status == obj.TIMEOUT_STATUS
+                value = [];
+            elseif status == obj.CONNECTION_LOST_STATUS
+                closeConnection(obj);
+                id = 'MATLAB:arduinoio:general:connectionIsLost';
+                throwAsCaller(MException(id, getString(message(id))));
+            elseif status < 0
+                id = 'MATLAB:arduinoio:general:nativeClientError';
+                throwAsCaller(MException(id, getString(message(id, num2str(status), ...
+                    calllib(obj.LIBRARY, 'arduinoClientLastError')))));
+            elseif ~isempty(value)
+                value = double(value(1:status))';
+            end
+        end
+
+        function debugStr = readDebug(obj)
+            [count, ~, text] = calllib(obj.LIBRARY, 'arduinoClientReadDebug', obj.Handle, blanks(obj.DEBUG_SIZE), obj.DEBUG_SIZE);
+            debugStr = text(1:count)';
+        end
+    end
+end
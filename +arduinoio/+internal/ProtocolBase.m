@@ -31,11 +31,26 @@ classdef (Abstract)ProtocolBase < arduinoio.internal.BaseClass
                 'writeDigitalPin', class(obj));
         end
         
+        function writeDigitalPins(obj, pins, values)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'writeDigitalPins', class(obj));
+        end
+        
         function value = readDigitalPin(obj, pin) %#ok<*STOUT>
             obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
                 'readDigitalPin', class(obj));
         end
         
+        function value = readDigitalPort(obj, port)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'readDigitalPort', class(obj));
+        end
+        
+        function value = writeDigitalPort(obj, port, operation, mask, value)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'writeDigitalPort', class(obj));
+        end
+        
         function configureDigitalPin(obj, pin, mode)
             obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
                 'configureDigitalPin', class(obj));
@@ -56,20 +71,133 @@ classdef (Abstract)ProtocolBase < arduinoio.internal.BaseClass
                 'readVoltage', class(obj));
         end
         
+        function values = readVoltages(obj, pins, numSamples, mode, aref)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'readVoltages', class(obj));
+        end
+        
         function playTone(obj, pin, frequency, duration)
             obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
                 'playTone', class(obj));
         end
         
-        function addrs = scanI2CBus(obj, libID, bus)
+        function addrs = scanI2CBus(obj, libID, bus, useCache)
             obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
                 'scanI2CBus', class(obj));
         end
         
+        function busSpeed = configureI2CBus(obj, libID, bus, busSpeed)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'configureI2CBus', class(obj));
+        end
+        
         function value = getAvailableRAM(obj)
             obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
                 'getAvailableRAM', class(obj));
         end
+        
+        function report = getMemoryReport(obj)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'getMemoryReport', class(obj));
+        end
+        
+        function stats = getStats(obj, reset)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'getStats', class(obj));
+        end
+        
+        function subscribePinChange(obj, pin, debounceTime)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'subscribePinChange', class(obj));
+        end
+        
+        function [pins, values, timestamps] = readPinChanges(obj)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'readPinChanges', class(obj));
+        end
+        
+        function unsubscribePinChange(obj, pin)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'unsubscribePinChange', class(obj));
+        end
+        
+        function startStreaming(obj, digitalPins, analogPins, samplePeriod)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'startStreaming', class(obj));
+        end
+        
+        function [digitalValues, analogValues, numOverruns] = readStream(obj, aref)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'readStream', class(obj));
+        end
+        
+        function stopStreaming(obj)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'stopStreaming', class(obj));
+        end
+        
+        function setRule(obj, ruleID, condition, action, emitEvent, oneShot)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'setRule', class(obj));
+        end
+        
+        function [ruleIDs, values, timestamps] = readRuleEvents(obj)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'readRuleEvents', class(obj));
+        end
+        
+        function clearRule(obj, ruleID)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'clearRule', class(obj));
+        end
+        
+        function subscribeLibraryEvents(obj, eventID)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'subscribeLibraryEvents', class(obj));
+        end
+        
+        function events = readLibraryEvents(obj, eventID)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'readLibraryEvents', class(obj));
+        end
+        
+        function unsubscribeLibraryEvents(obj, eventID)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'unsubscribeLibraryEvents', class(obj));
+        end
+        
+        function loadScript(obj, slot, steps)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'loadScript', class(obj));
+        end
+        
+        function runScript(obj, slot)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'runScript', class(obj));
+        end
+        
+        function stopScript(obj, slot)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'stopScript', class(obj));
+        end
+        
+        function enablePipelining(obj)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'enablePipelining', class(obj));
+        end
+        
+        function enableBinaryFraming(obj)
+            obj.localizedError('MATLAB:arduinoio:general:notSupportedMethod', ...
+                'enableBinaryFraming', class(obj));
+        end
+        
+        function output = encodePayload(~, data)
+            output = arduinoio.BinaryToASCII(data);
+        end
+        
+        function count = getMaxDataSize(~, ~)
+            count = 16;
+        end
     end
     
     methods(Abstract)
@@ -81,7 +209,9 @@ classdef (Abstract)ProtocolBase < arduinoio.internal.BaseClass
     
     methods(Access = private)
         function tlObj = createTransportLayer(obj, connectionObj, traceOn)
-            if isa(connectionObj, 'serial')
+            if isa(connectionObj, 'serial') && arduinoio.internal.NativeHostTransportLayer.isAvailable()
+                tlObj = arduinoio.internal.NativeHostTransportLayer(connectionObj, traceOn);
+            elseif isa(connectionObj, 'serial')
                 tlObj = arduinoio.internal.SerialHostTransportLayer(connectionObj, traceOn);
             elseif isa(connectionObj, 'raspi.internal.serialdev')
                 tlObj = arduinoio.internal.SerialRaspiTransportLayer(connectionObj, traceOn);
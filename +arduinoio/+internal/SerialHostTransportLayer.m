@@ -10,11 +10,30 @@ classdef SerialHostTransportLayer < arduinoio.internal.TransportLayerBase
         TIMEOUT	= 5
     end
     
+    properties (Access = public)
+        % Responses carry the sequence ID of their request, so several
+        % requests can be in flight at once
+        TaggedResponses = false
+        
+        % The server sends unsolicited event messages, e.g. acquisition
+        % stream frames, which must not be flushed before a request
+        ReceiveEvents = false
+    end
+    
+    properties (Access = private)
+        % Tagged responses received but not yet collected, keyed by sequence ID
+        PendingResponses
+        
+        % Event messages received but not yet read, one [eventID; payload] per cell
+        Events = {}
+    end
+    
     %% Constructor
     methods (Access = public)
         function obj = SerialHostTransportLayer(connectionObj, debug)
             obj.connectionObject = connectionObj;
             obj.Debug = debug;
+            obj.PendingResponses = containers.Map('KeyType', 'double', 'ValueType', 'any');
         end
     end
     
@@ -47,6 +66,66 @@ classdef SerialHostTransportLayer < arduinoio.internal.TransportLayerBase
             end
         end
         
+        function submitMessage(obj, msg, sequenceID)
+        % Write a request without waiting for its response. A response
+        % still pending under its sequence ID answered an earlier request,
+        % e.g. one whose collection timed out, and must not answer this one
+            if isKey(obj.PendingResponses, sequenceID)
+                remove(obj.PendingResponses, sequenceID);
+            end
+            writeMessage(obj, msg);
+        end
+        
+        function value = collectResponse(obj, sequenceID, timeout)
+        % Return the tagged response to the request with the given
+        % sequence ID, reading further responses as needed
+            if nargin < 3
+                obj.TIMEOUT = 5;
+            else
+                obj.TIMEOUT = timeout;
+            end
+            
+            value = [];
+            debugStr = receiveResponse(obj, sequenceID);
+            if isKey(obj.PendingResponses, sequenceID)
+                value = obj.PendingResponses(sequenceID);
+                remove(obj.PendingResponses, sequenceID);
+            end
+            
+            % print out received strings
+            if obj.Debug
+                fprintf('%s', debugStr);
+				fprintf('%s\n', value);
+            end
+        end
+        
+        function debugStr = receiveResponse(obj, sequenceID)
+        % Read responses until the one with the given sequence ID has
+        % arrived or the timeout expires; it stays pending for collection
+            debugStr = [];
+            while ~isKey(obj.PendingResponses, sequenceID)
+                [newDebugStr, newValue] = readMessage(obj);
+                debugStr = [debugStr; newDebugStr]; %#ok<AGROW>
+                if isempty(newValue) % timed out
+                    break;
+                end
+            end
+        end
+        
+        function events = readEvents(obj, eventID)
+        % Return the payloads of all event messages with the given event
+        % ID received so far, without waiting for further data
+            obj.TIMEOUT = obj.DT;
+            readMessage(obj);
+            
+            events = {};
+            isMatch = cellfun(@(e) e(1) == eventID, obj.Events);
+            for ii = find(isMatch)
+                events{end+1} = obj.Events{ii}(2:end); %#ok<AGROW>
+            end
+            obj.Events(isMatch) = [];
+        end
+        
         function openConnection(obj)
             try 
                 fopen(obj.connectionObject);
@@ -72,8 +151,9 @@ classdef SerialHostTransportLayer < arduinoio.internal.TransportLayerBase
     methods(Access = protected)
         function writeMessage(obj, msg)
             try 
-                % flush the serial line before sending any command
-                if obj.connectionObject.BytesAvailable
+                % flush the serial line before sending any command, unless
+                % responses to earlier requests may still be on their way
+                if ~obj.TaggedResponses && ~obj.ReceiveEvents && obj.connectionObject.BytesAvailable
                     fread(obj.connectionObject, obj.connectionObject.BytesAvailable);
                 end
                 fwrite(obj.connectionObject, msg);
@@ -111,6 +191,28 @@ classdef SerialHostTransportLayer < arduinoio.internal.TransportLayerBase
                                 value = [cmdID; payLoad];
                             end
                             break;
+                        elseif msgID == 2 % non debug message tagged with sequence ID
+                            header = fread(obj.connectionObject, 4);
+                            sequenceID = header(1);
+                            cmdID = header(2);
+                            payLoad = header(3:end);
+                            valueSize = bitshift(payLoad(1), 8) + payLoad(2);
+                            if valueSize
+                                value = [cmdID; payLoad; fread(obj.connectionObject, valueSize)];
+                            else
+                                value = [cmdID; payLoad];
+                            end
+                            obj.PendingResponses(sequenceID) = value;
+                            break;
+                        elseif msgID == 3 % unsolicited event, queued while reading on
+                            header = fread(obj.connectionObject, 3);
+                            eventID = header(1);
+                            valueSize = bitshift(header(2), 8) + header(3);
+                            if valueSize
+                                obj.Events{end+1} = [eventID; fread(obj.connectionObject, valueSize)];
+                            else
+                                obj.Events{end+1} = eventID;
+                            end
                         else
                             count = fread(obj.connectionObject, 1);
                             debugStr = [debugStr; fread(obj.connectionObject, count)]; %#ok<AGROW>
@@ -75,7 +75,7 @@ classdef Utility < arduinoio.internal.BaseClass
            buildInfo.CXXIncludePaths = [fullfile(buildInfo.SPPKGPath, 'src'), fullfile(buildInfo.ArduinoIDEPath, 'libraries', 'Firmata', 'src'), fullfile(tempdir, 'ArduinoServer'), propertyValues{3}];
            buildInfo.ServerPath = tempdir;
            buildInfo.CSource = propertyValues{2};
-           buildInfo.CXXSource = [fullfile(buildInfo.SPPKGPath, 'src', 'MWArduino.cpp'), fullfile(buildInfo.ArduinoIDEPath, 'libraries', 'Firmata', 'src', 'Firmata.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'ArduinoServer.cpp'), propertyValues{4}];
+           buildInfo.CXXSource = [fullfile(buildInfo.SPPKGPath, 'src', 'MWArduino.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'MWStream.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'MWPinChange.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'MWAnalogScan.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'MWScript.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'MWRules.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'MWMemory.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'MWStats.cpp'), fullfile(buildInfo.ArduinoIDEPath, 'libraries', 'Firmata', 'src', 'Firmata.cpp'), fullfile(buildInfo.SPPKGPath, 'src', 'ArduinoServer.cpp'), propertyValues{4}];
        end
        
        function updatePreference(obj, port, board)
@@ -0,0 +1,36 @@
+function output = cobsEncode(input)
+% COBSENCODE - Encodes the input bytes with Consistent Overhead Byte
+% Stuffing so that the output contains no zeros. The 0x00 frame delimiter
+% is not appended.
+% Example:
+% input = uint8([17 0 0 34]);
+% output = [2 17 1 2 34]
+
+%   Copyright 2014 The MathWorks, Inc.
+
+input = uint8(input(:));
+output = zeros(numel(input) + floor(numel(input)/254) + 1, 1, 'uint8');
+
+codeIndex = 1; % position of the code byte of the current block
+outIndex = 2;
+code = 1;
+for ii = 1:numel(input)
+    if input(ii) == 0
+        output(codeIndex) = code;
+        codeIndex = outIndex;
+        outIndex = outIndex + 1;
+        code = 1;
+    else
+        output(outIndex) = input(ii);
+        outIndex = outIndex + 1;
+        code = code + 1;
+        if code == 255 % maximum block length, start a new block without an encoded zero
+            output(codeIndex) = code;
+            codeIndex = outIndex;
+            outIndex = outIndex + 1;
+            code = 1;
+        end
+    end
+end
+output(codeIndex) = code;
+output = output(1:outIndex-1);
@@ -0,0 +1,12 @@
+function result = isErrorResponse(output, commandID)
+% ISERRORRESPONSE - True if output, a [cmdID; payload_size; values]
+% response, is the answer of a server that rejected the command, e.g. for
+% an unknown device or a parameter out of range. The payload of such an
+% answer is the status RESPONSE_ERROR (0xFF) alone, see MWArduino.h.
+% Only call it for commands whose regular answer cannot look the same.
+
+%   Copyright 2014 The MathWorks, Inc.
+
+result = numel(output) == 4 && output(1) == commandID && ...
+    output(2) == 0 && output(3) == 1 && output(4) == 255;
+end
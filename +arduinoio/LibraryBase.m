@@ -41,6 +41,14 @@ classdef LibraryBase < arduinoio.internal.BaseClass
         function count = getAvailableRAM(obj)
             count = getAvailableRAM(obj.Parent);
         end
+        
+        function output = encodePayload(obj, data)
+            output = encodePayload(obj.Parent, data);
+        end
+        
+        function count = getMaxDataSize(obj)
+            count = getMaxDataSize(obj.Parent);
+        end
     end
     
     methods(Abstract = true, Access = protected)
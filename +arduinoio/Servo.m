@@ -30,6 +30,10 @@ classdef Servo < arduinoio.ServoMotorBase & matlab.mixin.CustomDisplay
     %                     default 5.44e-4 seconds.
     %   'MaxPulseDuration' - The pulse duration for the servo at its maximum position (numeric,
     %                     default 2.4e-3 seconds.
+    %   'MaxVelocity'      - The speed at which writePosition moves the shaft, in positions per
+    %                     second (numeric, default 0 to move at full speed).
+    %   'Acceleration'     - The rate at which the shaft reaches MaxVelocity and slows down again,
+    %                     in positions per second^2 (numeric, default 0 for no ramp).
     %
     
     %   Copyright 2014 The MathWorks, Inc.
@@ -55,6 +59,8 @@ classdef Servo < arduinoio.ServoMotorBase & matlab.mixin.CustomDisplay
             fprintf('                Pins: %d\n', obj.Pins);
             fprintf('    MinPulseDuration: %.2e (s)\n', obj.MinPulseDuration);
             fprintf('    MaxPulseDuration: %.2e (s)\n', obj.MaxPulseDuration);  
+            fprintf('         MaxVelocity: %g (1/s)\n', obj.MaxVelocity);
+            fprintf('        Acceleration: %g (1/s^2)\n', obj.Acceleration);
             fprintf('\n');
                   
             % Allow for the possibility of a footer.
@@ -4,6 +4,8 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
     properties(SetAccess = immutable)
         MinPulseDuration
         MaxPulseDuration
+        MaxVelocity
+        Acceleration
     end
     
     properties(Access = private)
@@ -23,6 +25,10 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
         CLEAR_SERVO     = hex2dec('01')
         READ_POSITION   = hex2dec('02')
         WRITE_POSITION  = hex2dec('03')
+        CONFIGURE_MOTION = hex2dec('04')
+        WRITE_GROUP     = hex2dec('05')
+        READ_MOTION_STATUS = hex2dec('06')
+        MAX_ANGLE       = 180
     end
     
     properties(Access = protected, Constant = true)
@@ -65,11 +71,13 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
                 p = inputParser;
                 addParameter(p, 'MinPulseDuration', obj.DefaultMinPulseDuration);
                 addParameter(p, 'MaxPulseDuration', obj.DefaultMaxPulseDuration);
+                addParameter(p, 'MaxVelocity', 0);
+                addParameter(p, 'Acceleration', 0);
                 addParameter(p, 'ResourceMode', 'Servo');
                 addParameter(p, 'ResourceOwner', 'Servo');
                 parse(p, params{:});
             catch
-                parameters = {p.Parameters{1}, p.Parameters{2}};
+                parameters = {'MinPulseDuration', 'MaxPulseDuration', 'MaxVelocity', 'Acceleration'};
                 obj.localizedError('MATLAB:arduinoio:general:invalidNVPropertyName',...
                     'Servo', ...
                     arduinoio.internal.renderCellArrayOfStringsToString(parameters, ', '));
@@ -83,6 +91,15 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
                 arduinoio.internal.validateDoubleParameterRanged('MaxPulseDuration', ...
                                                              p.Results.MaxPulseDuration, ...
                                                              0, 4e-3, 's');
+            % In positions per second, 0 moves the shaft at full speed
+            obj.MaxVelocity = ...
+                arduinoio.internal.validateDoubleParameterRanged('MaxVelocity', ...
+                                                             p.Results.MaxVelocity, ...
+                                                             0, 100, '1/s');
+            obj.Acceleration = ...
+                arduinoio.internal.validateDoubleParameterRanged('Acceleration', ...
+                                                             p.Results.Acceleration, ...
+                                                             0, 300, '1/s^2');
             
             if (any(ismember(p.UsingDefaults, 'MinPulseDuration')) && ~any(ismember(p.UsingDefaults, 'MaxPulseDuration'))) ||...
                (any(ismember(p.UsingDefaults, 'MaxPulseDuration')) && ~any(ismember(p.UsingDefaults, 'MinPulseDuration')))
@@ -97,7 +114,14 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
                 obj.allocateResource(pin);
                 try
                     attachServo(obj, pin, obj.MinPulseDuration*1e6, obj.MaxPulseDuration*1e6);
+                    if obj.MaxVelocity > 0
+                        configureMotion(obj);
+                    end
                 catch e
+                    try
+                        clearServo(obj);
+                    catch
+                    end
                     clearResourceSlot(obj.Parent, obj.ResourceOwner, obj.Slot);
                     throwAsCaller(e);
                 end
@@ -155,6 +179,55 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
             end
             obj.IsServoAttached = false;
         end
+        
+        function configureMotion(obj)
+            % The Arduino ramps the speed up and down in degrees/s and degrees/s^2
+            commandID = obj.CONFIGURE_MOTION;
+            velocity = typecast(uint16(max(1, round(obj.MaxVelocity*obj.MAX_ANGLE))), 'uint8');
+            acceleration = typecast(uint16(round(obj.Acceleration*obj.MAX_ANGLE)), 'uint8');
+            try
+                cmd = [ ...
+                    arduinoio.BinaryToASCII(velocity); ...
+                    arduinoio.BinaryToASCII(acceleration) ...
+                    ];
+                sendCommand(obj, obj.LibraryName, commandID, cmd);
+            catch e
+                if strcmp(e.identifier, 'MATLAB:arduinoio:general:commandRejected')
+                    % boards with little RAM keep motion state for the first servos only
+                    obj.localizedError('MATLAB:arduinoio:general:maxServoMotions', obj.Parent.Board);
+                end
+                throwAsCaller(e);
+            end
+        end
+        
+        function writeGroupPosition(obj, value)
+            % One command for all servos, which start and arrive together
+            commandID = obj.WRITE_GROUP;
+            try
+                if numel(value) ~= numel(obj)
+                    obj(1).localizedError('MATLAB:arduinoio:general:invalidServoGroup');
+                end
+                parent = obj(1).Parent;
+                for ii = 2:numel(obj)
+                    if obj(ii).Parent ~= parent
+                        obj(1).localizedError('MATLAB:arduinoio:general:invalidServoGroup');
+                    end
+                end
+                maxServos = floor(getMaxDataSize(obj(1))/2);
+                if numel(obj) > maxServos
+                    obj(1).localizedError('MATLAB:arduinoio:general:maxServoGroup', num2str(maxServos));
+                end
+                pairs = zeros(2, numel(obj), 'uint8');
+                for ii = 1:numel(obj)
+                    arduinoio.internal.validateDoubleParameterRanged(['position(' num2str(ii) ')'], value(ii), 0, 1);
+                    pairs(:, ii) = [obj(ii).Slot-1; uint8(obj(ii).MAX_ANGLE*value(ii))];
+                end
+                cmd = [numel(obj); encodePayload(obj(1), pairs(:))];
+                sendCommand(obj(1), obj(1).LibraryName, commandID, cmd);
+            catch e
+                throwAsCaller(e);
+            end
+        end
     end
     
     methods (Access = public)
@@ -213,7 +286,11 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
             %
             %   Description:
             %   Set the position of a standard servo motor shaft as a
-            %   ratio of the motor's min/max range, from 0 to 1
+            %   ratio of the motor's min/max range, from 0 to 1. A servo
+            %   with a MaxVelocity moves there at that speed, ramped with
+            %   its Acceleration. With an array of servos, all of them
+            %   start in the same servo frame and are slowed down to arrive
+            %   together.
             %
             %   Example:
             %       a = arduino();
@@ -222,15 +299,26 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
 			%
             %   Example:
             %       a = arduino();
+            %       s1 = servo(a, 9, 'MaxVelocity', 0.5, 'Acceleration', 2);
+            %       s2 = servo(a, 10, 'MaxVelocity', 0.5, 'Acceleration', 2);
+            %       writePosition([s1 s2], [0.2 0.8]);
+			%
+            %   Example:
+            %       a = arduino();
             %       dev = addon(a, 'Adafruit/MotorShieldV2');
             %       s = servo(dev,1);
             %       writePosition(s, 0.6);
 			%
             %   Input Arguments:
-            %   s       - Servo motor device 
-            %   value   - Motor shaft position (double)
+            %   s       - Servo motor device, or array of them
+            %   value   - Motor shaft position, one per servo (double)
 			%
-			%   See also readPosition
+			%   See also readPosition, isMoving
+            
+            if numel(obj) > 1
+                writeGroupPosition(obj, value);
+                return;
+            end
             
             commandID = obj.WRITE_POSITION;
             try
@@ -244,6 +332,54 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
         end
     end
     
+    methods (Access = public)
+        function result = isMoving(obj)
+            %   Check whether a servo motor shaft is still moving to its position.
+            %
+            %   Syntax:
+            %   result = isMoving(s)
+            %
+            %   Description:
+            %   Returns true while a servo with a MaxVelocity has not yet
+            %   reached the position last written
+            %
+            %   Example:
+            %       a = arduino();
+            %       s = servo(a, 9, 'MaxVelocity', 0.25);
+            %       writePosition(s, 1);
+            %       while isMoving(s)
+            %       end
+            %
+            %   Input Arguments:
+            %   s       - Servo motor device 
+            %
+            %   Output Arguments:
+            %   result  - Shaft is moving (logical)
+            %
+            %   See also writePosition
+            
+            commandID = obj.READ_MOTION_STATUS;
+            try
+                value = sendCommand(obj, obj.LibraryName, commandID);
+                if isempty(value) || value(1) ~= commandID
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                result = value(4) ~= 0;
+            catch e
+                throwAsCaller(e);
+            end
+        end
+    end
+    
+    methods (Hidden, Access = public)
+        function [libName, cmd] = getWritePositionCommand(obj, value)
+            % Command of writePosition without libID, for scripts that run it on the server
+            arduinoio.internal.validateDoubleParameterRanged('position', value, 0, 1);
+            libName = obj.LibraryName;
+            cmd = [obj.Slot-1; obj.WRITE_POSITION; arduinoio.BinaryToASCII(uint8(180*value))];
+        end
+    end
+    
     methods (Access = protected)
         function output = sendCommand(obj, libName, commandID, varargin)
             cmd = [obj.Slot-1; commandID];
@@ -251,6 +387,9 @@ classdef (Abstract)ServoMotorBase < arduinoio.LibraryBase
                 cmd = [cmd; varargin{1}]; 
             end
             output = sendCustomMessage(obj.Parent, libName, cmd);
+            if arduinoio.internal.isErrorResponse(output, commandID)
+                obj.localizedError('MATLAB:arduinoio:general:commandRejected', obj.LibraryName);
+            end
         end
     end
     
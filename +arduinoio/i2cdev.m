@@ -20,6 +20,11 @@ classdef i2cdev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
         WRITE           = hex2dec('03')
         READ_REGISTER   = hex2dec('04')
         WRITE_REGISTER  = hex2dec('05')
+        TRANSACTION     = hex2dec('06')
+        OP_READ         = 1
+        OP_REGISTER     = 2
+        OP_BUS1         = 4
+        OP_NO_STOP      = 8
         AvailablePrecisions = {'int8', 'uint8', 'int16', 'uint16'}
         SIZEOF = struct('int8', 1, 'uint8', 1, 'int16', 2, 'uint16', 2)
     end
@@ -340,7 +345,7 @@ classdef i2cdev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                 for ii = 1:numBytes
                     tmp = [tmp; dataIn(ii)]; %#ok<AGROW>
                 end
-                cmd = [cmd; arduinoio.BinaryToASCII(tmp)];
+                cmd = [cmd; encodePayload(obj, tmp)];
                 output = sendCommand(obj, obj.LibraryName, commandID, cmd);
                 if isempty(output)
                     obj.localizedError('MATLAB:arduinoio:general:communicationLostI2C', num2str(obj.Bus));
@@ -348,6 +353,8 @@ classdef i2cdev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                 returnedCMDId = output(1);
                 if returnedCMDId ~= obj.WRITE
                     obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                elseif arduinoio.internal.isErrorResponse(output, obj.WRITE)
+                    obj.localizedError('MATLAB:arduinoio:general:commandRejected', obj.LibraryName);
                 end
             catch e
                 if strcmp(e.identifier, 'MATLAB:badsubscript')
@@ -488,7 +495,7 @@ classdef i2cdev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                     % Little endian
                     tmp = [tmp; dataIn(1+numBytes-ii)]; %#ok<AGROW>
                 end
-                cmd = [cmd; arduinoio.BinaryToASCII(tmp)];
+                cmd = [cmd; encodePayload(obj, tmp)];
                 output = sendCommand(obj, obj.LibraryName, commandID, cmd);
                 if isempty(output)
                     obj.localizedError('MATLAB:arduinoio:general:communicationLostI2C', num2str(obj.Bus));
@@ -496,6 +503,117 @@ classdef i2cdev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                 returnedCMDId = output(1);
                 if returnedCMDId ~= obj.WRITE_REGISTER
                     obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                elseif arduinoio.internal.isErrorResponse(output, obj.WRITE_REGISTER)
+                    obj.localizedError('MATLAB:arduinoio:general:commandRejected', obj.LibraryName);
+                end
+            catch e
+                if strcmp(e.identifier, 'MATLAB:badsubscript')
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                throwAsCaller(e);
+            end
+        end
+        
+        function [dataOut, status] = transaction(obj, ops)
+            %   Run several reads and writes on I2C devices in one command.
+            %
+            %   Syntax:
+            %   [dataOut, status] = transaction(dev,ops)
+            %
+            %   Description:
+            %   Executes the operations back to back on the Arduino hardware and
+            %   returns all results at once, so that polling several devices takes
+            %   one round trip. The devices may be on any bus of the same board.
+            %
+            %   Example:
+            %       a = arduino();
+            %       temp = i2cdev(a, '0x48');
+            %       eeprom = i2cdev(a, '0x50');
+            %       ops = struct('Device', {temp, eeprom}, 'Register', {0, 32}, ...
+            %                    'Count', {2, []}, 'Data', {[], [1 2]});
+            %       [dataOut, status] = transaction(temp, ops);
+            %
+            %   Input Arguments:
+            %   dev       - I2C device whose board runs the operations
+            %   ops       - Operations (struct array) with the fields
+            %               Device   - I2C device
+            %               Register - Register written before reading or writing, [] for none
+            %               Count    - Number of bytes to read, [] to write Data
+            %               Data     - Bytes to write (uint8)
+            %               RepeatedStart - (optional) true to keep the bus for the next
+            %                          operation instead of ending with a stop condition
+            %
+            %   Output Arguments:
+            %   dataOut   - Bytes read by each operation (cell array of uint8, [] for writes)
+            %   status    - Status of each operation, 0 on success
+            %
+            %   See also read, write, readRegister, writeRegister
+            
+            try
+                msg = [];
+                for ii = 1:numel(ops)
+                    op = ops(ii);
+                    dev = op.Device;
+                    if ~isa(dev, 'arduinoio.i2cdev') || dev.Parent ~= obj.Parent
+                        obj.localizedError('MATLAB:arduinoio:general:invalidI2CTransaction');
+                    end
+                    code = obj.OP_BUS1*(dev.Bus == 1);
+                    if isfield(op, 'RepeatedStart') && ~isempty(op.RepeatedStart) && op.RepeatedStart
+                        code = code + obj.OP_NO_STOP;
+                    end
+                    header = dev.Address;
+                    if ~isempty(op.Register)
+                        arduinoio.internal.validateIntParameterRanged('register', op.Register, 0, 255);
+                        code = code + obj.OP_REGISTER;
+                        header = [header; op.Register];
+                    end
+                    if ~isempty(op.Count)
+                        try
+                            arduinoio.internal.validateIntParameterRanged('count', op.Count, 1, obj.MaxI2CData);
+                        catch
+                            obj.localizedError('MATLAB:arduinoio:general:maxI2CData');
+                        end
+                        msg = [msg; code + obj.OP_READ; header; op.Count]; %#ok<AGROW>
+                    else
+                        data = uint8(op.Data(:));
+                        if numel(data) > obj.MaxI2CData
+                            obj.localizedError('MATLAB:arduinoio:general:maxI2CData');
+                        end
+                        msg = [msg; code; header; numel(data); data]; %#ok<AGROW>
+                    end
+                end
+                if isempty(msg) || numel(msg) > 255
+                    obj.localizedError('MATLAB:arduinoio:general:invalidI2CTransaction');
+                end
+            catch e
+                throwAsCaller(e);
+            end
+            
+            commandID = obj.TRANSACTION;
+            try
+                cmd = [commandID; arduinoio.BinaryToASCII(uint8(numel(msg))); encodePayload(obj, msg)];
+                output = sendCustomMessage(obj.Parent, obj.LibraryName, cmd);
+                if isempty(output)
+                    obj.localizedError('MATLAB:arduinoio:general:communicationLostI2C', num2str(obj.Bus));
+                end
+                if output(1) ~= obj.TRANSACTION
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                elseif numel(output) < 4
+                    % the server rejects lists whose results would not fit its buffer
+                    obj.localizedError('MATLAB:arduinoio:general:invalidI2CTransaction');
+                end
+                
+                results = output(4:end);
+                dataOut = cell(1, numel(ops));
+                status = zeros(1, numel(ops));
+                index = 1;
+                for ii = 1:numel(ops)
+                    status(ii) = results(index);
+                    index = index + 1;
+                    if ~isempty(ops(ii).Count)
+                        dataOut{ii} = uint8(results(index:index+ops(ii).Count-1));
+                        index = index + ops(ii).Count;
+                    end
                 end
             catch e
                 if strcmp(e.identifier, 'MATLAB:badsubscript')
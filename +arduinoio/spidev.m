@@ -9,6 +9,7 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
         ChipSelectPin
         Mode
         BitOrder
+        BusSpeed
     end
     
     properties(Access = private)
@@ -17,7 +18,7 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
     end
     
     properties(Access = private, Constant = true)
-        MaxSPIData     = 16
+        DefaultBusSpeed = 4000000
     end
     
     properties(Access = private, Constant = true)
@@ -26,6 +27,10 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
         SET_MODE       = hex2dec('02')
         SET_BIT_ORDER  = hex2dec('03')
         WRITE_READ     = hex2dec('04')
+        SET_CLOCK      = hex2dec('05')
+        TRANSFER       = hex2dec('06')
+        HOLD_CS        = 1 % the next transfer continues this one
+        WRITE_ONLY     = 2 % the data read is not returned
         SIZEOF = struct('int8', 1, 'uint8', 1, 'int16', 2, 'uint16', 2, ...
             'int32', 4, 'uint32', 4, 'int64', 8, 'uint64', 8)
     end
@@ -46,7 +51,7 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
     methods(Hidden, Access = public)
         function obj = spidev(parentObj, cspin, varargin)
             obj.ResourceOwner = 'spidev';
-            count = parentObj.incrementResourceCount(obj.ResourceOwner);
+            parentObj.incrementResourceCount(obj.ResourceOwner);
             
             iUndo = 0;
             obj.Undo = [];
@@ -118,18 +123,13 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                 obj.Pins = [];
             end
             
-            defaultSPIMode = 0;
-            defaultBitOrder = 'msbfirst';
-            if count > 1
-                defaultSPIMode = parentObj.getResourceProperty(obj.ResourceOwner, 'Mode');
-                defaultBitOrder = parentObj.getResourceProperty(obj.ResourceOwner, 'BitOrder');
-            end
-            % Mode and BitOrder should be only set once in the end to avoid
+            % Mode, BitOrder and BusSpeed should be only set once in the end to avoid
             % incorrect server call
             try
                 p = inputParser;
-                addParameter(p, 'Mode', defaultSPIMode);
-                addParameter(p, 'BitOrder', defaultBitOrder);
+                addParameter(p, 'Mode', 0);
+                addParameter(p, 'BitOrder', 'msbfirst');
+                addParameter(p, 'BusSpeed', obj.DefaultBusSpeed);
                 parse(p, varargin{:});
             catch
                 obj.localizedError('MATLAB:arduinoio:general:invalidNVPropertyName',...
@@ -147,28 +147,14 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                     'BitOrder', ...
                     arduinoio.internal.renderCellArrayOfStringsToString(bitOrderValues, ', '));
             end
+            busSpeed = arduinoio.internal.validateIntParameterRanged('BusSpeed', p.Results.BusSpeed, 1, intmax('uint32'));
             
-            % Uno/Mega SPI Property Conflict
-            if count == 1
-                parentObj.setResourceProperty(obj.ResourceOwner, 'Mode', obj.Mode);
-                parentObj.setResourceProperty(obj.ResourceOwner, 'BitOrder', obj.BitOrder);
-            else
-                mcu = obj.Parent.getMCU();
-                if ~strcmp(mcu, 'cortex-m3')
-                    if obj.Mode ~= defaultSPIMode
-                        obj.localizedError('MATLAB:arduinoio:general:propertyConflict',...
-                            parentObj.Board, 'Mode', 'spidev');
-                    end
-                    if ~strcmp(obj.BitOrder, defaultBitOrder)
-                        obj.localizedError('MATLAB:arduinoio:general:propertyConflict',...
-                            parentObj.Board, 'BitOrder', 'spidev');
-                    end
-                end
-            end
-            
+            % Each device keeps its own Mode, BitOrder and BusSpeed on the
+            % Arduino, applied whenever its chip select is asserted
+            startSPI(obj);
             setMode(obj);
             setBitOrder(obj);
-            startSPI(obj, count);
+            obj.BusSpeed = setBusSpeed(obj, busSpeed);
             
             obj.Undo = [];
             
@@ -188,7 +174,7 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
         function delete(obj)
             try
                 count = decrementResourceCount(obj.Parent, obj.ResourceOwner);
-                stopSPI(obj, count);
+                stopSPI(obj);
 
                 parentObj = obj.Parent;
                 spiTerminals = parentObj.getSPITerminals();
@@ -232,7 +218,8 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
             %
             %   Description: Writes the data, dataIn, to the device and reads
             %   the data available, dataOut, from the device as a result of
-            %   writing dataIn
+            %   writing dataIn. Data longer than one command is sent in several
+            %   commands with the chip select kept asserted.
             %
             %   dataPrecision - Data Precision 'uint8' (default) | 'uint16'
             %
@@ -248,8 +235,8 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
             %
             %   Output Argument:
             %   dataOut - Available data read from the device (double)
-            
-            commandID = obj.WRITE_READ;
+            %
+            %   See also write
             
             if nargin < 3
                 castDataOut = false;
@@ -259,97 +246,79 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                 dataPrecision = validatestring(dataPrecision, {'uint8', 'uint16'});
             end
             
-            numBytes = obj.SIZEOF.(dataPrecision);
-            maxValue = 2^(numBytes*8)-1;
-            
             try
-                dataInLen = size(dataIn,2);
-                if dataInLen*numBytes > obj.MaxSPIData
-                    obj.localizedError('MATLAB:arduinoio:general:maxSPIData');
-                end
-                cmd = [obj.ChipSelectPin; arduinoio.BinaryToASCII(uint8(dataInLen*numBytes))];
-                tmp = [];
-                for ii = 1:dataInLen
-                    val = arduinoio.internal.validateIntParameterRanged(...
-                        ['dataIn(' num2str(ii) ')'], ...
-                        dataIn(ii), ...
-                        0, ...
-                        maxValue);
-                    val = cast(val, dataPrecision);
-                    val = typecast(val, 'uint8');
-                    for jj = 1:numBytes
-                        % Little endian
-                        tmp = [tmp; val(1+numBytes-jj)]; %#ok<AGROW>
-                    end
-                end
-                cmd = [cmd; arduinoio.BinaryToASCII(tmp)]; 
+                returnedData = transferData(obj, dataIn, dataPrecision, false);
                 
-                % Returned data
-                %
-                output = sendCommand(obj, obj.LibraryName, commandID, cmd);
-                returnedCMDId = output(1);
-                if returnedCMDId ~= obj.WRITE_READ
-                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
-                else
-                    returnedData = output(4:end)';
-                    dataOutLen = size(returnedData,2)/numBytes;
-                    if castDataOut
-                        switch numBytes
-                            case 1
-                                dataOut = uint8(zeros(1, dataOutLen));
-                            case 2
-                                dataOut = uint16(zeros(1, dataOutLen));
-                            case 4
-                                dataOut = uint32(zeros(1, dataOutLen));
-                            case 8
-                                dataOut = uint64(zeros(1, dataOutLen));
-                        end
-                    else
-                        dataOut = zeros(1, dataOutLen);
-                    end
-                    for ii = 1:dataOutLen
-                        returnedDataIdx = ((ii-1)*numBytes)+1;
-                        for jj = 1:numBytes
-                            dataOut(ii) = dataOut(ii) + ...
-                                returnedData(returnedDataIdx + jj - 1) * 2^(8*(numBytes-jj));
-                        end
-                    end
+                numBytes = obj.SIZEOF.(dataPrecision);
+                values = reshape(double(returnedData), numBytes, []);
+                dataOut = 2.^(8*(numBytes-1:-1:0)) * values; % msb first
+                if castDataOut
+                    dataOut = cast(dataOut, dataPrecision);
                 end
             catch e
                 throwAsCaller(e);
             end
         end
+        
+        function write(obj, dataIn, dataPrecision)
+            %   Write binary data to SPI device.
+            %
+            %   Syntax:
+            %   write(dev,dataIn)
+            %   write(dev,dataIn,dataPrecision)
+            %
+            %   Description: Writes the data, dataIn, to the device and discards
+            %   the data read meanwhile, which leaves the serial line to the
+            %   data written, e.g. to fill a display or a flash page.
+            %
+            %   dataPrecision - Data Precision 'uint8' (default) | 'uint16'
+            %
+            %   Example:
+            %       a = arduino();
+            %       dev = spidev(a, 7);
+            %       write(dev,[2 0 0 zeros(1,256)]);
+            %
+            %   Input Arguments:
+            %   dev     - SPI device
+            %   dataIn  - Data to write to the device (double).
+            %
+            %   See also writeRead
+            
+            if nargin < 3
+                dataPrecision = 'uint8';
+            else
+                dataPrecision = validatestring(dataPrecision, {'uint8', 'uint16'});
+            end
+            
+            try
+                transferData(obj, dataIn, dataPrecision, true);
+            catch e
+                throwAsCaller(e);
+            end
+        end
     end
     
     methods (Access = private)
-        function startSPI(obj, count)
-            mcu = obj.Parent.getMCU();
-            if count > 1 && ~strcmp(mcu, 'cortex-m3')
-                % Already started
-                % Atmel MCU's call SPI.begin without specifying CS
-                % One call is sufficient for all SPI devices.
-                %
-                return;
-            end
+        function startSPI(obj)
+            % The Arduino calls SPI.begin for the first device only on Atmel
+            % MCU's, which have no chip select in the SPI controller
             commandID = obj.START_SPI;
             try
                 cmd = obj.ChipSelectPin;
-                sendCommand(obj, obj.LibraryName, commandID, cmd);
+                output = sendCommand(obj, obj.LibraryName, commandID, cmd);
+                if output(1) ~= commandID
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                elseif output(4) ~= 0
+                    obj.localizedError('MATLAB:arduinoio:general:maxSPIDevices');
+                end
             catch e
                 throwAsCaller(e);
             end
         end
         
-        function stopSPI(obj, count)
-            mcu = obj.Parent.getMCU();
-            if count > 0 && ~strcmp(mcu, 'cortex-m3')
-                % Other SPI devices still exist
-                % Atmel MCU's call SPI.end without specifying CS
-                % One call is sufficient for all SPI devices.
-                %
-                return;
-            end
-            
+        function stopSPI(obj)
+            % The Arduino calls SPI.end once the last device stops on Atmel
+            % MCU's
             commandID = obj.STOP_SPI;
             try
                 cmd = obj.ChipSelectPin;
@@ -382,6 +351,74 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
             end
         end
         
+        function busSpeed = setBusSpeed(obj, busSpeed)
+            % Returns the clock the device runs at, the fastest one at or
+            % below busSpeed
+            commandID = obj.SET_CLOCK;
+            try
+                cmd = [obj.ChipSelectPin; arduinoio.BinaryToASCII(typecast(uint32(busSpeed), 'uint8'))];
+                output = sendCommand(obj, obj.LibraryName, commandID, cmd);
+                if isempty(output) || output(1) ~= commandID
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                elseif arduinoio.internal.isErrorResponse(output, commandID)
+                    obj.localizedError('MATLAB:arduinoio:general:commandRejected', obj.LibraryName);
+                end
+                speed = double(output(4:7));
+                busSpeed = sum(speed(:)' .* 2.^[24 16 8 0]);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function dataOut = transferData(obj, dataIn, dataPrecision, writeOnly)
+            % Sends dataIn msb first in chunks of what fits into one command,
+            % all but the last one keep the chip select asserted
+            numBytes = obj.SIZEOF.(dataPrecision);
+            maxValue = 2^(numBytes*8)-1;
+            
+            if isempty(dataIn) || ~isnumeric(dataIn) || ~isvector(dataIn)
+                arduinoio.internal.validateIntParameterRanged('dataIn', dataIn, 0, maxValue);
+            end
+            dataIn = double(dataIn(:)');
+            invalid = find(dataIn < 0 | dataIn > maxValue | dataIn ~= floor(dataIn), 1);
+            if ~isempty(invalid)
+                arduinoio.internal.validateIntParameterRanged(...
+                    ['dataIn(' num2str(invalid) ')'], dataIn(invalid), 0, maxValue);
+            end
+            bytes = reshape(typecast(cast(dataIn, dataPrecision), 'uint8'), numBytes, []);
+            bytes = reshape(flipud(bytes), 1, []); % typecast is little endian
+            
+            commandID = obj.TRANSFER;
+            flags = 0;
+            if writeOnly
+                flags = obj.WRITE_ONLY;
+            end
+            chunkSize = getMaxDataSize(obj);
+            numChunks = ceil(numel(bytes)/chunkSize);
+            dataOut = cell(1, numChunks);
+            for ii = 1:numChunks
+                chunk = bytes((ii-1)*chunkSize+1:min(ii*chunkSize, end));
+                chunkFlags = flags;
+                if ii < numChunks
+                    chunkFlags = bitor(chunkFlags, obj.HOLD_CS);
+                end
+                cmd = [obj.ChipSelectPin; ...
+                    chunkFlags; ...
+                    arduinoio.BinaryToASCII(typecast(uint16(numel(chunk)), 'uint8')); ...
+                    encodePayload(obj, chunk)];
+                output = sendCommand(obj, obj.LibraryName, commandID, cmd);
+                if isempty(output) || output(1) ~= commandID
+                    obj.localizedError('MATLAB:arduinoio:general:connectionIsLost');
+                end
+                dataOut{ii} = reshape(output(4:end), 1, []);
+                if numel(dataOut{ii}) ~= (~writeOnly)*numel(chunk)
+                    % the server had no buffer for the chunk
+                    obj.localizedError('MATLAB:arduinoio:general:unsuccessfulSPITransfer', num2str(numel(chunk)));
+                end
+            end
+            dataOut = [dataOut{:}];
+        end
+        
         function setBitOrder(obj)
             commandID = obj.SET_BIT_ORDER;
             try
@@ -442,6 +479,7 @@ classdef spidev < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
             fprintf('             Pins: %s\n', spiPins);
             fprintf('             Mode: %-15d (0, 1, 2 or 3)\n', obj.Mode);
             fprintf('         BitOrder: %-15s (''msbfirst'' or ''lsbfirst'')\n', obj.BitOrder');
+            fprintf('         BusSpeed: %-15d (Hz)\n', obj.BusSpeed);
             fprintf('\n');
                   
             % Allow for the possibility of a footer.
@@ -7,6 +7,25 @@
 
 #include "MWArduino.h"
 
+// Largest transfer of one command, plus the status byte of reads
+#ifdef BUFFER_LENGTH
+#define I2C_SCRATCH_SIZE (BUFFER_LENGTH+1)
+#else
+#define I2C_SCRATCH_SIZE 33
+#endif
+
+// Decoded operations of a transaction followed by their results
+#define I2C_TRANSACTION_SIZE MAX_FRAME_SIZE
+
+#if !defined(SCRATCH_SIZE) || SCRATCH_SIZE < I2C_SCRATCH_SIZE
+#undef SCRATCH_SIZE
+#define SCRATCH_SIZE I2C_SCRATCH_SIZE
+#endif
+#if SCRATCH_SIZE < I2C_TRANSACTION_SIZE
+#undef SCRATCH_SIZE
+#define SCRATCH_SIZE I2C_TRANSACTION_SIZE
+#endif
+
 //prog_char MSG_I2C_ENTER_COMMAND_HANDLER[] 	PROGMEM = "I2CBase::commandHandler: sequence_ID %d, payload_size %d, %d, libraryID %d, cmdID %d\n";
 //prog_char MSG_I2C_UNRECOGNIZED_COMMAND[] 	PROGMEM = "I2CBase::commandHandler:unrecognized command ID %d\n";
 //prog_char MSG_I2C_SCAN_BUS[]                PROGMEM = "scanI2CBus(%d)\n";
@@ -40,6 +59,50 @@ prog_char MSG_WIRE1_REQUESTFROM[]           PROGMEM = "Arduino::Wire1.requestFro
 
 bool hasBegin[2] = {false, false};
 
+// Bus clock, reapplied whenever a bus begins since begin() resets it
+#define I2C_DEFAULT_CLOCK 100000UL
+#if defined(TWBR)
+#define I2C_MAX_CLOCK 400000UL // fast mode, the rating of the AVR TWI
+#elif defined(ARDUINO_ARCH_SAM) && ARDUINO >= 10600
+#define I2C_MAX_CLOCK 1000000UL
+#else
+#define I2C_MAX_CLOCK I2C_DEFAULT_CLOCK // the core cannot change it
+#endif
+
+unsigned long busClock[2] = {I2C_DEFAULT_CLOCK, I2C_DEFAULT_CLOCK};
+
+// Bus scan, probed I2C_SCAN_SLICE addresses per update() pass
+#define I2C_SCAN_FIRST_ADDRESS 8
+#define I2C_SCAN_LAST_ADDRESS  119
+#define I2C_SCAN_SLICE         8
+#define I2C_MAP_SIZE           ((I2C_SCAN_LAST_ADDRESS - I2C_SCAN_FIRST_ADDRESS) / 8 + 1)
+#define I2C_PROBE_TIMEOUT      1000 // microseconds a register level probe waits for the bus
+
+// Scan modes
+#define I2C_SCAN_FULL   0x00 // probe every address
+#define I2C_SCAN_CACHED 0x01 // answer from the device map if the bus has been scanned before
+
+typedef struct {
+    byte bus;
+    byte address;    // next address to probe
+    byte sequenceID; // of the deferred response
+    byte found[I2C_MAP_SIZE]; // bit per address that acknowledged
+} I2CScanState;
+
+// Devices known on each bus, bit per address from I2C_SCAN_FIRST_ADDRESS. Set by a scan and
+// kept up to date by later transfers that find an address acknowledging or not.
+byte deviceMap[2][I2C_MAP_SIZE];
+bool hasDeviceMap[2] = {false, false};
+
+I2CScanState i2cScan;
+byte i2cScanTask = NO_TASK;
+
+// Transaction operations: op, address, register (with I2C_OP_REGISTER), length, data (writes)
+#define I2C_OP_READ     0x01 // read length bytes, otherwise write the data
+#define I2C_OP_REGISTER 0x02 // write the register first, reads follow it with a repeated start
+#define I2C_OP_BUS1     0x04 // on bus 1 instead of bus 0
+#define I2C_OP_NO_STOP  0x08 // keep the bus for the next operation, which starts with a repeated start
+
 class _Wire {
 public:
     static void begin() {
@@ -174,6 +237,7 @@ class I2CBase : public LibraryBase
 	public:
 		I2CBase(MWArduinoClass& a) : libName("I2C")
 		{
+			setCommandTable(commandTable, sizeof(commandTable)/sizeof(CommandEntry));
 			a.registerLibrary(this);
 		}
 		
@@ -184,242 +248,644 @@ class I2CBase : public LibraryBase
 		{
 			return libName;
 		}
+		
+		unsigned int getStaticSize() const
+		{
+			return sizeof(*this) + sizeof(hasBegin) + sizeof(busClock) + sizeof(deviceMap) + sizeof(hasDeviceMap) +
+			       sizeof(i2cScan) + sizeof(i2cScanTask);
+		}
+		
+		unsigned int getDynamicSize() const
+		{
+		// device maps of the scanned buses, and the state of a scan in progress
+			return (hasDeviceMap[0] + hasDeviceMap[1]) * I2C_MAP_SIZE + ((i2cScanTask != NO_TASK) ? sizeof(i2cScan) : 0);
+		}
 	
-		void commandHandler(byte* command)
+	// Command handlers
+	// command: sequence_ID, payload_size (2 bytes), libraryID, cmdID, params
+	//
+	public:
+		static const CommandEntry commandTable[8];
+		
+		static void startI2C(byte argc, byte* command)
 		{
-            //_p(MSG_I2C_ENTER_COMMAND_HANDLER, command[0], command[1], command[2], command[3], command[4]);
-            byte sequenceID = command[0];
-            byte cmdID = command[4];
-            switch (cmdID){
-                case 0x00:{  // startI2C
-                    byte bus = command[5];
-                    byte address = command[6];
-                    
-                    if(hasBegin[bus] == false){
-                        if(bus == 0){
-                            _Wire::begin();
-                        }
-                        else{ // For now, only bus 0 and 1 are supported
-                            #ifdef ARDUINO_ARCH_SAM
-                            _Wire1::begin();
-                            #endif
-                        }
-                        hasBegin[bus] = true;
+            byte bus = command[5];
+            if(bus > 1){ // For now, only bus 0 and 1 are supported
+                sendErrorResponseMsg(0x00);
+                return;
+            }
+            beginBus(bus);
+            
+            sendResponseMsg(0x00, 0, 0);
+		}
+		
+		static void scanI2CBus(byte argc, byte* command)
+		{
+            //_p(MSG_I2C_SCAN_BUS, command[5]);
+            byte bus      = command[5];
+            if(bus > 1){ // For now, only bus 0 and 1 are supported
+                sendErrorResponseMsg(0x01);
+                return;
+            }
+            byte mode = (argc > 6) ? command[6] : I2C_SCAN_FULL;
+            
+            beginBus(bus);
+            
+            if(mode == I2C_SCAN_CACHED && hasDeviceMap[bus]){
+                sendMapResponse(deviceMap[bus]);
+                return;
+            }
+            
+            // Probing all addresses takes several milliseconds on a bus without pull-ups, so
+            // the scan runs as a task and answers when it is done. Inside a batch or script,
+            // or while another scan runs, it still scans in one go.
+            if(i2cScanTask == NO_TASK && deferResponse(&i2cScan.sequenceID)){
+                startScan(i2cScan, bus);
+                i2cScanTask = MWArduino.addTask(scanTask, &i2cScan, 0, 0);
+                if(i2cScanTask != NO_TASK){
+                    return;
+                }
+            }
+            I2CScanState scan;
+            startScan(scan, bus);
+            while(scanSlice(scan)){
+            }
+            sendMapResponse(scan.found);
+		}
+		
+		static void configureBus(byte argc, byte* command)
+		{
+            byte bus = command[5];
+            if(bus > 1){ // For now, only bus 0 and 1 are supported
+                sendErrorResponseMsg(0x07);
+                return;
+            }
+            byte clockBytes[4];
+            ASCII2Binary(4, &command[6], clockBytes);
+            unsigned long clock = (unsigned long)clockBytes[0] + ((unsigned long)clockBytes[1]<<8) + 
+                                  ((unsigned long)clockBytes[2]<<16) + ((unsigned long)clockBytes[3]<<24);
+            if(clock == 0){
+                sendErrorResponseMsg(0x07);
+                return;
+            }
+            
+            busClock[bus] = supportedClock(clock);
+            if(hasBegin[bus]){
+                applyClock(bus);
+            }
+            else{
+                beginBus(bus);
+            }
+            
+            clock = busClock[bus];
+            byte val[4];
+            val[0] = (clock >> 24) & 0xff;
+            val[1] = (clock >> 16) & 0xff;
+            val[2] = (clock >> 8) & 0xff;
+            val[3] = clock & 0xff;
+            sendResponseMsg(0x07, 4, val);
+		}
+		
+	private:
+		static void beginBus(byte bus)
+		{
+            if(hasBegin[bus] == false){
+                if(bus == 0){
+                    _Wire::begin();
+                }
+                else{ // For now, only bus 0 and 1 are supported
+                    #ifdef ARDUINO_ARCH_SAM
+                    _Wire1::begin();
+                    #endif
+                }
+                hasBegin[bus] = true;
+                applyClock(bus);
+            }
+		}
+		
+		static unsigned long supportedClock(unsigned long clock)
+		{
+		// Closest clock at or below the requested one that the bus can run at
+            if(clock > I2C_MAX_CLOCK){
+                clock = I2C_MAX_CLOCK;
+            }
+            #if defined(TWBR)
+            unsigned long twbr = (F_CPU / clock - 16 + 1) / 2; // rounded up, to stay at or below clock
+            if(twbr > 255){
+                twbr = 255;
+            }
+            clock = F_CPU / (16 + 2 * twbr);
+            #elif !(defined(ARDUINO_ARCH_SAM) && ARDUINO >= 10600)
+            clock = I2C_DEFAULT_CLOCK;
+            #endif
+            return clock;
+		}
+		
+		static void applyClock(byte bus)
+		{
+            #if defined(TWBR)
+            if(bus == 0){
+                TWBR = (F_CPU / busClock[0] - 16) / 2; // prescaler 1, as set by Wire
+            }
+            #elif defined(ARDUINO_ARCH_SAM) && ARDUINO >= 10600
+            if(bus == 0){
+                Wire.setClock(busClock[0]);
+            }
+            else{
+                Wire1.setClock(busClock[1]);
+            }
+            #endif
+		}
+		
+		static void noteDevice(byte bus, byte address, byte status)
+		{
+		// Updates the device map with the outcome of addressing a device
+            if(address < I2C_SCAN_FIRST_ADDRESS || address > I2C_SCAN_LAST_ADDRESS){
+                return;
+            }
+            byte index = address - I2C_SCAN_FIRST_ADDRESS;
+            if(status == 0){
+                deviceMap[bus][index >> 3] |= 1 << (index & 0x07);
+            }
+            else if(status == 2){ // address not acknowledged
+                deviceMap[bus][index >> 3] &= ~(1 << (index & 0x07));
+            }
+		}
+		
+		#if defined(TWCR) && defined(TWSTA)
+		static bool waitTWI()
+		{
+            unsigned long start = micros();
+            while(!(TWCR & _BV(TWINT))){
+                if(micros() - start > I2C_PROBE_TIMEOUT){
+                    return false;
+                }
+            }
+            return true;
+		}
+		#endif
+		
+		static byte probe(byte bus, byte address)
+		{
+		// Addresses a device without data, returns 0 if it acknowledged, 2 if not
+            #if defined(TWCR) && defined(TWSTA)
+            if(bus == 0){
+                // Straight through the TWI registers: no Wire buffering, and a timeout instead
+                // of hanging on a bus without pull-ups
+                byte savedTWCR = TWCR;
+                byte status = 4;
+                TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+                if(waitTWI() && (TWSR & 0xF8) == 0x08){ // START sent
+                    TWDR = address << 1;
+                    TWCR = _BV(TWINT) | _BV(TWEN);
+                    if(waitTWI()){
+                        status = ((TWSR & 0xF8) == 0x18) ? 0 : 2; // SLA+W acknowledged
                     }
-                    
-                    sendResponseMsg(0x00, 0, 0);
-                    break;
                 }
-                case 0x01:{ // scanI2CBus
-                    //_p(MSG_I2C_SCAN_BUS, command[5]);
-                    byte bus      = command[5];
-                    
-                    if(hasBegin[bus] == false){
-                        if(bus == 0){
-                            _Wire::begin();
-                        }
-                        else{
-                            #ifdef ARDUINO_ARCH_SAM
-                            _Wire1::begin();
-                            #endif
-                        }
-                        hasBegin[bus] = true;
+                TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+                unsigned long start = micros();
+                while((TWCR & _BV(TWSTO)) && micros() - start <= I2C_PROBE_TIMEOUT){
+                }
+                if(status == 4){
+                    TWCR = 0; // release a stuck bus
+                }
+                TWCR = savedTWCR & ~(_BV(TWINT) | _BV(TWSTA) | _BV(TWSTO));
+                return status;
+            }
+            #endif
+            byte code = 4;
+            if(bus == 0){
+                _Wire::beginTransmission(address);
+                code = _Wire::endTransmission();
+            }
+            else{
+                #ifdef ARDUINO_ARCH_SAM
+                _Wire1::beginTransmission(address);
+                code = _Wire1::endTransmission();
+                #endif
+            }
+            return code;
+		}
+		
+		static void startScan(I2CScanState& scan, byte bus)
+		{
+            scan.bus = bus;
+            scan.address = I2C_SCAN_FIRST_ADDRESS;
+            memset(scan.found, 0, sizeof(scan.found));
+		}
+		
+		static bool scanSlice(I2CScanState& scan)
+		{
+		// Probes the next I2C_SCAN_SLICE addresses, false once all have been probed and the
+		// device map has been replaced
+            for(byte i = 0; i < I2C_SCAN_SLICE && scan.address <= I2C_SCAN_LAST_ADDRESS; ++i, ++scan.address){
+                if(probe(scan.bus, scan.address) == 0){
+                    byte index = scan.address - I2C_SCAN_FIRST_ADDRESS;
+                    scan.found[index >> 3] |= 1 << (index & 0x07);
+                }
+            }
+            if(scan.address <= I2C_SCAN_LAST_ADDRESS){
+                return true;
+            }
+            memcpy(deviceMap[scan.bus], scan.found, I2C_MAP_SIZE);
+            hasDeviceMap[scan.bus] = true;
+            return false;
+		}
+		
+		static byte foundAddresses(const byte* map, byte* val)
+		{
+            byte count = 0;
+            for(byte index = 0; index <= I2C_SCAN_LAST_ADDRESS - I2C_SCAN_FIRST_ADDRESS; ++index){
+                if(map[index >> 3] & (1 << (index & 0x07))){
+                    val[count++] = I2C_SCAN_FIRST_ADDRESS + index;
+                }
+            }
+            return count;
+		}
+		
+		static void sendMapResponse(const byte* map)
+		{
+            byte val[I2C_SCAN_LAST_ADDRESS - I2C_SCAN_FIRST_ADDRESS + 1];
+            byte count = foundAddresses(map, val);
+            if(count == 0){
+                val[0] = 0;
+            }
+            sendResponseMsg(0x01, count, val);
+		}
+		
+		static bool scanTask(void* context)
+		{
+            I2CScanState& scan = *(I2CScanState*)context;
+            if(scanSlice(scan)){
+                return true;
+            }
+            byte val[I2C_SCAN_LAST_ADDRESS - I2C_SCAN_FIRST_ADDRESS + 1];
+            byte count = foundAddresses(scan.found, val);
+            if(count == 0){
+                val[0] = 0;
+            }
+            sendDeferredResponseMsg(scan.sequenceID, 0x01, count, val);
+            i2cScanTask = NO_TASK;
+            return false;
+		}
+		
+	public:
+		static void transaction(byte argc, byte* command)
+		{
+            byte length;
+            ASCII2Binary(1, &command[5], &length);
+            if(argc < 7 + encodedPayloadSize(length)){
+                sendResponseMsg(0x06, 0, 0); // no results tells the host that nothing was run
+                return;
+            }
+            
+            byte* buffer = MWArduino.borrowScratch(I2C_TRANSACTION_SIZE);
+            if(buffer == NULL || length >= I2C_TRANSACTION_SIZE){
+                if(buffer != NULL){
+                    MWArduino.returnScratch();
+                }
+                sendResponseMsg(0x06, 0, 0);
+                return;
+            }
+            decodePayload(length, &command[7], buffer);
+            unsigned int count = runTransaction(buffer, length, &buffer[length], I2C_TRANSACTION_SIZE - length);
+            
+            sendResponseMsg(0x06, count, &buffer[length]);
+            
+            MWArduino.returnScratch();
+		}
+		
+		// Executes a list of operations back to back, see I2C_OP_READ. Each operation adds its
+		// status to results, 0 on success, followed by the bytes it read (zeros if it failed).
+		// Write statuses are those of endTransmission, failed reads 0xFF. Returns the size of
+		// the results, 0 if the list is malformed or they would exceed maxResults, in which
+		// case nothing is executed.
+		static unsigned int runTransaction(byte* ops, byte length, byte* results, unsigned int maxResults)
+		{
+            unsigned int count = 0;
+            byte i = 0;
+            while(i < length){
+                byte op = ops[i];
+                byte header = (op & I2C_OP_REGISTER) ? 4 : 3;
+                if(length - i < header){
+                    return 0;
+                }
+                byte numBytes = ops[i + header - 1];
+                if((op & I2C_OP_READ) && (numBytes == 0 || numBytes > I2C_SCRATCH_SIZE - 1)){
+                    return 0;
+                }
+                i += header;
+                if(op & I2C_OP_READ){
+                    count += 1 + numBytes;
+                }
+                else{
+                    if(length - i < numBytes || header - 3 + numBytes > I2C_SCRATCH_SIZE - 1){ // Wire buffers BUFFER_LENGTH bytes
+                        return 0;
                     }
-                    
-                    byte val[112];
-                    byte count = 0;
-                    for(byte addr = 8; addr < 120; ++addr){
-                        if(bus == 0){
-                            _Wire::beginTransmission(addr);
-                            byte code = _Wire::endTransmission();
-                            
-                            if(code == 0){
-                                val[count++] = addr;
-                            }
+                    i += numBytes;
+                    count += 1;
+                }
+            }
+            if(count > maxResults){
+                return 0;
+            }
+            
+            byte* result = results;
+            i = 0;
+            while(i < length){
+                byte op = ops[i++];
+                byte bus = (op & I2C_OP_BUS1) ? 1 : 0;
+                byte address = ops[i++];
+                byte reg = (op & I2C_OP_REGISTER) ? ops[i++] : 0;
+                byte numBytes = ops[i++];
+                byte* data = &ops[i];
+                if(!(op & I2C_OP_READ)){
+                    i += numBytes;
+                }
+                bool stop = !(op & I2C_OP_NO_STOP);
+                
+                byte status = 0xFF;
+                beginBus(bus);
+                if(bus == 0){
+                    if(op & I2C_OP_READ){
+                        if(op & I2C_OP_REGISTER){
+                            _Wire::beginTransmission(address);
+                            _Wire::write(reg);
+                            status = _Wire::endTransmission(false);
                         }
                         else{
-                            #ifdef ARDUINO_ARCH_SAM
-                            _Wire1::beginTransmission(addr);
-                            byte code = _Wire1::endTransmission();
-                            
-                            if(code == 0){
-                                val[count++] = addr;
-                            }
-                            #endif
+                            status = 0;
+                        }
+                        if(status == 0){
+                            status = (_Wire::requestFrom(address, numBytes, stop) == numBytes) ? 0 : 0xFF;
                         }
                     }
-                    if(count == 0){
-                        val[0] = 0;
+                    else{
+                        _Wire::beginTransmission(address);
+                        if(op & I2C_OP_REGISTER){
+                            _Wire::write(reg);
+                        }
+                        _Wire::write(data, numBytes);
+                        status = _Wire::endTransmission(stop);
                     }
-                    sendResponseMsg(0x01, count, val);
-                    break;
                 }
-                case 0x02:{ // read
-                    //_p(MSG_I2C_READ_PARAMS, command[5], command[6], command[7]);
-                    byte bus      = command[5];
-                    byte address  = command[6];
-                    
-                    byte numBytes; // numBytes can only be a byte according to requestFrom API prototype
-                    ASCII2Binary(1, &command[7], &numBytes); 
-                    
-                    byte dataRead;
-                    
-                    byte* val = new byte [numBytes+1];
-                    
-                    if(bus == 0){
-                        _Wire::beginTransmission(address);
-                        if(_Wire::requestFrom(address, (uint8_t)numBytes) != numBytes){
-                            val[0] = 0xFF;
+                else{
+                    #ifdef ARDUINO_ARCH_SAM
+                    if(op & I2C_OP_READ){
+                        if(op & I2C_OP_REGISTER){
+                            _Wire1::beginTransmission(address);
+                            _Wire1::write(reg);
+                            status = _Wire1::endTransmission(false);
                         }
                         else{
-                            val[0] = 0x00;
-                            for(byte i = 1; i < numBytes+1; ++i){
-                                val[i] = _Wire::read();
-                            }
+                            status = 0;
+                        }
+                        if(status == 0){
+                            status = (_Wire1::requestFrom(address, numBytes, stop) == numBytes) ? 0 : 0xFF;
                         }
-                        _Wire::endTransmission(true); 
                     }
                     else{
-                        #ifdef ARDUINO_ARCH_SAM
                         _Wire1::beginTransmission(address);
-                        if(_Wire1::requestFrom(address, (uint8_t)numBytes) != numBytes){
-                            val[0] = 0xFF;
-                        }
-                        else{
-                            val[0] = 0x00;
-                            for(byte i = 1; i < numBytes+1; ++i){
-                                val[i] = _Wire1::read();
-                            }
+                        if(op & I2C_OP_REGISTER){
+                            _Wire1::write(reg);
                         }
-                        _Wire1::endTransmission(false); 
-                        #endif
+                        _Wire1::write(data, numBytes);
+                        status = _Wire1::endTransmission(stop);
                     }
-                    
-                    sendResponseMsg(0x02, numBytes+1, val);
-                    
-                    delete [] val;
-                    break;
+                    #endif
                 }
-                case 0x03:{ // write
-                    //_p(MSG_I2C_WRITE_PARAMS, command[5], command[6], command[7]);
-                    byte bus      = command[5];
-                    byte address  = command[6];
-                    
-                    byte numBytes; // numBytes can only be a byte according to requestFrom API prototype
-                    ASCII2Binary(1, &command[7], &numBytes); 
-                    
-                    byte* val = new byte [numBytes];
-                    ASCII2Binary(numBytes, &command[9], val); 
-                    for(byte i = 0; i < numBytes; ++i){
-                        //_p(MSG_I2C_WRITE_VALUES, val[i]);
-                    }
-                    
-                    if(bus == 0){
-                        _Wire::beginTransmission(address);
-                        _Wire::write(val, numBytes);
-                        _Wire::endTransmission(true);
-                    }
-                    else{ // For now, only bus 0 and 1 are supported
-                        #ifdef ARDUINO_ARCH_SAM
-                        _Wire1::beginTransmission(address);
-                        _Wire1::write(val, numBytes);
-                        _Wire1::endTransmission(true);
-                        #endif
-                    }
-                    
-                    delete [] val;
-                    
-                    sendResponseMsg(0x03, 0, 0);
-                    break;
+                
+                if(!(op & I2C_OP_READ) || (op & I2C_OP_REGISTER)){
+                    noteDevice(bus, address, status);
                 }
-                case 0x04:{ // readRegister
-                    //_p(MSG_I2C_READ_REGISTER_PARAMS, command[5], command[6], command[7], command[8]);
-                    byte bus      = command[5];
-                    byte address  = command[6];
-                    
-                    byte reg;
-                    ASCII2Binary(1, &command[7], &reg);
-                    byte numBytes = command[9];
-                    byte dataRead;
-                    
-                    byte* val = new byte [numBytes+1];
-                    
-                    if(bus == 0){
-                        _Wire::beginTransmission(address);
-                        _Wire::write(reg);  
-                        _Wire::endTransmission(false); 
-                        if(_Wire::requestFrom(address, (uint8_t)numBytes) != numBytes){
-                            val[0] = 0xFF;
+                *result++ = status;
+                if(op & I2C_OP_READ){
+                    for(byte j = 0; j < numBytes; ++j){
+                        if(status == 0){
+                            *result++ = (bus == 0) ? _Wire::read() : _Wire1::read();
                         }
                         else{
-                            val[0] = 0x00;
-                            for(byte i = 1; i < numBytes+1; ++i){
-                                val[i] = _Wire::read();
-                                //_p(MSG_I2C_READ_VALUES, val[i]);
-                            }
+                            *result++ = 0;
                         }
                     }
-                    else{
-                        #ifdef ARDUINO_ARCH_SAM
-                        _Wire1::beginTransmission(address);
-                        _Wire1::write(reg);  
-                        _Wire1::endTransmission(false); 
-                        if(_Wire1::requestFrom(address, (uint8_t)numBytes) != numBytes){
-                            val[0] = 0xFF;
-                        }
-                        else{
-                            val[0] = 0x00;
-                            for(byte i = 1; i < numBytes+1; ++i){
-                                val[i] = _Wire1::read();
-                            }
-                        }
-                        #endif
+                }
+            }
+            return count;
+		}
+		
+		static void read(byte argc, byte* command)
+		{
+            //_p(MSG_I2C_READ_PARAMS, command[5], command[6], command[7]);
+            byte bus      = command[5];
+            if(bus > 1){ // For now, only bus 0 and 1 are supported
+                sendErrorResponseMsg(0x02);
+                return;
+            }
+            byte address  = command[6];
+            
+            byte numBytes; // numBytes can only be a byte according to requestFrom API prototype
+            ASCII2Binary(1, &command[7], &numBytes); 
+            
+            byte* val = MWArduino.borrowScratch(numBytes+1);
+            if(val == NULL){
+                sendErrorResponseMsg(0x02);
+                return;
+            }
+            
+            if(bus == 0){
+                _Wire::beginTransmission(address);
+                if(_Wire::requestFrom(address, (uint8_t)numBytes) != numBytes){
+                    val[0] = 0xFF;
+                }
+                else{
+                    val[0] = 0x00;
+                    for(byte i = 1; i < numBytes+1; ++i){
+                        val[i] = _Wire::read();
                     }
-                    
-                    sendResponseMsg(0x04, numBytes+1, val);
-                    
-                    delete [] val;
-                    break;
                 }
-                case 0x05:{ // writeRegister
-                    //_p(MSG_I2C_WRITE_REGISTER_PARAMS, command[5], command[6], command[7], command[8]);
-                    byte bus      = command[5];
-                    byte address  = command[6];
-                    
-                    byte reg;
-                    ASCII2Binary(1, &command[7], &reg);
-                    
-                    byte numBytes = command[9];
-                    
-                    byte* val = new byte [numBytes];
-                    ASCII2Binary(numBytes, &command[10], val);
-                    for(byte i = 0; i < numBytes; ++i){
-                        //_p(MSG_I2C_WRITE_VALUES, val[i]);
+                _Wire::endTransmission(true); 
+            }
+            else{
+                #ifdef ARDUINO_ARCH_SAM
+                _Wire1::beginTransmission(address);
+                if(_Wire1::requestFrom(address, (uint8_t)numBytes) != numBytes){
+                    val[0] = 0xFF;
+                }
+                else{
+                    val[0] = 0x00;
+                    for(byte i = 1; i < numBytes+1; ++i){
+                        val[i] = _Wire1::read();
                     }
-                    
-                    if(bus == 0){
-                        _Wire::beginTransmission(address);
-                        _Wire::write(reg);
-                        _Wire::write(val, numBytes);
-                        _Wire::endTransmission(true);
+                }
+                _Wire1::endTransmission(false); 
+                #endif
+            }
+            
+            sendResponseMsg(0x02, numBytes+1, val);
+            
+            MWArduino.returnScratch();
+		}
+		
+		static void write(byte argc, byte* command)
+		{
+            //_p(MSG_I2C_WRITE_PARAMS, command[5], command[6], command[7]);
+            byte bus      = command[5];
+            if(bus > 1){ // For now, only bus 0 and 1 are supported
+                sendErrorResponseMsg(0x03);
+                return;
+            }
+            byte address  = command[6];
+            
+            byte numBytes; // numBytes can only be a byte according to requestFrom API prototype
+            ASCII2Binary(1, &command[7], &numBytes); 
+            if(argc < 9 + encodedPayloadSize(numBytes)){
+                sendErrorResponseMsg(0x03);
+                return;
+            }
+            
+            byte* val = MWArduino.borrowScratch(numBytes);
+            if(val == NULL){
+                sendErrorResponseMsg(0x03);
+                return;
+            }
+            decodePayload(numBytes, &command[9], val); 
+            for(byte i = 0; i < numBytes; ++i){
+                //_p(MSG_I2C_WRITE_VALUES, val[i]);
+            }
+            
+            if(bus == 0){
+                _Wire::beginTransmission(address);
+                _Wire::write(val, numBytes);
+                noteDevice(0, address, _Wire::endTransmission(true));
+            }
+            else{ // For now, only bus 0 and 1 are supported
+                #ifdef ARDUINO_ARCH_SAM
+                _Wire1::beginTransmission(address);
+                _Wire1::write(val, numBytes);
+                noteDevice(1, address, _Wire1::endTransmission(true));
+                #endif
+            }
+            
+            MWArduino.returnScratch();
+            
+            sendResponseMsg(0x03, 0, 0);
+		}
+		
+		static void readRegister(byte argc, byte* command)
+		{
+            //_p(MSG_I2C_READ_REGISTER_PARAMS, command[5], command[6], command[7], command[8]);
+            byte bus      = command[5];
+            if(bus > 1){ // For now, only bus 0 and 1 are supported
+                sendErrorResponseMsg(0x04);
+                return;
+            }
+            byte address  = command[6];
+            
+            byte reg;
+            ASCII2Binary(1, &command[7], &reg);
+            byte numBytes = command[9];
+            
+            byte* val = MWArduino.borrowScratch(numBytes+1);
+            if(val == NULL){
+                sendErrorResponseMsg(0x04);
+                return;
+            }
+            
+            if(bus == 0){
+                _Wire::beginTransmission(address);
+                _Wire::write(reg);  
+                _Wire::endTransmission(false); 
+                if(_Wire::requestFrom(address, (uint8_t)numBytes) != numBytes){
+                    val[0] = 0xFF;
+                }
+                else{
+                    val[0] = 0x00;
+                    for(byte i = 1; i < numBytes+1; ++i){
+                        val[i] = _Wire::read();
+                        //_p(MSG_I2C_READ_VALUES, val[i]);
                     }
-                    else{ // For now, only bus 0 and 1 are supported
-                        #ifdef ARDUINO_ARCH_SAM
-                        _Wire1::beginTransmission(address);
-                        _Wire1::write(reg);
-                        _Wire1::write(val, numBytes);
-                        _Wire1::endTransmission(true);
-                        #endif
+                }
+            }
+            else{
+                #ifdef ARDUINO_ARCH_SAM
+                _Wire1::beginTransmission(address);
+                _Wire1::write(reg);  
+                _Wire1::endTransmission(false); 
+                if(_Wire1::requestFrom(address, (uint8_t)numBytes) != numBytes){
+                    val[0] = 0xFF;
+                }
+                else{
+                    val[0] = 0x00;
+                    for(byte i = 1; i < numBytes+1; ++i){
+                        val[i] = _Wire1::read();
                     }
-                    
-                    delete [] val;
-                    
-                    sendResponseMsg(0x05, 0, 0);
-                    break;
                 }
-                default:
-                    //_p(MSG_I2C_UNRECOGNIZED_COMMAND, cmdID);
-					break;
+                #endif
+            }
+            
+            sendResponseMsg(0x04, numBytes+1, val);
+            
+            MWArduino.returnScratch();
+		}
+		
+		static void writeRegister(byte argc, byte* command)
+		{
+            //_p(MSG_I2C_WRITE_REGISTER_PARAMS, command[5], command[6], command[7], command[8]);
+            byte bus      = command[5];
+            if(bus > 1){ // For now, only bus 0 and 1 are supported
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            byte address  = command[6];
+            
+            byte reg;
+            ASCII2Binary(1, &command[7], &reg);
+            
+            byte numBytes = command[9];
+            if(argc < 10 + encodedPayloadSize(numBytes)){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            
+            byte* val = MWArduino.borrowScratch(numBytes);
+            if(val == NULL){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            decodePayload(numBytes, &command[10], val);
+            for(byte i = 0; i < numBytes; ++i){
+                //_p(MSG_I2C_WRITE_VALUES, val[i]);
             }
+            
+            if(bus == 0){
+                _Wire::beginTransmission(address);
+                _Wire::write(reg);
+                _Wire::write(val, numBytes);
+                noteDevice(0, address, _Wire::endTransmission(true));
+            }
+            else{ // For now, only bus 0 and 1 are supported
+                #ifdef ARDUINO_ARCH_SAM
+                _Wire1::beginTransmission(address);
+                _Wire1::write(reg);
+                _Wire1::write(val, numBytes);
+                noteDevice(1, address, _Wire1::endTransmission(true));
+                #endif
+            }
+            
+            MWArduino.returnScratch();
+            
+            sendResponseMsg(0x05, 0, 0);
 		}
-};
\ No newline at end of file
+};
+
+// handler, numParams, numData, responseSize
+const CommandEntry I2CBase::commandTable[8] PROGMEM = {
+    {I2CBase::startI2C,         2, 0, 0},                       // 0x00 bus, address
+    {I2CBase::scanI2CBus,       1, 0, RESPONSE_SIZE_VARIABLE},  // 0x01 bus, mode (optional)
+    {I2CBase::read,             4, 0, RESPONSE_SIZE_VARIABLE},  // 0x02 bus, address, numBytes (7-bit encoded)
+    {I2CBase::write,            4, 0, 0},                       // 0x03 bus, address, numBytes (7-bit encoded), data
+    {I2CBase::readRegister,     5, 0, RESPONSE_SIZE_VARIABLE},  // 0x04 bus, address, register (7-bit encoded), numBytes
+    {I2CBase::writeRegister,    5, 0, 0},                       // 0x05 bus, address, register (7-bit encoded), numBytes, data
+    {I2CBase::transaction,      2, 0, RESPONSE_SIZE_VARIABLE},  // 0x06 length (7-bit encoded), operations
+    {I2CBase::configureBus,     6, 0, 4},                       // 0x07 bus, clock (7-bit encoded)
+};
@@ -7,22 +7,65 @@
 
 #include "MWArduino.h"
 
+// Largest transfer of one command, bounded by the command frame. Longer transfers are
+// split by the host into commands that keep the chip select asserted in between.
+#define SPI_SCRATCH_SIZE MAX_FRAME_SIZE
+
+#if !defined(SCRATCH_SIZE) || SCRATCH_SIZE < SPI_SCRATCH_SIZE
+#undef SCRATCH_SIZE
+#define SCRATCH_SIZE SPI_SCRATCH_SIZE
+#endif
+
 //prog_char MSG_SPI_ENTER_COMMAND_HANDLER[] 	PROGMEM = "SPIBase::commandHandler: sequence_ID %d, payload_size %d, %d, libraryID %d, cmdID %d\n";
 //prog_char MSG_SPI_UNRECOGNIZED_COMMAND[] 	PROGMEM = "SPIBase::commandHandler:unrecognized command ID %d\n";
         
 // Arduino trace commands
 prog_char MSG_SPI_BEGIN[]                   PROGMEM = "Arduino::SPI.begin();\n";
 prog_char MSG_SPI_BEGIN_DUE[]               PROGMEM = "Arduino::SPI.begin(%d);\n";
-prog_char MSG_SPI_SETCLOCKDIVIDER[]         PROGMEM = "Arduino::SPI.setClockDivider(%s);\n";
+prog_char MSG_SPI_SETCLOCKDIVIDER[]         PROGMEM = "Arduino::SPI.setClockDivider(%d);\n";
 prog_char MSG_SPI_SETCLOCKDIVIDER_DUE[]     PROGMEM = "Arduino::SPI.setClockDivider(%d, %d);\n";
 prog_char MSG_SPI_END[]                     PROGMEM = "Arduino::SPI.end();\n";
 prog_char MSG_SPI_END_DUE[]                 PROGMEM = "Arduino::SPI.end(%d);\n";
-prog_char MSG_SPI_SETDATAMODE[]             PROGMEM = "Arduino::SPI.setDataMode(%s);\n";
-prog_char MSG_SPI_SETDATAMODE_DUE[]         PROGMEM = "Arduino::SPI.setDataMode(%d, %s);\n";
-prog_char MSG_SPI_SETBITORDER[]             PROGMEM = "Arduino::SPI.setBitOrder(%s);\n";
-prog_char MSG_SPI_SETBITORDER_DUE[]         PROGMEM = "Arduino::SPI.setBitOrder(%d, %s);\n";
+prog_char MSG_SPI_SETDATAMODE[]             PROGMEM = "Arduino::SPI.setDataMode(%d);\n";
+prog_char MSG_SPI_SETDATAMODE_DUE[]         PROGMEM = "Arduino::SPI.setDataMode(%d, %d);\n";
+prog_char MSG_SPI_SETBITORDER[]             PROGMEM = "Arduino::SPI.setBitOrder(%d);\n";
+prog_char MSG_SPI_SETBITORDER_DUE[]         PROGMEM = "Arduino::SPI.setBitOrder(%d, %d);\n";
 prog_char MSG_SPI_TRANSFER[]                PROGMEM = "Arduino::SPI.Transfer(%d); --> %d\n";
 prog_char MSG_SPI_TRANSFER_DUE[]            PROGMEM = "Arduino::SPI.Transfer(%d, %d, %d); --> %d\n";
+prog_char MSG_SPI_TRANSFER_BUFFER[]         PROGMEM = "Arduino::SPI.Transfer([%d, ...], %d);\n";
+
+// Chip select devices
+// Each chip select keeps its own clock, mode and bit order. SAM boards hold them in the
+// controller per chip select; AVR boards have one set of SPI registers, loaded when a
+// device is selected whose settings are not the ones already in place.
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_SPI_DEVICES 4
+#else
+#define MAX_SPI_DEVICES 8
+#endif
+#define SPI_NO_DEVICE 0xFF
+#define SPI_DEFAULT_CLOCK 4000000UL // clock of a device until it is configured
+#ifdef ARDUINO_ARCH_SAM
+#define SPI_DEFAULT_DIVIDER 21 // 84 MHz / 21
+#else
+#define SPI_DEFAULT_DIVIDER SPI_CLOCK_DIV4 // 16 MHz / 4
+#endif
+
+// Transfer flags
+#define SPI_HOLD_CS    0x01 // keep the chip select asserted, the next transfer continues this one
+#define SPI_WRITE_ONLY 0x02 // do not return the data read
+
+struct SPIDevice {
+    bool isUsed;
+    byte cspin;
+    byte divider;  // SPI_CLOCK_DIVx on AVR, divider of the master clock on SAM
+    byte mode;     // SPI_MODEx
+    byte bitOrder; // LSBFIRST or MSBFIRST
+};
+
+SPIDevice spiDevices[MAX_SPI_DEVICES];
+byte spiSelected = SPI_NO_DEVICE; // device whose chip select is held between transfers
+byte spiApplied = SPI_NO_DEVICE;  // device whose settings are in the SPI registers (AVR)
 
 class _SPI {
 public:
@@ -45,40 +88,12 @@ public:
 
     static void setDataMode(byte cspin, byte mode) {
         SPI.setDataMode(cspin, mode);
-		switch (mode) {
-			case SPI_MODE0:
-				_p(MSG_SPI_SETDATAMODE_DUE, cspin, "SPI_MODE0");
-				break;
-			case SPI_MODE1:
-				_p(MSG_SPI_SETDATAMODE_DUE, cspin, "SPI_MODE1");
-				break;
-			case SPI_MODE2:
-				_p(MSG_SPI_SETDATAMODE_DUE, cspin, "SPI_MODE2");
-				break;
-			case SPI_MODE3:
-				_p(MSG_SPI_SETDATAMODE_DUE, cspin, "SPI_MODE3");
-				break;
-			default:
-				char szBuffer[8];
-				_p(MSG_SPI_SETDATAMODE_DUE, cspin, itoa(mode, szBuffer, 10));
-				break;
-		}
+		_p(MSG_SPI_SETDATAMODE_DUE, cspin, mode);
     }
 	
 	static void setBitOrder(byte cspin, BitOrder order) {
         SPI.setBitOrder(cspin, order);
-		switch (order) {
-			case MSBFIRST:
-				_p(MSG_SPI_SETBITORDER_DUE, cspin, "MSBFIRST");
-				break;
-			case LSBFIRST:
-				_p(MSG_SPI_SETBITORDER_DUE, cspin, "LSBFIRST");
-				break;
-			default:
-				char szBuffer[8];
-				_p(MSG_SPI_SETBITORDER_DUE, cspin, itoa(order, szBuffer, 10));
-				break;
-		}
+		_p(MSG_SPI_SETBITORDER_DUE, cspin, order);
     }
 
     static byte transfer(byte cspin, byte val, SPITransferMode transferMode = SPI_LAST) {
@@ -102,71 +117,17 @@ public:
 	
 	static void setClockDivider(byte divider) {
         SPI.setClockDivider(divider);
-		switch (divider) {
-			case SPI_CLOCK_DIV2:
-				_p(MSG_SPI_SETCLOCKDIVIDER, "SPI_CLOCK_DIV2");
-				break;
-			case SPI_CLOCK_DIV4:
-				_p(MSG_SPI_SETCLOCKDIVIDER, "SPI_CLOCK_DIV4");
-				break;
-			case SPI_CLOCK_DIV8:
-				_p(MSG_SPI_SETCLOCKDIVIDER, "SPI_CLOCK_DIV8");
-				break;
-			case SPI_CLOCK_DIV16:
-				_p(MSG_SPI_SETCLOCKDIVIDER, "SPI_CLOCK_DIV16");
-				break;
-			case SPI_CLOCK_DIV32:
-				_p(MSG_SPI_SETCLOCKDIVIDER, "SPI_CLOCK_DIV32");
-				break;
-			case SPI_CLOCK_DIV64:
-				_p(MSG_SPI_SETCLOCKDIVIDER, "SPI_CLOCK_DIV64");
-				break;
-			case SPI_CLOCK_DIV128:
-				_p(MSG_SPI_SETCLOCKDIVIDER, "SPI_CLOCK_DIV128");
-				break;
-			default:
-				char szBuffer[8];
-				_p(MSG_SPI_SETCLOCKDIVIDER, itoa(divider, szBuffer, 10));
-				break;
-		}
+		_p(MSG_SPI_SETCLOCKDIVIDER, divider);
     }
 
     static void setDataMode(byte mode) {
         SPI.setDataMode(mode);
-        switch (mode) {
-			case SPI_MODE0:
-				_p(MSG_SPI_SETDATAMODE, "SPI_MODE0");
-				break;
-			case SPI_MODE1:
-				_p(MSG_SPI_SETDATAMODE, "SPI_MODE1");
-				break;
-			case SPI_MODE2:
-				_p(MSG_SPI_SETDATAMODE, "SPI_MODE2");
-				break;
-			case SPI_MODE3:
-				_p(MSG_SPI_SETDATAMODE, "SPI_MODE3");
-				break;
-			default:
-				char szBuffer[8];
-				_p(MSG_SPI_SETDATAMODE, itoa(mode, szBuffer, 10));
-				break;
-		}
+        _p(MSG_SPI_SETDATAMODE, mode);
     }
 
     static void setBitOrder(byte order) {
         SPI.setBitOrder(order);
-        switch (order) {
-			case MSBFIRST:
-				_p(MSG_SPI_SETBITORDER, "MSBFIRST");
-				break;
-			case LSBFIRST:
-				_p(MSG_SPI_SETBITORDER, "LSBFIRST");
-				break;
-			default:
-				char szBuffer[8];
-				_p(MSG_SPI_SETBITORDER, itoa(order, szBuffer, 10));
-				break;
-		}
+        _p(MSG_SPI_SETBITORDER, order);
     }
 
     static byte transfer(byte val) {
@@ -176,6 +137,35 @@ public:
     }
 
     #endif
+    
+    // Exchanges len bytes in place
+    static void transfer(byte cspin, byte* data, unsigned int len, bool holdCS) {
+        _p(MSG_SPI_TRANSFER_BUFFER, data[0], len);
+        #ifdef ARDUINO_ARCH_SAM
+        for(unsigned int i = 0; i < len-1; ++i){
+            data[i] = SPI.transfer(cspin, data[i], SPI_CONTINUE);
+        }
+        data[len-1] = SPI.transfer(cspin, data[len-1], holdCS ? SPI_CONTINUE : SPI_LAST);
+        #elif defined(SPDR)
+        // Straight through the data register, the next byte goes out as soon as the
+        // previous one is in, without a call per byte
+        SPDR = data[0];
+        for(unsigned int i = 1; i < len; ++i){
+            byte out = data[i];
+            while(!(SPSR & _BV(SPIF))){
+            }
+            data[i-1] = SPDR;
+            SPDR = out;
+        }
+        while(!(SPSR & _BV(SPIF))){
+        }
+        data[len-1] = SPDR;
+        #else
+        for(unsigned int i = 0; i < len; ++i){
+            data[i] = SPI.transfer(data[i]);
+        }
+        #endif
+    }
 };
 
 class SPIBase : public LibraryBase
@@ -186,6 +176,7 @@ class SPIBase : public LibraryBase
 	public:
 		SPIBase(MWArduinoClass& a) : libName("SPI")
 		{
+			setCommandTable(commandTable, sizeof(commandTable)/sizeof(CommandEntry));
 			a.registerLibrary(this);
 		}
 		
@@ -196,101 +187,305 @@ class SPIBase : public LibraryBase
 		{
 			return libName;
 		}
+		
+		unsigned int getStaticSize() const
+		{
+			return sizeof(*this) + sizeof(spiDevices) + sizeof(spiSelected) + sizeof(spiApplied);
+		}
+		
+		unsigned int getDynamicSize() const
+		{
+			return numDevices() * sizeof(SPIDevice);
+		}
 	
-		void commandHandler(byte* command)
+	// Command handlers
+	// command: sequence_ID, payload_size (2 bytes), libraryID, cmdID, params
+	//
+	public:
+		static const CommandEntry commandTable[7];
+		
+		static void startSPI(byte argc, byte* command)
 		{
-            //_p(MSG_SPI_ENTER_COMMAND_HANDLER, command[0], command[1], command[2], command[3], command[4]);
-            byte sequenceID = command[0];
-            byte cmdID = command[4];
-            switch (cmdID){
-                case 0x00:{  // startSPI
-                    byte cspin = command[5];
-                    
-					#ifdef ARDUINO_ARCH_SAM
-                    _SPI::setClockDivider(cspin, 21);
-                    #else
-                    _SPI::setClockDivider(SPI_CLOCK_DIV4);
-                    #endif
-					
-                    _SPI::begin(cspin);
-                    
-                    sendResponseMsg(0x00, 0, 0);
-                    break;
-                }
-                case 0x01:{ // stopSPI
-                    byte cspin = command[5];
-                    
-                    _SPI::end(cspin);
-                    
-                    sendResponseMsg(0x01, 0, 0);
-                    break;
-                }
-                case 0x02:{ // setDataMode
-                    byte cspin = command[5];
-                    byte mode = command[6];
-                    
-                    #ifdef ARDUINO_ARCH_SAM
-                    _SPI::setDataMode(cspin, mode);
-                    #else
-                    _SPI::setDataMode(mode);
-                    #endif
-                    
-                    sendResponseMsg(0x02, 0, 0);
-                    break;
-                }
-                case 0x03:{ // setBitOrder
-                    byte cspin = command[5];
-                    byte order = command[6];
-                    
-                    #ifdef ARDUINO_ARCH_SAM
-                    _SPI::setBitOrder(cspin, BitOrder(order));
-                    #else
-                    _SPI::setBitOrder(order);
-                    #endif
-                    
-                    sendResponseMsg(0x03, 0, 0);
-                    break;
+            byte cspin = command[5];
+            
+            byte status = 0;
+            byte index = findDevice(cspin);
+            if(index == SPI_NO_DEVICE){
+                index = findDevice(SPI_NO_DEVICE);
+            }
+            if(index == SPI_NO_DEVICE){ // no free device slot
+                status = 1;
+                sendResponseMsg(0x00, 1, &status);
+                return;
+            }
+            // begin() puts the controller back to the defaults
+            SPIDevice& device = spiDevices[index];
+            device.isUsed = true;
+            device.cspin = cspin;
+            device.divider = SPI_DEFAULT_DIVIDER;
+            device.mode = SPI_MODE0;
+            device.bitOrder = MSBFIRST;
+            
+            #ifdef ARDUINO_ARCH_SAM
+            _SPI::setClockDivider(cspin, SPI_DEFAULT_DIVIDER);
+            _SPI::begin(cspin);
+            #else
+            // One SPI.begin for all chip selects
+            if(numDevices() == 1){
+                _SPI::begin(cspin);
+            }
+            else{
+                _Arduino::pinMode(cspin, OUTPUT);
+            }
+            _Arduino::digitalWrite(cspin, HIGH);
+            spiApplied = SPI_NO_DEVICE;
+            #endif
+            
+            sendResponseMsg(0x00, 1, &status);
+		}
+		
+		static void stopSPI(byte argc, byte* command)
+		{
+            byte cspin = command[5];
+            
+            byte index = findDevice(cspin);
+            if(index != SPI_NO_DEVICE){
+                if(spiSelected == index){
+                    deselect();
                 }
-                case 0x04:{ // writeRead
-                    byte cspin = command[5];
-                    
-                    byte len;
-                    ASCII2Binary(1, &command[6], &len);
-
-                    byte dataRead;
-                    byte dataToSend;
+                spiDevices[index].isUsed = false;
+            }
+            
+            #ifdef ARDUINO_ARCH_SAM
+            _SPI::end(cspin);
+            #else
+            if(numDevices() == 0){
+                _SPI::end(cspin);
+                spiApplied = SPI_NO_DEVICE;
+            }
+            #endif
+            
+            sendResponseMsg(0x01, 0, 0);
+		}
+		
+		static void setDataMode(byte argc, byte* command)
+		{
+            byte cspin = command[5];
+            byte mode = command[6];
+            
+            byte index = findDevice(cspin);
+            if(index != SPI_NO_DEVICE){
+                spiDevices[index].mode = mode;
+            }
+            #ifdef ARDUINO_ARCH_SAM
+            _SPI::setDataMode(cspin, mode);
+            #else
+            if(index == SPI_NO_DEVICE){
+                _SPI::setDataMode(mode);
+            }
+            spiApplied = SPI_NO_DEVICE;
+            #endif
+            
+            sendResponseMsg(0x02, 0, 0);
+		}
+		
+		static void setBitOrder(byte argc, byte* command)
+		{
+            byte cspin = command[5];
+            byte order = command[6];
+            
+            byte index = findDevice(cspin);
+            if(index != SPI_NO_DEVICE){
+                spiDevices[index].bitOrder = order;
+            }
+            #ifdef ARDUINO_ARCH_SAM
+            _SPI::setBitOrder(cspin, BitOrder(order));
+            #else
+            if(index == SPI_NO_DEVICE){
+                _SPI::setBitOrder(order);
+            }
+            spiApplied = SPI_NO_DEVICE;
+            #endif
+            
+            sendResponseMsg(0x03, 0, 0);
+		}
+		
+		static void writeRead(byte argc, byte* command)
+		{
+            byte cspin = command[5];
+            
+            byte len;
+            ASCII2Binary(1, &command[6], &len);
+            if(len == 0 || argc < 8 + encodedPayloadSize(len)){
+                sendResponseMsg(0x04, 0, 0); // no data tells the host that nothing was exchanged
+                return;
+            }
 
-                    byte* val = new byte [len];
-                    for(byte i = 0; i < len; ++i){
-                        ASCII2Binary(len, &command[8], val);
-                    }
-                    
-                    #ifdef ARDUINO_ARCH_SAM
-                    for(byte i = 0; i < len-1; ++i){
-                        dataToSend = val[i];
-                        dataRead = _SPI::transfer(cspin, dataToSend, SPI_CONTINUE);
-                        val[i] = dataRead;
-                    }
-                    dataToSend = val[len-1];
-                    dataRead = _SPI::transfer(cspin, dataToSend);
-                    val[len-1] = dataRead;
-                    #else
-                    _Arduino::digitalWrite(cspin, LOW);
-                    for(byte i = 0; i < len; ++i){
-                        dataToSend = val[i];
-                        dataRead = _SPI::transfer(dataToSend);
-                        val[i] = dataRead;
-                    }
-                    _Arduino::digitalWrite(cspin, HIGH);
-                    #endif
-                    
-                    sendResponseMsg(0x04, len, val);
-                    delete [] val;
-                    break;
+            byte* val = MWArduino.borrowScratch(len);
+            if(val == NULL){
+                sendResponseMsg(0x04, 0, 0); // no data tells the host that nothing was exchanged
+                return;
+            }
+            decodePayload(len, &command[8], val);
+            
+            exchange(cspin, val, len, false);
+            
+            sendResponseMsg(0x04, len, val);
+            MWArduino.returnScratch();
+		}
+		
+		static void setClock(byte argc, byte* command)
+		{
+            byte cspin = command[5];
+            byte index = findDevice(cspin);
+            if(index == SPI_NO_DEVICE){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            byte clockBytes[4];
+            ASCII2Binary(4, &command[6], clockBytes);
+            unsigned long clock = (unsigned long)clockBytes[0] + ((unsigned long)clockBytes[1]<<8) + 
+                                  ((unsigned long)clockBytes[2]<<16) + ((unsigned long)clockBytes[3]<<24);
+            if(clock == 0){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            
+            // Fastest clock at or below the requested one
+            #ifdef ARDUINO_ARCH_SAM
+            SPIDevice& device = spiDevices[index];
+            unsigned long divider = (F_CPU + clock - 1) / clock;
+            if(divider > 255){
+                divider = 255;
+            }
+            device.divider = divider;
+            clock = F_CPU / divider;
+            _SPI::setClockDivider(cspin, device.divider);
+            #elif defined(SPCR)
+            SPIDevice& device = spiDevices[index];
+            static const byte dividers[] = {SPI_CLOCK_DIV2, SPI_CLOCK_DIV4, SPI_CLOCK_DIV8, SPI_CLOCK_DIV16, 
+                                            SPI_CLOCK_DIV32, SPI_CLOCK_DIV64, SPI_CLOCK_DIV128};
+            byte shift = 0;
+            while(shift < 6 && (F_CPU >> (shift+1)) > clock){
+                shift++;
+            }
+            device.divider = dividers[shift];
+            clock = F_CPU >> (shift+1);
+            spiApplied = SPI_NO_DEVICE;
+            #else
+            clock = SPI_DEFAULT_CLOCK; // the core cannot change it
+            #endif
+            
+            byte val[4];
+            val[0] = (clock >> 24) & 0xff;
+            val[1] = (clock >> 16) & 0xff;
+            val[2] = (clock >> 8) & 0xff;
+            val[3] = clock & 0xff;
+            sendResponseMsg(0x05, 4, val);
+		}
+		
+		static void transfer(byte argc, byte* command)
+		{
+            byte cspin = command[5];
+            byte flags = command[6];
+            
+            byte lenBytes[2];
+            ASCII2Binary(2, &command[7], lenBytes);
+            unsigned int len = lenBytes[0] + (lenBytes[1] << 8);
+            // a response size other than the data read or, when writing only, 0 tells the
+            // host that nothing was exchanged
+            byte status = RESPONSE_ERROR;
+            if(len == 0 || argc < 10 + encodedPayloadSize(len)){
+                sendResponseMsg(0x06, (flags & SPI_WRITE_ONLY) ? 1 : 0, &status);
+                return;
+            }
+            
+            byte* val = MWArduino.borrowScratch(len);
+            if(val == NULL){
+                sendResponseMsg(0x06, (flags & SPI_WRITE_ONLY) ? 1 : 0, &status);
+                return;
+            }
+            decodePayload(len, &command[10], val);
+            
+            exchange(cspin, val, len, flags & SPI_HOLD_CS);
+            
+            if(flags & SPI_WRITE_ONLY){
+                sendResponseMsg(0x06, 0, 0);
+            }
+            else{
+                sendResponseMsg(0x06, len, val);
+            }
+            MWArduino.returnScratch();
+		}
+		
+	private:
+		static byte findDevice(byte cspin)
+		{
+		// Index of the device with chip select cspin, or of a free slot for SPI_NO_DEVICE
+            for(byte i = 0; i < MAX_SPI_DEVICES; ++i){
+                if(cspin == SPI_NO_DEVICE ? !spiDevices[i].isUsed : (spiDevices[i].isUsed && spiDevices[i].cspin == cspin)){
+                    return i;
                 }
-                default:
-                    //_p(MSG_SPI_UNRECOGNIZED_COMMAND, cmdID);
-					break;
             }
+            return SPI_NO_DEVICE;
+		}
+		
+		static byte numDevices()
+		{
+            byte count = 0;
+            for(byte i = 0; i < MAX_SPI_DEVICES; ++i){
+                count += spiDevices[i].isUsed;
+            }
+            return count;
+		}
+		
+		static void deselect()
+		{
+            #ifndef ARDUINO_ARCH_SAM
+            _Arduino::digitalWrite(spiDevices[spiSelected].cspin, HIGH);
+            #endif
+            spiSelected = SPI_NO_DEVICE;
 		}
-};
\ No newline at end of file
+		
+		static void exchange(byte cspin, byte* data, unsigned int len, bool holdCS)
+		{
+		// Transfers data in place with the settings of the device, chip select pins
+		// that were not started keep whatever settings are in place
+            byte index = findDevice(cspin);
+            if(spiSelected != SPI_NO_DEVICE && spiSelected != index){
+                deselect(); // a held transfer of another device ends here
+            }
+            
+            #ifdef ARDUINO_ARCH_SAM
+            _SPI::transfer(cspin, data, len, holdCS);
+            #else
+            if(index != SPI_NO_DEVICE && spiApplied != index){
+                SPIDevice& device = spiDevices[index];
+                _SPI::setClockDivider(device.divider);
+                _SPI::setDataMode(device.mode);
+                _SPI::setBitOrder(device.bitOrder);
+                spiApplied = index;
+            }
+            if(spiSelected == SPI_NO_DEVICE){
+                _Arduino::digitalWrite(cspin, LOW);
+            }
+            _SPI::transfer(cspin, data, len, holdCS);
+            if(!holdCS){
+                _Arduino::digitalWrite(cspin, HIGH);
+            }
+            #endif
+            
+            spiSelected = (holdCS && index != SPI_NO_DEVICE) ? index : SPI_NO_DEVICE;
+		}
+};
+
+// handler, numParams, numData, responseSize
+const CommandEntry SPIBase::commandTable[7] PROGMEM = {
+    {SPIBase::startSPI,     1, 0, 1},                      // 0x00 cspin
+    {SPIBase::stopSPI,      1, 0, 0},                      // 0x01 cspin
+    {SPIBase::setDataMode,  2, 0, 0},                      // 0x02 cspin, mode
+    {SPIBase::setBitOrder,  2, 0, 0},                      // 0x03 cspin, order
+    {SPIBase::writeRead,    3, 0, RESPONSE_SIZE_VARIABLE}, // 0x04 cspin, len (7-bit encoded), data
+    {SPIBase::setClock,     6, 0, 4},                      // 0x05 cspin, clock (4 bytes, 7-bit encoded)
+    {SPIBase::transfer,     6, 0, RESPONSE_SIZE_VARIABLE}, // 0x06 cspin, flags, len (2 bytes, 7-bit encoded), data
+};
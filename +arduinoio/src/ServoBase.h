@@ -11,26 +11,36 @@
 //prog_char MSG_SERVO_UNRECOGNIZED_COMMAND[] 		PROGMEM = "ServoBase::commandHandler:unrecognized command ID %d\n";
 
 // Arduino trace commands
-prog_char MSG_SERVO_NEW[] 			            PROGMEM = "Arduino::servoArray[%d] = new Servo; --> 0x%04X\n";
-prog_char MSG_SERVO_DELETE[]     	            PROGMEM = "Arduino::delete servoArray[%d]\nArduino:servoArray[%d] = NULL;\n";
+prog_char MSG_SERVO_NEW[] 			            PROGMEM = "Arduino::servoArray[%d] = &servoPool[%d]; --> 0x%04X\n";
+prog_char MSG_SERVO_DELETE[]     	            PROGMEM = "Arduino::servoArray[%d] = NULL;\n";
 prog_char MSG_SERVO_ATTACH[] 			        PROGMEM = "Arduino::servoArray[%d]->attach(%d, %d, %d)\n";
 prog_char MSG_SERVO_DETACH[]			        PROGMEM = "Arduino::servoArray[%d]->detach()\n";
 prog_char MSG_SERVO_READ[]			            PROGMEM = "Arduino::servoArray[%d]->read(); --> %d\n";
 prog_char MSG_SERVO_WRITE[]			            PROGMEM = "Arduino::servoArray[%d]->write(%d);\n";
+prog_char MSG_SERVO_WRITE_MICROSECONDS[]	    PROGMEM = "Arduino::servoArray[%d]->writeMicroseconds(%d);\n";
 
+// Largest writeServoGroup, a servo ID and an angle per servo
+#define SERVO_SCRATCH_SIZE (2 * MAX_SERVOS)
+
+#if !defined(SCRATCH_SIZE) || SCRATCH_SIZE < SERVO_SCRATCH_SIZE
+#undef SCRATCH_SIZE
+#define SCRATCH_SIZE SERVO_SCRATCH_SIZE
+#endif
+
+// One statically allocated Servo per servo ID; servoArray marks the ones in use
+Servo servoPool[MAX_SERVOS];
 Servo *servoArray[MAX_SERVOS];
 
 class _Servo {
 public:
     static void _new(byte servoID) {
-        servoArray[servoID] = new Servo;
-        _p(MSG_SERVO_NEW, servoID, servoArray[servoID]);
+        servoArray[servoID] = &servoPool[servoID];
+        _p(MSG_SERVO_NEW, servoID, servoID, servoArray[servoID]);
     }
 
     static void _delete(byte servoID) {
-        delete servoArray[servoID];
         servoArray[servoID] = NULL;
-        _p(MSG_SERVO_DELETE, servoID, servoID);
+        _p(MSG_SERVO_DELETE, servoID);
     }
 
     static void attach(byte servoID, byte pin, int min, int max) {
@@ -53,6 +63,252 @@ public:
         servoArray[servoID]->write(angle);
         _p(MSG_SERVO_WRITE, servoID, angle);
     }
+
+    static void writeMicroseconds(byte servoID, int value) {
+        servoArray[servoID]->writeMicroseconds(value);
+        _p(MSG_SERVO_WRITE_MICROSECONDS, servoID, value);
+    }
+};
+
+// Servo motion engine
+// A servo with a velocity limit moves to a new position over several servo frames instead
+// of jumping: a task of the server sets the pulse width of every moving servo once per
+// frame, in the same pass, with a speed that ramps up and down with the acceleration limit.
+// Pulse widths are set in microseconds, finer than the whole degrees of Servo::write().
+// The servos of a group write are slowed down to the slowest of them, so that they all
+// start in the same frame and arrive in the same frame.
+#ifdef REFRESH_INTERVAL
+#define SERVO_FRAME_MICROS REFRESH_INTERVAL // of the Servo library
+#else
+#define SERVO_FRAME_MICROS 20000UL
+#endif
+#define SERVO_MAX_ANGLE 180
+
+typedef struct {
+    bool isMoving;
+    byte target;               // degrees
+    unsigned int maxVelocity;  // degrees/s, 0 - no limit, the servo jumps to the target
+    unsigned int acceleration; // degrees/s^2, 0 - no limit
+    unsigned int minPulse;     // microseconds at 0 degrees
+    unsigned int maxPulse;     // microseconds at SERVO_MAX_ANGLE degrees
+    float position;            // degrees, of the last pulse width set
+    float velocity;            // degrees/s, signed
+    float scale;               // of the limits for the current move, see startMoves
+} ServoMotion;
+
+// Motion state is kept for the first MAX_SERVO_MOTIONS servos created, all of them except
+// on boards with 2KB SRAM where a table for every servo ID would take an eighth of the RAM.
+// A servo created while all slots are taken jumps to every position and cannot get a velocity limit.
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_SERVO_MOTIONS 4
+#else
+#define MAX_SERVO_MOTIONS MAX_SERVOS
+#endif
+#define NO_SERVO_MOTION 0xFF
+
+ServoMotion servoMotions[MAX_SERVO_MOTIONS];
+byte servoMotionSlots[MAX_SERVOS]; // index into servoMotions per servo ID, NO_SERVO_MOTION if none
+byte servoTask = NO_TASK;
+
+class ServoMotionEngine {
+public:
+    static void begin() {
+        for(byte i = 0; i < MAX_SERVOS; ++i){
+            servoMotionSlots[i] = NO_SERVO_MOTION;
+        }
+    }
+
+    // Takes a free motion slot for the servo, false if there is none left
+    static bool attach(byte servoID, int minPulse, int maxPulse) {
+        byte slot = freeSlot();
+        if(slot == NO_SERVO_MOTION){
+            return false;
+        }
+        servoMotionSlots[servoID] = slot;
+        ServoMotion& motion = servoMotions[slot];
+        motion.isMoving = false;
+        motion.maxVelocity = 0;
+        motion.acceleration = 0;
+        motion.minPulse = minPulse;
+        motion.maxPulse = maxPulse;
+        motion.position = _Servo::read(servoID);
+        motion.target = motion.position;
+        motion.velocity = 0;
+        return true;
+    }
+
+    // Ends a move in progress and frees the motion slot
+    static void detach(byte servoID) {
+        byte slot = servoMotionSlots[servoID];
+        if(slot != NO_SERVO_MOTION){
+            servoMotions[slot].isMoving = false;
+            servoMotionSlots[servoID] = NO_SERVO_MOTION;
+        }
+    }
+
+    static bool hasMotion(byte servoID) {
+        return servoMotionSlots[servoID] != NO_SERVO_MOTION;
+    }
+
+    // False for a servo without a motion slot
+    static bool setLimits(byte servoID, unsigned int maxVelocity, unsigned int acceleration) {
+        if(!hasMotion(servoID)){
+            return false;
+        }
+        ServoMotion& motion = servoMotions[servoMotionSlots[servoID]];
+        motion.maxVelocity = maxVelocity;
+        motion.acceleration = acceleration;
+        return true;
+    }
+
+    static bool hasVelocityLimit(byte servoID) {
+        return hasMotion(servoID) && servoMotions[servoMotionSlots[servoID]].maxVelocity != 0;
+    }
+
+    static bool isMoving(byte servoID) {
+        return hasMotion(servoID) && servoMotions[servoMotionSlots[servoID]].isMoving;
+    }
+
+    // Sets the servo to angle at once, ending a move in progress
+    static void jumpTo(byte servoID, byte angle) {
+        _Servo::write(servoID, angle);
+        if(hasMotion(servoID)){
+            ServoMotion& motion = servoMotions[servoMotionSlots[servoID]];
+            motion.isMoving = false;
+            motion.velocity = 0;
+            motion.position = _Servo::read(servoID);
+            motion.target = motion.position;
+        }
+    }
+
+    // Moves the servos of pairs (servo ID, angle) together
+    static void startMoves(const byte* pairs, byte count) {
+        // Time each servo takes on its own, a trapezoidal or triangular speed profile
+        float duration = 0;
+        for(byte i = 0; i < count; ++i){
+            if(!hasMotion(pairs[2*i])){
+                continue;
+            }
+            ServoMotion& motion = servoMotions[servoMotionSlots[pairs[2*i]]];
+            motion.target = pairs[2*i+1];
+            float time = moveTime(motion);
+            motion.scale = time; // until the longest time is known
+            if(time > duration){
+                duration = time;
+            }
+        }
+        
+        if(duration > 0 && servoTask == NO_TASK){
+            servoTask = MWArduino.addTask(update, NULL, SERVO_FRAME_MICROS, SERVO_FRAME_MICROS);
+        }
+        for(byte i = 0; i < count; ++i){
+            byte servoID = pairs[2*i];
+            if(!hasMotion(servoID)){
+                _Servo::write(servoID, pairs[2*i+1]);
+                continue;
+            }
+            ServoMotion& motion = servoMotions[servoMotionSlots[servoID]];
+            if(motion.maxVelocity == 0 || duration == 0 || servoTask == NO_TASK){
+                moveTo(servoID, motion.target);
+                continue;
+            }
+            // Scaling the velocity by k and the acceleration by k^2 scales the time by 1/k
+            motion.scale = motion.scale / duration;
+            motion.isMoving = motion.scale > 0;
+        }
+    }
+
+private:
+    static byte freeSlot() {
+        for(byte slot = 0; slot < MAX_SERVO_MOTIONS; ++slot){
+            bool isUsed = false;
+            for(byte i = 0; i < MAX_SERVOS && !isUsed; ++i){
+                isUsed = (servoMotionSlots[i] == slot);
+            }
+            if(!isUsed){
+                return slot;
+            }
+        }
+        return NO_SERVO_MOTION;
+    }
+
+    static float moveTime(ServoMotion& motion) {
+        float distance = fabs(motion.target - motion.position);
+        float velocity = motion.maxVelocity;
+        if(velocity == 0 || distance == 0){
+            return 0;
+        }
+        if(motion.acceleration == 0){
+            return distance / velocity;
+        }
+        float acceleration = motion.acceleration;
+        if(distance >= velocity * velocity / acceleration){
+            return distance / velocity + velocity / acceleration;
+        }
+        return 2 * sqrt(distance / acceleration);
+    }
+
+    static void moveTo(byte servoID, float position) {
+        ServoMotion& motion = servoMotions[servoMotionSlots[servoID]];
+        motion.position = position;
+        if(position == motion.target){
+            motion.isMoving = false;
+            motion.velocity = 0;
+        }
+        _Servo::writeMicroseconds(servoID, motion.minPulse + 
+            (long)((motion.maxPulse - motion.minPulse) * position / SERVO_MAX_ANGLE + 0.5));
+    }
+
+    static void step(byte servoID) {
+        ServoMotion& motion = servoMotions[servoMotionSlots[servoID]];
+        const float dt = SERVO_FRAME_MICROS / 1e6;
+        float distance = motion.target - motion.position;
+        float maxVelocity = motion.scale * motion.maxVelocity;
+        float acceleration = motion.scale * motion.scale * motion.acceleration;
+        
+        // Fastest speed towards the target that can still stop there
+        float velocity = maxVelocity;
+        if(acceleration > 0){
+            float stopping = sqrt(2 * acceleration * fabs(distance));
+            if(stopping < velocity){
+                velocity = stopping;
+            }
+        }
+        if(distance < 0){
+            velocity = -velocity;
+        }
+        if(acceleration > 0){
+            float change = acceleration * dt;
+            if(velocity > motion.velocity + change){
+                velocity = motion.velocity + change;
+            }
+            else if(velocity < motion.velocity - change){
+                velocity = motion.velocity - change;
+            }
+        }
+        motion.velocity = velocity;
+        
+        float position = motion.position + velocity * dt;
+        if((distance >= 0 && position >= motion.target) || (distance <= 0 && position <= motion.target)){
+            position = motion.target;
+        }
+        moveTo(servoID, position);
+    }
+
+    static bool update(void* context) {
+    // Task of the moving servos, removes itself once none is left
+        bool isRunning = false;
+        for(byte i = 0; i < MAX_SERVOS; ++i){
+            if(isMoving(i)){
+                step(i);
+                isRunning = isRunning || isMoving(i);
+            }
+        }
+        if(!isRunning){
+            servoTask = NO_TASK;
+        }
+        return isRunning;
+    }
 };
 
 class ServoBase : public LibraryBase
@@ -62,6 +318,8 @@ class ServoBase : public LibraryBase
 	public:
 		ServoBase(MWArduinoClass& a) : libName("Servo")
 		{
+			setCommandTable(commandTable, sizeof(commandTable)/sizeof(CommandEntry), 5);
+			ServoMotionEngine::begin();
  			a.registerLibrary(this);
 		}
 		
@@ -72,60 +330,179 @@ class ServoBase : public LibraryBase
 		{
 			return libName;
 		}
+		
+		unsigned int getStaticSize() const
+		{
+			return sizeof(*this) + sizeof(servoPool) + sizeof(servoArray) + sizeof(servoMotions) + sizeof(servoMotionSlots) + sizeof(servoTask);
+		}
+		
+		unsigned int getDynamicSize() const
+		{
+			unsigned int size = 0;
+			for(byte i = 0; i < MAX_SERVOS; ++i){
+				if(servoArray[i] != NULL){
+					size += sizeof(Servo);
+				}
+				if(ServoMotionEngine::hasMotion(i)){
+					size += sizeof(ServoMotion);
+				}
+			}
+			return size;
+		}
 	
-		void commandHandler(byte* command)
+	// Command handlers
+	// command: sequence_ID, payload_size (2 bytes), libraryID, servoID, cmdID, params
+	//
+	public:
+		static const CommandEntry commandTable[7];
+		
+		static void createServo(byte argc, byte* command)
 		{
-            //_p(MSG_SERVO_ENTER_COMMAND_HANDLER, command[0], command[1], command[2], command[3], command[4], command[5]);
-            byte sequenceID = command[0];
-            byte cmdID = command[5];
-            switch (cmdID){
-                case 0x00:{  // createServo
-                    byte servoID = command[4];
-                    byte pin = command[6];
-                    
-                    byte minBytes[2];
-                    ASCII2Binary(2, &command[7], minBytes);
-                    int min = minBytes[0]+(minBytes[1]<<8);
-                    byte maxBytes[2];
-                    ASCII2Binary(2, &command[10], maxBytes);
-                    int max = maxBytes[0]+(maxBytes[1]<<8);
-                    
-
-                    _Servo::_new(servoID);
-                    _Servo::attach(servoID, pin, min, max);
-                    
-                    sendResponseMsg(0x00, 0, 0);
-                    break;
-                }
-                case 0x01:{ // clearServo
-                    byte servoID = command[4];
-                    _Servo::detach(servoID);
-                    _Servo::_delete(servoID);
-                    
-                    sendResponseMsg(0x01, 0, 0);
-                    break;
-                }
-                case 0x02:{ // readPosition
-                    byte servoID = command[4];
-                    byte angle = _Servo::read(servoID);
-                    
-                    byte val[1] = {angle};
-                    sendResponseMsg(0x02, 1, val);
-                    break;
-                }
-                case 0x03:{ // writePosition
-                    byte servoID = command[4];
-                    
-                    byte angle;
-                    ASCII2Binary(1, &command[6], &angle);
-                    _Servo::write(servoID, angle);
-                    
-                    sendResponseMsg(0x03, 0, 0);
-                    break;
+            byte servoID = command[4];
+            if(servoID >= MAX_SERVOS){
+                sendErrorResponseMsg(0x00);
+                return;
+            }
+            if(servoArray[servoID] != NULL){ // left over from a session that did not clear it
+                ServoMotionEngine::detach(servoID);
+                _Servo::detach(servoID);
+                _Servo::_delete(servoID);
+            }
+            byte pin = command[6];
+            
+            byte minBytes[2];
+            ASCII2Binary(2, &command[7], minBytes);
+            int min = minBytes[0]+(minBytes[1]<<8);
+            byte maxBytes[2];
+            ASCII2Binary(2, &command[10], maxBytes);
+            int max = maxBytes[0]+(maxBytes[1]<<8);
+            
+
+            _Servo::_new(servoID);
+            _Servo::attach(servoID, pin, min, max);
+            ServoMotionEngine::attach(servoID, min, max);
+            
+            sendResponseMsg(0x00, 0, 0);
+		}
+		
+		static void clearServo(byte argc, byte* command)
+		{
+            byte servoID = command[4];
+            if(servoID >= MAX_SERVOS || servoArray[servoID] == NULL){
+                sendErrorResponseMsg(0x01);
+                return;
+            }
+            ServoMotionEngine::detach(servoID);
+            _Servo::detach(servoID);
+            _Servo::_delete(servoID);
+            
+            sendResponseMsg(0x01, 0, 0);
+		}
+		
+		static void readPosition(byte argc, byte* command)
+		{
+            byte servoID = command[4];
+            if(servoID >= MAX_SERVOS || servoArray[servoID] == NULL){
+                sendErrorResponseMsg(0x02);
+                return;
+            }
+            byte angle = _Servo::read(servoID);
+            
+            byte val[1] = {angle};
+            sendResponseMsg(0x02, 1, val);
+		}
+		
+		static void writePosition(byte argc, byte* command)
+		{
+            byte servoID = command[4];
+            if(servoID >= MAX_SERVOS || servoArray[servoID] == NULL){
+                sendErrorResponseMsg(0x03);
+                return;
+            }
+            
+            byte angle = 0;
+            ASCII2Binary(1, &command[6], &angle);
+            if(!ServoMotionEngine::hasVelocityLimit(servoID)){
+                ServoMotionEngine::jumpTo(servoID, angle);
+            }
+            else if(angle <= SERVO_MAX_ANGLE){
+                byte pair[2] = {servoID, angle};
+                ServoMotionEngine::startMoves(pair, 1);
+            }
+            
+            sendResponseMsg(0x03, 0, 0);
+		}
+		
+		static void configureMotion(byte argc, byte* command)
+		{
+            byte servoID = command[4];
+            if(servoID >= MAX_SERVOS || servoArray[servoID] == NULL){
+                sendErrorResponseMsg(0x04);
+                return;
+            }
+            
+            byte velocityBytes[2];
+            ASCII2Binary(2, &command[6], velocityBytes);
+            byte accelerationBytes[2];
+            ASCII2Binary(2, &command[9], accelerationBytes);
+            if(!ServoMotionEngine::setLimits(servoID, velocityBytes[0] + (velocityBytes[1]<<8), 
+                                             accelerationBytes[0] + (accelerationBytes[1]<<8))){
+                sendErrorResponseMsg(0x04); // created after the motion slots ran out
+                return;
+            }
+            
+            sendResponseMsg(0x04, 0, 0);
+		}
+		
+		static void writeGroupPositions(byte argc, byte* command)
+		{
+		// The servo ID of the command is not used, each servo comes with its angle
+            byte count = command[6];
+            if(count == 0 || count > MAX_SERVOS || argc < 7 + encodedPayloadSize(2*count)){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            
+            byte* pairs = MWArduino.borrowScratch(2*count);
+            if(pairs == NULL){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            decodePayload(2*count, &command[7], pairs);
+            for(byte i = 0; i < count; ++i){
+                byte servoID = pairs[2*i];
+                if(servoID >= MAX_SERVOS || servoArray[servoID] == NULL || pairs[2*i+1] > SERVO_MAX_ANGLE){
+                    MWArduino.returnScratch();
+                    sendErrorResponseMsg(0x05);
+                    return;
                 }
-                default:
-                    //_p(MSG_SERVO_UNRECOGNIZED_COMMAND, cmdID);
-					break;
             }
+            ServoMotionEngine::startMoves(pairs, count);
+            MWArduino.returnScratch();
+            
+            sendResponseMsg(0x05, 0, 0);
 		}
-};
\ No newline at end of file
+		
+		static void readMotionStatus(byte argc, byte* command)
+		{
+            byte servoID = command[4];
+            if(servoID >= MAX_SERVOS || servoArray[servoID] == NULL){
+                sendErrorResponseMsg(0x06);
+                return;
+            }
+            
+            byte isMoving = ServoMotionEngine::isMoving(servoID);
+            sendResponseMsg(0x06, 1, &isMoving);
+		}
+};
+
+// handler, numParams, numData, responseSize
+const CommandEntry ServoBase::commandTable[7] PROGMEM = {
+    {ServoBase::createServo,            7, 0, 0}, // 0x00 pin, min and max (2 bytes each, 7-bit encoded)
+    {ServoBase::clearServo,             0, 0, 0}, // 0x01
+    {ServoBase::readPosition,           0, 0, 1}, // 0x02
+    {ServoBase::writePosition,          2, 0, 0}, // 0x03 angle (7-bit encoded)
+    {ServoBase::configureMotion,        6, 0, 0}, // 0x04 max velocity and acceleration (2 bytes each, 7-bit encoded)
+    {ServoBase::writeGroupPositions,    1, 0, 0}, // 0x05 count, then a servo ID and an angle per servo
+    {ServoBase::readMotionStatus,       0, 0, 1}, // 0x06
+};
@@ -90,6 +90,8 @@ classdef Servo < arduinoio.ServoMotorBase & matlab.mixin.CustomDisplay
             fprintf('                Pins: %d\n', obj.Pins);
             fprintf('    MinPulseDuration: %.2e (s)\n', obj.MinPulseDuration);
             fprintf('    MaxPulseDuration: %.2e (s)\n', obj.MaxPulseDuration);  
+            fprintf('         MaxVelocity: %g (1/s)\n', obj.MaxVelocity);
+            fprintf('        Acceleration: %g (1/s^2)\n', obj.Acceleration);
             fprintf('\n');
                   
             % Allow for the possibility of a footer.
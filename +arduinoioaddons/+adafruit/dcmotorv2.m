@@ -19,6 +19,7 @@ classdef dcmotorv2 < arduinoio.MotorBase & matlab.mixin.CustomDisplay
         ResourceMode
         ResourceOwner
         MaxDCMotors
+        IsSpeedCommandSkipped = false % Speed set without a command, writeSpeed sends it
     end
     
     properties(Access = private, Constant = true)
@@ -26,6 +27,7 @@ classdef dcmotorv2 < arduinoio.MotorBase & matlab.mixin.CustomDisplay
         START_DC_MOTOR      = hex2dec('03')
         STOP_DC_MOTOR       = hex2dec('04')
         SET_SPEED_DC_MOTOR  = hex2dec('05')
+        SET_DC_MOTOR_SPEEDS = hex2dec('0E')
     end
     
     %% Constructor
@@ -167,6 +169,61 @@ classdef dcmotorv2 < arduinoio.MotorBase & matlab.mixin.CustomDisplay
             end
         end
         
+        function writeSpeed(obj, speed)
+            %   Change the speed of several DC motors together.
+            %
+            %   Syntax:
+            %   writeSpeed(dev, speed)
+            %
+            %   Description:
+            %   Sets the Speed of each DC motor in dev. The running motors
+            %   of a shield change speed at the same time, with one command
+            %   per shield.
+            %
+            %   Example:
+            %       a = arduino('COM7', 'Uno', 'Libraries', 'Adafruit\MotorShieldV2');
+            %       shield = addon(a, 'Adafruit/MotorShieldV2');
+            %       dcm1 = dcmotor(shield,1,'Speed',0.3);
+            %       dcm2 = dcmotor(shield,2,'Speed',0.3);
+            %       start(dcm1);
+            %       start(dcm2);
+            %       writeSpeed([dcm1 dcm2], [0.5 -0.5]);
+			%
+            %   Input Arguments:
+            %   dev       - DC motor devices
+            %   speed     - One speed from -1 to 1, or one per DC motor
+            %
+			%   See also start, stop
+            
+            try
+                if isscalar(speed)
+                    speed = repmat(speed, size(obj));
+                end
+                if numel(speed) ~= numel(obj)
+                    obj(1).localizedError('MATLAB:arduinoio:general:invalidDCMotorGroup');
+                end
+                for ii = 1:numel(obj)
+                    arduinoio.internal.validateDoubleParameterRanged(...
+                        'AdafruitMotorShieldV2\DCMotor Speed', speed(ii), -1, 1);
+                end
+                for ii = 1:numel(obj)
+                    obj(ii).IsSpeedCommandSkipped = true;
+                    obj(ii).Speed = speed(ii);
+                    obj(ii).IsSpeedCommandSkipped = false;
+                end
+                
+                running = obj([obj.IsRunning]);
+                while ~isempty(running)
+                    parent = running(1).Parent;
+                    isOnShield = arrayfun(@(m) m.Parent == parent, running);
+                    setDCMotorSpeeds(running(isOnShield));
+                    running = running(~isOnShield);
+                end
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
         function set.Speed(obj, speed)
             % Valid speed range is -1 to 1
             try
@@ -177,7 +234,7 @@ classdef dcmotorv2 < arduinoio.MotorBase & matlab.mixin.CustomDisplay
                     speed = 0;
                 end
                 
-                if obj.IsRunning == true %#ok<MCSUP>
+                if obj.IsRunning == true && ~obj.IsSpeedCommandSkipped %#ok<MCSUP>
                     if speed > 0
                         convertedSpeed = floor(abs(speed)*255);
                     else
@@ -255,6 +312,27 @@ classdef dcmotorv2 < arduinoio.MotorBase & matlab.mixin.CustomDisplay
             end
         end
         
+        function setDCMotorSpeeds(obj)
+            % One command for DC motors of the same shield
+            commandID = obj(1).SET_DC_MOTOR_SPEEDS;
+            try
+                motors = zeros(3, numel(obj), 'uint8');
+                for ii = 1:numel(obj)
+                    if obj(ii).ConvertedSpeed > 0
+                        direction = 1;
+                    else
+                        direction = 2;
+                    end
+                    motors(:, ii) = [obj(ii).MotorNumber-1; abs(obj(ii).ConvertedSpeed); direction];
+                end
+                parent = obj(1).Parent;
+                cmd = [numel(obj); encodeShieldPayload(parent, motors(:))];
+                sendShieldCommand(parent, commandID, cmd);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
         function stopDCMotor(obj)
             commandID = obj.STOP_DC_MOTOR;
             try
@@ -38,10 +38,14 @@ classdef motorshieldv2 < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
             obj.Bus = 0;
             obj.ResourceOwner = 'AdafruitMotorShieldV2';
             
-            if strcmp(obj.Parent.Board, 'Uno')
-                obj.CountCutOff = 4;
-            else
-                obj.CountCutOff = 32;
+            % Shield slots of the server, by the SRAM of the board
+            switch obj.Parent.Board
+                case 'Due'
+                    obj.CountCutOff = 32;
+                case {'Mega2560', 'Mega1280', 'MegaADK', 'Leonardo', 'Micro'}
+                    obj.CountCutOff = 8;
+                otherwise
+                    obj.CountCutOff = 4;
             end
             
             count = incrementResourceCount(obj.Parent, obj.ResourceOwner);
@@ -280,6 +284,10 @@ classdef motorshieldv2 < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
                 otherwise
             end
         end
+        
+        function output = encodeShieldPayload(obj, data)
+            output = encodePayload(obj, data);
+        end
     end
     
     methods(Access = private)
@@ -376,6 +384,9 @@ classdef motorshieldv2 < arduinoio.LibraryBase & matlab.mixin.CustomDisplay
             else
                 output = sendCustomMessage(obj.Parent, libName, cmd, timeout);
             end
+            if arduinoio.internal.isErrorResponse(output, commandID)
+                obj.localizedError('MATLAB:arduinoio:general:commandRejected', libName);
+            end
         end
         
         function displayScalarObject(obj)
@@ -7,110 +7,424 @@
 #include "Adafruit_PWMServoDriver.h"
 #include "MWArduino.h"
 
+#include "Wire.h"
+
 #define MIN_I2C 0x60
 #define MAX_I2C 0x80
 
-#if MW_BOARD == Uno
+// Shields in use at the same time; their state is kept in slots claimed by createMotorShield
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
 #define MAX_SHIELDS 4
+#elif defined(ARDUINO_ARCH_AVR)
+#define MAX_SHIELDS 8
 #else
-#define MAX_SHIELDS 32
+#define MAX_SHIELDS 32 // every address from MIN_I2C
 #endif
+#define NO_SHIELD 0xFF
 
 #define MAX_DCMOTORS 4
 #define MAX_STEPPERMOTORS 2
 
-Adafruit_MotorShield *AFMS[MAX_SHIELDS];
-Adafruit_DCMotor *DCMotors[MAX_SHIELDS][MAX_DCMOTORS];
-Adafruit_StepperMotor *StepperMotors[MAX_SHIELDS][MAX_STEPPERMOTORS];
+// PCA9685 PWM driver of the shield
+#define PCA9685_LED0_ON_L  0x06 // ON_L, ON_H, OFF_L and OFF_H of channel n start at 0x06 + 4*n
+#define PCA9685_CHANNELS   16
+#define PCA9685_FULL_ON    4096
+#define PCA9685_BURST_SIZE ((BUFFER_LENGTH - 1) / 4) // channels per transmission, after the register address
+
+// Stepper moves in progress or waiting for their group to start, across all shields
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_STEPPER_MOVES 4
+#else
+#define MAX_STEPPER_MOVES 8
+#endif
+#define NO_STEPPER_MOVE 0xFF
+
+#define STEPPER_EVENT      0x70
+#define STEPPER_EMIT_EVENT 0x01 // move flag: send a stepper event when the move ends
+
+// Stepper status
+#define STEPPER_IDLE    0x00
+#define STEPPER_QUEUED  0x01 // waiting for its group to start
+#define STEPPER_RUNNING 0x02
+
+// The Adafruit_MotorShield of a slot is allocated by createMotorShield, so that free slots
+// only take a few bytes
+typedef struct {
+    byte i2caddress;                                    // 0 for a free slot
+    byte dcMotors;                                      // bit per created DC motor
+    Adafruit_StepperMotor *steppers[MAX_STEPPERMOTORS];
+    long stepperPositions[MAX_STEPPERMOTORS];           // onesteps since the stepper was created, forward positive
+    Adafruit_MotorShield *shield;
+} MotorShieldSlot;
+
+MotorShieldSlot shieldSlots[MAX_SHIELDS];
+
+// PCA9685 channels of each DC motor: PWM, IN1, IN2, as Adafruit_MotorShield::getMotor() assigns them
+const byte dcMotorChannels[MAX_DCMOTORS][3] PROGMEM = {{8, 10, 9}, {13, 11, 12}, {2, 4, 3}, {7, 5, 6}};
 
 //prog_char MSG_MSV2_ENTER_COMMAND_HANDLER[]      PROGMEM = "MotorShieldV2Base::commandHandler: sequence_ID %d, payload_size %d, %d, libraryID %d, cmdID %d\n";
 //prog_char MSG_MSV2_UNRECOGNIZED_COMMAND[]       PROGMEM = "MotorShieldV2Base::commandHandler:unrecognized command ID %d\n";
         
 // Arduino trace commands
-prog_char MSG_MSV2_CREATE_MOTOR_SHIELD[]        PROGMEM = "Adafruit::Adafruit_MotorShield(%d)->begin(%d);\n";
-prog_char MSG_MSV2_DELETE_MOTOR_SHIELD[]        PROGMEM = "Adafruit::address %d;delete AFMS[%d];\n";
-prog_char MSG_MSV2_CREATE_DC_MOTOR[]            PROGMEM = "Adafruit::address(%d);AFMS[%d]->getMotor(%d);\n";
-prog_char MSG_MSV2_START_DC_MOTOR[]             PROGMEM = "Adafruit::DCMotors[%d][%d]->setSpeed(%d);\nDCMotors[%d][%d]->run(%d);\n";
-prog_char MSG_MSV2_RELEASE_DC_MOTOR[]           PROGMEM = "Adafruit::DCMotors[%d][%d]->run(4);\n";
-prog_char MSG_MSV2_SET_SPEED_DC_MOTOR[]         PROGMEM = "Adafruit::DCMotors[%d][%d]->setSpeed(%d);\nDCMotors[%d][%d]->run(%d);\n";
-prog_char MSG_MSV2_CREATE_STEPPER_MOTOR[]       PROGMEM = "Adafruit::address(%d);AFMS[%d]->getStepper(%d, %d)-->0x%04X;\nStepperMotors[%d][%d]->setSpeed(%d);\n"; 
-prog_char MSG_MSV2_MOVE_STEPPER_MOTOR[]         PROGMEM = "Adafruit::-->0x%04X;StepperMotors[%d][%d]->step(%d, %d, %d);\n";
-prog_char MSG_MSV2_RELEASE_STEPPER_MOTOR[]      PROGMEM = "Adafruit::StepperMotors[%d][%d]->release();\n";
-prog_char MSG_MSV2_SET_SPEED_STEPPER_MOTOR[]    PROGMEM = "Adafruit::StepperMotors[%d][%d]->setSpeed(%d);\n";
+prog_char MSG_MSV2_CREATE_MOTOR_SHIELD[]        PROGMEM = "Adafruit::shieldSlots[%d].shield = new Adafruit_MotorShield(%d);shieldSlots[%d].shield->begin(%d);\n";
+prog_char MSG_MSV2_DELETE_MOTOR_SHIELD[]        PROGMEM = "Adafruit::address %d;delete shieldSlots[%d].shield;\n";
+prog_char MSG_MSV2_CREATE_DC_MOTOR[]            PROGMEM = "Adafruit::address(%d);shieldSlots[%d].dcMotors |= 1 << %d;\n";
+prog_char MSG_MSV2_WRITE_DC_MOTORS[]            PROGMEM = "Adafruit::Wire.beginTransmission(%d);Wire.write(%d);<%d channels>;Wire.endTransmission();\n";
+prog_char MSG_MSV2_CREATE_STEPPER_MOTOR[]       PROGMEM = "Adafruit::address(%d);shieldSlots[%d].shield->getStepper(%d, %d)-->0x%04X;\nsteppers[%d]->setSpeed(%d);\n"; 
+prog_char MSG_MSV2_MOVE_STEPPER_MOTOR[]         PROGMEM = "Adafruit::-->0x%04X;shieldSlots[%d].steppers[%d]->step(%d, %d, %d);\n";
+prog_char MSG_MSV2_RELEASE_STEPPER_MOTOR[]      PROGMEM = "Adafruit::shieldSlots[%d].steppers[%d]->release();\n";
+prog_char MSG_MSV2_SET_SPEED_STEPPER_MOTOR[]    PROGMEM = "Adafruit::shieldSlots[%d].steppers[%d]->setSpeed(%d);\n";
+prog_char MSG_MSV2_ONESTEP_STEPPER_MOTOR[]      PROGMEM = "Adafruit::shieldSlots[%d].steppers[%d]->onestep(%d, %d);\n";
 
 
 class _Adafruit_MotorShield {
 public:
-    // motorshield
-    static void createMotorShield(byte i2caddress, unsigned int pwmfreq) {
-        if(i2caddress >= MIN_I2C && i2caddress <= MAX_I2C){
-            byte shieldnum = (i2caddress - MIN_I2C);
-            AFMS[shieldnum] = new Adafruit_MotorShield(i2caddress);
-            AFMS[shieldnum]->begin(pwmfreq);
-            _p(MSG_MSV2_CREATE_MOTOR_SHIELD, i2caddress, pwmfreq);
+    // Slot of the shield at i2caddress, or the first free slot with 0; NO_SHIELD if there is none
+    static byte findShield(byte i2caddress) {
+        for(byte i = 0; i < MAX_SHIELDS; ++i){
+            if(shieldSlots[i].i2caddress == i2caddress){
+                return i;
+            }
         }
+        return NO_SHIELD;
     }
     
-    static void deleteMotorShield(byte i2caddress) {
-        if(i2caddress >= MIN_I2C && i2caddress <= MAX_I2C){
-            byte shieldnum = (i2caddress - MIN_I2C);
-            delete AFMS[shieldnum];
-            AFMS[shieldnum] = NULL;
-            _p(MSG_MSV2_DELETE_MOTOR_SHIELD, i2caddress, shieldnum);
+    // motorshield, false if there is no memory for it
+    static bool createMotorShield(byte slot, byte i2caddress, unsigned int pwmfreq) {
+        MotorShieldSlot& state = shieldSlots[slot];
+        state.shield = new Adafruit_MotorShield(i2caddress);
+        if(state.shield == NULL){
+            return false;
         }
+        state.i2caddress = i2caddress;
+        state.dcMotors = 0;
+        for(byte i = 0; i < MAX_STEPPERMOTORS; ++i){
+            state.steppers[i] = NULL;
+            state.stepperPositions[i] = 0;
+        }
+        state.shield->begin(pwmfreq); // also turns on register auto-increment of the PCA9685
+        _p(MSG_MSV2_CREATE_MOTOR_SHIELD, slot, i2caddress, slot, pwmfreq);
+        return true;
+    }
+    
+    static void deleteMotorShield(byte slot) {
+        // the motors belong to the shield object
+        _p(MSG_MSV2_DELETE_MOTOR_SHIELD, shieldSlots[slot].i2caddress, slot);
+        delete shieldSlots[slot].shield;
+        shieldSlots[slot].shield = NULL;
+        shieldSlots[slot].i2caddress = 0;
     }
     
     // DC motor
-    static void createDCMotor(byte i2caddress, byte motornum) {
-            byte shieldnum = (i2caddress - MIN_I2C);
-            DCMotors[shieldnum][motornum] = AFMS[shieldnum]->getMotor(motornum+1);
-            _p(MSG_MSV2_CREATE_DC_MOTOR, i2caddress, shieldnum, motornum+1);
+    static void createDCMotor(byte slot, byte motornum) {
+        shieldSlots[slot].dcMotors |= 1 << motornum;
+        _p(MSG_MSV2_CREATE_DC_MOTOR, shieldSlots[slot].i2caddress, slot, motornum);
     }
     
-    static void startDCMotor(byte i2caddress, byte motornum, unsigned int speed, byte direction) {
-        byte shieldnum = (i2caddress - MIN_I2C);
-        DCMotors[shieldnum][motornum]->setSpeed(speed);
-        DCMotors[shieldnum][motornum]->run(direction);
-        _p(MSG_MSV2_START_DC_MOTOR, shieldnum, motornum, speed, shieldnum, motornum, direction);
+    // Sets speed and direction of DC motors in place of Adafruit_DCMotor::setSpeed() and run(),
+    // which take a transmission per PWM channel, three per motor. The PCA9685 channels of the
+    // motors are written as runs of consecutive registers instead, up to PCA9685_BURST_SIZE
+    // channels in a transmission, so that all four motors take two. The outputs change together
+    // at the end of the transmission. motors holds a motornum, speed and direction per motor,
+    // direction FORWARD, BACKWARD or RELEASE.
+    static void writeDCMotors(byte slot, byte count, const byte* motors) {
+        unsigned int levels[PCA9685_CHANNELS]; // 0 to 4095 on-time, or PCA9685_FULL_ON
+        unsigned int channels = 0;
+        for(byte i = 0; i < count; ++i){
+            const byte* motor = &motors[3*i];
+            byte pwm = pgm_read_byte(&dcMotorChannels[motor[0]][0]);
+            byte in1 = pgm_read_byte(&dcMotorChannels[motor[0]][1]);
+            byte in2 = pgm_read_byte(&dcMotorChannels[motor[0]][2]);
+            levels[pwm] = motor[1] * 16;
+            levels[in1] = (motor[2] == FORWARD) ? PCA9685_FULL_ON : 0;
+            levels[in2] = (motor[2] == BACKWARD) ? PCA9685_FULL_ON : 0;
+            channels |= (1 << pwm) | (1 << in1) | (1 << in2);
+        }
+        
+        byte i2caddress = shieldSlots[slot].i2caddress;
+        byte first = 0;
+        while(first < PCA9685_CHANNELS){
+            if(!(channels & (1 << first))){
+                first++;
+                continue;
+            }
+            byte last = first;
+            while(last + 1 < PCA9685_CHANNELS && (channels & (1 << (last + 1))) && last + 1 - first < PCA9685_BURST_SIZE){
+                last++;
+            }
+            Wire.beginTransmission(i2caddress);
+            Wire.write(PCA9685_LED0_ON_L + 4*first);
+            for(byte ch = first; ch <= last; ++ch){
+                unsigned int on = (levels[ch] == PCA9685_FULL_ON) ? PCA9685_FULL_ON : 0;
+                unsigned int off = (levels[ch] == PCA9685_FULL_ON) ? 0 : levels[ch];
+                Wire.write(on & 0xff);
+                Wire.write(on >> 8);
+                Wire.write(off & 0xff);
+                Wire.write(off >> 8);
+            }
+            Wire.endTransmission();
+            _p(MSG_MSV2_WRITE_DC_MOTORS, i2caddress, PCA9685_LED0_ON_L + 4*first, last - first + 1);
+            first = last + 1;
+        }
     }
     
-    static void stopDCMotor(byte i2caddress, byte motornum) {
-        byte shieldnum = (i2caddress - MIN_I2C);
-        DCMotors[shieldnum][motornum]->run(4);
-        _p(MSG_MSV2_RELEASE_DC_MOTOR, shieldnum, motornum);
+    // Stepper motor
+    static void createStepperMotor(byte slot, byte motornum, unsigned int sprev, unsigned int rpm) {
+        MotorShieldSlot& state = shieldSlots[slot];
+        state.steppers[motornum] = state.shield->getStepper(sprev, motornum+1);
+        state.steppers[motornum]->setSpeed(rpm);
+        state.stepperPositions[motornum] = 0;
+        _p(MSG_MSV2_CREATE_STEPPER_MOTOR, state.i2caddress, slot, sprev, motornum+1, state.steppers[motornum], motornum, rpm);
     }
-
-    static void setSpeedDCMotor(byte i2caddress, byte motornum, unsigned int speed, byte direction) {
-        byte shieldnum = (i2caddress - MIN_I2C);
-        DCMotors[shieldnum][motornum]->setSpeed(speed);
-        DCMotors[shieldnum][motornum]->run(direction);
-        _p(MSG_MSV2_SET_SPEED_DC_MOTOR, shieldnum, motornum, speed, shieldnum, motornum, direction);
+    
+    static void moveStepperMotor(byte slot, byte motornum, unsigned int steps, byte direction, byte steptype) {
+        shieldSlots[slot].steppers[motornum]->step(steps, direction, steptype);
+        _p(MSG_MSV2_MOVE_STEPPER_MOTOR, shieldSlots[slot].steppers[motornum], slot, motornum, steps, direction, steptype);
+    }
+    
+    static void oneStepStepperMotor(byte slot, byte motornum, byte direction, byte steptype) {
+        shieldSlots[slot].steppers[motornum]->onestep(direction, steptype);
+        _p(MSG_MSV2_ONESTEP_STEPPER_MOTOR, slot, motornum, direction, steptype);
+    }
+    
+    static void releaseStepperMotor(byte slot, byte motornum) {
+        shieldSlots[slot].steppers[motornum]->release();
+        _p(MSG_MSV2_RELEASE_STEPPER_MOTOR, slot, motornum);
+    }
+    
+    static void setSpeedStepperMotor(byte slot, byte motornum, unsigned int rpm) {
+        shieldSlots[slot].steppers[motornum]->setSpeed(rpm);
+        _p(MSG_MSV2_SET_SPEED_STEPPER_MOTOR, slot, motornum, rpm);
     }
+};
 
-    // Stepper motor
-    static void createStepperMotor(byte i2caddress, byte motornum, unsigned int sprev, unsigned int rpm) {
-        byte shieldnum = (i2caddress - MIN_I2C);
-        StepperMotors[shieldnum][motornum] = AFMS[shieldnum]->getStepper(sprev, motornum+1);
-        StepperMotors[shieldnum][motornum]->setSpeed(rpm);
-        _p(MSG_MSV2_CREATE_STEPPER_MOTOR, i2caddress, shieldnum, sprev, motornum+1, StepperMotors[shieldnum][motornum], shieldnum, motornum, rpm);
+// Stepper motion engine
+// Adafruit_StepperMotor::step() busy-waits between steps for the whole move, so moves are
+// stepped from a cooperative task of the server instead, one onestep() per due step, and
+// the server keeps serving commands meanwhile. Every step is an I2C transfer to the PWM
+// driver, which rules out a timer interrupt; the achievable step rate is bounded by the bus.
+//
+// Moves follow a trapezoidal speed profile: they accelerate to the top speed, cruise and
+// decelerate to stop at the target (linear speed ramps after D. Austin, "Generate stepper
+// motor speed profiles in real time"). Moves of the same group, on any shield, wait until
+// the group is started and then start on the same step time; the host scales their speeds
+// so that they also arrive together.
+typedef struct {
+    byte state;               // STEPPER_IDLE for a free slot
+    byte slot;                // of the shield in shieldSlots
+    byte motornum;
+    byte direction;           // FORWARD or BACKWARD
+    byte steptype;
+    byte group;               // 0 - not grouped
+    byte flags;
+    byte isStopped;           // ended by a stop instead of at its target
+    byte hasDeferredResponse; // answer sequenceID when the move ends
+    byte sequenceID;
+    unsigned long remaining;  // onesteps to the target
+    unsigned int rampStep;    // steps into the acceleration ramp the current speed corresponds to
+    float interval;           // microseconds to the next step
+    float minInterval;        // at top speed
+    float c0;                 // interval of the first step, 0 without acceleration
+    unsigned long nextTime;   // micros() of the next step
+} StepperMove;
+
+StepperMove stepperMoves[MAX_STEPPER_MOVES];
+byte stepperTask = NO_TASK;
+
+class StepperMotion {
+public:
+    // Starts a move right away or, with a group, once the group is started. A new move of a
+    // stepper replaces the one in progress. Returns NO_STEPPER_MOVE if all slots are taken.
+    static byte begin(byte slot, byte motornum, unsigned long steps, byte direction, byte steptype,
+                      float minInterval, float acceleration, byte group, byte flags) {
+        byte index = find(slot, motornum);
+        if(index != NO_STEPPER_MOVE){
+            finish(stepperMoves[index], true);
+        }
+        else{
+            index = find(NO_SHIELD, 0);
+            if(index == NO_STEPPER_MOVE){
+                return NO_STEPPER_MOVE;
+            }
+        }
+        StepperMove& move = stepperMoves[index];
+        move.slot = slot;
+        move.motornum = motornum;
+        move.direction = direction;
+        move.steptype = steptype;
+        move.group = group;
+        move.flags = flags;
+        move.isStopped = 0;
+        move.hasDeferredResponse = 0;
+        move.remaining = steps;
+        move.rampStep = 0;
+        move.minInterval = minInterval;
+        move.c0 = 0;
+        if(acceleration > 0){
+            // interval of the first step from standstill, corrected for the error of the recurrence
+            float c0 = 0.676 * sqrt(2.0 / acceleration) * 1e6;
+            if(c0 > minInterval){
+                move.c0 = c0;
+            }
+        }
+        move.interval = (move.c0 > 0) ? move.c0 : minInterval;
+        move.state = STEPPER_QUEUED;
+        if(group == 0){
+            start(move, micros());
+        }
+        return index;
+    }
+    
+    // Starts the moves of a group, returns how many
+    static byte startGroup(byte group) {
+        byte count = 0;
+        unsigned long now = micros();
+        for(byte i = 0; i < MAX_STEPPER_MOVES; ++i){
+            if(stepperMoves[i].state == STEPPER_QUEUED && stepperMoves[i].group == group){
+                start(stepperMoves[i], now);
+                count++;
+            }
+        }
+        return count;
+    }
+    
+    // Decelerates to a stop, or stops at once
+    static void stop(byte slot, byte motornum, bool immediately) {
+        byte index = find(slot, motornum);
+        if(index == NO_STEPPER_MOVE){
+            return;
+        }
+        StepperMove& move = stepperMoves[index];
+        if(immediately || move.state == STEPPER_QUEUED || move.rampStep == 0){
+            finish(move, true);
+        }
+        else if(move.remaining > move.rampStep){
+            move.remaining = move.rampStep;
+            move.isStopped = 1;
+        }
+    }
+    
+    // Stops the moves of a shield, or of all shields with NO_SHIELD
+    static void stopAll(byte slot) {
+        for(byte i = 0; i < MAX_STEPPER_MOVES; ++i){
+            if(stepperMoves[i].state != STEPPER_IDLE &&
+               (slot == NO_SHIELD || stepperMoves[i].slot == slot)){
+                finish(stepperMoves[i], true);
+            }
+        }
     }
     
-    static void moveStepperMotor(byte i2caddress, byte motornum, unsigned int steps, byte direction, byte steptype) {
-        byte shieldnum = (i2caddress - MIN_I2C);
-        StepperMotors[shieldnum][motornum]->step(steps, direction, steptype);
-        _p(MSG_MSV2_MOVE_STEPPER_MOTOR, StepperMotors[shieldnum][motornum], shieldnum, motornum, steps, direction, steptype);
+    // Answers the current moveStepperMotor command when the move ends, false if it cannot wait
+    static bool deferResponseOf(byte index) {
+        StepperMove& move = stepperMoves[index];
+        move.hasDeferredResponse = deferResponse(&move.sequenceID);
+        return move.hasDeferredResponse;
     }
     
-    static void releaseStepperMotor(byte i2caddress, byte motornum) {
-        byte shieldnum = (i2caddress - MIN_I2C);
-        StepperMotors[shieldnum][motornum]->release();
-        _p(MSG_MSV2_RELEASE_STEPPER_MOTOR, shieldnum, motornum);
+    // Status and current speed in onesteps per second
+    static byte status(byte slot, byte motornum, unsigned int& speed) {
+        byte index = find(slot, motornum);
+        speed = 0;
+        if(index == NO_STEPPER_MOVE){
+            return STEPPER_IDLE;
+        }
+        StepperMove& move = stepperMoves[index];
+        if(move.state == STEPPER_RUNNING && move.interval > 0){
+            float value = 1e6 / move.interval;
+            speed = (value < 65535.0) ? (unsigned int)value : 65535;
+        }
+        return move.state;
     }
     
-    static void setSpeedStepperMotor(byte i2caddress, byte motornum, unsigned int rpm) {
-        byte shieldnum = (i2caddress - MIN_I2C);
-        StepperMotors[shieldnum][motornum]->setSpeed(rpm);
-        _p(MSG_MSV2_SET_SPEED_STEPPER_MOTOR, shieldnum, motornum, rpm);
+private:
+    static byte find(byte slot, byte motornum) {
+    // Index of the stepper's move, or the first free one with NO_SHIELD
+        for(byte i = 0; i < MAX_STEPPER_MOVES; ++i){
+            if(slot == NO_SHIELD ? stepperMoves[i].state == STEPPER_IDLE :
+               (stepperMoves[i].state != STEPPER_IDLE && stepperMoves[i].slot == slot &&
+                stepperMoves[i].motornum == motornum)){
+                return i;
+            }
+        }
+        return NO_STEPPER_MOVE;
+    }
+    
+    static void start(StepperMove& move, unsigned long now) {
+        move.state = STEPPER_RUNNING;
+        move.nextTime = now;
+        if(stepperTask == NO_TASK){
+            stepperTask = MWArduino.addTask(update, NULL, 0, 0);
+        }
+    }
+    
+    static void finish(StepperMove& move, bool stopped) {
+        move.state = STEPPER_IDLE;
+        if(stopped){
+            move.isStopped = 1;
+        }
+        if(move.hasDeferredResponse){
+            sendDeferredResponseMsg(move.sequenceID, 0x08, 0, 0);
+        }
+        if(move.flags & STEPPER_EMIT_EVENT){
+            long position = shieldSlots[move.slot].stepperPositions[move.motornum];
+            byte event[8];
+            event[0] = shieldSlots[move.slot].i2caddress;
+            event[1] = move.motornum;
+            event[2] = move.group;
+            event[3] = move.isStopped;
+            event[4] = (position >> 24) & 0xff;
+            event[5] = (position >> 16) & 0xff;
+            event[6] = (position >> 8) & 0xff;
+            event[7] = position & 0xff;
+            sendEventMsg(STEPPER_EVENT, 8, event);
+        }
+    }
+    
+    static void step(StepperMove& move) {
+        if(move.remaining == 0){
+            finish(move, false);
+            return;
+        }
+        _Adafruit_MotorShield::oneStepStepperMotor(move.slot, move.motornum, move.direction, move.steptype);
+        shieldSlots[move.slot].stepperPositions[move.motornum] += (move.direction == BACKWARD) ? -1 : 1;
+        if(--move.remaining == 0){
+            finish(move, false);
+            return;
+        }
+        if(move.remaining <= move.rampStep){
+            // decelerate, stepping the ramp back down so that the last step leaves it
+            move.interval = move.interval * (4.0 * move.rampStep + 1) / (4.0 * move.rampStep - 1);
+            move.rampStep--;
+        }
+        else if(move.c0 > 0 && move.interval > move.minInterval){
+            move.rampStep++;
+            move.interval -= 2 * move.interval / (4.0 * move.rampStep + 1);
+            if(move.interval < move.minInterval){
+                move.interval = move.minInterval;
+            }
+        }
+        move.nextTime += (unsigned long)move.interval;
+        unsigned long now = micros();
+        if((long)(now - move.nextTime) >= 0){
+            // more than one interval late after a stalled loop: keep the ramp instead of catching up
+            move.nextTime = now + (unsigned long)move.interval;
+        }
+    }
+    
+    static bool update(void* context) {
+    // Task of the running moves, removes itself once none is left
+        bool isRunning = false;
+        for(byte i = 0; i < MAX_STEPPER_MOVES; ++i){
+            StepperMove& move = stepperMoves[i];
+            if(move.state == STEPPER_RUNNING && (long)(micros() - move.nextTime) >= 0){
+                step(move);
+            }
+            isRunning = isRunning || move.state == STEPPER_RUNNING;
+        }
+        if(!isRunning){
+            stepperTask = NO_TASK;
+        }
+        return isRunning;
     }
 };
 
@@ -122,6 +436,7 @@ class MotorShieldV2Base : public LibraryBase
 	public:
 		MotorShieldV2Base(MWArduinoClass& a) : libName("Adafruit/MotorShieldV2")
 		{
+			setCommandTable(commandTable, sizeof(commandTable)/sizeof(CommandEntry));
 			a.registerLibrary(this);
 		}
 		
@@ -132,152 +447,426 @@ class MotorShieldV2Base : public LibraryBase
 		{
 			return libName;
 		}
+		
+		unsigned int getStaticSize() const
+		{
+			return sizeof(*this) + sizeof(shieldSlots) + sizeof(stepperMoves) + sizeof(stepperTask);
+		}
+		
+		unsigned int getDynamicSize() const
+		{
+		// shield slots of the created shields, and the stepper moves in progress
+			unsigned int size = 0;
+			for(byte i = 0; i < MAX_SHIELDS; ++i){
+				if(shieldSlots[i].i2caddress != 0){
+					size += sizeof(MotorShieldSlot) + sizeof(Adafruit_MotorShield);
+				}
+			}
+			for(byte i = 0; i < MAX_STEPPER_MOVES; ++i){
+				if(stepperMoves[i].state != STEPPER_IDLE){
+					size += sizeof(StepperMove);
+				}
+			}
+			return size;
+		}
 	
-		void commandHandler(byte* command)
+	// Command handlers
+	// command: sequence_ID, payload_size (2 bytes), libraryID, cmdID, params
+	//
+	public:
+		static const CommandEntry commandTable[15];
+		
+		static byte findShield(byte i2caddress)
 		{
-            //_p(MSG_MSV2_ENTER_COMMAND_HANDLER, command[0], command[1], command[2], command[3], command[4]);
-            byte sequenceID = command[0];
-            byte cmdID = command[4];
-            switch (cmdID){
-                // Motor shield
-                case 0x00:{  // createMotorShield
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte freqBytes[3];
-                    ASCII2Binary(2, &command[7], freqBytes); 
-                    unsigned int pwmfreq = freqBytes[0]+(freqBytes[1]<<8);
-                    
-                    _Adafruit_MotorShield::createMotorShield(i2caddress, pwmfreq) ;
-                    
-                    sendResponseMsg(0x00, 0, 0);
-                    break;
-                }
-                case 0x01:{ // deleteMotorShield
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    
-                    _Adafruit_MotorShield::deleteMotorShield(i2caddress);
-                            
-                    sendResponseMsg(0x01, 0, 0);
-                    break;
-                }
-                
-                // DC motor
-                case 0x02:{ // createDCMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte motornum = command[7];
-                    
-                    _Adafruit_MotorShield::createDCMotor(i2caddress, motornum);
-                            
-                    sendResponseMsg(0x02, 0, 0);
-                    break;
+		// Slot of a created shield, NO_SHIELD if there is none at the address
+            if(!(i2caddress >= MIN_I2C && i2caddress < MAX_I2C)){
+                return NO_SHIELD;
+            }
+            return _Adafruit_MotorShield::findShield(i2caddress);
+		}
+		
+		static bool isValidDCMotor(byte slot, byte motornum)
+		{
+            return slot != NO_SHIELD && motornum < MAX_DCMOTORS && (shieldSlots[slot].dcMotors & (1 << motornum));
+		}
+		
+		static bool isValidStepperMotor(byte slot, byte motornum)
+		{
+            return slot != NO_SHIELD && motornum < MAX_STEPPERMOTORS && shieldSlots[slot].steppers[motornum] != NULL;
+		}
+		
+		static bool isValidDirection(byte direction)
+		{
+            return direction == FORWARD || direction == BACKWARD || direction == RELEASE;
+		}
+		
+		static void createMotorShield(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte freqBytes[3];
+            ASCII2Binary(2, &command[7], freqBytes); 
+            unsigned int pwmfreq = freqBytes[0]+(freqBytes[1]<<8);
+            if(!(i2caddress >= MIN_I2C && i2caddress < MAX_I2C)){
+                sendErrorResponseMsg(0x00);
+                return;
+            }
+            byte slot = findShield(i2caddress);
+            if(slot != NO_SHIELD){ // left over from a session that did not delete it
+                StepperMotion::stopAll(slot);
+                _Adafruit_MotorShield::deleteMotorShield(slot);
+            }
+            else{
+                slot = _Adafruit_MotorShield::findShield(0);
+                if(slot == NO_SHIELD){
+                    sendErrorResponseMsg(0x00);
+                    return;
                 }
-                case 0x03:{ // startDCMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
+            }
+            
+            if(!_Adafruit_MotorShield::createMotorShield(slot, i2caddress, pwmfreq)){
+                sendErrorResponseMsg(0x00);
+                return;
+            }
+            
+            sendResponseMsg(0x00, 0, 0);
+		}
+		
+		static void deleteMotorShield(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte slot = findShield(i2caddress);
+            if(slot == NO_SHIELD){
+                sendErrorResponseMsg(0x01);
+                return;
+            }
+            
+            StepperMotion::stopAll(slot);
+            _Adafruit_MotorShield::deleteMotorShield(slot);
                     
-                    byte motornum = command[7];
+            sendResponseMsg(0x01, 0, 0);
+		}
+		
+		static void createDCMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!(slot != NO_SHIELD && motornum < MAX_DCMOTORS)){
+                sendErrorResponseMsg(0x02);
+                return;
+            }
+            
+            _Adafruit_MotorShield::createDCMotor(slot, motornum);
                     
-                    byte speed;
-                    ASCII2Binary(1, &command[8], &speed); 
+            sendResponseMsg(0x02, 0, 0);
+		}
+		
+		static void startDCMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            
+            byte motor[3];
+            motor[0] = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidDCMotor(slot, motor[0])){
+                sendErrorResponseMsg(0x03);
+                return;
+            }
+            
+            ASCII2Binary(1, &command[8], &motor[1]); 
 
-                    byte direction = command[10];
-                    
-                    _Adafruit_MotorShield::startDCMotor(i2caddress, motornum, speed, direction);
-                    
-                    sendResponseMsg(0x03, 0, 0);
-                    break;    
-                }
-                case 0x04:{ // stopDCMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte motornum = command[7];
-                    
-                    _Adafruit_MotorShield::stopDCMotor(i2caddress, motornum);
-                    
-                    sendResponseMsg(0x04, 0, 0);
-                    break;
-                }
-                case 0x05:{ // setSpeedDCMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte motornum = command[7];
-                    
-                    byte speed;
-                    ASCII2Binary(1, &command[8], &speed); 
+            motor[2] = command[10];
+            if(!isValidDirection(motor[2])){
+                sendErrorResponseMsg(0x03);
+                return;
+            }
+            
+            _Adafruit_MotorShield::writeDCMotors(slot, 1, motor);
+            
+            sendResponseMsg(0x03, 0, 0);
+		}
+		
+		static void stopDCMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motor[3];
+            motor[0] = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidDCMotor(slot, motor[0])){
+                sendErrorResponseMsg(0x04);
+                return;
+            }
+            
+            motor[1] = 0;
+            motor[2] = RELEASE;
+            _Adafruit_MotorShield::writeDCMotors(slot, 1, motor);
+            
+            sendResponseMsg(0x04, 0, 0);
+		}
+		
+		static void setSpeedDCMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motor[3];
+            motor[0] = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidDCMotor(slot, motor[0])){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            
+            ASCII2Binary(1, &command[8], &motor[1]); 
 
-                    byte direction = command[10];
-                    
-                    _Adafruit_MotorShield::setSpeedDCMotor(i2caddress, motornum, speed, direction);
-                    
-                    sendResponseMsg(0x05, 0, 0);
-                    break;
-                }
-                
-                // Stepper Motor
-                case 0x06:{ // createStepperMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte motornum = command[7];
-                    
-                    byte sprevBytes[2];
-                    ASCII2Binary(2, &command[8], sprevBytes); 
-                    unsigned int sprev = sprevBytes[0]+(sprevBytes[1]<<8);
-                    
-                    byte rpmBytes[2];
-                    ASCII2Binary(2, &command[11], rpmBytes); 
-                    unsigned int rpm = rpmBytes[0]+(rpmBytes[1]<<8);
-                            
-                    _Adafruit_MotorShield::createStepperMotor(i2caddress, motornum, sprev, rpm);
-                    
-                    sendResponseMsg(0x06, 0, 0);
-                    break;
-                }
-                case 0x07:{ // releaseStepperMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte motornum = command[7];
-                    
-                    _Adafruit_MotorShield::releaseStepperMotor(i2caddress, motornum);
-                    
-                    sendResponseMsg(0x07, 0, 0);
-                    break;
-                }
-                case 0x08:{ // moveStepperMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte motornum = command[7];
-                    
-                    byte stepsBytes[2];
-                    ASCII2Binary(2, &command[8], stepsBytes); 
-                    unsigned int steps = stepsBytes[0]+(stepsBytes[1]<<8);
-                    
-                    byte direction = command[11];
-                    byte steptype = command[12];
-                    
-                    _Adafruit_MotorShield::moveStepperMotor(i2caddress, motornum, steps, direction, steptype);
-                    
-                    sendResponseMsg(0x08, 0, 0);
-                    break;
-                }
-                case 0x09:{ // setSpeedStepperMotor
-                    byte i2caddress;
-                    ASCII2Binary(1, &command[5], &i2caddress); 
-                    byte motornum = command[7];
-                    
-                    byte rpmBytes[2];
-                    ASCII2Binary(2, &command[8], rpmBytes); 
-                    unsigned int rpm = rpmBytes[0]+(rpmBytes[1]<<8);
-                    
-                    _Adafruit_MotorShield::setSpeedStepperMotor(i2caddress, motornum, rpm);
+            motor[2] = command[10];
+            if(!isValidDirection(motor[2])){
+                sendErrorResponseMsg(0x05);
+                return;
+            }
+            
+            _Adafruit_MotorShield::writeDCMotors(slot, 1, motor);
+            
+            sendResponseMsg(0x05, 0, 0);
+		}
+		
+		static void createStepperMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!(slot != NO_SHIELD && motornum < MAX_STEPPERMOTORS)){
+                sendErrorResponseMsg(0x06);
+                return;
+            }
+            
+            byte sprevBytes[2];
+            ASCII2Binary(2, &command[8], sprevBytes); 
+            unsigned int sprev = sprevBytes[0]+(sprevBytes[1]<<8);
+            
+            byte rpmBytes[2];
+            ASCII2Binary(2, &command[11], rpmBytes); 
+            unsigned int rpm = rpmBytes[0]+(rpmBytes[1]<<8);
                     
-                    sendResponseMsg(0x09, 0, 0);
-                    break;
+            _Adafruit_MotorShield::createStepperMotor(slot, motornum, sprev, rpm);
+            
+            sendResponseMsg(0x06, 0, 0);
+		}
+		
+		static void releaseStepperMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidStepperMotor(slot, motornum)){
+                sendErrorResponseMsg(0x07);
+                return;
+            }
+            
+            StepperMotion::stop(slot, motornum, true);
+            _Adafruit_MotorShield::releaseStepperMotor(slot, motornum);
+            
+            sendResponseMsg(0x07, 0, 0);
+		}
+		
+		static void moveStepperMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidStepperMotor(slot, motornum)){
+                sendErrorResponseMsg(0x08);
+                return;
+            }
+            
+            byte stepsBytes[2];
+            ASCII2Binary(2, &command[8], stepsBytes); 
+            unsigned int steps = stepsBytes[0]+(stepsBytes[1]<<8);
+            
+            byte direction = command[11];
+            byte steptype = command[12];
+            
+            // same steps and step interval as Adafruit_StepperMotor::step()
+            unsigned long uspers = shieldSlots[slot].steppers[motornum]->usperstep;
+            unsigned long onesteps = steps;
+            if(steptype == INTERLEAVE){
+                uspers /= 2;
+            }
+            else if(steptype == MICROSTEP){
+                uspers /= MICROSTEPS;
+                onesteps *= MICROSTEPS;
+            }
+            byte index = StepperMotion::begin(slot, motornum, onesteps, direction, steptype, uspers, 0, 0, 0);
+            if(index == NO_STEPPER_MOVE){ // all slots busy, step in place as before
+                _Adafruit_MotorShield::moveStepperMotor(slot, motornum, steps, direction, steptype);
+            }
+            else if(StepperMotion::deferResponseOf(index)){
+                return;
+            }
+            
+            sendResponseMsg(0x08, 0, 0);
+		}
+		
+		static void setSpeedStepperMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidStepperMotor(slot, motornum)){
+                sendErrorResponseMsg(0x09);
+                return;
+            }
+            
+            byte rpmBytes[2];
+            ASCII2Binary(2, &command[8], rpmBytes); 
+            unsigned int rpm = rpmBytes[0]+(rpmBytes[1]<<8);
+            
+            _Adafruit_MotorShield::setSpeedStepperMotor(slot, motornum, rpm);
+            
+            sendResponseMsg(0x09, 0, 0);
+		}
+		
+		static void queueStepperMove(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidStepperMotor(slot, motornum)){
+                sendErrorResponseMsg(0x0A);
+                return;
+            }
+            
+            byte moveBytes[6];
+            ASCII2Binary(2, &command[8], moveBytes); 
+            unsigned int steps = moveBytes[0]+(moveBytes[1]<<8);
+            byte direction = command[11];
+            byte steptype = command[12];
+            ASCII2Binary(2, &command[13], &moveBytes[2]); 
+            unsigned int speed = moveBytes[2]+(moveBytes[3]<<8);
+            ASCII2Binary(2, &command[16], &moveBytes[4]); 
+            unsigned int acceleration = moveBytes[4]+(moveBytes[5]<<8);
+            byte group = command[19];
+            byte flags = command[20];
+            if((direction != FORWARD && direction != BACKWARD) || steptype < SINGLE || steptype > MICROSTEP || speed == 0){
+                sendErrorResponseMsg(0x0A);
+                return;
+            }
+            
+            // speed and acceleration are in steps, the engine counts onesteps like step()
+            unsigned long onesteps = steps;
+            float rateFactor = 1;
+            if(steptype == INTERLEAVE){
+                rateFactor = 2;
+            }
+            else if(steptype == MICROSTEP){
+                rateFactor = MICROSTEPS;
+                onesteps *= MICROSTEPS;
+            }
+            byte index = StepperMotion::begin(slot, motornum, onesteps, direction, steptype,
+                                              1e6 / (speed * rateFactor), acceleration * rateFactor, group, flags);
+            byte status = (index != NO_STEPPER_MOVE);
+            
+            sendResponseMsg(0x0A, 1, &status);
+		}
+		
+		static void startStepperGroup(byte argc, byte* command)
+		{
+            byte count = StepperMotion::startGroup(command[7]);
+            
+            sendResponseMsg(0x0B, 1, &count);
+		}
+		
+		static void stopStepperMotor(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidStepperMotor(slot, motornum)){
+                sendErrorResponseMsg(0x0C);
+                return;
+            }
+            
+            StepperMotion::stop(slot, motornum, command[8] != 0);
+            
+            sendResponseMsg(0x0C, 0, 0);
+		}
+		
+		static void readStepperStatus(byte argc, byte* command)
+		{
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte motornum = command[7];
+            byte slot = findShield(i2caddress);
+            if(!isValidStepperMotor(slot, motornum)){
+                sendErrorResponseMsg(0x0D);
+                return;
+            }
+            
+            unsigned int speed;
+            byte val[7];
+            val[0] = StepperMotion::status(slot, motornum, speed);
+            long position = shieldSlots[slot].stepperPositions[motornum];
+            val[1] = (position >> 24) & 0xff;
+            val[2] = (position >> 16) & 0xff;
+            val[3] = (position >> 8) & 0xff;
+            val[4] = position & 0xff;
+            val[5] = speed >> 8;
+            val[6] = speed & 0xff;
+            
+            sendResponseMsg(0x0D, 7, val);
+		}
+		
+		static void setDCMotorSpeeds(byte argc, byte* command)
+		{
+		// All motors in one update of the PWM driver, each with its motornum, speed and direction
+            byte i2caddress;
+            ASCII2Binary(1, &command[5], &i2caddress); 
+            byte count = command[7];
+            byte slot = findShield(i2caddress);
+            if(slot == NO_SHIELD || count == 0 || count > MAX_DCMOTORS || argc < 8 + encodedPayloadSize(3*count)){
+                sendErrorResponseMsg(0x0E);
+                return;
+            }
+            
+            byte motors[3*MAX_DCMOTORS];
+            decodePayload(3*count, &command[8], motors);
+            for(byte i = 0; i < count; ++i){
+                if(!isValidDCMotor(slot, motors[3*i]) || !isValidDirection(motors[3*i+2])){
+                    sendErrorResponseMsg(0x0E);
+                    return;
                 }
-                default:
-                    //_p(MSG_MSV2_UNRECOGNIZED_COMMAND, cmdID);
-					break;
             }
+            _Adafruit_MotorShield::writeDCMotors(slot, count, motors);
+            
+            sendResponseMsg(0x0E, 0, 0);
 		}
-};
\ No newline at end of file
+};
+
+// handler, numParams, numData, responseSize
+const CommandEntry MotorShieldV2Base::commandTable[15] PROGMEM = {
+    {MotorShieldV2Base::createMotorShield,     5, 0, 0}, // 0x00 i2caddress, pwmfreq (7-bit encoded)
+    {MotorShieldV2Base::deleteMotorShield,     2, 0, 0}, // 0x01 i2caddress (7-bit encoded)
+    {MotorShieldV2Base::createDCMotor,         3, 0, 0}, // 0x02 i2caddress (7-bit encoded), motornum
+    {MotorShieldV2Base::startDCMotor,          6, 0, 0}, // 0x03 i2caddress (7-bit encoded), motornum, speed (7-bit encoded), direction
+    {MotorShieldV2Base::stopDCMotor,           3, 0, 0}, // 0x04 i2caddress (7-bit encoded), motornum
+    {MotorShieldV2Base::setSpeedDCMotor,       6, 0, 0}, // 0x05 i2caddress (7-bit encoded), motornum, speed (7-bit encoded), direction
+    {MotorShieldV2Base::createStepperMotor,    9, 0, 0}, // 0x06 i2caddress (7-bit encoded), motornum, sprev and rpm (7-bit encoded)
+    {MotorShieldV2Base::releaseStepperMotor,   3, 0, 0}, // 0x07 i2caddress (7-bit encoded), motornum
+    {MotorShieldV2Base::moveStepperMotor,      8, 0, 0}, // 0x08 i2caddress (7-bit encoded), motornum, steps (7-bit encoded), direction, steptype
+    {MotorShieldV2Base::setSpeedStepperMotor,  6, 0, 0}, // 0x09 i2caddress (7-bit encoded), motornum, rpm (7-bit encoded)
+    {MotorShieldV2Base::queueStepperMove,     16, 0, 1}, // 0x0A i2caddress (7-bit encoded), motornum, steps (7-bit encoded), direction, steptype, speed and acceleration (7-bit encoded), group, flags
+    {MotorShieldV2Base::startStepperGroup,     3, 0, 1}, // 0x0B i2caddress (7-bit encoded), group
+    {MotorShieldV2Base::stopStepperMotor,      4, 0, 0}, // 0x0C i2caddress (7-bit encoded), motornum, immediately
+    {MotorShieldV2Base::readStepperStatus,     3, 0, 7}, // 0x0D i2caddress (7-bit encoded), motornum
+    {MotorShieldV2Base::setDCMotorSpeeds,      3, 0, 0}, // 0x0E i2caddress (7-bit encoded), count, then a motornum, speed and direction per motor
+};
@@ -9,6 +9,9 @@ classdef stepper < arduinoio.MotorBase & matlab.mixin.CustomDisplay
     
     properties(Access = public)
         RPM = 0
+        
+        % Acceleration of start and syncMove in steps/s^2, 0 for no ramps
+        Acceleration = 0
     end
     
     properties (SetAccess = immutable)
@@ -27,6 +30,13 @@ classdef stepper < arduinoio.MotorBase & matlab.mixin.CustomDisplay
         RELEASE_STEPPER    = hex2dec('07')
         MOVE_STEPPER       = hex2dec('08')
         SET_SPEED_STEPPER  = hex2dec('09')
+        QUEUE_STEPPER_MOVE = hex2dec('0A')
+        START_STEPPER_GROUP = hex2dec('0B')
+        STOP_STEPPER       = hex2dec('0C')
+        READ_STEPPER_STATUS = hex2dec('0D')
+        STEPPER_EVENT      = hex2dec('70')
+        STEPPER_EMIT_EVENT = 1
+        MICROSTEPS         = 16
     end
     
 	%% Constructor
@@ -182,6 +192,228 @@ classdef stepper < arduinoio.MotorBase & matlab.mixin.CustomDisplay
             end
         end
         
+        function start(obj, steps)
+            %   Start moving the stepper motor without waiting for the move to end.
+            %
+            %   Syntax:
+            %   start(dev, steps)
+            %
+            %   Description:
+            %   Move the stepper motor the specified number of steps in the background.
+            %   The motor accelerates to RPM and decelerates to the target at
+            %   Acceleration. A move in progress is replaced.
+            %
+            %   Example:
+            %       a = arduino('COM7', 'Uno', 'Libraries', 'Adafruit\MotorShieldV2');
+            %       shield = addon(a, 'Adafruit/MotorShieldV2');
+            %       sm = stepper(shield,1,200,'RPM',120);
+            %       sm.Acceleration = 400;
+            %       start(sm, 1000);
+            %       while isMoving(sm)
+            %       end
+            %
+            %   Input Arguments:
+            %   dev       - stepper motor device 
+            %   steps     - The number of steps to move
+            %
+			%   See also syncMove, stop, readPosition, isMoving, readMoveEvents
+            
+            try
+                maxSteps = 2^15-1;
+                steps = arduinoio.internal.validateIntParameterRanged(...
+                    'AdafruitMotorShieldV2\Stepper Steps', steps, -maxSteps, maxSteps);
+                
+                if obj.RPM > 0
+                    queueMove(obj, steps, getStepRate(obj), obj.Acceleration, 0);
+                end
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function syncMove(obj, steps)
+            %   Move several stepper motors together.
+            %
+            %   Syntax:
+            %   syncMove([dev1 dev2 ...], [steps1 steps2 ...])
+            %
+            %   Description:
+            %   Start moving the stepper motors, on the same or on different shields,
+            %   at the same time and scale their speeds so that they also arrive
+            %   together. The motor that takes longest moves at its RPM and
+            %   Acceleration.
+            %
+            %   Example:
+            %       a = arduino('COM7', 'Uno', 'Libraries', 'Adafruit\MotorShieldV2');
+            %       shield = addon(a, 'Adafruit/MotorShieldV2');
+            %       sm1 = stepper(shield,1,200,'RPM',60);
+            %       sm2 = stepper(shield,2,200,'RPM',60);
+            %       syncMove([sm1 sm2], [400 -100]);
+            %
+            %   Input Arguments:
+            %   dev       - stepper motor devices
+            %   steps     - The number of steps each motor moves
+            %
+			%   See also start, stop, readMoveEvents
+            
+            try
+                maxSteps = 2^15-1;
+                if numel(steps) ~= numel(obj)
+                    obj(1).localizedError('MATLAB:arduinoio:general:invalidStepperSyncMove');
+                end
+                for ii = 1:numel(obj)
+                    steps(ii) = arduinoio.internal.validateIntParameterRanged(...
+                        'AdafruitMotorShieldV2\Stepper Steps', steps(ii), -maxSteps, maxSteps);
+                end
+                rates = arrayfun(@getStepRate, obj);
+                if any(rates == 0)
+                    return;
+                end
+                
+                % the move taking longest sets the pace
+                [~, lead] = max(abs(steps)./rates);
+                if steps(lead) == 0
+                    return;
+                end
+                scale = abs(steps)/abs(steps(lead));
+                
+                arduinoObj = obj(1).Parent.Parent;
+                group = getResourceProperty(arduinoObj, obj(1).ResourceOwner, 'group');
+                if isempty(group) || group >= 127
+                    group = 0;
+                end
+                group = group + 1;
+                setResourceProperty(arduinoObj, obj(1).ResourceOwner, 'group', group);
+                
+                for ii = 1:numel(obj)
+                    queueMove(obj(ii), steps(ii), rates(lead)*scale(ii), obj(lead).Acceleration*scale(ii), group);
+                end
+                sendShieldCommand(obj(1).Parent, obj(1).START_STEPPER_GROUP, group);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function stop(obj)
+            %   Stop moving the stepper motor
+            %
+            %   Syntax:
+            %   stop(dev)
+            %
+            %   Description:
+            %   Decelerate the move started by start or syncMove to a stop
+            %
+            %   Example:
+            %       a = arduino('COM7', 'Uno', 'Libraries', 'Adafruit\MotorShieldV2');
+            %       shield = addon(a, 'Adafruit/MotorShieldV2');
+            %       sm = stepper(shield,1,200,'RPM',10);
+            %       start(sm, 1000);
+            %       stop(sm);
+            %
+            %   Input Arguments:
+            %   dev       - stepper motor device 
+            %
+			%   See also start, release
+            
+            try
+                sendCommand(obj, obj.STOP_STEPPER, 0);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function position = readPosition(obj)
+            %   Read the position of the stepper motor
+            %
+            %   Syntax:
+            %   position = readPosition(dev)
+            %
+            %   Description:
+            %   Return the steps moved since the stepper motor object was created,
+            %   forward steps positive
+            %
+            %   Input Arguments:
+            %   dev       - stepper motor device 
+            %
+            %   Output Arguments:
+            %   position  - position in steps
+            %
+			%   See also isMoving, readMoveEvents
+            
+            try
+                [~, position] = readStatus(obj);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function result = isMoving(obj)
+            %   Check whether the stepper motor is moving
+            %
+            %   Syntax:
+            %   result = isMoving(dev)
+            %
+            %   Description:
+            %   Return true while a move started by start or syncMove is in progress
+            %   or waiting for the other motors of its syncMove
+            %
+            %   Input Arguments:
+            %   dev       - stepper motor device 
+            %
+			%   See also readPosition
+            
+            try
+                result = readStatus(obj) ~= 0;
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function events = readMoveEvents(obj)
+            %   Read the ends of moves of the stepper motor
+            %
+            %   Syntax:
+            %   events = readMoveEvents(dev)
+            %
+            %   Description:
+            %   Return the moves started by start or syncMove that ended since the
+            %   last call, as a struct array with the fields Stopped (true if the
+            %   move was stopped before its target) and Position (in steps)
+            %
+            %   Input Arguments:
+            %   dev       - stepper motor device 
+            %
+			%   See also start, syncMove
+            
+            try
+                arduinoObj = obj.Parent.Parent;
+                % events of the other motors are kept for them
+                pending = getResourceProperty(arduinoObj, obj.ResourceOwner, 'events');
+                frames = [pending, readLibraryEvents(arduinoObj, obj.STEPPER_EVENT)];
+                isMine = cellfun(@(f) f(1) == obj.Parent.I2CAddress && f(2) == obj.MotorNumber-1, frames);
+                setResourceProperty(arduinoObj, obj.ResourceOwner, 'events', frames(~isMine));
+                
+                events = struct('Stopped', {}, 'Position', {});
+                for frame = frames(isMine)
+                    event = double(frame{1});
+                    position = typecast(uint8(event(8:-1:5)), 'int32');
+                    events(end+1) = struct('Stopped', event(4) ~= 0, 'Position', toSteps(obj, position)); %#ok<AGROW>
+                end
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function set.Acceleration(obj, acceleration)
+            try
+                maxAcceleration = 2^16-1;
+                obj.Acceleration = arduinoio.internal.validateIntParameterRanged(...
+                    'Stepper Acceleration', acceleration, 0, maxAcceleration);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
         function set.RPM(obj, rpm)
             try
                 maxRPM = 2^15-1;
@@ -246,17 +478,7 @@ classdef stepper < arduinoio.MotorBase & matlab.mixin.CustomDisplay
                     direction = 2;
                 end
                 
-                switch obj.StepType
-                    case 'Single'
-                        stepType = 1;
-                    case 'Double'
-                        stepType = 2;
-                    case 'Interleave'
-                        stepType = 3;
-                    case 'Microstep'
-                        stepType = 4;
-                    otherwise
-                end
+                stepType = getStepType(obj);
                 steps = typecast(uint16(abs(steps)),'uint8');
                 cmd = [...
                     arduinoio.BinaryToASCII(steps); ...
@@ -268,6 +490,64 @@ classdef stepper < arduinoio.MotorBase & matlab.mixin.CustomDisplay
             end
         end
         
+        function queueMove(obj, steps, rate, acceleration, group)
+            % group 0 starts the move right away
+            commandID = obj.QUEUE_STEPPER_MOVE;
+            if steps >= 0
+                direction = 1;
+            else
+                direction = 2;
+            end
+            rate = typecast(uint16(max(1, min(2^16-1, round(rate)))), 'uint8');
+            acceleration = typecast(uint16(min(2^16-1, ceil(acceleration))), 'uint8');
+            cmd = [...
+                arduinoio.BinaryToASCII(typecast(uint16(abs(steps)), 'uint8')); ...
+                direction; ...
+                getStepType(obj); ...
+                arduinoio.BinaryToASCII(rate); ...
+                arduinoio.BinaryToASCII(acceleration); ...
+                group; ...
+                obj.STEPPER_EMIT_EVENT];
+            subscribeLibraryEvents(obj.Parent.Parent, obj.STEPPER_EVENT);
+            output = sendCommand(obj, commandID, cmd);
+            if output(4) == 0
+                obj.localizedError('MATLAB:arduinoio:general:maxStepperMoves');
+            end
+        end
+        
+        function [status, position] = readStatus(obj)
+            output = sendCommand(obj, obj.READ_STEPPER_STATUS, []);
+            status = output(4);
+            position = toSteps(obj, typecast(uint8(output(8:-1:5)), 'int32'));
+        end
+        
+        function rate = getStepRate(obj)
+            % steps/s at RPM
+            rate = obj.RPM*obj.StepsPerRevolution/60;
+        end
+        
+        function steps = toSteps(obj, onesteps)
+            % the server counts microsteps of Microstep moves
+            steps = double(onesteps);
+            if strcmp(obj.StepType, 'Microstep')
+                steps = steps/obj.MICROSTEPS;
+            end
+        end
+        
+        function stepType = getStepType(obj)
+            switch obj.StepType
+                case 'Single'
+                    stepType = 1;
+                case 'Double'
+                    stepType = 2;
+                case 'Interleave'
+                    stepType = 3;
+                case 'Microstep'
+                    stepType = 4;
+                otherwise
+            end
+        end
+        
         function releaseStepper(obj)
             commandID = obj.RELEASE_STEPPER;
             try
@@ -313,6 +593,7 @@ classdef stepper < arduinoio.MotorBase & matlab.mixin.CustomDisplay
             fprintf('           MotorNumber: %-15d\n', obj.MotorNumber);
             fprintf('    StepsPerRevolution: %-15d\n', obj.StepsPerRevolution);
             fprintf('                   RPM: %-15d\n', obj.RPM);  
+            fprintf('          Acceleration: %-15d\n', obj.Acceleration);  
             fprintf('              StepType: %s (''Single'', ''Double'', ''Interleave'', ''Microstep'')\n', obj.StepType);
             fprintf('\n');
                   
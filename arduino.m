@@ -84,6 +84,7 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
         ResourceOwner
         ResourceMap
         SerialConnection
+        AnalogRules = [] % rule IDs whose events report analog counts
     end
     
     properties(Access = private, Constant = true)
@@ -289,6 +290,130 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
             end
         end
         
+        function writeDigitalPins(obj, pins, values)
+            %   Write values to several digital pins on Arduino hardware.
+            %
+            %   Syntax:
+            %   writeDigitalPins(a,pins,values)
+            %
+            %   Description:
+            %   Writes the specified values to the specified pins in order, using one
+            %   round trip to the Arduino hardware instead of one per pin.
+            %
+            %   Example:
+            %       a = arduino();
+            %       writeDigitalPins(a,[8 9],[1 0]);
+            %
+            %   Input Arguments:
+            %   a      - Arduino hardware
+            %   pins   - Digital pin numbers on the Arduino hardware (numeric vector)
+            %   values - Digital values (0, 1) or (true, false) to write to the pins (vector of the same length as pins).
+            %
+            %   See also writeDigitalPin, readDigitalPin
+            
+            try
+                if numel(pins) ~= numel(values)
+                    obj.localizedError('MATLAB:arduinoio:general:invalidPinsValuesLength');
+                end
+                for ii = 1:numel(pins)
+                    configureDigitalResource(obj, pins(ii), obj.ResourceOwner, 'Output', false);
+                    values(ii) = arduinoio.internal.validateDigitalParameter(values(ii));
+                end
+                writeDigitalPins(obj.Protocol, pins, values);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function value = writeDigitalPort(obj, port, value, mask)
+            %   Write the digital pins of a port on Arduino hardware at once.
+            %
+            %   Syntax:
+            %   writeDigitalPort(a,port,value)
+            %   writeDigitalPort(a,port,value,mask)
+            %   writeDigitalPort(a,port,operation,mask)
+            %   value = writeDigitalPort(...)
+            %
+            %   Description:
+            %   Writes the pins of the specified port, pins port*8 to port*8+7 of the Arduino
+            %   hardware, with one command. Bit n of value and mask belongs to pin port*8+n.
+            %   Only pins whose mask bit is set are changed; they are set to the bits of value,
+            %   or set, cleared or toggled by the operation 'set', 'clear' or 'toggle'.
+            %   Pins 0 and 1 carry the serial connection and are never changed.
+            %
+            %   Example:
+            %       a = arduino();
+            %       writeDigitalPort(a,1,'toggle',bin2dec('00100000'));
+            %
+            %   Input Arguments:
+            %   a         - Arduino hardware
+            %   port      - Port number on the Arduino hardware (numeric)
+            %   value     - Pin values, one per bit (numeric, 0 - 255)
+            %   operation - 'set', 'clear' or 'toggle' (string)
+            %   mask      - Pins to change, one per bit (numeric, 0 - 255, default 255).
+            %
+            %   Output Arguments:
+            %   value - Value of all pins of the port after the write (double)
+            %
+            %   See also readDigitalPort, writeDigitalPin, writeDigitalPins
+            
+            try
+                if nargin < 4
+                    mask = 255;
+                end
+                port = arduinoio.internal.validateIntParameterRanged('port', port, 0, 255);
+                mask = arduinoio.internal.validateIntParameterRanged('mask', mask, 0, 255);
+                if ischar(value)
+                    operation = validatestring(value, {'set', 'clear', 'toggle'});
+                    value = 0;
+                else
+                    operation = 'write';
+                    value = arduinoio.internal.validateIntParameterRanged('value', value, 0, 255);
+                end
+                for bit = find(bitget(mask, 1:8))
+                    pin = port*8 + bit - 1;
+                    if pin > 1
+                        configureDigitalResource(obj, pin, obj.ResourceOwner, 'Output', false);
+                    end
+                end
+                value = writeDigitalPort(obj.Protocol, port, operation, mask, value);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function value = readDigitalPort(obj, port)
+            %   Read the digital pins of a port on Arduino hardware at once.
+            %
+            %   Syntax:
+            %   value = readDigitalPort(a,port)
+            %
+            %   Description:
+            %   Reads the logical values of pins port*8 to port*8+7 of the Arduino hardware
+            %   with one command, without changing their configuration.
+            %
+            %   Example:
+            %       a = arduino();
+            %       value = readDigitalPort(a,0);
+            %       pin6 = bitget(value,7);
+            %
+            %   Input Arguments:
+            %   a    - Arduino hardware
+            %   port - Port number on the Arduino hardware (numeric)
+            %
+            %   Output Arguments:
+            %   value - Pin values, bit n belongs to pin port*8+n (double)
+            %
+            %   See also writeDigitalPort, readDigitalPin
+            
+            try
+                port = arduinoio.internal.validateIntParameterRanged('port', port, 0, 255);
+                value = readDigitalPort(obj.Protocol, port);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
         function value = readDigitalPin(obj, pin)
             %   Read digital pin value on Arduino hardware.
             %
@@ -405,6 +530,466 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
             end    
         end
         
+        function values = readVoltages(obj, pins, numSamples, mode)
+            %   Read oversampled analog pin values on Arduino hardware.
+            %
+            %   Syntax:
+            %   values = readVoltages(a,pins,numSamples)
+            %   values = readVoltages(a,pins,numSamples,mode)
+            %
+            %   Description:
+            %   Samples each of the specified pins numSamples times on the Arduino hardware
+            %   and returns one value per pin in a single exchange. mode is 'mean' (default),
+            %   'median' or 'minmax'.
+            %
+            %   Example:
+            %       a = arduino();
+            %       values = readVoltages(a,[0 1],16);
+            %       values = readVoltages(a,2,9,'median');
+            %
+            %   Input Arguments:
+            %   a          - Arduino hardware
+            %   pins       - Analog pin numbers on the Arduino hardware (numeric vector, 1 to 8 pins)
+            %   numSamples - Samples per pin (numeric, 1 to 32)
+            %   mode       - Reduction of the samples of a pin (character vector)
+            %
+            %   Output Arguments:
+            %   values - Voltage value per pin (double row vector), a row of minimums and a
+            %            row of maximums for 'minmax'
+            %
+            %   See also readVoltage
+            try
+                if nargin < 4
+                    mode = 'mean';
+                end
+                mode = validatestring(mode, {'mean', 'median', 'minmax'});
+                numSamples = arduinoio.internal.validateIntParameterRanged('number of samples', numSamples, 1, 32);
+                if isempty(pins) || numel(pins) > 8
+                    arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidScanConfiguration');
+                end
+                for ii = 1:numel(pins)
+                    configureAnalogPin(obj.ResourceManager, pins(ii), obj.ResourceOwner, 'Input', false);
+                end
+                values = readVoltages(obj.Protocol, pins, numSamples, mode, obj.Aref);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function subscribePinChange(obj, pin, debounceTime)
+            %   Get notified of changes of a digital pin on Arduino hardware.
+            %
+            %   Syntax:
+            %   subscribePinChange(a,pin)
+            %   subscribePinChange(a,pin,debounceTime)
+            %
+            %   Description:
+            %   Watches the specified pin on the Arduino hardware, which reports every new
+            %   state once it has been stable for the debounce time. Use readPinChanges to
+            %   retrieve the reported changes instead of polling with readDigitalPin.
+            %
+            %   Example:
+            %       a = arduino();
+            %       configureDigitalPin(a,6,'pullup');
+            %       subscribePinChange(a,6,0.02);
+            %
+            %   Input Arguments:
+            %   a            - Arduino hardware
+            %   pin          - Digital pin number on the Arduino hardware (numeric)
+            %   debounceTime - Time in seconds the pin must be stable before a change is reported (double, default 0.01).
+            %
+            %   See also readPinChanges, unsubscribePinChange, readDigitalPin
+            if nargin < 3
+                debounceTime = 0.01;
+            end
+            try
+                configureDigitalResource(obj, pin, obj.ResourceOwner, 'Input', false);
+                debounceTime = arduinoio.internal.validateDoubleParameterRanged('debounce time', debounceTime, 0, 60, 's');
+                subscribePinChange(obj.Protocol, pin, debounceTime);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function [pins, values, timestamps] = readPinChanges(obj)
+            %   Read the pin changes reported by Arduino hardware.
+            %
+            %   Syntax:
+            %   [pins,values] = readPinChanges(a)
+            %   [pins,values,timestamps] = readPinChanges(a)
+            %
+            %   Description:
+            %   Returns the changes of subscribed pins received since the last call, oldest
+            %   first, without waiting for further changes.
+            %
+            %   Example:
+            %       a = arduino();
+            %       subscribePinChange(a,6);
+            %       [pins,values] = readPinChanges(a);
+            %
+            %   Input Arguments:
+            %   a - Arduino hardware
+            %
+            %   Output Arguments:
+            %   pins       - Pin numbers that changed (double vector)
+            %   values     - New digital value of each pin (double vector)
+            %   timestamps - Time of the last edge of each change in seconds, taken from the Arduino hardware's micros() clock (double vector)
+            %
+            %   See also subscribePinChange, unsubscribePinChange
+            try
+                [pins, values, timestamps] = readPinChanges(obj.Protocol);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function unsubscribePinChange(obj, pin)
+            %   Stop notifications of changes of a digital pin on Arduino hardware.
+            %
+            %   Syntax:
+            %   unsubscribePinChange(a,pin)
+            %
+            %   Example:
+            %       a = arduino();
+            %       subscribePinChange(a,6);
+            %       unsubscribePinChange(a,6);
+            %
+            %   Input Arguments:
+            %   a   - Arduino hardware
+            %   pin - Digital pin number on the Arduino hardware (numeric)
+            %
+            %   See also subscribePinChange, readPinChanges
+            try
+                unsubscribePinChange(obj.Protocol, pin);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function startStreaming(obj, digitalPins, analogPins, samplePeriod)
+            %   Start continuous acquisition on Arduino hardware.
+            %
+            %   Syntax:
+            %   startStreaming(a,digitalPins,analogPins,samplePeriod)
+            %
+            %   Description:
+            %   Samples the specified pins from a hardware timer on the Arduino hardware at
+            %   a fixed period and sends the samples in frames until stopStreaming is called.
+            %   Use readStream to retrieve the samples received so far. While streaming,
+            %   playTone and PWM on the pins driven by the sample timer are unavailable.
+            %
+            %   Example:
+            %       a = arduino();
+            %       startStreaming(a,[2 3],0,0.001);
+            %
+            %   Input Arguments:
+            %   a            - Arduino hardware
+            %   digitalPins  - Digital pin numbers on the Arduino hardware (numeric vector, may be empty)
+            %   analogPins   - Analog pin numbers on the Arduino hardware (numeric vector, may be empty)
+            %   samplePeriod - Time between two samples in seconds (double).
+            %
+            %   See also readStream, stopStreaming
+            try
+                for ii = 1:numel(digitalPins)
+                    configureDigitalResource(obj, digitalPins(ii), obj.ResourceOwner, 'Input', false);
+                end
+                for ii = 1:numel(analogPins)
+                    configureAnalogPin(obj.ResourceManager, analogPins(ii), obj.ResourceOwner, 'Input', false);
+                end
+                samplePeriod = arduinoio.internal.validateDoubleParameterRanged('sample period', samplePeriod, 1e-4, 4, 's');
+                startStreaming(obj.Protocol, digitalPins, analogPins, samplePeriod);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function [digitalValues, voltages, numOverruns] = readStream(obj)
+            %   Read samples acquired by continuous acquisition.
+            %
+            %   Syntax:
+            %   [digitalValues,voltages] = readStream(a)
+            %   [digitalValues,voltages,numOverruns] = readStream(a)
+            %
+            %   Description:
+            %   Returns the samples received from the Arduino hardware since the last call,
+            %   one row per sample and one column per pin in the order given to startStreaming.
+            %
+            %   Example:
+            %       a = arduino();
+            %       startStreaming(a,[],[0 1],0.001);
+            %       pause(1);
+            %       [~,voltages] = readStream(a);
+            %
+            %   Input Arguments:
+            %   a - Arduino hardware
+            %
+            %   Output Arguments:
+            %   digitalValues - Values of the digital pins (double matrix)
+            %   voltages      - Voltages of the analog pins (double matrix)
+            %   numOverruns   - Samples dropped by the Arduino hardware because its buffer was full (double)
+            %
+            %   See also startStreaming, stopStreaming
+            try
+                [digitalValues, voltages, numOverruns] = readStream(obj.Protocol, obj.Aref);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function stopStreaming(obj)
+            %   Stop continuous acquisition on Arduino hardware.
+            %
+            %   Syntax:
+            %   stopStreaming(a)
+            %
+            %   Description:
+            %   Stops sampling. Samples already received can still be retrieved with readStream.
+            %
+            %   Example:
+            %       a = arduino();
+            %       startStreaming(a,2,[],0.01);
+            %       stopStreaming(a);
+            %
+            %   Input Arguments:
+            %   a - Arduino hardware
+            %
+            %   See also startStreaming, readStream
+            try
+                stopStreaming(obj.Protocol);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function loadScript(obj, slot, steps)
+            %   Load a timed action script into Arduino hardware.
+            %
+            %   Syntax:
+            %   loadScript(a,slot,steps)
+            %
+            %   Description:
+            %   Stores a sequence of pin writes, servo positions and pauses in a script slot
+            %   of the Arduino hardware. runScript plays it back on the Arduino hardware with
+            %   microsecond timing while other commands keep being served. Each step is a
+            %   cell array:
+            %       {'writeDigitalPin', pin, value}
+            %       {'writePWMDutyCycle', pin, dutyCycle}
+            %       {'writePWMVoltage', pin, voltage}
+            %       {'writePosition', servo, position}
+            %       {'pause', seconds}
+            %       {'loop', firstStep, count} - repeat the steps from firstStep count more
+            %                                    times, or forever if count is 0; loops do not nest
+            %
+            %   Example:
+            %       a = arduino();
+            %       loadScript(a,0,{{'writeDigitalPin',8,1},{'pause',3},{'writeDigitalPin',8,0}});
+            %       runScript(a,0);
+            %
+            %   Input Arguments:
+            %   a     - Arduino hardware
+            %   slot  - Script slot on the Arduino hardware (numeric, from 0)
+            %   steps - Script steps (cell array of cell arrays)
+            %
+            %   See also runScript, stopScript
+            try
+                slot = arduinoio.internal.validateIntParameterRanged('slot', slot, 0, 127);
+                if ~iscell(steps)
+                    arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidScriptStep', '1');
+                end
+                for ii = 1:numel(steps)
+                    steps{ii} = validateScriptStep(obj, steps{ii}, ii);
+                end
+                loadScript(obj.Protocol, slot, steps);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function runScript(obj, slot)
+            %   Run a timed action script on Arduino hardware.
+            %
+            %   Syntax:
+            %   runScript(a,slot)
+            %
+            %   Description:
+            %   Starts the script loaded into the slot with loadScript and returns
+            %   immediately. A running script restarts from its first step.
+            %
+            %   Example:
+            %       a = arduino();
+            %       loadScript(a,0,{{'writeDigitalPin',8,1},{'pause',3},{'writeDigitalPin',8,0}});
+            %       runScript(a,0);
+            %
+            %   Input Arguments:
+            %   a    - Arduino hardware
+            %   slot - Script slot on the Arduino hardware (numeric)
+            %
+            %   See also loadScript, stopScript
+            try
+                slot = arduinoio.internal.validateIntParameterRanged('slot', slot, 0, 127);
+                runScript(obj.Protocol, slot);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function stopScript(obj, slot)
+            %   Stop a timed action script on Arduino hardware.
+            %
+            %   Syntax:
+            %   stopScript(a)
+            %   stopScript(a,slot)
+            %
+            %   Description:
+            %   Stops the script in the slot, or all scripts if no slot is given. Pins keep
+            %   the values the script wrote last.
+            %
+            %   Example:
+            %       a = arduino();
+            %       stopScript(a,0);
+            %
+            %   Input Arguments:
+            %   a    - Arduino hardware
+            %   slot - Script slot on the Arduino hardware (numeric)
+            %
+            %   See also loadScript, runScript
+            try
+                if nargin < 2
+                    slot = 127; % out of range, stops all slots
+                end
+                slot = arduinoio.internal.validateIntParameterRanged('slot', slot, 0, 127);
+                stopScript(obj.Protocol, slot);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function setRule(obj, ruleID, condition, action, varargin)
+            %   Set a rule that Arduino hardware evaluates on its own.
+            %
+            %   Syntax:
+            %   setRule(a,ruleID,condition,action)
+            %   setRule(a,ruleID,condition,action,Name,Value)
+            %
+            %   Description:
+            %   The Arduino hardware checks the condition on every pass of its main loop and
+            %   performs the action when it is met, without waiting for the host. Conditions:
+            %       {'pinEdge', pin, edge, debounceTime} - edge is 'rising', 'falling' or 'both'
+            %       {'analogAbove', pin, voltage, hysteresis}
+            %       {'analogBelow', pin, voltage, hysteresis}
+            %       {'hostTimeout', timeout} - no command from the host for timeout seconds
+            %   Actions:
+            %       {}, {'writeDigitalPin', pin, value}, {'writePosition', servo, position},
+            %       {'runScript', slot}, {'stopScript', slot}
+            %   An analog rule fires again only once the voltage is back by the hysteresis.
+            %   Setting a rule ID again replaces the rule.
+            %
+            %   Example:
+            %       a = arduino();
+            %       setRule(a,0,{'pinEdge',6,'rising',0.01},{'runScript',0});
+            %
+            %   Example:
+            %       a = arduino();
+            %       setRule(a,1,{'hostTimeout',2},{'writeDigitalPin',8,0},'EmitEvent',true);
+            %
+            %   Input Arguments:
+            %   a         - Arduino hardware
+            %   ruleID    - Rule number on the Arduino hardware (numeric, from 0)
+            %   condition - Condition of the rule (cell array)
+            %   action    - Action of the rule (cell array)
+            %
+            %   Name-Value Pair Input Arguments:
+            %   'EmitEvent' - Report every time the rule fires, see readRuleEvents (logical, default false)
+            %   'OneShot'   - Disable the rule after it fired once (logical, default false)
+            %
+            %   See also readRuleEvents, clearRule, loadScript
+            try
+                p = inputParser;
+                addParameter(p, 'EmitEvent', false);
+                addParameter(p, 'OneShot', false);
+                parse(p, varargin{:});
+                ruleID = arduinoio.internal.validateIntParameterRanged('rule ID', ruleID, 0, 126);
+                condition = validateRuleCondition(obj, condition);
+                action = validateRuleAction(obj, action);
+                setRule(obj.Protocol, ruleID, condition, action, logical(p.Results.EmitEvent), logical(p.Results.OneShot));
+                if any(strcmp(condition{1}, {'analogAbove', 'analogBelow'}))
+                    obj.AnalogRules = union(obj.AnalogRules, ruleID);
+                else
+                    obj.AnalogRules = setdiff(obj.AnalogRules, ruleID);
+                end
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function [ruleIDs, values, timestamps] = readRuleEvents(obj)
+            %   Read the rule events reported by Arduino hardware.
+            %
+            %   Syntax:
+            %   ruleIDs = readRuleEvents(a)
+            %   [ruleIDs,values,timestamps] = readRuleEvents(a)
+            %
+            %   Description:
+            %   Returns the firings of rules set with 'EmitEvent' received since the last
+            %   call, oldest first, without waiting for further events.
+            %
+            %   Example:
+            %       a = arduino();
+            %       setRule(a,0,{'pinEdge',6,'rising',0.01},{},'EmitEvent',true);
+            %       ruleIDs = readRuleEvents(a);
+            %
+            %   Input Arguments:
+            %   a - Arduino hardware
+            %
+            %   Output Arguments:
+            %   ruleIDs    - Rules that fired (double vector)
+            %   values     - Pin value or analog voltage that made each rule fire (double vector)
+            %   timestamps - Time each rule fired in seconds, taken from the Arduino hardware's micros() clock (double vector)
+            %
+            %   See also setRule, clearRule
+            try
+                [ruleIDs, values, timestamps] = readRuleEvents(obj.Protocol);
+                isAnalog = ismember(ruleIDs, obj.AnalogRules);
+                values(isAnalog) = values(isAnalog)/1024*obj.Aref;
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function clearRule(obj, ruleID)
+            %   Clear a rule on Arduino hardware.
+            %
+            %   Syntax:
+            %   clearRule(a)
+            %   clearRule(a,ruleID)
+            %
+            %   Description:
+            %   Removes the rule, or all rules if no rule ID is given.
+            %
+            %   Example:
+            %       a = arduino();
+            %       clearRule(a,0);
+            %
+            %   Input Arguments:
+            %   a      - Arduino hardware
+            %   ruleID - Rule number on the Arduino hardware (numeric)
+            %
+            %   See also setRule, readRuleEvents
+            try
+                if nargin < 2
+                    ruleID = 127; % out of range, clears all rules
+                end
+                ruleID = arduinoio.internal.validateIntParameterRanged('rule ID', ruleID, 0, 127);
+                clearRule(obj.Protocol, ruleID);
+                obj.AnalogRules = setdiff(obj.AnalogRules, ruleID);
+                if ruleID == 127
+                    obj.AnalogRules = [];
+                end
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
         function playTone(obj, pin, varargin)
             %   Play a tone on piezo speaker
             %
@@ -654,14 +1239,16 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
             end
         end
         
-        function addrs = scanI2CBus(obj, bus)
+        function addrs = scanI2CBus(obj, bus, varargin)
             %   Scan Arduino I2C bus for connected I2C devices and return the device addresses.
             %
             %   Syntax:
             %   addrs = scanI2CBus(a,bus);
+            %   addrs = scanI2CBus(a,bus,'UseCache',true);
             %
             %   Description: 
             %   Scans the specified Arduino hardware I2C bus for conected I2C devices, and returns a cell array of the I2C device addresses in hex. 
+            %   With 'UseCache' the addresses known from the last scan and from the I2C traffic since are returned without probing the bus again.
             %
             %   Example:
             %   TMP102 I2C device connected on I2C bus 0.
@@ -672,87 +1259,189 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
             %   a   - Arduino
             %   bus - I2C bus number (numeric, default 0)
             %
+            %   Name-Value Pair Input Arguments:
+            %   'UseCache' - Return the cached device map of the bus (logical, default false)
+            %
             %   Output Arguments:
             %   addrs - I2C bus addresses in hex (cell array of strings)
             %
-            %   See also i2cdev
+            %   See also i2cdev, configureI2CBus
             
             if nargin < 2
                 bus = 0;
             end
             
             try
-                terminals = obj.getI2CTerminals();
-                
-                if strcmp(obj.Board, 'Due')
-                    buses = 0:1;
-                else
-                    buses = 0:floor(numel(terminals)/2)-1;
+                p = inputParser;
+                addParameter(p, 'UseCache', false);
+                parse(p, varargin{:});
+                bus = reserveI2CBus(obj, bus);
+                libID = getLibraryID(obj, 'I2C');
+                addrs = scanI2CBus(obj.Protocol, libID, bus, logical(p.Results.UseCache));
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function busSpeed = configureI2CBus(obj, bus, busSpeed)
+            %   Set the clock speed of an Arduino I2C bus.
+            %
+            %   Syntax:
+            %   busSpeed = configureI2CBus(a,bus,busSpeed);
+            %
+            %   Description: 
+            %   Sets the clock of the specified Arduino hardware I2C bus and returns the clock the board actually runs,
+            %   which is lower than requested when the board cannot reach it. The clock is kept when the bus is restarted.
+            %
+            %   Example:
+            %   Run I2C bus 0 in fast mode.
+            %       a = arduino('com9');
+            %       busSpeed = configureI2CBus(a,0,400000);
+            %
+            %   Input Arguments:
+            %   a        - Arduino
+            %   bus      - I2C bus number (numeric)
+            %   busSpeed - I2C bus clock in Hz (100000, 400000 or 1000000)
+            %
+            %   Output Arguments:
+            %   busSpeed - Actual I2C bus clock in Hz (numeric)
+            %
+            %   See also scanI2CBus, i2cdev
+            
+            try
+                if ~isnumeric(busSpeed) || ~isscalar(busSpeed) || ~ismember(busSpeed, [100000 400000 1000000])
+                    obj.localizedError('MATLAB:arduinoio:general:invalidI2CBusSpeed', '100000, 400000, 1000000');
                 end
-                
-                try
-                    bus = arduinoio.internal.validateIntParameterRanged('I2C Bus', bus, 0, buses(end));
-                catch
-                    buses = sprintf('%d, ', buses);
-                    buses = buses(1:end-2);
-                    obj.localizedError('MATLAB:arduinoio:general:invalidBoardBusNumber',...
-                        obj.Board, buses);
+                bus = reserveI2CBus(obj, bus);
+                libID = getLibraryID(obj, 'I2C');
+                busSpeed = configureI2CBus(obj.Protocol, libID, bus, busSpeed);
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function report = memoryReport(obj)
+            %   Report the memory use of the Arduino server.
+            %
+            %   Syntax:
+            %   report = memoryReport(a);
+            %
+            %   Description: 
+            %   Returns the free RAM, the deepest the stack has reached since the board started, the heap
+            %   size and fragmentation, and the RAM taken by each library. Values the board cannot measure
+            %   are NaN; the stack and heap values are available on AVR boards, e.g. Uno and Mega.
+            %
+            %   Example:
+            %   Check the stack headroom left after a test run.
+            %       a = arduino('com9', 'Uno', 'Libraries', {'I2C', 'Servo'});
+            %       report = memoryReport(a);
+            %       report.StackHeadroom
+            %
+            %   Input Arguments:
+            %   a        - Arduino
+            %
+            %   Output Arguments:
+            %   report   - Structure with fields FreeRAM, MaxStackDepth, StackHeadroom, HeapSize,
+            %              HeapFreeBytes, HeapFreeBlocks, LargestFreeBlock (bytes) and Libraries, a
+            %              structure array with the Name, StaticBytes and DynamicBytes of each library.
+            %              StaticBytes is the RAM the library reserves, DynamicBytes the part of it
+            %              held by the devices created now.
+            
+            try
+                value = getMemoryReport(obj.Protocol);
+                report = rmfield(value, {'LibraryStaticBytes', 'LibraryDynamicBytes'});
+                libraries = struct('Name', {}, 'StaticBytes', {}, 'DynamicBytes', {});
+                for ii = 1:numel(value.LibraryStaticBytes)
+                    name = obj.Libraries(obj.LibraryIDs == ii-1);
+                    if isempty(name)
+                        name = {''};
+                    end
+                    libraries(ii).Name = name{1};
+                    libraries(ii).StaticBytes = value.LibraryStaticBytes(ii);
+                    libraries(ii).DynamicBytes = value.LibraryDynamicBytes(ii);
                 end
-
-                % Configure I2C pins
-                if (floor(numel(terminals)-1)/2) >= bus
-                    isAnalog = obj.IsAnalogTerminal(terminals(bus*2+1));
-                    if isAnalog
-                        pins = obj.getAnalogPinsFromTerminals(terminals);
-                        sda = pins(bus*2+1);
-                        scl = pins(bus*2+2);
-
-                        sdaConfig = obj.configureAnalogResource(sda);
-                        if ~(strcmp(sdaConfig, 'Unset') || strcmp(sdaConfig, 'I2C'))
-                            obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
-                                obj.Board, 'analog', ['A' num2str(sda)], ['A' num2str(scl)], ...
-                                num2str(sda), sdaConfig, 'configureAnalogPin');
-                        end
-
-                        sclConfig = obj.configureAnalogResource(scl);
-                        if ~(strcmp(sclConfig, 'Unset') || strcmp(sclConfig, 'I2C'))
-                            obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
-                                obj.Board, 'analog', ['A' num2str(sda)], ['A' num2str(scl)], ...
-                                num2str(scl), sclConfig, 'configureAnalogPin');
-                        end
-
-                        % If all validations have passed, reserve the sda/scl pins
-                        % for I2C
-                        configureAnalogPin(obj.ResourceManager, sda, 'I2C', 'I2C', true);
-                        configureAnalogPin(obj.ResourceManager, scl, 'I2C', 'I2C', true);
-                    else
-                        pins = obj.getDigitalPinsFromTerminals(terminals);
-                        sda = pins(bus*2+1);
-                        scl = pins(bus*2+2);
-
-                        sdaConfig = obj.configureDigitalResource(sda);
-                        if ~(strcmp(sdaConfig, 'Unset') || strcmp(sdaConfig, 'I2C'))
-                            obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
-                                obj.Board, 'digital', ['D' num2str(sda)], ['D' num2str(scl)], ...
-                                num2str(sda), sdaConfig, 'configureDigitalPin');
-                        end
-
-                        sclConfig = obj.configureDigitalResource(scl);
-                        if ~(strcmp(sclConfig, 'Unset') || strcmp(sclConfig, 'I2C'))
-                            obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
-                                obj.Board, 'digital', ['D' num2str(sda)], ['D' num2str(scl)], ...
-                                num2str(scl), sclConfig, 'configureDigitalPin');
-                        end
-
-                        % If all validations have passed, reserve the sda/scl pins
-                        % for I2C
-                        configureDigitalPin(obj.ResourceManager, sda, 'I2C', 'I2C', true);
-                        configureDigitalPin(obj.ResourceManager, scl, 'I2C', 'I2C', true);
+                report.Libraries = libraries;
+            catch e
+                throwAsCaller(e);
+            end
+        end
+        
+        function stats = serverStats(obj, varargin)
+            %   Report command latencies and main loop statistics of the Arduino server.
+            %
+            %   Syntax:
+            %   stats = serverStats(a);
+            %   stats = serverStats(a,'Reset',true);
+            %
+            %   Description: 
+            %   Returns the statistics the server collects since it started or since the last reset:
+            %   a latency histogram of the handler time of each command, the main loop rate and its
+            %   longest pass, and the peak occupancy of the serial receive and response buffers.
+            %   Comparing handler times with the round trip time on the host tells whether a slow
+            %   response is spent on the board or on the serial link.
+            %
+            %   Example:
+            %   Find the slowest commands of a test run.
+            %       a = arduino('com9', 'Uno', 'Libraries', 'I2C');
+            %       serverStats(a,'Reset',true);
+            %       % ... run the test ...
+            %       stats = serverStats(a);
+            %       [~, order] = sort([stats.Commands.MaxTime], 'descend');
+            %       stats.Commands(order)
+            %
+            %   Input Arguments:
+            %   a        - Arduino
+            %
+            %   Name-Value Pair Input Arguments:
+            %   Reset    - Start over once the statistics are read (logical, default false)
+            %
+            %   Output Arguments:
+            %   stats    - Structure with fields ElapsedTime (s), LoopRate (passes/s), MaxLoopTime (s),
+            %              RXPeak and TXPeak (bytes), TXStalls (bytes that waited for the UART),
+            %              UnrecordedCommands (commands without a free histogram), BucketEdges (s) and
+            %              Commands, a structure array with the Library ('' for base commands),
+            %              CommandID, Count, MeanTime, MaxTime (s) and Histogram (counts per bucket)
+            %              of each command.
+            
+            try
+                p = inputParser;
+                addParameter(p, 'Reset', false);
+                parse(p, varargin{:});
+            catch
+                obj.localizedError('MATLAB:arduinoio:general:invalidNVPropertyName',...
+                    'serverStats', 'Reset');
+            end
+            
+            try
+                value = getStats(obj.Protocol, logical(p.Results.Reset));
+                stats.ElapsedTime = value.ElapsedMillis / 1e3;
+                stats.LoopRate = value.NumLoops / max(stats.ElapsedTime, 1e-3);
+                stats.MaxLoopTime = value.MaxLoopMicros / 1e6;
+                stats.RXPeak = value.RXPeak;
+                stats.TXPeak = value.TXPeak;
+                stats.TXStalls = value.TXStalls;
+                stats.UnrecordedCommands = value.UnrecordedCommands;
+                numBuckets = 8;
+                if ~isempty(value.Commands)
+                    numBuckets = numel(value.Commands(1).Buckets);
+                end
+                % bucket k below 16*4^k microseconds, the last one unbounded
+                stats.BucketEdges = [0, 16 * 4.^(0:numBuckets-2), Inf] / 1e6;
+                commands = struct('Library', {}, 'CommandID', {}, 'Count', {}, 'MeanTime', {}, 'MaxTime', {}, 'Histogram', {});
+                for ii = 1:numel(value.Commands)
+                    slot = value.Commands(ii);
+                    name = obj.Libraries(obj.LibraryIDs == slot.LibID);
+                    if slot.LibID == 255 || isempty(name)
+                        name = {''};
                     end
+                    commands(ii).Library = name{1};
+                    commands(ii).CommandID = slot.CmdID;
+                    commands(ii).Count = sum(slot.Buckets);
+                    commands(ii).MeanTime = slot.TotalMicros / max(commands(ii).Count, 1) / 1e6;
+                    commands(ii).MaxTime = slot.MaxMicros / 1e6;
+                    commands(ii).Histogram = slot.Buckets;
                 end
-                
-                libID = getLibraryID(obj, 'I2C');
-                addrs = scanI2CBus(obj.Protocol, libID, bus);
+                stats.Commands = commands;
             catch e
                 throwAsCaller(e);
             end
@@ -761,6 +1450,78 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
     
     %% Private methods
     methods(Access = private)    
+        function bus = reserveI2CBus(obj, bus)
+        % Validate the I2C bus number and reserve its SDA and SCL pins
+            terminals = obj.getI2CTerminals();
+            
+            if strcmp(obj.Board, 'Due')
+                buses = 0:1;
+            else
+                buses = 0:floor(numel(terminals)/2)-1;
+            end
+            
+            try
+                bus = arduinoio.internal.validateIntParameterRanged('I2C Bus', bus, 0, buses(end));
+            catch
+                buses = sprintf('%d, ', buses);
+                buses = buses(1:end-2);
+                obj.localizedError('MATLAB:arduinoio:general:invalidBoardBusNumber',...
+                    obj.Board, buses);
+            end
+
+            % Configure I2C pins
+            if (floor(numel(terminals)-1)/2) >= bus
+                isAnalog = obj.IsAnalogTerminal(terminals(bus*2+1));
+                if isAnalog
+                    pins = obj.getAnalogPinsFromTerminals(terminals);
+                    sda = pins(bus*2+1);
+                    scl = pins(bus*2+2);
+
+                    sdaConfig = obj.configureAnalogResource(sda);
+                    if ~(strcmp(sdaConfig, 'Unset') || strcmp(sdaConfig, 'I2C'))
+                        obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
+                            obj.Board, 'analog', ['A' num2str(sda)], ['A' num2str(scl)], ...
+                            num2str(sda), sdaConfig, 'configureAnalogPin');
+                    end
+
+                    sclConfig = obj.configureAnalogResource(scl);
+                    if ~(strcmp(sclConfig, 'Unset') || strcmp(sclConfig, 'I2C'))
+                        obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
+                            obj.Board, 'analog', ['A' num2str(sda)], ['A' num2str(scl)], ...
+                            num2str(scl), sclConfig, 'configureAnalogPin');
+                    end
+
+                    % If all validations have passed, reserve the sda/scl pins
+                    % for I2C
+                    configureAnalogPin(obj.ResourceManager, sda, 'I2C', 'I2C', true);
+                    configureAnalogPin(obj.ResourceManager, scl, 'I2C', 'I2C', true);
+                else
+                    pins = obj.getDigitalPinsFromTerminals(terminals);
+                    sda = pins(bus*2+1);
+                    scl = pins(bus*2+2);
+
+                    sdaConfig = obj.configureDigitalResource(sda);
+                    if ~(strcmp(sdaConfig, 'Unset') || strcmp(sdaConfig, 'I2C'))
+                        obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
+                            obj.Board, 'digital', ['D' num2str(sda)], ['D' num2str(scl)], ...
+                            num2str(sda), sdaConfig, 'configureDigitalPin');
+                    end
+
+                    sclConfig = obj.configureDigitalResource(scl);
+                    if ~(strcmp(sclConfig, 'Unset') || strcmp(sclConfig, 'I2C'))
+                        obj.localizedError('MATLAB:arduinoio:general:reservedI2CPins', ...
+                            obj.Board, 'digital', ['D' num2str(sda)], ['D' num2str(scl)], ...
+                            num2str(scl), sclConfig, 'configureDigitalPin');
+                    end
+
+                    % If all validations have passed, reserve the sda/scl pins
+                    % for I2C
+                    configureDigitalPin(obj.ResourceManager, sda, 'I2C', 'I2C', true);
+                    configureDigitalPin(obj.ResourceManager, scl, 'I2C', 'I2C', true);
+                end
+            end
+        end
+        
         function output = parseInputs(obj, inputs)
         % Parse validate given inputs
             output = struct('Port', '', 'Board', '', 'Libraries', {{''}}, 'TraceOn', false, 'ForceBuildOn', false);
@@ -951,6 +1712,94 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
                 obj.LibraryIDs(whichLib) = libIDs(not(cellfun('isempty', IndexC)));
             end
         end
+        
+        function step = validateScriptStep(obj, step, index)
+            % Check a loadScript step, reserve its pins and convert it to the form
+            % expected by Protocol.loadScript
+            if ~iscell(step) || isempty(step) || ~ischar(step{1})
+                arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidScriptStep', num2str(index));
+            end
+            numArgs = struct('writeDigitalPin', 2, 'writePWMDutyCycle', 2, 'writePWMVoltage', 2, ...
+                'writePosition', 2, 'pause', 1, 'loop', 2);
+            if ~isfield(numArgs, step{1}) || numel(step) ~= numArgs.(step{1}) + 1
+                arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidScriptStep', num2str(index));
+            end
+            switch step{1}
+                case 'writeDigitalPin'
+                    configureDigitalResource(obj, step{2}, obj.ResourceOwner, 'Output', false);
+                    step = {'writeDigitalPin', step{2}, arduinoio.internal.validateDigitalParameter(step{3})};
+                case 'writePWMDutyCycle'
+                    configureDigitalPin(obj.ResourceManager, step{2}, obj.ResourceOwner, 'PWM', false);
+                    dutyCycle = arduinoio.internal.validateDoubleParameterRanged('PWM duty cycle', step{3}, 0, 1);
+                    step = {'writePWM', step{2}, floor(dutyCycle*255)};
+                case 'writePWMVoltage'
+                    configureDigitalPin(obj.ResourceManager, step{2}, obj.ResourceOwner, 'PWM', false);
+                    voltage = arduinoio.internal.validateDoubleParameterRanged('PWM voltage', step{3}, 0, obj.Aref, 'V');
+                    step = {'writePWM', step{2}, floor(voltage/obj.Aref*255)};
+                case 'writePosition'
+                    if ~isa(step{2}, 'arduinoio.ServoMotorBase')
+                        arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidScriptStep', num2str(index));
+                    end
+                    [libName, cmd] = getWritePositionCommand(step{2}, step{3});
+                    step = {'command', 1, [getLibraryID(obj, libName); cmd]};
+                case 'pause'
+                    step = {'pause', arduinoio.internal.validateDoubleParameterRanged('pause', step{2}, 0, 600, 's')};
+                case 'loop'
+                    firstStep = arduinoio.internal.validateIntParameterRanged('first step', step{2}, 1, index);
+                    count = arduinoio.internal.validateIntParameterRanged('loop count', step{3}, 0, 255);
+                    step = {'loop', firstStep, count};
+            end
+        end
+        
+        function condition = validateRuleCondition(obj, condition)
+            % Check a setRule condition and convert it to {name, pin, option, argument}
+            numArgs = struct('pinEdge', 3, 'analogAbove', 3, 'analogBelow', 3, 'hostTimeout', 1);
+            if ~iscell(condition) || isempty(condition) || ~ischar(condition{1}) || ...
+                    ~isfield(numArgs, condition{1}) || numel(condition) ~= numArgs.(condition{1}) + 1
+                arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidRuleCondition');
+            end
+            switch condition{1}
+                case 'pinEdge'
+                    configureDigitalResource(obj, condition{2}, obj.ResourceOwner, 'Input', false);
+                    edge = find(strcmp(validatestring(condition{3}, {'rising', 'falling', 'both'}), {'rising', 'falling', 'both'}));
+                    debounce = arduinoio.internal.validateDoubleParameterRanged('debounce time', condition{4}, 0, 0.065, 's');
+                    condition = {'pinEdge', condition{2}, edge, round(debounce*1e6)};
+                case {'analogAbove', 'analogBelow'}
+                    configureAnalogPin(obj.ResourceManager, condition{2}, obj.ResourceOwner, 'Input', false);
+                    voltage = arduinoio.internal.validateDoubleParameterRanged('threshold', condition{3}, 0, obj.Aref, 'V');
+                    hysteresis = arduinoio.internal.validateDoubleParameterRanged('hysteresis', condition{4}, 0, obj.Aref/4, 'V');
+                    condition = {condition{1}, condition{2}, min(round(hysteresis/obj.Aref*1024), 255), ...
+                        min(round(voltage/obj.Aref*1024), 1023)};
+                case 'hostTimeout'
+                    timeout = arduinoio.internal.validateDoubleParameterRanged('timeout', condition{2}, 0.001, 65, 's');
+                    condition = {'hostTimeout', 0, 0, round(timeout*1000)};
+            end
+        end
+        
+        function action = validateRuleAction(obj, action)
+            % Check a setRule action and convert it to the form expected by Protocol.setRule
+            if isempty(action)
+                action = {};
+                return;
+            end
+            numArgs = struct('writeDigitalPin', 2, 'writePosition', 2, 'runScript', 1, 'stopScript', 1);
+            if ~iscell(action) || ~ischar(action{1}) || ~isfield(numArgs, action{1}) || numel(action) ~= numArgs.(action{1}) + 1
+                arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidRuleAction');
+            end
+            switch action{1}
+                case 'writeDigitalPin'
+                    configureDigitalResource(obj, action{2}, obj.ResourceOwner, 'Output', false);
+                    action = {'writeDigitalPin', action{2}, arduinoio.internal.validateDigitalParameter(action{3})};
+                case 'writePosition'
+                    if ~isa(action{2}, 'arduinoio.ServoMotorBase')
+                        arduinoio.internal.localizedError('MATLAB:arduinoio:general:invalidRuleAction');
+                    end
+                    [libName, cmd] = getWritePositionCommand(action{2}, action{3});
+                    action = {'command', 1, [getLibraryID(obj, libName); cmd]};
+                case {'runScript', 'stopScript'}
+                    action = {action{1}, arduinoio.internal.validateIntParameterRanged('slot', action{2}, 0, 127)};
+            end
+        end
     end
        
     %% Public methods for arduino libraries implementing LibraryBase
@@ -970,6 +1819,14 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
             count = getAvailableRAM(obj.Protocol);
         end
         
+        function output = encodePayload(obj, data)
+            output = encodePayload(obj.Protocol, data);
+        end
+        
+        function count = getMaxDataSize(obj)
+            count = getMaxDataSize(obj.Protocol, obj.getMCU());
+        end
+        
         function value =  sendCustomMessage(obj, libName, cmd, timeout)
             libID = getLibraryID(obj, libName);
             if nargin < 4
@@ -979,6 +1836,19 @@ classdef (Sealed) arduino < arduinoio.internal.BaseClass & matlab.mixin.CustomDi
             end
         end
         
+        % Unsolicited event messages of a library, each a uint8 payload
+        function subscribeLibraryEvents(obj, eventID)
+            subscribeLibraryEvents(obj.Protocol, eventID);
+        end
+        
+        function events = readLibraryEvents(obj, eventID)
+            events = readLibraryEvents(obj.Protocol, eventID);
+        end
+        
+        function unsubscribeLibraryEvents(obj, eventID)
+            unsubscribeLibraryEvents(obj.Protocol, eventID);
+        end
+        
         function result = getMCU(obj)
             result = obj.ResourceManager.MCU;
         end
@@ -10,23 +10,20 @@ object
 if object == 1
     
     %%open the dustbin for metal cans
-    writeDigitalPin(a, 8, 1);
-    writeDigitalPin(a, 9, 0);
+    writeDigitalPins(a, [8 9], [1 0]);
     pause(3);
     returnError = 1
     
 elseif object == 2
     
     %%open the dustbin for metal cans
-    writeDigitalPin(a, 8, 0);
-    writeDigitalPin(a, 9, 1);
+    writeDigitalPins(a, [8 9], [0 1]);
     pause(3);
     returnError = 2  
     
 elseif object == 0
     %%open the dustbin for smetal cans
-    writeDigitalPin(a, 8, 1);
-    writeDigitalPin(a, 9, 1);
+    writeDigitalPins(a, [8 9], [1 1]);
     pause(3);
     returnError = 0;
 else
@@ -38,8 +35,7 @@ else
 end
 %pause(3);
 
-writeDigitalPin(a, 8, 0);
-writeDigitalPin(a, 9, 0);
+writeDigitalPins(a, [8 9], [0 0]);
 
 end
 
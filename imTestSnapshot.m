@@ -6,9 +6,9 @@ numberOfTest = 0;
 
 
 %while(numberOfTest == 0)
-    SensorState = readDigitalPin(a,6);
+    [pins, values] = readPinChanges(a); % pin 6 is subscribed in main
     
-    if SensorState == 0
+    if any(pins == 6 & values == 0)
         pause(1);
         imwrite(getsnapshot(obj), strcat('imTest.jpg'));
         [  object , similarity ] = imKNN();
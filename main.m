@@ -12,6 +12,7 @@ set(obj, 'TriggerRepeat', Inf);
 %%start(obj);
 a = arduino('com3','Uno');
 configureDigitalPin(a,6,'pullup');
+subscribePinChange(a,6,0.02); % the IR presence sensor reports changes itself
 writeDigitalPin(a, 9, 0);
 writeDigitalPin(a, 10, 0);
 
@@ -6,12 +6,46 @@
 #ifndef LibraryBase_h
 #define LibraryBase_h
 
+#define RESPONSE_SIZE_VARIABLE 0xFF
+
+// Command dispatch table entry, tables are stored in flash and indexed by cmdID
+// numParams counts the parameter bytes after the cmdID, numData the bytes of a trailing
+// data array of fixed size (7-bit encoded unless binary framed). Commands with variable
+// length data check the remaining bytes themselves.
+typedef void (*CommandHandler)(byte argc, byte* argv);
+typedef struct {
+    CommandHandler handler; // NULL for unused command IDs
+    byte numParams;
+    byte numData;
+    byte responseSize;      // response payload bytes, or RESPONSE_SIZE_VARIABLE
+} CommandEntry;
+
 class LibraryBase{
 	public:
+		LibraryBase() : commandTable(NULL), numCommands(0), cmdIDIndex(4) {}
 		virtual const char* getLibraryName() const = 0;
 		
 	public:
-		virtual void commandHandler(byte* command) = 0;
+		// Only called for libraries that have not registered a command table
+		virtual void commandHandler(byte* command) {}
+		
+		// Footprint for the memory report: bytes of the library's global state, and the
+		// part of it held by the devices the host has created
+		virtual unsigned int getStaticSize() const { return 0; }
+		virtual unsigned int getDynamicSize() const { return 0; }
+		
+	protected:
+		void setCommandTable(const CommandEntry* table, byte size, byte index = 4)
+		{
+			commandTable = table;
+			numCommands = size;
+			cmdIDIndex = index;
+		}
+		
+	public:
+		const CommandEntry* commandTable;
+		byte numCommands;
+		byte cmdIDIndex; // position of the cmdID in the command, after sequence_ID, payload_size and libID
 };
 
-#endif
\ No newline at end of file
+#endif
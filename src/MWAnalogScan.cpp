@@ -0,0 +1,168 @@
+/*
+  MWAnalogScan.cpp - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#include "MWArduino.h"
+#include "MWStream.h"
+#include "MWAnalogScan.h"
+
+// Free running conversions
+// AVR boards with an auto trigger source convert back to back from ADC_vect. Other
+// boards fall back to analogRead.
+#if defined(ARDUINO_ARCH_AVR) && defined(ADC_vect) && defined(ADATE)
+#define ADC_SCAN_FREE_RUNNING
+#endif
+
+#define ADC_SCAN_ACCURATE_CLOCK 200000UL // max ADC clock for full 10-bit accuracy
+#define ADC_SCAN_FAST_CLOCK     500000UL // ADC clock of oversampled means
+#define ADC_SCAN_FAST_MIN_SAMPLES 4      // samples per channel from which the mean uses the fast clock
+
+#if defined(ADC_SCAN_FREE_RUNNING) || defined(STREAM_USE_ADC_INTERRUPT)
+ISR(ADC_vect){
+// Shared with the acquisition stream, which never converts during a scan (see MWStream.lock)
+    #if defined(STREAM_USE_ADC_INTERRUPT)
+    if(MWStream.isConverting()){
+        MWStream.conversionComplete(ADC);
+        return;
+    }
+    #endif
+    MWAnalogScan.conversionComplete(ADC);
+}
+#endif
+
+#if defined(ADC_SCAN_FREE_RUNNING)
+unsigned int* scanSamples;
+byte scanNumSamples = 0;
+volatile byte scanCount = 0;
+volatile byte scanDiscard = 0; // conversions to drop before sampling, owned by the interrupt
+
+static byte adcPrescaler(unsigned long maxClock){
+// ADPS bits of the smallest prescaler that keeps the ADC clock at or below maxClock
+    byte adps = 1;
+    while(adps < 7 && (F_CPU >> adps) > maxClock){
+        adps++;
+    }
+    return adps;
+}
+
+static void convertChannel(byte pin, byte numSamples, byte adps, unsigned int* samples){
+// Same pin to channel mapping as analogRead, with the reference left at DEFAULT
+    if(pin >= A0){
+        pin -= A0;
+    }
+    #if defined(analogPinToChannel)
+    pin = analogPinToChannel(pin);
+    #endif
+    // ADTS = 0, free running; other bits such as ACME stay as the sketch set them
+    #if defined(MUX5)
+    ADCSRB = (ADCSRB & ~(_BV(MUX5) | _BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0))) | ((pin & 0x08) ? _BV(MUX5) : 0);
+    #elif defined(ADCSRB)
+    ADCSRB &= ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0));
+    #endif
+    ADMUX = (DEFAULT << 6) | (pin & 0x07);
+
+    scanSamples = samples;
+    scanNumSamples = numSamples;
+    scanCount = 0;
+    scanDiscard = 1; // the sample and hold capacitor still carries the previous channel
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE) | adps;
+    while(scanCount < numSamples){
+    }
+    // the conversion started before the interrupt stopped free running
+    while(ADCSRA & _BV(ADSC)){
+    }
+}
+
+#else
+static void convertChannel(byte pin, byte numSamples, byte adps, unsigned int* samples){
+    for(byte i = 0; i < numSamples; ++i){
+        samples[i] = ::analogRead(pin);
+    }
+}
+#endif
+
+// MWAnalogScan class
+//
+MWAnalogScanClass::MWAnalogScanClass()
+{
+}
+
+bool MWAnalogScanClass::scan(byte numChannels, const byte* pins, byte numSamples, byte mode, unsigned int* results)
+{
+    if(numChannels == 0 || numChannels > MAX_ADC_SCAN_CHANNELS ||
+       numSamples == 0 || numSamples > MAX_ADC_SCAN_SAMPLES || mode > ADC_SCAN_MINMAX){
+        return false;
+    }
+
+    byte adps = 0;
+    #if defined(ADC_SCAN_FREE_RUNNING)
+    byte savedADCSRA = ADCSRA;
+    bool isFast = (mode == ADC_SCAN_MEAN && numSamples >= ADC_SCAN_FAST_MIN_SAMPLES);
+    adps = adcPrescaler(isFast ? ADC_SCAN_FAST_CLOCK : ADC_SCAN_ACCURATE_CLOCK);
+    #endif
+
+    unsigned int samples[MAX_ADC_SCAN_SAMPLES];
+    MWStream.lock(); // the sample timer would switch channels under the scan
+    for(byte i = 0; i < numChannels; ++i){
+        convertChannel(pins[i], numSamples, adps, samples);
+        if(mode == ADC_SCAN_MEAN){
+            unsigned long sum = 0;
+            for(byte j = 0; j < numSamples; ++j){
+                sum += samples[j];
+            }
+            *results++ = (sum * 16 + numSamples / 2) / numSamples;
+        }
+        else if(mode == ADC_SCAN_MEDIAN){
+            // insertion sort, numSamples is small
+            for(byte j = 1; j < numSamples; ++j){
+                unsigned int value = samples[j];
+                byte k = j;
+                while(k > 0 && samples[k-1] > value){
+                    samples[k] = samples[k-1];
+                    k--;
+                }
+                samples[k] = value;
+            }
+            *results++ = (samples[(numSamples - 1) / 2] + samples[numSamples / 2]) * 8;
+        }
+        else{
+            unsigned int minValue = samples[0];
+            unsigned int maxValue = samples[0];
+            for(byte j = 1; j < numSamples; ++j){
+                if(samples[j] < minValue){
+                    minValue = samples[j];
+                }
+                if(samples[j] > maxValue){
+                    maxValue = samples[j];
+                }
+            }
+            *results++ = minValue << 4;
+            *results++ = maxValue << 4;
+        }
+    }
+    #if defined(ADC_SCAN_FREE_RUNNING)
+    ADCSRA = savedADCSRA & ~(_BV(ADATE) | _BV(ADIE));
+    #endif
+    MWStream.unlock();
+    return true;
+}
+
+void MWAnalogScanClass::conversionComplete(unsigned int value)
+{
+// Called from ADC_vect while free running
+    #if defined(ADC_SCAN_FREE_RUNNING)
+    if(scanDiscard > 0){
+        scanDiscard--;
+        return;
+    }
+    scanSamples[scanCount] = value;
+    if(++scanCount == scanNumSamples){
+        ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+    }
+    #endif
+}
+
+MWAnalogScanClass MWAnalogScan;
@@ -0,0 +1,45 @@
+/*
+  MWAnalogScan.h - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#ifndef MWAnalogScan_h
+#define MWAnalogScan_h
+
+#include "Arduino.h"
+
+#define MAX_ADC_SCAN_CHANNELS 8
+// Samples per channel, bounded by the median buffer on the stack
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_ADC_SCAN_SAMPLES 32
+#else
+#define MAX_ADC_SCAN_SAMPLES 64
+#endif
+
+// Decimation of the samples of one channel
+#define ADC_SCAN_MEAN   0x00
+#define ADC_SCAN_MEDIAN 0x01
+#define ADC_SCAN_MINMAX 0x02 // two results per channel, min then max
+
+// Oversampled analog scan
+// Converts numSamples samples of every channel in one call and reduces each channel to
+// its mean, median or min/max. Results are in 1/16 LSB so that the mean keeps the extra
+// resolution gained by oversampling.
+//
+// AVR boards run the ADC free-running from its conversion complete interrupt, one
+// channel at a time, with the first conversion after a channel switch discarded. The
+// ADC clock is raised for oversampled means, whose averaging makes up for the lower
+// per-sample accuracy. Other boards use analogRead.
+class MWAnalogScanClass
+{
+public:
+    MWAnalogScanClass();
+    bool scan(byte numChannels, const byte* pins, byte numSamples, byte mode, unsigned int* results);
+    void conversionComplete(unsigned int value);
+};
+
+extern MWAnalogScanClass MWAnalogScan;
+
+#endif // MWAnalogScan.h
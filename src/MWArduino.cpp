@@ -6,6 +6,13 @@
 */
 
 #include "MWArduino.h"
+#include "MWStream.h"
+#include "MWPinChange.h"
+#include "MWAnalogScan.h"
+#include "MWScript.h"
+#include "MWRules.h"
+#include "MWMemory.h"
+#include "MWStats.h"
 
 extern "C" {
 #include <string.h>
@@ -13,62 +20,76 @@ extern "C" {
 #include <stdarg.h>
 }
 
-int freeRam () {
-  extern int __heap_start, *__brkval; 
-  int v; 
-  return (int) &v - (__brkval == 0 ? (int) &__heap_start : (int) __brkval); 
+// Transmit ring buffer
+// Responses are queued here and handed to Serial from MWArduinoClass::update(), so command
+// handlers return without waiting for the UART to drain.
+byte txBuffer[TX_BUFFER_SIZE];
+unsigned int txHead = 0; // next free slot
+unsigned int txTail = 0; // next byte to send
+
+void drainTxBuffer(){
+// Move queued bytes to Serial without blocking on a full UART buffer
+    #if ARDUINO >= 10600
+    int room = Serial.availableForWrite();
+    #else
+    int room = TX_DRAIN_CHUNK;
+    #endif
+    while(txTail != txHead && room-- > 0){
+        Serial.write(txBuffer[txTail]);
+        txTail = (txTail + 1) & (TX_BUFFER_SIZE - 1);
+    }
 }
 
-// String formatting- variable-length inputs
+void writeTxBuffer(byte value){
+    unsigned int next = (txHead + 1) & (TX_BUFFER_SIZE - 1);
+    if(next == txTail){
+        // buffer full, push the oldest byte out to make room
+        MWStats.txStall();
+        Serial.write(txBuffer[txTail]);
+        txTail = (txTail + 1) & (TX_BUFFER_SIZE - 1);
+    }
+    txBuffer[txHead] = value;
+    txHead = next;
+}
+
+// Debug trace ring buffer, see TracePolicy
 //
 #ifdef MW_DEBUG
 byte isTraceOn = 0x00;
-void _p(char *fmt, ... ){
-    	Serial.flush();
-        char tmp[256]; // resulting string limited to 256 chars
-        
-        char fmt_char[256];
-        char c;
-        byte i = 0;
-        while((c = pgm_read_byte(fmt++)) && i < 255){
-            fmt_char[i] = c;
-            i++;
-        }
-        fmt_char[i] = 0; // add 0 in the end to indicate end of string
-        
-        va_list args;
-        va_start (args, fmt);
-        vsnprintf(tmp, 256, fmt_char, args);
-        va_end (args);
-        
-        byte count = strlen(tmp);
-        
-        /*
-        char availableRAM [11];
-        sprintf(availableRAM, "RAM: %d\n", freeRam()+11);
-        byte additional_count = strlen(availableRAM);
-        
-        // format of debug message is count, e.g number of chars, followed by the message
-        Serial.write(uint8_t(0)); // MW header
-        Serial.write(uint8_t(1)); // msgID: 0 - non debug msg; 1 - debug msg
-        Serial.write(count + additional_count);
-        Serial.print(tmp);
-        Serial.print(availableRAM);
-		Serial.flush();
-        */
-        
-        // format of debug message is count, e.g number of chars, followed by the message
-        Serial.write(uint8_t(0)); // MW header
-        Serial.write(uint8_t(1)); // msgID: 0 - non debug msg; 1 - debug msg
-        Serial.write(count);
-        Serial.print(tmp);
-		Serial.flush();
+byte traceBuffer[TRACE_BUFFER_SIZE];
+unsigned int traceHead = 0; // next free slot
+unsigned int traceTail = 0; // first byte of the oldest record
+unsigned int numDroppedTraces = 0;
+
+void writeTraceBuffer(unsigned long value, byte size){
+    for(byte i = 0; i < size; ++i){
+        traceBuffer[traceHead] = value & 0xff;
+        traceHead = (traceHead + 1) & (TRACE_BUFFER_SIZE - 1);
+        value >>= 8;
+    }
+}
+
+void TracePolicy<true>::record(const char* fmt, byte numArgs, const long* args){
+    byte length = TRACE_POINTER_SIZE + 4*numArgs;
+    unsigned int used = (traceHead - traceTail) & (TRACE_BUFFER_SIZE - 1);
+    if(used + 1 + length >= TRACE_BUFFER_SIZE){ // one slot stays free to tell full from empty
+        if(numDroppedTraces < 0xFFFF){
+            numDroppedTraces++;
+        }
+        return;
+    }
+    writeTraceBuffer(length, 1);
+    uintptr_t address = (uintptr_t)fmt;
+    for(byte i = 0; i < TRACE_POINTER_SIZE; ++i){ // may be wider than unsigned long
+        writeTraceBuffer(address & 0xff, 1);
+        address >>= 8;
+    }
+    for(byte i = 0; i < numArgs; ++i){
+        writeTraceBuffer(args[i], 4);
+    }
 }
 #else
 byte isTraceOn = 0x01;
-void _p(char *fmt, ... ){
-    // do nothing
-}
 #endif
 
 #define STR_EXPAND(tok) #tok
@@ -83,211 +104,842 @@ void _p(char *fmt, ... ){
 //prog_char MSG_MWARDUINO_GET_SERVER_INFO[]         PROGMEM = "MWArduino::getServerInfo();\n";
 //prog_char MSG_MWARDUINO_GET_AVAILABLE_RAM[]       PROGMEM = "MWArduino::getAvailableRAM() --> %d;\n";
 
+// Protocol state
+byte protocolOptions = 0x00;    // PROTOCOL_* flags enabled by the host
+byte currentSequenceID = 0x00;  // sequence ID of the request being processed
+
+// Batched command execution
+// While a batch is executed, each response is queued as a record (cmdID, payload_size, value)
+// and all records are returned together in one response message.
+byte isBatching = 0;
+byte isBatchOverflow = 0;
+unsigned int batchResponseSize = 0;
+byte batchResponse[MAX_BATCH_RESPONSE_SIZE];
+
+byte isQuiet = 0; // the command being processed was not sent by the host, see executeCommandQuietly
+unsigned long commandMillis = 0;
+
 void sendResponseMsg(byte cmdID, int payload_size, byte* val){ 
 // returning message format: 0, 0, cmdID, payload_size, value
-    Serial.write(uint8_t(0)); // MW header
-    Serial.write(uint8_t(0)); // msgID: 0 - non debug msg; 1 - debug msg
-    Serial.write(cmdID);
-    Serial.write((payload_size >> 8)); // msb
-	Serial.write(payload_size & 0xff); // lsb
-    for(int i = 0; i < payload_size; ++i){
-        Serial.write(val[i]);
+// with tagged responses:    0, 2, sequenceID, cmdID, payload_size, value
+    if(isQuiet && !isBatching){
+        return;
+    }
+    if(isBatching){
+        if(batchResponseSize + 3 + payload_size > MAX_BATCH_RESPONSE_SIZE){
+            isBatchOverflow = 1;
+            return;
+        }
+        batchResponse[batchResponseSize++] = cmdID;
+        batchResponse[batchResponseSize++] = (payload_size >> 8); // msb
+        batchResponse[batchResponseSize++] = payload_size & 0xff; // lsb
+        for(int i = 0; i < payload_size; ++i){
+            batchResponse[batchResponseSize++] = val[i];
+        }
+        return;
     }
-    Serial.flush();
     
-    // empty receive buffer
-    while(Serial.available()){
-        Serial.read();
+    writeTxBuffer(0); // MW header
+    if(protocolOptions & PROTOCOL_TAGGED_RESPONSES){
+        writeTxBuffer(2); // msgID: 2 - non debug msg tagged with sequence ID
+        writeTxBuffer(currentSequenceID);
+    }
+    else{
+        writeTxBuffer(0); // msgID: 0 - non debug msg; 1 - debug msg
+    }
+    writeTxBuffer(cmdID);
+    writeTxBuffer(payload_size >> 8); // msb
+	writeTxBuffer(payload_size & 0xff); // lsb
+    for(int i = 0; i < payload_size; ++i){
+        writeTxBuffer(val[i]);
+    }
+    // commands already waiting in the receive buffer are kept and processed next
+}
+
+void sendErrorResponseMsg(byte cmdID){
+    byte status = RESPONSE_ERROR;
+    sendResponseMsg(cmdID, 1, &status);
+}
+
+bool deferResponse(byte* sequenceID){
+    if(isBatching || isQuiet){
+        return false;
+    }
+    *sequenceID = currentSequenceID;
+    return true;
+}
+
+void sendDeferredResponseMsg(byte sequenceID, byte cmdID, int payload_size, byte* val){
+// May be called while a batch or a script command is processed, which must not capture the response
+    byte requestSequenceID = currentSequenceID;
+    byte requestIsBatching = isBatching;
+    byte requestIsQuiet = isQuiet;
+    currentSequenceID = sequenceID;
+    isBatching = 0;
+    isQuiet = 0;
+    sendResponseMsg(cmdID, payload_size, val);
+    currentSequenceID = requestSequenceID;
+    isBatching = requestIsBatching;
+    isQuiet = requestIsQuiet;
+}
+
+void sendEventMsg(byte eventID, int payload_size, byte* val){
+// event message format: 0, 3, eventID, payload_size, value
+// events are never batched or tagged since they do not answer a request
+    writeTxBuffer(0); // MW header
+    writeTxBuffer(3); // msgID: 3 - unsolicited event
+    writeTxBuffer(eventID);
+    writeTxBuffer(payload_size >> 8); // msb
+    writeTxBuffer(payload_size & 0xff); // lsb
+    for(int i = 0; i < payload_size; ++i){
+        writeTxBuffer(val[i]);
     }
 }
 
 void ASCII2Binary(unsigned int count, byte* dataIn, byte* dataOut){
 // Decode incoming ASCII arrays back into unit8 data
-    byte startBit = 0;
-    byte numASCIIs = 0;
-    byte combinedVal = dataIn[0];
-    for(unsigned int i = 0; i < count; ++i){
-        startBit = i%7;
-        byte lowerBitsVal = (combinedVal >> startBit) & (0x7f >> startBit);
-        byte upperBitsVal = dataIn[numASCIIs+1] & (0x7f >> (7-startBit-1));
-        dataOut[i] = lowerBitsVal + (upperBitsVal << (7-startBit));
-        if(startBit == 6){
-            numASCIIs++;
+// Every 8 ASCII bytes carry 7 data bytes, so whole groups are decoded with fixed shifts
+// and only the tail goes through the bit accumulator.
+    while(count >= 7){
+        dataOut[0] = dataIn[0]        | (dataIn[1] << 7);
+        dataOut[1] = (dataIn[1] >> 1) | (dataIn[2] << 6);
+        dataOut[2] = (dataIn[2] >> 2) | (dataIn[3] << 5);
+        dataOut[3] = (dataIn[3] >> 3) | (dataIn[4] << 4);
+        dataOut[4] = (dataIn[4] >> 4) | (dataIn[5] << 3);
+        dataOut[5] = (dataIn[5] >> 5) | (dataIn[6] << 2);
+        dataOut[6] = (dataIn[6] >> 6) | (dataIn[7] << 1);
+        dataIn += 8;
+        dataOut += 7;
+        count -= 7;
+    }
+    
+    unsigned int bits = 0;
+    byte numBits = 0;
+    while(count--){
+        while(numBits < 8){
+            bits |= (unsigned int)(*dataIn++) << numBits;
+            numBits += 7;
+        }
+        *dataOut++ = bits & 0xff;
+        bits >>= 8;
+        numBits -= 8;
+    }
+}
+
+// Binary framing
+// Commands are COBS encoded and terminated by 0x00. A decoded frame has the same layout as a
+// sysex message, [command, sequenceID, payload_size msb, lsb, cmdID/libID, params], except that
+// payload_size is the number of bytes after it and trailing data arrays are raw 8-bit values.
+byte isBinaryFrame = 0;         // the command being processed arrived in a binary frame
+byte frameBuffer[MAX_FRAME_SIZE];
+unsigned int frameLength = 0;
+byte cobsRemaining = 0;         // data bytes left in the current COBS block
+byte cobsCode = 0x00;           // code byte of the current block, 0 at the start of a frame
+byte isFrameOverflow = 0;
+
+void decodePayload(unsigned int count, byte* dataIn, byte* dataOut){
+// Decode the trailing data array of a command
+    if(isBinaryFrame){
+        memcpy(dataOut, dataIn, count);
+    }
+    else{
+        ASCII2Binary(count, dataIn, dataOut);
+    }
+}
+
+void sysexCallback(byte command, byte argc, byte *argv);
+
+void processFrameInput(byte inputByte){
+    if(inputByte == 0x00){ // end of frame
+        if(!isFrameOverflow && cobsRemaining == 0 && frameLength >= 5){
+            unsigned int payloadSize = (frameBuffer[2] << 8) + frameBuffer[3];
+            if(payloadSize == frameLength - 4){ // drop frames that are truncated or corrupted
+                isBinaryFrame = 1;
+                sysexCallback(frameBuffer[0], frameLength - 1, &frameBuffer[1]);
+                isBinaryFrame = 0;
+            }
+        }
+        frameLength = 0;
+        cobsRemaining = 0;
+        cobsCode = 0x00;
+        isFrameOverflow = 0;
+        return;
+    }
+    
+    if(cobsRemaining == 0){ // code byte
+        if(cobsCode != 0x00 && cobsCode != 0xFF){
+            // the previous block ended with an encoded zero
+            if(frameLength < MAX_FRAME_SIZE){
+                frameBuffer[frameLength++] = 0x00;
+            }
+            else{
+                isFrameOverflow = 1;
+            }
+        }
+        cobsCode = inputByte;
+        cobsRemaining = inputByte - 1;
+    }
+    else{
+        if(frameLength < MAX_FRAME_SIZE){
+            frameBuffer[frameLength++] = inputByte;
+        }
+        else{
+            isFrameOverflow = 1;
+        }
+        cobsRemaining--;
+    }
+}
+
+unsigned int encodedPayloadSize(unsigned int count){
+// Number of frame bytes carrying a trailing data array of count bytes
+    if(count == 0 || isBinaryFrame){
+        return count;
+    }
+    return count + count/7 + 1;
+}
+
+bool dispatchCommand(const CommandEntry* table, byte numCommands, byte cmdIDIndex, byte argc, byte* argv){
+// Look up the command in a dispatch table stored in flash and run it, unless the frame
+// is too short for its parameters or a batch has no room left for its response
+    if(argc <= cmdIDIndex){
+        sendErrorResponseMsg(RESPONSE_ERROR); // no command ID to answer with
+        return false;
+    }
+    byte cmdID = argv[cmdIDIndex];
+    if(cmdID >= numCommands){
+        sendErrorResponseMsg(cmdID);
+        return false;
+    }
+    CommandEntry entry;
+    memcpy_P(&entry, &table[cmdID], sizeof(CommandEntry));
+    if(entry.handler == NULL){
+        sendErrorResponseMsg(cmdID);
+        return false;
+    }
+    if(argc < cmdIDIndex + 1 + entry.numParams + encodedPayloadSize(entry.numData)){
+        sendErrorResponseMsg(cmdID);
+        return false;
+    }
+    if(isBatching && entry.responseSize != RESPONSE_SIZE_VARIABLE &&
+       batchResponseSize + 3 + entry.responseSize > MAX_BATCH_RESPONSE_SIZE){
+        isBatchOverflow = 1;
+        return false;
+    }
+    entry.handler(argc, argv);
+    return true;
+}
+
+// Base command handlers
+// argv: sequence_ID, payload_size (2 bytes), cmdID, params
+//
+void getServerInfo(byte argc, byte* argv){
+    //_p(MSG_MWARDUINO_GET_SERVER_INFO);
+    
+    byte val[256];
+    
+    // Board 
+    const char *board = STR(MW_BOARD);
+    byte len = strlen(board);
+    for(byte i = 0; i < len; i++){
+        val[i] = board[i];
+    }
+    val[len] = 0x3B;
+    
+    // TraceOn
+    val[len+1] = isTraceOn;
+    val[len+2] = 0x3B;
+    
+    // Libraries
+    int count = len+3;
+    for (byte i = 0; i < MAX_NUM_LIBRARIES; ++i) {
+        if (MWArduino.libraryArray[i] != NULL){
+            val[count++] = i;
+            const char * libName = MWArduino.libraryArray[i]->getLibraryName();
+            byte len = strlen(libName);
+            for(byte j = 0; j < len; ++j){
+                val[count++] = libName[j];
+            }
+            if (MWArduino.libraryArray[i+1] != NULL){
+                val[count++] = 0x3B; // send ';' to seperate libraries
+            }
+        }
+        else
+            break;
+    }
+    val[count] = 0;
+    sendResponseMsg(0x01, count, val);
+}
+
+void resetPinsState(byte argc, byte* argv){
+    MWStream.stop();
+    MWPinChange.unsubscribeAll();
+    MWScript.stopAll();
+    MWRules.clearAll();
+    // outputs are driven low and pullups disabled a whole port at a time, then all pins become inputs
+    for(byte port = 0; port < TOTAL_PORTS; ++port){
+        byte mask = 0;
+        for(byte bit = 0; bit < 8; ++bit){
+            byte i = port*8 + bit;
+            if(i >= 2 && i < TOTAL_PINS && IS_PIN_DIGITAL(i)){
+                mask |= (1 << bit);
+            }
+        }
+        if(mask){
+            MWArduino.writePortMW(port, 0, mask);
+        }
+    }
+    for(byte i = 2; i < TOTAL_PINS; ++i){
+        if(IS_PIN_DIGITAL(i)){
+            MWArduino.pinModeMW(i, INPUT);
+        }
+    }
+    sendResponseMsg(0x02, 0, 0);
+}
+
+void getAvailableRAM(byte argc, byte* argv){
+    int availableRAM = freeRam();
+    byte val[2];
+    val[1] = availableRAM & 0xff; // lsb
+    val[0] = availableRAM >> 8;   // msb
+    //_p(MSG_MWARDUINO_GET_AVAILABLE_RAM, availableRAM);
+
+    sendResponseMsg(0x03, 2, val);
+}
+
+static void putWord(byte* val, unsigned int value){
+    val[0] = (value >> 8) & 0xff; // msb
+    val[1] = value & 0xff;        // lsb
+}
+
+void getMemoryReport(byte argc, byte* argv){
+// response: flags, free RAM, stack depth, stack headroom, heap size, free list bytes, free list
+// blocks, largest free block, numLibraries, then static and dynamic bytes per library by libID
+    MemoryReport report;
+    MWMemory.report(report);
+    byte val[16 + 4*MAX_NUM_LIBRARIES];
+    val[0] = report.flags;
+    putWord(&val[1], report.freeRam);
+    putWord(&val[3], report.maxStackDepth);
+    putWord(&val[5], report.stackHeadroom);
+    putWord(&val[7], report.heapSize);
+    putWord(&val[9], report.freeListSize);
+    putWord(&val[11], report.freeListBlocks);
+    putWord(&val[13], report.largestFreeBlock);
+    byte numLibraries = 0;
+    while(numLibraries < MAX_NUM_LIBRARIES && MWArduino.libraryArray[numLibraries] != NULL){
+        LibraryBase* library = MWArduino.libraryArray[numLibraries];
+        putWord(&val[16 + 4*numLibraries], library->getStaticSize());
+        putWord(&val[18 + 4*numLibraries], library->getDynamicSize());
+        numLibraries++;
+    }
+    val[15] = numLibraries;
+
+    sendResponseMsg(0x08, 16 + 4*numLibraries, val);
+}
+
+void getStats(byte argc, byte* argv){
+// params: flags (STATS_RESET), response: see MWStats.h
+    byte val[STATS_REPORT_SIZE];
+    unsigned int size = MWStats.report(val);
+    if(argv[4] & STATS_RESET){
+        MWStats.reset();
+    }
+
+    sendResponseMsg(0x09, size, val);
+}
+
+void executeBatch(byte argc, byte* argv){
+// params: numCommands, then per command: header (0x00 or 0x01), length, cmdID/libID, params
+// response: numExecuted, then one (cmdID, payload_size, value) record per executed command;
+// a rejected command adds its error record, execution stops at the first command that
+// sends no response
+    byte sequenceID = argv[0];
+    byte numCommands = argv[4];
+    byte subCommand[MAX_FRAME_SIZE];
+    byte index = 5;
+    byte numExecuted = 0;
+    
+    isBatching = 1;
+    isBatchOverflow = 0;
+    batchResponseSize = 1;
+    for(byte i = 0; i < numCommands && !isBatchOverflow; ++i){
+        if(index + 2 > argc){
+            break;
+        }
+        byte subHeader = argv[index];
+        byte subLength = argv[index+1];
+        if(subLength == 0 || index + 2 + subLength > argc){
+            break; // truncated frame
+        }
+        if(subHeader == 0x00 && argv[index+2] == 0x04){
+            break; // batches cannot be nested
+        }
+        
+        // rebuild the sub-command with the same layout as a standalone frame
+        subCommand[0] = sequenceID;
+        subCommand[1] = 0x01; // unused payload_size
+        subCommand[2] = 0x01;
+        for(byte j = 0; j < subLength; ++j){
+            subCommand[3+j] = argv[index+2+j];
+        }
+        unsigned int recordStart = batchResponseSize;
+        sysexCallback(subHeader, subLength+3, subCommand);
+        if(batchResponseSize == recordStart){
+            break; // unanswered, later records would no longer line up with their commands
+        }
+        
+        numExecuted++;
+        index += subLength+2;
+    }
+    isBatching = 0;
+    
+    batchResponse[0] = numExecuted;
+    sendResponseMsg(0x04, batchResponseSize, batchResponse);
+}
+
+void configureProtocol(byte argc, byte* argv){
+// params: PROTOCOL_* flags; the response already uses the new format and
+// the framing applies from the next command on
+// response: the flags, MAX_OUTSTANDING_REQUESTS
+    protocolOptions = argv[4];
+    byte val[2] = {protocolOptions, MAX_OUTSTANDING_REQUESTS};
+    
+    sendResponseMsg(0x05, 2, val);
+}
+
+void drainTrace(byte argc, byte* argv){
+// response: TRACE_POINTER_SIZE, number of dropped records (2 bytes), the oldest whole records
+// that fit into MAX_TRACE_DRAIN bytes; empty without MW_DEBUG
+    byte val[3 + MAX_TRACE_DRAIN];
+    unsigned int count = 3;
+    val[0] = TRACE_POINTER_SIZE;
+    #ifdef MW_DEBUG
+    val[1] = numDroppedTraces >> 8; // msb
+    val[2] = numDroppedTraces & 0xff; // lsb
+    numDroppedTraces = 0;
+    while(traceTail != traceHead){
+        byte length = traceBuffer[traceTail];
+        if(count + 1 + length > sizeof(val)){
+            break;
+        }
+        for(byte i = 0; i <= length; ++i){
+            val[count++] = traceBuffer[traceTail];
+            traceTail = (traceTail + 1) & (TRACE_BUFFER_SIZE - 1);
+        }
+    }
+    #else
+    val[1] = 0;
+    val[2] = 0;
+    #endif
+    
+    sendResponseMsg(0x06, count, val);
+}
+
+void getTraceString(byte argc, byte* argv){
+// data: address of a PROGMEM string from a trace record (TRACE_POINTER_SIZE bytes, lsb first)
+// response: the string without its terminating 0; empty without MW_DEBUG
+    byte val[MAX_TRACE_STRING];
+    byte count = 0;
+    #ifdef MW_DEBUG
+    byte addressBytes[TRACE_POINTER_SIZE];
+    decodePayload(TRACE_POINTER_SIZE, &argv[4], addressBytes);
+    uintptr_t address = 0;
+    for(byte i = TRACE_POINTER_SIZE; i > 0; --i){
+        address = (address << 8) | addressBytes[i-1];
+    }
+    const char* str = (const char*)address;
+    char c;
+    while(count < MAX_TRACE_STRING && (c = pgm_read_byte(str + count))){
+        val[count++] = c;
+    }
+    #endif
+    
+    sendResponseMsg(0x07, count, val);
+}
+
+void writeDigitalPin(byte argc, byte* argv){
+    byte pin;
+    int value;
+
+    pin = argv[4];
+    value = argv[5];
+    MWArduino.digitalWriteMW(pin, value);
+    
+    sendResponseMsg(0x10, 0, 0);
+}
+
+void readDigitalPin(byte argc, byte* argv){
+    byte pin;
+    byte value;
+    
+    pin = argv[4];
+    
+    value = MWArduino.digitalReadMW(pin);
+    
+    sendResponseMsg(0x11, 1, &value);
+}
+
+void configureDigitalPin(byte argc, byte* argv){
+    byte pin;
+    byte value;
+
+    pin = argv[4];
+    value = argv[5];
+    MWArduino.pinModeMW(pin, value);
+    
+    sendResponseMsg(0x12, 0, 0);
+}
+
+void readDigitalPort(byte argc, byte* argv){
+// params: port
+// response: one bit per pin of the port, pin port*8 in bit 0
+    byte port = argv[4];
+    byte value = 0;
+    if(port < TOTAL_PORTS){
+        value = MWArduino.readPortMW(port, 0xFF);
+    }
+    sendResponseMsg(0x13, 1, &value);
+}
+
+void writeDigitalPort(byte argc, byte* argv){
+// params: port, operation (PORT_WRITE, PORT_SET, PORT_CLEAR, PORT_TOGGLE), mask and value (uint8 each)
+// response: port value after the write
+    byte port = argv[4];
+    byte operation = argv[5];
+    byte maskValue[2];
+    decodePayload(2, &argv[6], maskValue);
+    byte mask = maskValue[0];
+    byte value = 0;
+    if(port < TOTAL_PORTS){
+        if(port == 0){
+            mask &= 0xFC; // pins 0 and 1 carry the serial connection
+        }
+        switch(operation){
+            case PORT_WRITE:
+                MWArduino.writePortMW(port, maskValue[1], mask);
+                break;
+            case PORT_SET:
+                MWArduino.writePortMW(port, 0xFF, mask);
+                break;
+            case PORT_CLEAR:
+                MWArduino.writePortMW(port, 0, mask);
+                break;
+            case PORT_TOGGLE:
+                MWArduino.writePortMW(port, ~MWArduino.readPortMW(port, mask), mask);
+                break;
+            default:
+                break;
+        }
+        value = MWArduino.readPortMW(port, 0xFF);
+    }
+    sendResponseMsg(0x14, 1, &value);
+}
+
+void subscribePinChange(byte argc, byte* argv){
+// params: pin, debounce window in microseconds (uint32)
+// response: status (0 - subscribed, 0xFF - no free subscription)
+    byte pin = argv[4];
+    byte debounceBytes[4];
+    decodePayload(4, &argv[5], debounceBytes);
+    unsigned long debounce = (unsigned long)debounceBytes[0] + ((unsigned long)debounceBytes[1]<<8) + 
+                             ((unsigned long)debounceBytes[2]<<16) + ((unsigned long)debounceBytes[3]<<24);
+    byte status = MWPinChange.subscribe(pin, debounce) ? 0 : 0xFF;
+    sendResponseMsg(0x15, 1, &status);
+}
+
+void unsubscribePinChange(byte argc, byte* argv){
+    MWPinChange.unsubscribe(argv[4]);
+    sendResponseMsg(0x16, 0, 0);
+}
+
+void writePWM(byte argc, byte* argv){
+// writePWMVoltage and writePWMDutyCycle
+    byte pin;
+    byte value;
+
+    pin = argv[4];
+    
+    ASCII2Binary(1, &argv[5], &value); // the host sends one 8-bit value in 2 ASCII bytes
+    
+    MWArduino.analogWriteMW(pin, value);
+    
+    sendResponseMsg(0x21, 0, 0);
+}
+
+void playTone(byte argc, byte* argv){
+// response: status (0 - playing, 0xFF - Timer2 is taken by the acquisition stream)
+    byte pin;
+    unsigned int frequency;
+    unsigned long duration;
+    
+    pin = argv[4];
+    
+    byte frequencyBytes[2];
+    ASCII2Binary(2, &argv[5], frequencyBytes);
+    frequency = frequencyBytes[0]+(frequencyBytes[1]<<8); // unsigned int
+    
+    byte durationBytes[2];
+    ASCII2Binary(2, &argv[8], durationBytes);
+    duration = durationBytes[0]+(durationBytes[1]<<8); // unsigned long
+    
+    byte status = MWArduino.toneMW(pin, frequency, duration) ? 0 : 0xFF;
+    
+    sendResponseMsg(0x22, 1, &status);
+}
+
+void readVoltage(byte argc, byte* argv){
+    byte pin;
+    int value;
+    
+    pin = argv[4];
+    value = MWArduino.analogReadMW(pin);
+    
+    byte val[2];
+    val[0] = (value >> 8) & 0x03;
+    val[1] = value & 0xff;
+    sendResponseMsg(0x30, 2, val);
+}
+
+void scanVoltages(byte argc, byte* argv){
+// params: numChannels, numSamples per channel, mode (0 - mean, 1 - median, 2 - min/max), pins
+// response: one 16-bit result in 1/16 LSB (msb, lsb) per channel, two for min/max;
+//           empty for an invalid scan
+    byte numChannels = argv[4];
+    byte numSamples = argv[5];
+    byte mode = argv[6];
+    unsigned int results[2*MAX_ADC_SCAN_CHANNELS];
+    byte val[4*MAX_ADC_SCAN_CHANNELS];
+    byte count = 0;
+    if(argc >= 7 + numChannels &&
+       MWAnalogScan.scan(numChannels, &argv[7], numSamples, mode, results)){
+        byte numResults = (mode == ADC_SCAN_MINMAX) ? 2*numChannels : numChannels;
+        for(byte i = 0; i < numResults; ++i){
+            val[count++] = results[i] >> 8;
+            val[count++] = results[i] & 0xff;
+        }
+    }
+    sendResponseMsg(0x31, count, val);
+}
+
+void uploadScript(byte argc, byte* argv){
+// params: slot, offset, length, bytecode (length bytes)
+// response: status (0 - loaded, 0xFF - invalid slot, offset or length)
+    byte slot = argv[4];
+    byte offset = argv[5];
+    byte length = argv[6];
+    byte status = 0xFF;
+    if(length <= MAX_SCRIPT_SIZE && argc >= 7 + encodedPayloadSize(length)){
+        byte code[MAX_SCRIPT_SIZE];
+        decodePayload(length, &argv[7], code);
+        if(MWScript.load(slot, offset, length, code)){
+            status = 0;
+        }
+    }
+    sendResponseMsg(0x50, 1, &status);
+}
+
+void runScript(byte argc, byte* argv){
+// params: slot
+// response: status (0 - started, 0xFF - empty slot)
+    byte status = MWScript.run(argv[4]) ? 0 : 0xFF;
+    sendResponseMsg(0x51, 1, &status);
+}
+
+void stopScript(byte argc, byte* argv){
+// params: slot, all slots if it is out of range
+    if(argv[4] < MAX_SCRIPTS){
+        MWScript.stop(argv[4]);
+    }
+    else{
+        MWScript.stopAll();
+    }
+    sendResponseMsg(0x52, 0, 0);
+}
+
+void setRule(byte argc, byte* argv){
+// params: ruleID, length, rule definition (length bytes), see MWRules.h
+// response: status (0 - set, 0xFF - invalid rule)
+    byte ruleID = argv[4];
+    byte length = argv[5];
+    byte status = 0xFF;
+    if(length <= MAX_RULE_SIZE && argc >= 6 + encodedPayloadSize(length)){
+        byte definition[MAX_RULE_SIZE];
+        decodePayload(length, &argv[6], definition);
+        if(MWRules.set(ruleID, length, definition)){
+            status = 0;
+        }
+    }
+    sendResponseMsg(0x60, 1, &status);
+}
+
+void clearRule(byte argc, byte* argv){
+// params: ruleID, all rules if it is out of range
+    if(argv[4] < MAX_RULES){
+        MWRules.clear(argv[4]);
+    }
+    else{
+        MWRules.clearAll();
+    }
+    sendResponseMsg(0x61, 0, 0);
+}
+
+void startStreaming(byte argc, byte* argv){
+// params: numChannels, then per channel: pin, type (0 - digital, 1 - analog),
+//         samplesPerFrame, samplePeriod in microseconds (uint32)
+// response: status (0 - started, 0xFF - invalid configuration)
+    byte numChannels = argv[4];
+    byte status = 0xFF;
+    if(numChannels > 0 && numChannels <= MAX_STREAM_CHANNELS &&
+       argc >= 6 + 2*numChannels + encodedPayloadSize(4)){
+        byte pins[MAX_STREAM_CHANNELS];
+        byte types[MAX_STREAM_CHANNELS];
+        for(byte i = 0; i < numChannels; ++i){
+            pins[i] = argv[5+2*i];
+            types[i] = argv[6+2*i];
+        }
+        byte samplesPerFrame = argv[5+2*numChannels];
+        byte periodBytes[4];
+        decodePayload(4, &argv[6+2*numChannels], periodBytes);
+        unsigned long period = (unsigned long)periodBytes[0] + ((unsigned long)periodBytes[1]<<8) + 
+                               ((unsigned long)periodBytes[2]<<16) + ((unsigned long)periodBytes[3]<<24);
+        if(MWStream.start(numChannels, pins, types, period, samplesPerFrame)){
+            status = 0;
         }
-        combinedVal = dataIn[++numASCIIs];
     }
+    sendResponseMsg(0x40, 1, &status);
 }
 
+void stopStreaming(byte argc, byte* argv){
+    MWStream.stop();
+    sendResponseMsg(0x41, 0, 0);
+}
+
+// Base command table, indexed by cmdID
+// handler, numParams, numData, responseSize
+#define NO_COMMAND {NULL, 0, 0, 0}
+const CommandEntry baseCommandTable[] PROGMEM = {
+    NO_COMMAND,                                                 // 0x00
+    {getServerInfo,         0, 0, RESPONSE_SIZE_VARIABLE},      // 0x01
+    {resetPinsState,        0, 0, 0},                           // 0x02
+    {getAvailableRAM,       0, 0, 2},                           // 0x03
+    {executeBatch,          1, 0, RESPONSE_SIZE_VARIABLE},      // 0x04
+    {configureProtocol,     1, 0, 2},                           // 0x05
+    {drainTrace,            0, 0, RESPONSE_SIZE_VARIABLE},      // 0x06
+    {getTraceString,        0, TRACE_POINTER_SIZE, RESPONSE_SIZE_VARIABLE}, // 0x07
+    {getMemoryReport,       0, 0, RESPONSE_SIZE_VARIABLE},      // 0x08
+    {getStats,              1, 0, RESPONSE_SIZE_VARIABLE},      // 0x09
+    NO_COMMAND,                                                 // 0x0A
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x0B - 0x0F
+    {writeDigitalPin,       2, 0, 0},                           // 0x10
+    {readDigitalPin,        1, 0, 1},                           // 0x11
+    {configureDigitalPin,   2, 0, 0},                           // 0x12
+    {readDigitalPort,       1, 0, 1},                           // 0x13
+    {writeDigitalPort,      2, 2, 1},                           // 0x14
+    {subscribePinChange,    1, 4, 1},                           // 0x15
+    {unsubscribePinChange,  1, 0, 0},                           // 0x16
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x17 - 0x1B
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND,             // 0x1C - 0x1F
+    {writePWM,              3, 0, 0},                           // 0x20 writePWMVoltage
+    {writePWM,              3, 0, 0},                           // 0x21 writePWMDutyCycle
+    {playTone,              7, 0, 1},                           // 0x22
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x23 - 0x27
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x28 - 0x2C
+    NO_COMMAND, NO_COMMAND, NO_COMMAND,                         // 0x2D - 0x2F
+    {readVoltage,           1, 0, 2},                           // 0x30
+    {scanVoltages,          3, 0, RESPONSE_SIZE_VARIABLE},      // 0x31
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND,             // 0x32 - 0x35
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x36 - 0x3A
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x3B - 0x3F
+    {startStreaming,        4, 4, 1},                           // 0x40
+    {stopStreaming,         0, 0, 0},                           // 0x41
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x42 - 0x46
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x47 - 0x4B
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND,             // 0x4C - 0x4F
+    {uploadScript,          3, 0, 1},                           // 0x50
+    {runScript,             1, 0, 1},                           // 0x51
+    {stopScript,            1, 0, 0},                           // 0x52
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x53 - 0x57
+    NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, NO_COMMAND, // 0x58 - 0x5C
+    NO_COMMAND, NO_COMMAND, NO_COMMAND,                         // 0x5D - 0x5F
+    {setRule,               2, 0, 1},                           // 0x60
+    {clearRule,             1, 0, 0},                           // 0x61
+};
+#define NUM_BASE_COMMANDS (sizeof(baseCommandTable)/sizeof(CommandEntry))
+
 // Callback functions
 //
 void sysexCallback(byte command, byte argc, byte *argv){
+    if(argc < 4){
+        return; // sequence_ID, payload_size and cmdID/libID are always present
+    }
+    if(!isBatching && !isQuiet){
+        currentSequenceID = argv[0];
+        commandMillis = millis();
+    }
+    unsigned long startMicros = micros();
 	if(command == 0x00){ // basic arduino and firmata commands
         //_p(MSG_BASE_SYSEX, command, argv[0], argv[1], argv[2], argv[3], argv[4], argv[5]);
-		byte sequenceID = argv[0];
-	    byte commandID = argv[3];
-		switch(commandID){
-            case 0x01:{ // getServerInfo
-                //_p(MSG_MWARDUINO_GET_SERVER_INFO);
-                
-                byte val[256];
-                
-                // Board 
-                char *board = STR(MW_BOARD);
-                byte len = strlen(board);
-                for(byte i = 0; i < len; i++){
-                    val[i] = board[i];
-                }
-                val[len] = 0x3B;
-                
-                // TraceOn
-                val[len+1] = isTraceOn;
-                val[len+2] = 0x3B;
-                
-                // Libraries
-                int count = len+3;
-				for (byte i = 0; i < MAX_NUM_LIBRARIES; ++i) {
-					if (MWArduino.libraryArray[i] != NULL){
-                        val[count++] = i;
-                        const char * libName = MWArduino.libraryArray[i]->getLibraryName();
-                        byte len = strlen(libName);
-                        for(byte j = 0; j < len; ++j){
-                            val[count++] = libName[j];
-                        }
-                        if (MWArduino.libraryArray[i+1] != NULL){
-                            val[count++] = 0x3B; // send ';' to seperate libraries
-                        }
-                    }
-					else
-						break;
-				}
-                val[count] = 0;
-                sendResponseMsg(0x01, count, val);
-                break;
-            }
-            case 0x02:{ // resetPinsState
-                for(byte i = 2; i < TOTAL_PINS; ++i){
-                    if(IS_PIN_DIGITAL(i)){
-                        MWArduino.pinModeMW(i, OUTPUT);
-                        MWArduino.digitalWriteMW(i, 0);
-                        MWArduino.pinModeMW(i, INPUT);
-                    }
-                }
-                sendResponseMsg(0x02, 0, 0);
-				break;
-            }
-            case 0x03:{ // getAvailableRAM
-                int availableRAM = freeRam();
-                byte val[2];
-                val[1] = availableRAM & 0xff; // lsb
-                val[0] = availableRAM >> 8;   // msb
-                //_p(MSG_MWARDUINO_GET_AVAILABLE_RAM, availableRAM);
-        
-                sendResponseMsg(0x03, 2, val);
-				break;
-            }
-			case 0x10:{ // writeDigitalPin
-				byte pin;
-				int value;
-		
-				pin = argv[4];
-				value = argv[5];
-				MWArduino.digitalWriteMW(pin, value);
-                
-                sendResponseMsg(0x10, 0, 0);
-				break;
-			}
-			case 0x11:{ // readDigitalPin
-				byte pin;
-				byte value;
-				
-				pin = argv[4];
-                
-				value = MWArduino.digitalReadMW(pin);
-                
-                sendResponseMsg(0x11, 1, &value);
-				break;
-			}
-			case 0x12:{ // configureDigitalPin
-				byte pin;
-				byte value;
-		
-				pin = argv[4];
-				value = argv[5];
-				MWArduino.pinModeMW(pin, value);
-                
-                sendResponseMsg(0x12, 0, 0);
-				break;
-			}
-			case 0x20: // writePWMVoltage
-			case 0x21:{ // writePWMDutyCycle
-				byte pin;
-				int value;
-		
-				pin = argv[4];
-                
-                byte voltageBytes[2];
-                ASCII2Binary(2, &argv[5], voltageBytes);
-				value = voltageBytes[0]+(voltageBytes[1]<<8);
-                
-				MWArduino.analogWriteMW(pin, value);
-                
-                sendResponseMsg(0x21, 0, 0);
-				break;
-			}
-			case 0x22:{ // playTone
-				byte pin;
-				unsigned int frequency;
-				unsigned long duration;
-                
-				pin = argv[4];
-                
-                byte frequencyBytes[2];
-                ASCII2Binary(2, &argv[5], frequencyBytes);
-                frequency = frequencyBytes[0]+(frequencyBytes[1]<<8); // unsigned int
-                
-                byte durationBytes[2];
-                ASCII2Binary(2, &argv[8], durationBytes);
-                duration = durationBytes[0]+(durationBytes[1]<<8); // unsigned long
-                
-				MWArduino.toneMW(pin, frequency, duration);
-                
-                sendResponseMsg(0x22, 0, 0);
-				break;
-			}
-			case 0x30:{ // readVoltage
-				byte pin;
-				int value;
-				
-				pin = argv[4];
-				value = MWArduino.analogReadMW(pin);
-                
-                byte val[2];
-                val[0] = (value >> 8) & 0x03;
-                val[1] = value & 0xff;
-                sendResponseMsg(0x30, 2, val);
-				break;
-			}
-			default:
-				break;
-		}
+        if(dispatchCommand(baseCommandTable, NUM_BASE_COMMANDS, 3, argc, argv)){
+            MWStats.command(STATS_BASE_LIBRARY, argv[3], micros() - startMicros);
+        }
 	}
 	else if(command == 0x01){
 	     // add-on library commands
 		 // command is actually libraryID, which is also the index
         //_p(MSG_ADDON_SYSEX, command, argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6]);
         byte libraryID = argv[3];
-        if (MWArduino.libraryArray[libraryID] != NULL){
-            MWArduino.libraryArray[libraryID]->commandHandler(argv);
+        if (libraryID < MAX_NUM_LIBRARIES && MWArduino.libraryArray[libraryID] != NULL){
+            LibraryBase* library = MWArduino.libraryArray[libraryID];
+            bool isDispatched = true;
+            if (library->commandTable != NULL){
+                isDispatched = dispatchCommand(library->commandTable, library->numCommands, library->cmdIDIndex, argc, argv);
+            }
+            else{
+                library->commandHandler(argv);
+            }
+            if(isDispatched){
+                byte cmdID = (argc > library->cmdIDIndex) ? argv[library->cmdIDIndex] : 0;
+                MWStats.command(libraryID, cmdID, micros() - startMicros);
+            }
+        }
+        else{
+            sendErrorResponseMsg(RESPONSE_ERROR);
         }
 	}
     else{
         //_p(MSG_UNRECOGNIZED_SYSEX, command);
+        sendErrorResponseMsg(RESPONSE_ERROR);
     }
 
+    MWStats.buffers(0, (txHead - txTail) & (TX_BUFFER_SIZE - 1));
+
 	//Serial.write(10); // ACK - LF/CR
 	//Serial.write(13); 
 }
 
+void executeCommandQuietly(byte command, byte argc, byte* argv){
+    isQuiet = 1;
+    sysexCallback(command, argc, argv);
+    isQuiet = 0;
+}
+
+unsigned long lastCommandMillis(){
+    return commandMillis;
+}
+
+// Arduino debug trace
+//
+//
+prog_char MSG_MWARDUINOCLASS_DIGITAL_WRITE[]      PROGMEM = "Arduino::digitalWrite(%d, %d);\n";
+prog_char MSG_MWARDUINOCLASS_DIGITAL_READ[]  	  PROGMEM = "Arduino::digitalRead(%d); --> %d\n";
+prog_char MSG_MWARDUINOCLASS_PIN_MODE[]  	  	  PROGMEM = "Arduino::pinMode(%d, %d);\n";
+prog_char MSG_MWARDUINOCLASS_ANALOG_WRITE[]  	  PROGMEM = "Arduino::analogWrite(%d, %d);\n";
+prog_char MSG_MWARDUINOCLASS_ANALOG_READ[] 		  PROGMEM = "Arduino::analogRead(%d) --> %d;\n";
+prog_char MSG_MWARDUINOCLASS_PLAY_TONE[]   		  PROGMEM = "Arduino::playTone(%d, %d, %d);\n";
+prog_char MSG_MWARDUINOCLASS_NO_TONE[]   		  PROGMEM = "Arduino::noTone(%d);\n";
+prog_char MSG_MWARDUINOCLASS_READ_PORT[]   		  PROGMEM = "Arduino::readPort(%d, %d) --> %d;\n";
+prog_char MSG_MWARDUINOCLASS_WRITE_PORT[]   	  PROGMEM = "Arduino::writePort(%d, %d, %d);\n";
+
 // MWArduino class
 //
 MWArduinoClass::MWArduinoClass()
@@ -298,36 +950,146 @@ MWArduinoClass::MWArduinoClass()
   for (byte i = 0; i < MAX_NUM_LIBRARIES; ++i) {
 	libraryArray[i] = NULL;
   }
+  scratchBorrowed = false;
+  for (byte i = 0; i < MAX_TASKS; ++i) {
+	tasks[i].callback = NULL;
+  }
 }
 
+#ifdef GPIO_FAST_PATH_AVR
+void MWArduinoClass::initPinRegisters()
+{
+    for (byte pin = 0; pin < NUM_DIGITAL_PINS; ++pin) {
+        pinOutput[pin] = NULL;
+        pinMask[pin] = digitalPinToBitMask(pin);
+        byte port = digitalPinToPort(pin);
+        if (port == NOT_A_PIN) {
+            continue;
+        }
+        // the fast path addresses PIN and DDR relative to PORT, true for every AVR core port
+        volatile uint8_t* out = portOutputRegister(port);
+        if (portModeRegister(port) == out - 1 && portInputRegister(port) == out - 2) {
+            pinOutput[pin] = out;
+        }
+    }
+    for (byte i = 0; i < sizeof(pwmPins); ++i) {
+        pwmPins[i] = 0;
+    }
+}
+
+#define IS_PWM_PIN_SET(pin) (pwmPins[(pin) >> 3] & (1 << ((pin) & 7)))
+#endif
+
 void MWArduinoClass::pinModeMW(byte pin, byte value) {
     byte pinIndex = PIN_TO_DIGITAL(pin);
+#ifdef GPIO_FAST_PATH_AVR
+    if (pinIndex < NUM_DIGITAL_PINS && pinOutput[pinIndex] != NULL &&
+        (value == INPUT || value == OUTPUT || value == INPUT_PULLUP)) {
+        _p(MSG_MWARDUINOCLASS_PIN_MODE, pinIndex, value);
+        volatile uint8_t* out = pinOutput[pinIndex];
+        byte mask = pinMask[pinIndex];
+        uint8_t oldSREG = SREG;
+        cli();
+        if (value == OUTPUT) {
+            *(out - 1) |= mask;
+        }
+        else {
+            *(out - 1) &= ~mask;
+            if (value == INPUT_PULLUP) {
+                *out |= mask;
+            }
+            else {
+                *out &= ~mask;
+            }
+        }
+        SREG = oldSREG;
+        return;
+    }
+#endif
     _Arduino::pinMode(pinIndex, value);
 }
 
 void MWArduinoClass::digitalWriteMW(byte pin, byte value)
 {
+#if defined(GPIO_FAST_PATH_AVR)
+    if (pin < NUM_DIGITAL_PINS && pinOutput[pin] != NULL) {
+        if (!IS_PWM_PIN_SET(pin)) {
+            _p(MSG_MWARDUINOCLASS_DIGITAL_WRITE, pin, value);
+            volatile uint8_t* out = pinOutput[pin];
+            uint8_t oldSREG = SREG;
+            cli(); // read-modify-write, an interrupt may write the same port
+            if (value == LOW) {
+                *out &= ~pinMask[pin];
+            }
+            else {
+                *out |= pinMask[pin];
+            }
+            SREG = oldSREG;
+            return;
+        }
+        pwmPins[pin >> 3] &= ~(1 << (pin & 7)); // the core turns the timer off
+    }
+#elif defined(GPIO_FAST_PATH_SAM)
+    if (pin < PINS_COUNT) {
+        Pio* pio = g_APinDescription[pin].pPort;
+        uint32_t mask = g_APinDescription[pin].ulPin;
+        if ((pio->PIO_PSR & mask) && (pio->PIO_OSR & mask)) { // PIO-controlled output
+            _p(MSG_MWARDUINOCLASS_DIGITAL_WRITE, pin, value);
+            if (value == LOW) {
+                pio->PIO_CODR = mask;
+            }
+            else {
+                pio->PIO_SODR = mask;
+            }
+            return;
+        }
+    }
+#endif
 	_Arduino::digitalWrite(pin, value);
 }
 
 byte MWArduinoClass::digitalReadMW(byte pin)
 {
+#if defined(GPIO_FAST_PATH_AVR)
+    if (pin < NUM_DIGITAL_PINS && pinOutput[pin] != NULL && !IS_PWM_PIN_SET(pin)) {
+        byte value = (*(pinOutput[pin] - 2) & pinMask[pin]) ? HIGH : LOW;
+        _p(MSG_MWARDUINOCLASS_DIGITAL_READ, pin, value);
+        return value;
+    }
+#elif defined(GPIO_FAST_PATH_SAM)
+    if (pin < PINS_COUNT && g_APinDescription[pin].ulPinType != PIO_NOT_A_PIN) {
+        byte value = (g_APinDescription[pin].pPort->PIO_PDSR & g_APinDescription[pin].ulPin) ? HIGH : LOW;
+        _p(MSG_MWARDUINOCLASS_DIGITAL_READ, pin, value);
+        return value;
+    }
+#endif
     return _Arduino::digitalRead(pin);
 }
 
 void MWArduinoClass::analogWriteMW(byte pin, byte value)
 {
+#ifdef GPIO_FAST_PATH_AVR
+    if (pin < NUM_DIGITAL_PINS) {
+        pwmPins[pin >> 3] |= (1 << (pin & 7));
+    }
+#endif
 	_Arduino::analogWrite(pin, value);
 }
 
 int MWArduinoClass::analogReadMW(byte pin)
 {
-	return _Arduino::analogRead(pin);;
+    MWStream.lock();
+	int value = _Arduino::analogRead(pin);
+    MWStream.unlock();
+    return value;
 }
 
-void MWArduinoClass::toneMW(byte pin, unsigned int frequency, unsigned long duration)
+bool MWArduinoClass::toneMW(byte pin, unsigned int frequency, unsigned long duration)
 {
     #ifdef ARDUINO_ARCH_AVR
+    if (MWStream.isRunning()) {
+        return false; // tone() shares Timer2 with the acquisition stream
+    }
 	if (frequency == 0 || duration == 0) {
 		_Arduino::noTone(pin);
 	}
@@ -335,20 +1097,95 @@ void MWArduinoClass::toneMW(byte pin, unsigned int frequency, unsigned long dura
 		_Arduino::tone(pin, frequency, duration);
 	}
     #endif
+    return true;
+}
+
+byte MWArduinoClass::readPortMW(byte port, byte bitmask)
+{
+    return _Arduino::readPort(port, bitmask);
+}
+
+void MWArduinoClass::writePortMW(byte port, byte value, byte bitmask)
+{
+    _Arduino::writePort(port, value, bitmask);
 }
 
 void MWArduinoClass::begin(long speed) 
 {
     Firmata.setFirmwareNameAndVersion("ArduinoServer IO Library", FIRMATA_MAJOR_VERSION, FIRMATA_MINOR_VERSION);
 	Firmata.attach(START_SYSEX, sysexCallback);
+#ifdef GPIO_FAST_PATH_AVR
+    initPinRegisters();
+#endif
 
     Firmata.begin(speed);
+    MWStats.reset();
 }
 
 void MWArduinoClass::update()
 {
+    unsigned long startMicros = micros();
+    MWStats.buffers(Serial.available(), 0);
     while(Firmata.available()) {
-        Firmata.processInput();
+        // framing is checked per byte since configureProtocol can switch it mid-stream
+        if(protocolOptions & PROTOCOL_BINARY_FRAMING){
+            processFrameInput(Serial.read());
+        }
+        else{
+            Firmata.processInput();
+        }
+        drainTxBuffer();
+    }
+    runTasks();
+    MWStream.update();
+    MWPinChange.update();
+    MWRules.update();
+    MWScript.update();
+    MWStats.buffers(0, (txHead - txTail) & (TX_BUFFER_SIZE - 1));
+    drainTxBuffer();
+    MWStats.loop(micros() - startMicros);
+}
+
+byte MWArduinoClass::addTask(TaskCallback callback, void* context, unsigned long delayMicros, unsigned long periodMicros)
+{
+    for (byte i = 0; i < MAX_TASKS; ++i) {
+        if (tasks[i].callback == NULL) {
+            tasks[i].context = context;
+            tasks[i].dueTime = micros() + delayMicros;
+            tasks[i].period = periodMicros;
+            tasks[i].callback = callback;
+            tasks[i].generation++;
+            return i;
+        }
+    }
+    return NO_TASK;
+}
+
+void MWArduinoClass::removeTask(byte taskID)
+{
+    if (taskID < MAX_TASKS) {
+        tasks[taskID].callback = NULL;
+    }
+}
+
+void MWArduinoClass::runTasks()
+{
+    for (byte i = 0; i < MAX_TASKS; ++i) {
+        Task& task = tasks[i];
+        if (task.callback == NULL || (long)(micros() - task.dueTime) < 0) {
+            continue;
+        }
+        byte generation = task.generation;
+        bool isAgain = task.callback(task.context);
+        if (task.generation != generation) {
+            continue; // the task removed itself and the slot was reused, possibly by the same callback
+        }
+        if (!isAgain) {
+            task.callback = NULL;
+        }
+        else if (task.period != 0) {
+            task.dueTime += task.period;
+        }
     }
 }
 
@@ -362,67 +1199,21 @@ void MWArduinoClass::registerLibrary(LibraryBase* lib)
 	}
 }
 
-
-// Arduino debug trace
+// Arduino core wrappers
 //
-//
-prog_char MSG_MWARDUINOCLASS_DIGITAL_WRITE[]      PROGMEM = "Arduino::digitalWrite(%d, %s);\n";
-prog_char MSG_MWARDUINOCLASS_DIGITAL_READ[]  	  PROGMEM = "Arduino::digitalRead(%d); --> %s\n";
-prog_char MSG_MWARDUINOCLASS_PIN_MODE[]  	  	  PROGMEM = "Arduino::pinMode(%d, %s);\n";
-prog_char MSG_MWARDUINOCLASS_ANALOG_WRITE[]  	  PROGMEM = "Arduino::analogWrite(%d, %d);\n";
-prog_char MSG_MWARDUINOCLASS_ANALOG_READ[] 		  PROGMEM = "Arduino::analogRead(%d) --> %d;\n";
-prog_char MSG_MWARDUINOCLASS_PLAY_TONE[]   		  PROGMEM = "Arduino::playTone(%d, %d, %d);\n";
-prog_char MSG_MWARDUINOCLASS_NO_TONE[]   		  PROGMEM = "Arduino::noTone(%d);\n";
-
 void _Arduino::pinMode(byte pin, byte value) {
-	switch (value) {
-	case INPUT:
-		_p(MSG_MWARDUINOCLASS_PIN_MODE, pin, "INPUT");
-		break;
-	case OUTPUT:
-		_p(MSG_MWARDUINOCLASS_PIN_MODE, pin, "OUTPUT");
-		break;
-	case INPUT_PULLUP:
-		_p(MSG_MWARDUINOCLASS_PIN_MODE, pin, "INPUT_PULLUP");
-		break;
-	default:
-		char szBuffer[8];
-		_p(MSG_MWARDUINOCLASS_PIN_MODE, pin, itoa(value, szBuffer, 10));
-		break;
-	}
+    _p(MSG_MWARDUINOCLASS_PIN_MODE, pin, value);
     ::pinMode(pin, value);
 }
 
 void _Arduino::digitalWrite(byte pin, byte value) {
-	switch (value) {
-	case HIGH:
-		_p(MSG_MWARDUINOCLASS_DIGITAL_WRITE, pin, "HIGH");
-		break;
-	case LOW:
-		_p(MSG_MWARDUINOCLASS_DIGITAL_WRITE, pin, "LOW");
-		break;
-	default:
-		char szBuffer[8];
-		_p(MSG_MWARDUINOCLASS_DIGITAL_WRITE, pin, itoa(value, szBuffer, 10));
-		break;
-	}
+    _p(MSG_MWARDUINOCLASS_DIGITAL_WRITE, pin, value);
 	::digitalWrite(pin, value);
 }
 
 byte _Arduino::digitalRead(byte pin) {
     byte value = ::digitalRead(pin);
-	switch (value) {
-	case HIGH:
-		_p(MSG_MWARDUINOCLASS_DIGITAL_READ, pin, "HIGH");
-		break;
-	case LOW:
-		_p(MSG_MWARDUINOCLASS_DIGITAL_READ, pin, "LOW");
-		break;
-	default:
-		char szBuffer[8];
-		_p(MSG_MWARDUINOCLASS_DIGITAL_READ, pin, itoa(value, szBuffer, 10));
-		break;
-	}
+    _p(MSG_MWARDUINOCLASS_DIGITAL_READ, pin, value);
     return value;
 }
 
@@ -445,7 +1236,7 @@ void _Arduino::tone(byte pin, unsigned int frequency, unsigned long duration) {
     #endif
 }
 
-byte _Arduino::noTone(byte pin) {
+void _Arduino::noTone(byte pin) {
     #ifdef ARDUINO_ARCH_SAM
     #else
     _p(MSG_MWARDUINOCLASS_NO_TONE, pin);
@@ -453,6 +1244,17 @@ byte _Arduino::noTone(byte pin) {
     #endif
 }
 
+byte _Arduino::readPort(byte port, byte bitmask) {
+    byte value = ::readPort(port, bitmask);
+    _p(MSG_MWARDUINOCLASS_READ_PORT, port, bitmask, value);
+    return value;
+}
+
+void _Arduino::writePort(byte port, byte value, byte bitmask) {
+    _p(MSG_MWARDUINOCLASS_WRITE_PORT, port, value, bitmask);
+    ::writePort(port, value, bitmask);
+}
+
 //
 //
 //
@@ -460,3 +1262,22 @@ byte _Arduino::noTone(byte pin) {
 //
 //
 //
+
+// Scratch arena, sized by the libraries included from Dynamic.cpp
+#ifndef SCRATCH_SIZE
+#define SCRATCH_SIZE 1
+#endif
+
+byte MWArduinoClass::scratchArena[SCRATCH_SIZE];
+
+byte* MWArduinoClass::borrowScratch(unsigned int size) {
+    if(scratchBorrowed || size > SCRATCH_SIZE){
+        return NULL;
+    }
+    scratchBorrowed = true;
+    return scratchArena;
+}
+
+void MWArduinoClass::returnScratch() {
+    scratchBorrowed = false;
+}
@@ -13,6 +13,195 @@
 
 #define MAX_NUM_LIBRARIES 16
 
+// Operations of writeDigitalPort on the pins selected by its mask
+#define PORT_WRITE  0x00 // pins take the corresponding bits of value
+#define PORT_SET    0x01
+#define PORT_CLEAR  0x02
+#define PORT_TOGGLE 0x03
+
+// Direct-register GPIO fast path of digitalWriteMW/digitalReadMW/pinModeMW.
+// On AVR the output register and bitmask of each pin are cached by begin(); on SAM the
+// PIO controller of the pin is taken from g_APinDescription. Pins the fast path does not
+// cover (PWM outputs, pins without a port) go through the Arduino core.
+#if defined(ARDUINO_ARCH_AVR) && defined(portOutputRegister)
+#define GPIO_FAST_PATH_AVR
+#elif defined(ARDUINO_ARCH_SAM)
+#define GPIO_FAST_PATH_SAM
+#endif
+
+// Protocol options negotiated by the host with configureProtocol
+#define PROTOCOL_TAGGED_RESPONSES 0x01 // responses carry the sequence ID of their request
+#define PROTOCOL_BINARY_FRAMING   0x02 // commands arrive as COBS frames with raw 8-bit payloads instead of sysex
+#define MAX_BATCH_RESPONSE_SIZE 64 // combined size of all response records returned by one batch
+
+// Requests the host may have in flight, reported by configureProtocol. Requests queued behind
+// a slow handler, e.g. an I2C transaction, wait in the serial receive buffer, which has to hold
+// them whole; counted in sysex requests of MAX_DATA_BYTES, 2 on the Uno
+#if defined(SERIAL_RX_BUFFER_SIZE) // AVR core 1.6.6 and later
+#define SERIAL_RX_SIZE SERIAL_RX_BUFFER_SIZE
+#elif defined(SERIAL_BUFFER_SIZE)
+#define SERIAL_RX_SIZE SERIAL_BUFFER_SIZE
+#else
+#define SERIAL_RX_SIZE 64
+#endif
+#define MAX_OUTSTANDING_REQUESTS ((SERIAL_RX_SIZE / MAX_DATA_BYTES > 1) ? SERIAL_RX_SIZE / MAX_DATA_BYTES : 1)
+
+// Largest decoded COBS command frame, at most 256 so that argc fits into a byte
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_FRAME_SIZE 64
+#else
+#define MAX_FRAME_SIZE 256
+#endif
+
+// Size of the response transmit ring buffer, must be a power of 2
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define TX_BUFFER_SIZE 64
+#else
+#define TX_BUFFER_SIZE 256
+#endif
+#define TX_DRAIN_CHUNK 16 // max bytes handed to Serial per pass when its free space cannot be queried
+
+// Working memory shared by the library command handlers instead of heap allocations.
+// Each library header raises SCRATCH_SIZE to what its largest command needs before
+// Dynamic.cpp is included, and the arena is defined after it with the final size:
+//   #if !defined(SCRATCH_SIZE) || SCRATCH_SIZE < MYLIB_SCRATCH_SIZE
+//   #undef SCRATCH_SIZE
+//   #define SCRATCH_SIZE MYLIB_SCRATCH_SIZE
+//   #endif
+
+// Unsolicited event messages sent without a request, e.g. acquisition stream frames
+void sendEventMsg(byte eventID, int payload_size, byte* val);
+
+// Runs a command in sysex layout that did not come from the host, e.g. from a script,
+// and discards its response. command is 0x00 for base or 0x01 for library commands.
+void executeCommandQuietly(byte command, byte argc, byte* argv);
+
+// millis() at which the last command from the host arrived
+unsigned long lastCommandMillis();
+
+// Cooperative tasks
+// Long operations run as tasks split into short slices instead of blocking their command
+// handler. update() calls each due task once per pass, after the pending input has been
+// processed. A task returns true to be called again, after periodMicros if it has a
+// period and on the next pass otherwise, and false when it is done.
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_TASKS 4
+#else
+#define MAX_TASKS 8
+#endif
+#define NO_TASK 0xFF
+
+typedef bool (*TaskCallback)(void* context);
+typedef struct {
+    TaskCallback callback; // NULL for a free slot
+    void* context;
+    unsigned long dueTime; // micros() of the next call
+    unsigned long period;  // 0 for a task that is called on every pass
+    byte generation;       // counts the addTask calls that claimed the slot
+} Task;
+
+// A handler that rejects its request, e.g. for an unknown device or a parameter out of
+// range, answers with the status RESPONSE_ERROR as the only payload byte instead of no
+// response, so the host does not wait for its timeout.
+#define RESPONSE_ERROR 0xFF
+void sendErrorResponseMsg(byte cmdID);
+
+// A handler that answers its request from a task keeps the sequence ID from deferResponse
+// and answers with sendDeferredResponseMsg. deferResponse returns false inside a batch or
+// script, where the handler has to answer before it returns.
+bool deferResponse(byte* sequenceID);
+void sendDeferredResponseMsg(byte sequenceID, byte cmdID, int payload_size, byte* val);
+
+// Debug trace
+// _p(MSG_..., args) calls are resolved at compile time by the trace policy: without
+// MW_DEBUG they compile to nothing. With MW_DEBUG each call appends a binary record to a
+// ring buffer that the host empties with the drainTrace command; the host formats the
+// records itself and reads the format strings from flash with getTraceString.
+// Record: length of the rest, address of the PROGMEM format string (TRACE_POINTER_SIZE
+// bytes), one 4-byte value per argument; all values least significant byte first.
+// Records that do not fit into the buffer are dropped and counted.
+#define TRACE_POINTER_SIZE sizeof(const char*)
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define TRACE_BUFFER_SIZE 128 // must be a power of 2
+#define MAX_TRACE_DRAIN 48    // record bytes returned by one drainTrace
+#else
+#define TRACE_BUFFER_SIZE 512
+#define MAX_TRACE_DRAIN 240
+#endif
+#define MAX_TRACE_STRING 128 // longest format string returned by getTraceString
+
+#ifdef MW_DEBUG
+#define TRACE_ENABLED true
+#else
+#define TRACE_ENABLED false
+#endif
+
+template<bool enabled>
+class TracePolicy {
+public:
+    static void record(const char* fmt, byte numArgs, const long* args) {}
+};
+
+template<>
+class TracePolicy<true> {
+public:
+    static void record(const char* fmt, byte numArgs, const long* args);
+};
+
+typedef TracePolicy<TRACE_ENABLED> Trace;
+
+inline void _p(const char* fmt) {
+    Trace::record(fmt, 0, NULL);
+}
+
+template<class A1>
+inline void _p(const char* fmt, A1 a1) {
+    long args[] = {(long)a1};
+    Trace::record(fmt, 1, args);
+}
+
+template<class A1, class A2>
+inline void _p(const char* fmt, A1 a1, A2 a2) {
+    long args[] = {(long)a1, (long)a2};
+    Trace::record(fmt, 2, args);
+}
+
+template<class A1, class A2, class A3>
+inline void _p(const char* fmt, A1 a1, A2 a2, A3 a3) {
+    long args[] = {(long)a1, (long)a2, (long)a3};
+    Trace::record(fmt, 3, args);
+}
+
+template<class A1, class A2, class A3, class A4>
+inline void _p(const char* fmt, A1 a1, A2 a2, A3 a3, A4 a4) {
+    long args[] = {(long)a1, (long)a2, (long)a3, (long)a4};
+    Trace::record(fmt, 4, args);
+}
+
+template<class A1, class A2, class A3, class A4, class A5>
+inline void _p(const char* fmt, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5) {
+    long args[] = {(long)a1, (long)a2, (long)a3, (long)a4, (long)a5};
+    Trace::record(fmt, 5, args);
+}
+
+template<class A1, class A2, class A3, class A4, class A5, class A6>
+inline void _p(const char* fmt, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6) {
+    long args[] = {(long)a1, (long)a2, (long)a3, (long)a4, (long)a5, (long)a6};
+    Trace::record(fmt, 6, args);
+}
+
+template<class A1, class A2, class A3, class A4, class A5, class A6, class A7>
+inline void _p(const char* fmt, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6, A7 a7) {
+    long args[] = {(long)a1, (long)a2, (long)a3, (long)a4, (long)a5, (long)a6, (long)a7};
+    Trace::record(fmt, 7, args);
+}
+
+template<class A1, class A2, class A3, class A4, class A5, class A6, class A7, class A8>
+inline void _p(const char* fmt, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6, A7 a7, A8 a8) {
+    long args[] = {(long)a1, (long)a2, (long)a3, (long)a4, (long)a5, (long)a6, (long)a7, (long)a8};
+    Trace::record(fmt, 8, args);
+}
+
 // Arduino debug trace
 class _Arduino {
 public:
@@ -22,7 +211,9 @@ public:
     static void analogWrite(byte pin, byte value);
     static int  analogRead(byte pin);
     static void tone(byte pin, unsigned int frequency, unsigned long duration);
-    static byte noTone(byte pin);
+    static void noTone(byte pin);
+    static byte readPort(byte port, byte bitmask);
+    static void writePort(byte port, byte value, byte bitmask);
 };
 
 class MWArduinoClass
@@ -33,7 +224,9 @@ public:
 	byte digitalReadMW(byte pin);
 	void analogWriteMW(byte pin, byte value);
 	int analogReadMW(byte pin);
-	void toneMW(byte pin, unsigned int frequency, unsigned long duration);
+	bool toneMW(byte pin, unsigned int frequency, unsigned long duration); // false while Timer2 is taken
+    byte readPortMW(byte port, byte bitmask);
+    void writePortMW(byte port, byte value, byte bitmask);
 
 public:
 	LibraryBase* libraryArray[MAX_NUM_LIBRARIES];
@@ -43,6 +236,30 @@ public:
     void begin(long);
     void update();
 	void registerLibrary(LibraryBase* lib);
+
+    // Scratch arena for command handlers, see SCRATCH_SIZE.
+    // A handler borrows it for the length of one command and returns it before it
+    // returns; borrowScratch returns NULL if size does not fit or it is already borrowed.
+    byte* borrowScratch(unsigned int size);
+    void returnScratch();
+
+    // Cooperative tasks, see MAX_TASKS. addTask returns NO_TASK if all slots are taken.
+    byte addTask(TaskCallback callback, void* context, unsigned long delayMicros, unsigned long periodMicros);
+    void removeTask(byte taskID);
+
+private:
+    static byte scratchArena[];
+    bool scratchBorrowed;
+
+    void runTasks();
+    Task tasks[MAX_TASKS];
+
+#ifdef GPIO_FAST_PATH_AVR
+    void initPinRegisters();
+    volatile uint8_t* pinOutput[NUM_DIGITAL_PINS]; // NULL if the pin has no port
+    byte pinMask[NUM_DIGITAL_PINS];
+    byte pwmPins[(NUM_DIGITAL_PINS + 7) / 8]; // pins last driven by analogWrite, the core turns their timer off
+#endif
 };
 
 extern MWArduinoClass MWArduino;
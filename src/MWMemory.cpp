@@ -0,0 +1,84 @@
+/*
+  MWMemory.cpp - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#include "MWArduino.h"
+#include "MWMemory.h"
+
+extern int __heap_start, *__brkval;
+
+#if defined(__AVR__)
+#define MEMORY_USE_STACK_PAINT
+#define MEMORY_USE_FREE_LIST
+#endif
+
+#if defined(MEMORY_USE_STACK_PAINT)
+// Runs from .init1, before the stack pointer and the zero register are set up, so it cannot
+// be written in C. Fills _end up to and including __stack.
+void paintStack() __attribute__ ((naked)) __attribute__ ((used)) __attribute__ ((section (".init1")));
+void paintStack()
+{
+    __asm volatile (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :: "M" (STACK_CANARY));
+}
+#endif
+
+#if defined(MEMORY_USE_FREE_LIST)
+// Free list of avr-libc malloc, see malloc.c
+struct __freelist {
+    size_t sz; // bytes after this field
+    struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+#endif
+
+int freeRam () {
+  int v; 
+  return (int) ((uintptr_t) &v - (__brkval == 0 ? (uintptr_t) &__heap_start : (uintptr_t) __brkval)); 
+}
+
+void MWMemoryClass::report(MemoryReport& report)
+{
+    memset(&report, 0, sizeof(report));
+    report.freeRam = freeRam();
+    
+#if defined(MEMORY_USE_STACK_PAINT)
+    byte* heapTop = (byte*)((__brkval == 0) ? &__heap_start : __brkval);
+    byte* p = heapTop;
+    while(p <= (byte*)RAMEND && *p == STACK_CANARY){
+        p++;
+    }
+    report.stackHeadroom = p - heapTop;
+    report.maxStackDepth = (byte*)RAMEND - p + 1;
+    report.flags |= MEMORY_STACK_PAINTED;
+#endif
+
+#if defined(MEMORY_USE_FREE_LIST)
+    if(__brkval != 0){
+        report.heapSize = (byte*)__brkval - (byte*)&__heap_start;
+    }
+    for(struct __freelist* block = __flp; block != NULL; block = block->nx){
+        report.freeListSize += block->sz;
+        report.freeListBlocks++;
+        if(block->sz > report.largestFreeBlock){
+            report.largestFreeBlock = block->sz;
+        }
+    }
+    report.flags |= MEMORY_HEAP_LIST;
+#endif
+}
+
+MWMemoryClass MWMemory;
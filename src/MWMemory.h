@@ -0,0 +1,47 @@
+/*
+  MWMemory.h - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#ifndef MWMemory_h
+#define MWMemory_h
+
+#include "Arduino.h"
+
+#define STACK_CANARY 0xC5 // fill of the stack region that the stack has not reached yet
+
+// Report flags, set for the parts of the report the board supports
+#define MEMORY_STACK_PAINTED 0x01 // maxStackDepth and stackHeadroom are valid
+#define MEMORY_HEAP_LIST     0x02 // heapSize and the free list statistics are valid
+
+// Memory report
+// On AVR the RAM between the end of static data and the top of the stack is painted with
+// STACK_CANARY before main() runs. The deepest the stack has reached since boot is where the
+// paint ends, counted from the top of the heap, which overwrites the paint as it grows. Heap
+// statistics walk the avr-libc malloc free list; freed blocks are only returned to the
+// unallocated space when they are at the top of the heap, so the free list shows how
+// fragmented the heap is.
+typedef struct {
+    byte flags;
+    unsigned int freeRam;          // between the top of the heap and the stack pointer now
+    unsigned int maxStackDepth;    // bytes below the top of RAM the stack has reached since boot
+    unsigned int stackHeadroom;    // painted bytes between the top of the heap and that depth
+    unsigned int heapSize;         // from the start of the heap to its top
+    unsigned int freeListSize;     // bytes of the blocks in the free list
+    unsigned int freeListBlocks;
+    unsigned int largestFreeBlock;
+} MemoryReport;
+
+int freeRam();
+
+class MWMemoryClass
+{
+public:
+    void report(MemoryReport& report);
+};
+
+extern MWMemoryClass MWMemory;
+
+#endif // MWMemory.h
@@ -0,0 +1,190 @@
+/*
+  MWPinChange.cpp - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+ 
+  See file LICENSE.txt for licensing terms.
+*/
+
+#include "MWArduino.h"
+#include "MWPinChange.h"
+
+#define NO_SUBSCRIPTION 0xFF
+
+#if defined(ARDUINO_ARCH_AVR) && defined(PCICR)
+#define PIN_CHANGE_USE_PCINT
+#elif defined(ARDUINO_ARCH_SAM)
+#define PIN_CHANGE_USE_EXTINT
+#endif
+
+byte pinChangePins[MAX_PIN_CHANGE_SUBSCRIPTIONS];
+byte pinChangeHasInterrupt[MAX_PIN_CHANGE_SUBSCRIPTIONS];
+unsigned long pinChangeDebounce[MAX_PIN_CHANGE_SUBSCRIPTIONS];
+byte pinChangeReported[MAX_PIN_CHANGE_SUBSCRIPTIONS]; // last state sent to the host
+volatile byte pinChangeRaw[MAX_PIN_CHANGE_SUBSCRIPTIONS];
+volatile unsigned long pinChangeTime[MAX_PIN_CHANGE_SUBSCRIPTIONS];
+
+#if defined(PIN_CHANGE_USE_PCINT)
+// A pin change vector is shared by a whole port, so every subscribed pin is checked
+#if defined(PCINT0_vect)
+ISR(PCINT0_vect){ MWPinChange.edge(); }
+#endif
+#if defined(PCINT1_vect)
+ISR(PCINT1_vect){ MWPinChange.edge(); }
+#endif
+#if defined(PCINT2_vect)
+ISR(PCINT2_vect){ MWPinChange.edge(); }
+#endif
+#if defined(PCINT3_vect)
+ISR(PCINT3_vect){ MWPinChange.edge(); }
+#endif
+
+static bool attachPinChange(byte pin){
+    volatile uint8_t* pcicr = digitalPinToPCICR(pin);
+    if(pcicr == 0){
+        return false;
+    }
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    *pcicr |= _BV(digitalPinToPCICRbit(pin));
+    return true;
+}
+
+static void detachPinChange(byte pin){
+    // the port's vector stays enabled, edges on unmasked pins no longer reach it
+    if(digitalPinToPCICR(pin) != 0){
+        *digitalPinToPCMSK(pin) &= ~_BV(digitalPinToPCMSKbit(pin));
+    }
+}
+
+#elif defined(PIN_CHANGE_USE_EXTINT)
+static void pinChangeISR(){
+    MWPinChange.edge();
+}
+
+static bool attachPinChange(byte pin){
+    attachInterrupt(pin, pinChangeISR, CHANGE);
+    return true;
+}
+
+static void detachPinChange(byte pin){
+    detachInterrupt(pin);
+}
+
+#else
+static bool attachPinChange(byte pin){
+    return false;
+}
+
+static void detachPinChange(byte pin){
+}
+#endif
+
+// MWPinChange class
+//
+MWPinChangeClass::MWPinChangeClass()
+{
+    for(byte i = 0; i < MAX_PIN_CHANGE_SUBSCRIPTIONS; ++i){
+        pinChangePins[i] = NO_SUBSCRIPTION;
+    }
+}
+
+bool MWPinChangeClass::subscribe(byte pin, unsigned long debounceMicros)
+{
+    byte index = NO_SUBSCRIPTION;
+    for(byte i = 0; i < MAX_PIN_CHANGE_SUBSCRIPTIONS; ++i){
+        if(pinChangePins[i] == pin){ // resubscribing only changes the debounce window
+            pinChangeDebounce[i] = debounceMicros;
+            return true;
+        }
+        if(pinChangePins[i] == NO_SUBSCRIPTION && index == NO_SUBSCRIPTION){
+            index = i;
+        }
+    }
+    if(index == NO_SUBSCRIPTION){
+        return false;
+    }
+    
+    byte state = ::digitalRead(pin);
+    pinChangeDebounce[index] = debounceMicros;
+    pinChangeReported[index] = state;
+    noInterrupts();
+    pinChangeRaw[index] = state;
+    pinChangeTime[index] = micros();
+    pinChangePins[index] = pin;
+    interrupts();
+    pinChangeHasInterrupt[index] = attachPinChange(pin);
+    return true;
+}
+
+void MWPinChangeClass::unsubscribe(byte pin)
+{
+    for(byte i = 0; i < MAX_PIN_CHANGE_SUBSCRIPTIONS; ++i){
+        if(pinChangePins[i] == pin){
+            if(pinChangeHasInterrupt[i]){
+                detachPinChange(pin);
+            }
+            pinChangePins[i] = NO_SUBSCRIPTION;
+        }
+    }
+}
+
+void MWPinChangeClass::unsubscribeAll()
+{
+    for(byte i = 0; i < MAX_PIN_CHANGE_SUBSCRIPTIONS; ++i){
+        if(pinChangePins[i] != NO_SUBSCRIPTION){
+            unsubscribe(pinChangePins[i]);
+        }
+    }
+}
+
+void MWPinChangeClass::edge()
+{
+// Called from the pin interrupts, records the time of every subscribed pin that changed
+    unsigned long now = micros();
+    for(byte i = 0; i < MAX_PIN_CHANGE_SUBSCRIPTIONS; ++i){
+        if(pinChangePins[i] != NO_SUBSCRIPTION){
+            byte state = ::digitalRead(pinChangePins[i]);
+            if(state != pinChangeRaw[i]){
+                pinChangeRaw[i] = state;
+                pinChangeTime[i] = now;
+            }
+        }
+    }
+}
+
+void MWPinChangeClass::update()
+{
+    bool isPolling = false;
+    for(byte i = 0; i < MAX_PIN_CHANGE_SUBSCRIPTIONS; ++i){
+        if(pinChangePins[i] != NO_SUBSCRIPTION && !pinChangeHasInterrupt[i]){
+            isPolling = true;
+        }
+    }
+    if(isPolling){
+        noInterrupts();
+        edge();
+        interrupts();
+    }
+    
+    for(byte i = 0; i < MAX_PIN_CHANGE_SUBSCRIPTIONS; ++i){
+        if(pinChangePins[i] == NO_SUBSCRIPTION){
+            continue;
+        }
+        noInterrupts();
+        byte state = pinChangeRaw[i];
+        unsigned long changeTime = pinChangeTime[i];
+        interrupts();
+        if(state != pinChangeReported[i] && micros() - changeTime >= pinChangeDebounce[i]){
+            pinChangeReported[i] = state;
+            byte val[6];
+            val[0] = pinChangePins[i];
+            val[1] = state;
+            val[2] = (changeTime >> 24) & 0xff; // msb
+            val[3] = (changeTime >> 16) & 0xff;
+            val[4] = (changeTime >> 8) & 0xff;
+            val[5] = changeTime & 0xff;         // lsb
+            sendEventMsg(0x15, 6, val);
+        }
+    }
+}
+
+MWPinChangeClass MWPinChange;
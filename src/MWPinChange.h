@@ -0,0 +1,40 @@
+/*
+  MWPinChange.h - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+ 
+  See file LICENSE.txt for licensing terms.
+*/
+
+#ifndef MWPinChange_h
+#define MWPinChange_h
+
+#include "Arduino.h"
+
+// Number of pins that can be subscribed at the same time
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_PIN_CHANGE_SUBSCRIPTIONS 4
+#else
+#define MAX_PIN_CHANGE_SUBSCRIPTIONS 8
+#endif
+
+// Pin change notifications
+// Subscribed pins are watched by pin change interrupts (AVR), external interrupts (Due)
+// or polling from update() on pins without either. An edge only records its time; once
+// the pin has been stable for the debounce window, update() sends the new state as an
+// unsolicited event message.
+//
+// Event payload: pin, state, micros() timestamp of the last edge (msb first).
+class MWPinChangeClass
+{
+public:
+    MWPinChangeClass();
+    bool subscribe(byte pin, unsigned long debounceMicros);
+    void unsubscribe(byte pin);
+    void unsubscribeAll();
+    void update();
+    void edge();
+};
+
+extern MWPinChangeClass MWPinChange;
+
+#endif // MWPinChange.h
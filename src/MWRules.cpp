@@ -0,0 +1,221 @@
+/*
+  MWRules.cpp - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#include "MWArduino.h"
+#include "MWScript.h"
+#include "MWRules.h"
+
+#define RULE_EVENT 0x60
+#define RULE_DISABLED 0x00
+
+typedef struct {
+    byte definition[MAX_RULE_SIZE]; // definition[RULE_CONDITION] is RULE_DISABLED for a free rule
+    byte isPrimed;                  // state has been read since the rule was set
+    byte state;                     // debounced pin state, or 1 while an analog or timeout rule is armed
+    byte raw;                       // last pin state read
+    unsigned long changeTime;       // micros() of the last raw pin change
+} Rule;
+
+Rule rules[MAX_RULES];
+byte analogRuleTurn = 0; // first rule to consider for the next analog sample, see update()
+
+static bool isAnalogRule(byte ruleID){
+    byte condition = rules[ruleID].definition[RULE_CONDITION];
+    return condition == RULE_ANALOG_ABOVE || condition == RULE_ANALOG_BELOW;
+}
+
+static byte actionSize(byte length, byte* definition){
+// Bytes of the action and its operands, 0 if it is malformed
+    byte remaining = length - RULE_ACTION;
+    byte size;
+    switch(definition[RULE_ACTION]){
+        case RULE_NO_ACTION:
+            size = 1;
+            break;
+        case RULE_WRITE_DIGITAL:
+            size = 3;
+            break;
+        case RULE_RUN_SCRIPT:
+        case RULE_STOP_SCRIPT:
+            size = 2;
+            break;
+        case RULE_COMMAND:
+            if(remaining < 3 || definition[RULE_OPERANDS+1] == 0){
+                return 0;
+            }
+            size = 3 + definition[RULE_OPERANDS+1];
+            break;
+        default:
+            return 0;
+    }
+    return (size <= remaining) ? size : 0;
+}
+
+static void fire(byte ruleID, unsigned int value, unsigned long now){
+    Rule& rule = rules[ruleID];
+    byte* operands = &rule.definition[RULE_OPERANDS];
+    switch(rule.definition[RULE_ACTION]){
+        case RULE_WRITE_DIGITAL:
+            MWArduino.digitalWriteMW(operands[0], operands[1]);
+            break;
+        case RULE_RUN_SCRIPT:
+            MWScript.run(operands[0]);
+            break;
+        case RULE_STOP_SCRIPT:
+            MWScript.stop(operands[0]);
+            break;
+        case RULE_COMMAND:
+        {
+            // same layout as a received command: sequence_ID, payload_size, cmdID/libID, params
+            byte command[MAX_RULE_SIZE + 3];
+            byte length = operands[1];
+            command[0] = 0x00;
+            command[1] = 0x01; // unused payload_size
+            command[2] = 0x01;
+            memcpy(&command[3], &operands[2], length);
+            executeCommandQuietly(operands[0], length + 3, command);
+            break;
+        }
+    }
+    if(rule.definition[RULE_FLAGS] & RULE_EMIT_EVENT){
+        byte event[7];
+        event[0] = ruleID;
+        event[1] = value >> 8;
+        event[2] = value & 0xff;
+        event[3] = (now >> 24) & 0xff;
+        event[4] = (now >> 16) & 0xff;
+        event[5] = (now >> 8) & 0xff;
+        event[6] = now & 0xff;
+        sendEventMsg(RULE_EVENT, 7, event);
+    }
+    if(rule.definition[RULE_FLAGS] & RULE_ONE_SHOT){
+        rule.definition[RULE_CONDITION] = RULE_DISABLED;
+    }
+}
+
+static void evaluate(byte ruleID){
+    Rule& rule = rules[ruleID];
+    byte* definition = rule.definition;
+    byte pin = definition[RULE_PIN];
+    unsigned int arg = definition[RULE_ARG] + (definition[RULE_ARG+1] << 8);
+    unsigned long now = micros();
+    switch(definition[RULE_CONDITION]){
+        case RULE_PIN_EDGE:
+        {
+            byte raw = MWArduino.digitalReadMW(pin);
+            if(!rule.isPrimed){
+                rule.state = raw;
+                rule.raw = raw;
+                rule.isPrimed = 1;
+            }
+            if(raw != rule.raw){
+                rule.raw = raw;
+                rule.changeTime = now;
+            }
+            else if(raw != rule.state && now - rule.changeTime >= arg){
+                rule.state = raw;
+                if(definition[RULE_OPTION] & (raw ? 0x01 : 0x02)){
+                    fire(ruleID, raw, now);
+                }
+            }
+            break;
+        }
+        case RULE_ANALOG_ABOVE:
+        case RULE_ANALOG_BELOW:
+        {
+            int value = MWArduino.analogReadMW(pin);
+            bool isAbove = (definition[RULE_CONDITION] == RULE_ANALOG_ABOVE);
+            bool isPast = isAbove ? (value > (int)arg) : (value < (int)arg);
+            bool isBack = isAbove ? (value <= (int)arg - definition[RULE_OPTION]) :
+                                    (value >= (int)arg + definition[RULE_OPTION]);
+            if(!rule.isPrimed){
+                rule.state = !isPast; // armed unless it starts past the threshold
+                rule.isPrimed = 1;
+            }
+            if(rule.state && isPast){
+                rule.state = 0;
+                fire(ruleID, value, now);
+            }
+            else if(!rule.state && isBack){
+                rule.state = 1;
+            }
+            break;
+        }
+        case RULE_HOST_TIMEOUT:
+        {
+            bool isSilent = (millis() - lastCommandMillis() >= arg);
+            if(!rule.isPrimed){
+                rule.state = 1;
+                rule.isPrimed = 1;
+            }
+            if(rule.state && isSilent){
+                rule.state = 0;
+                fire(ruleID, 0, now);
+            }
+            else if(!isSilent){
+                rule.state = 1;
+            }
+            break;
+        }
+    }
+}
+
+// MWRules class
+//
+MWRulesClass::MWRulesClass()
+{
+    clearAll();
+}
+
+bool MWRulesClass::set(byte ruleID, byte length, byte* definition)
+{
+    if(ruleID >= MAX_RULES || length > MAX_RULE_SIZE || length <= RULE_ACTION ||
+       definition[RULE_CONDITION] == RULE_DISABLED || definition[RULE_CONDITION] > RULE_HOST_TIMEOUT ||
+       actionSize(length, definition) == 0){
+        return false;
+    }
+    Rule& rule = rules[ruleID];
+    memcpy(rule.definition, definition, length);
+    rule.isPrimed = 0;
+    return true;
+}
+
+void MWRulesClass::clear(byte ruleID)
+{
+    if(ruleID < MAX_RULES){
+        rules[ruleID].definition[RULE_CONDITION] = RULE_DISABLED;
+    }
+}
+
+void MWRulesClass::clearAll()
+{
+    for(byte i = 0; i < MAX_RULES; ++i){
+        rules[i].definition[RULE_CONDITION] = RULE_DISABLED;
+    }
+}
+
+void MWRulesClass::update()
+{
+    // An analog conversion takes about 100 us on AVR, so a pass samples one analog rule,
+    // in turns
+    byte analogRule = MAX_RULES;
+    for(byte n = 0; n < MAX_RULES; ++n){
+        byte i = (analogRuleTurn + n) % MAX_RULES;
+        if(isAnalogRule(i)){
+            analogRule = i;
+            analogRuleTurn = (i + 1) % MAX_RULES;
+            break;
+        }
+    }
+    for(byte i = 0; i < MAX_RULES; ++i){
+        if(rules[i].definition[RULE_CONDITION] != RULE_DISABLED && (i == analogRule || !isAnalogRule(i))){
+            evaluate(i);
+        }
+    }
+}
+
+MWRulesClass MWRules;
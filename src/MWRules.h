@@ -0,0 +1,73 @@
+/*
+  MWRules.h - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#ifndef MWRules_h
+#define MWRules_h
+
+#include "Arduino.h"
+
+// Number of rules and bytes per rule definition
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_RULES 4
+#define MAX_RULE_SIZE 16
+#else
+#define MAX_RULES 8
+#define MAX_RULE_SIZE 32
+#endif
+
+// Rule definition: condition, pin, option, argument (uint16, lsb first), flags, action, operands
+#define RULE_CONDITION 0
+#define RULE_PIN       1
+#define RULE_OPTION    2
+#define RULE_ARG       3
+#define RULE_FLAGS     5
+#define RULE_ACTION    6
+#define RULE_OPERANDS  7
+
+// Conditions
+#define RULE_PIN_EDGE     0x01 // option: 1 - rising, 2 - falling, 3 - both; argument: debounce in microseconds
+#define RULE_ANALOG_ABOVE 0x02 // option: hysteresis in counts; argument: threshold in counts
+#define RULE_ANALOG_BELOW 0x03 // option: hysteresis in counts; argument: threshold in counts
+#define RULE_HOST_TIMEOUT 0x04 // argument: milliseconds without a command from the host
+
+// Flags
+#define RULE_EMIT_EVENT 0x01 // send a rule event when the rule fires
+#define RULE_ONE_SHOT   0x02 // disable the rule after it fired once
+
+// Actions, operands follow RULE_ACTION
+#define RULE_NO_ACTION     0x00 //
+#define RULE_WRITE_DIGITAL 0x01 // pin, value
+#define RULE_RUN_SCRIPT    0x02 // slot
+#define RULE_STOP_SCRIPT   0x03 // slot
+#define RULE_COMMAND       0x04 // header (0x00 or 0x01), length, cmdID/libID, params
+
+// Event -> action rules
+// Rules are evaluated on every pass of the main loop, independent of the host, so reflexes
+// such as a safety stop keep working while the host is busy or gone. Analog rules take turns,
+// one is sampled per pass, so that n analog rules see every n-th pass. A pin edge fires once
+// the pin has been stable for the debounce time. An analog rule fires when the value crosses
+// the threshold and re-arms once it is back by the hysteresis. A host timeout fires once per
+// silence and re-arms with the next command.
+//
+// Longer reactions, e.g. servo or motor sequences, run a script; RULE_COMMAND runs one base
+// or library command in sysex layout and discards its response.
+//
+// Event payload: ruleID, value (pin state or analog counts, msb first), micros() timestamp
+// (msb first).
+class MWRulesClass
+{
+public:
+    MWRulesClass();
+    bool set(byte ruleID, byte length, byte* definition);
+    void clear(byte ruleID);
+    void clearAll();
+    void update();
+};
+
+extern MWRulesClass MWRules;
+
+#endif // MWRules.h
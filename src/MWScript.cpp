@@ -0,0 +1,186 @@
+/*
+  MWScript.cpp - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#include "MWArduino.h"
+#include "MWScript.h"
+
+#define NO_SCRIPT 0xFF
+
+typedef struct {
+    byte code[MAX_SCRIPT_SIZE];
+    byte length;
+    byte pc;                // offset of the next instruction
+    byte isRunning;
+    byte isLooping;         // the SCRIPT_LOOP at the end of the current loop body has been reached
+    byte loopRemaining;     // jumps left of the current loop
+    unsigned long nextTime; // micros() at which the next instruction is due
+} Script;
+
+Script scripts[MAX_SCRIPTS];
+byte executingSlot = NO_SCRIPT; // slot whose SCRIPT_COMMAND is being executed
+
+static byte instructionSize(Script& script){
+// Size of the instruction at pc including its operands, 0 if it is malformed
+    byte remaining = script.length - script.pc;
+    byte size;
+    switch(script.code[script.pc]){
+        case SCRIPT_END:
+            size = 1;
+            break;
+        case SCRIPT_WRITE_DIGITAL:
+        case SCRIPT_WRITE_PWM:
+        case SCRIPT_WAIT_MS:
+        case SCRIPT_WAIT_US:
+        case SCRIPT_LOOP:
+            size = 3;
+            break;
+        case SCRIPT_COMMAND:
+            if(remaining < 3 || script.code[script.pc+2] == 0){
+                return 0;
+            }
+            size = 3 + script.code[script.pc+2];
+            break;
+        default:
+            return 0;
+    }
+    return (size <= remaining) ? size : 0;
+}
+
+static void step(byte slot){
+    Script& script = scripts[slot];
+    if(script.pc >= script.length){
+        script.isRunning = 0;
+        return;
+    }
+    byte size = instructionSize(script);
+    if(size == 0){
+        script.isRunning = 0;
+        return;
+    }
+    byte* operands = &script.code[script.pc+1];
+    script.pc += size;
+    switch(operands[-1]){
+        case SCRIPT_END:
+            script.isRunning = 0;
+            break;
+        case SCRIPT_WRITE_DIGITAL:
+            MWArduino.digitalWriteMW(operands[0], operands[1]);
+            break;
+        case SCRIPT_WRITE_PWM:
+            MWArduino.analogWriteMW(operands[0], operands[1]);
+            break;
+        case SCRIPT_WAIT_MS:
+            script.nextTime += 1000UL * (operands[0] + (operands[1] << 8));
+            break;
+        case SCRIPT_WAIT_US:
+            script.nextTime += operands[0] + (operands[1] << 8);
+            break;
+        case SCRIPT_LOOP:
+            if(operands[1] == 0){
+                script.pc = operands[0];
+            }
+            else{
+                if(!script.isLooping){
+                    script.isLooping = 1;
+                    script.loopRemaining = operands[1];
+                }
+                if(script.loopRemaining > 0){
+                    script.loopRemaining--;
+                    script.pc = operands[0];
+                }
+                else{
+                    script.isLooping = 0;
+                }
+            }
+            break;
+        case SCRIPT_COMMAND:
+        {
+            // same layout as a received command: sequence_ID, payload_size, cmdID/libID, params
+            byte command[MAX_SCRIPT_SIZE + 3];
+            byte length = operands[1];
+            command[0] = 0x00;
+            command[1] = 0x01; // unused payload_size
+            command[2] = 0x01;
+            memcpy(&command[3], &operands[2], length);
+            executingSlot = slot;
+            executeCommandQuietly(operands[0], length + 3, command);
+            executingSlot = NO_SCRIPT;
+            break;
+        }
+    }
+}
+
+// MWScript class
+//
+MWScriptClass::MWScriptClass()
+{
+    for(byte i = 0; i < MAX_SCRIPTS; ++i){
+        scripts[i].length = 0;
+        scripts[i].isRunning = 0;
+    }
+}
+
+bool MWScriptClass::load(byte slot, byte offset, byte length, byte* code)
+{
+// Scripts larger than one command are uploaded in consecutive chunks; offset 0 starts a new one
+    if(slot >= MAX_SCRIPTS || slot == executingSlot ||
+       (unsigned int)offset + length > MAX_SCRIPT_SIZE || (offset > 0 && offset != scripts[slot].length)){
+        return false;
+    }
+    Script& script = scripts[slot];
+    script.isRunning = 0;
+    memcpy(&script.code[offset], code, length);
+    script.length = offset + length;
+    return true;
+}
+
+bool MWScriptClass::run(byte slot)
+{
+// A running script restarts from the beginning
+    if(slot >= MAX_SCRIPTS || scripts[slot].length == 0){
+        return false;
+    }
+    Script& script = scripts[slot];
+    script.pc = 0;
+    script.isLooping = 0;
+    script.nextTime = micros();
+    script.isRunning = 1;
+    return true;
+}
+
+void MWScriptClass::stop(byte slot)
+{
+    if(slot < MAX_SCRIPTS){
+        scripts[slot].isRunning = 0;
+    }
+}
+
+void MWScriptClass::stopAll()
+{
+    for(byte i = 0; i < MAX_SCRIPTS; ++i){
+        scripts[i].isRunning = 0;
+    }
+}
+
+bool MWScriptClass::isRunning(byte slot)
+{
+    return slot < MAX_SCRIPTS && scripts[slot].isRunning;
+}
+
+void MWScriptClass::update()
+{
+    for(byte i = 0; i < MAX_SCRIPTS; ++i){
+        Script& script = scripts[i];
+        // a loop without waits yields after MAX_SCRIPT_STEPS so that commands are still served
+        for(byte steps = 0; steps < MAX_SCRIPT_STEPS && script.isRunning &&
+            (long)(micros() - script.nextTime) >= 0; ++steps){
+            step(i);
+        }
+    }
+}
+
+MWScriptClass MWScript;
@@ -0,0 +1,56 @@
+/*
+  MWScript.h - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#ifndef MWScript_h
+#define MWScript_h
+
+#include "Arduino.h"
+
+// Number of script slots and bytes of bytecode per slot
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_SCRIPTS 2
+#define MAX_SCRIPT_SIZE 48
+#else
+#define MAX_SCRIPTS 4
+#define MAX_SCRIPT_SIZE 128
+#endif
+#define MAX_SCRIPT_STEPS 16 // instructions executed per slot and update() pass without a wait
+
+// Script instructions, operands follow the opcode
+#define SCRIPT_END           0x00 //
+#define SCRIPT_WRITE_DIGITAL 0x01 // pin, value
+#define SCRIPT_WRITE_PWM     0x02 // pin, value
+#define SCRIPT_WAIT_MS       0x03 // milliseconds (uint16, lsb first)
+#define SCRIPT_WAIT_US       0x04 // microseconds (uint16, lsb first)
+#define SCRIPT_LOOP          0x05 // target offset, count (0 - forever)
+#define SCRIPT_COMMAND       0x06 // header (0x00 or 0x01), length, cmdID/libID, params
+
+// Timed action scripts
+// The host uploads a bytecode timeline into a slot and starts it by slot number.
+// update() executes due instructions from the main loop, so commands keep being served
+// while a script waits. Waits are added to the scheduled time of the previous step, not
+// to the time the step ran, so the timeline does not drift.
+//
+// SCRIPT_LOOP jumps back to the target offset count more times before it falls through;
+// loops do not nest. SCRIPT_COMMAND runs a base or library command in sysex layout (data
+// arrays 7-bit encoded) and discards its response. A script stops at SCRIPT_END, at its
+// end or at a malformed instruction.
+class MWScriptClass
+{
+public:
+    MWScriptClass();
+    bool load(byte slot, byte offset, byte length, byte* code);
+    bool run(byte slot);
+    void stop(byte slot);
+    void stopAll();
+    bool isRunning(byte slot);
+    void update();
+};
+
+extern MWScriptClass MWScript;
+
+#endif // MWScript.h
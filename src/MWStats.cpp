@@ -0,0 +1,152 @@
+/*
+  MWStats.cpp - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#include "MWArduino.h"
+#include "MWStats.h"
+
+typedef struct {
+    byte libID;                                // STATS_BASE_LIBRARY for base commands
+    byte cmdID;
+    unsigned long maxMicros;
+    unsigned long totalMicros;
+    unsigned int buckets[NUM_LATENCY_BUCKETS];
+} LatencySlot;
+
+LatencySlot latencySlots[MAX_LATENCY_SLOTS];
+byte numLatencySlots = 0;
+unsigned int numUnrecorded = 0;
+
+unsigned long statsStartMillis = 0;
+unsigned long numLoops = 0;
+unsigned long maxLoopMicros = 0;
+unsigned int rxPeak = 0;
+unsigned int txPeak = 0;
+unsigned int numTxStalls = 0;
+
+static void putLong(byte* val, unsigned long value){
+    val[0] = (value >> 24) & 0xff;
+    val[1] = (value >> 16) & 0xff;
+    val[2] = (value >> 8) & 0xff;
+    val[3] = value & 0xff;
+}
+
+static void putWord(byte* val, unsigned int value){
+    val[0] = (value >> 8) & 0xff;
+    val[1] = value & 0xff;
+}
+
+MWStatsClass::MWStatsClass()
+{
+    reset();
+}
+
+void MWStatsClass::reset()
+{
+    numLatencySlots = 0;
+    numUnrecorded = 0;
+    statsStartMillis = millis();
+    numLoops = 0;
+    maxLoopMicros = 0;
+    rxPeak = 0;
+    txPeak = 0;
+    numTxStalls = 0;
+}
+
+void MWStatsClass::command(byte libID, byte cmdID, unsigned long micros)
+{
+    LatencySlot* slot = NULL;
+    for(byte i = 0; i < numLatencySlots; ++i){
+        if(latencySlots[i].cmdID == cmdID && latencySlots[i].libID == libID){
+            slot = &latencySlots[i];
+            break;
+        }
+    }
+    if(slot == NULL){
+        if(numLatencySlots == MAX_LATENCY_SLOTS){
+            if(numUnrecorded < 0xFFFF){
+                numUnrecorded++;
+            }
+            return;
+        }
+        slot = &latencySlots[numLatencySlots++];
+        memset(slot, 0, sizeof(LatencySlot));
+        slot->libID = libID;
+        slot->cmdID = cmdID;
+    }
+    
+    byte bucket = 0;
+    unsigned long bound = LATENCY_FIRST_BOUND;
+    while(bucket < NUM_LATENCY_BUCKETS - 1 && micros >= bound){
+        bucket++;
+        bound <<= 2;
+    }
+    if(slot->buckets[bucket] < 0xFFFF){
+        slot->buckets[bucket]++;
+    }
+    if(micros > slot->maxMicros){
+        slot->maxMicros = micros;
+    }
+    if(slot->totalMicros + micros >= slot->totalMicros){
+        slot->totalMicros += micros;
+    }
+}
+
+void MWStatsClass::loop(unsigned long micros)
+{
+    if(numLoops < 0xFFFFFFFFUL){
+        numLoops++;
+    }
+    if(micros > maxLoopMicros){
+        maxLoopMicros = micros;
+    }
+}
+
+void MWStatsClass::buffers(unsigned int rxBytes, unsigned int txBytes)
+{
+    if(rxBytes > rxPeak){
+        rxPeak = rxBytes;
+    }
+    if(txBytes > txPeak){
+        txPeak = txBytes;
+    }
+}
+
+void MWStatsClass::txStall()
+{
+    if(numTxStalls < 0xFFFF){
+        numTxStalls++;
+    }
+}
+
+unsigned int MWStatsClass::report(byte* val)
+{
+// Writes the getStats response, returns its size
+    putLong(&val[0], millis() - statsStartMillis);
+    putLong(&val[4], numLoops);
+    putLong(&val[8], maxLoopMicros);
+    putWord(&val[12], rxPeak);
+    putWord(&val[14], txPeak);
+    putWord(&val[16], numTxStalls);
+    putWord(&val[18], numUnrecorded);
+    val[20] = NUM_LATENCY_BUCKETS;
+    val[21] = numLatencySlots;
+    unsigned int size = STATS_HEADER_SIZE;
+    for(byte i = 0; i < numLatencySlots; ++i){
+        LatencySlot& slot = latencySlots[i];
+        val[size] = slot.libID;
+        val[size+1] = slot.cmdID;
+        putLong(&val[size+2], slot.maxMicros);
+        putLong(&val[size+6], slot.totalMicros);
+        for(byte k = 0; k < NUM_LATENCY_BUCKETS; ++k){
+            putWord(&val[size+10+2*k], slot.buckets[k]);
+        }
+        size += STATS_SLOT_SIZE;
+    }
+    return size;
+}
+
+MWStatsClass MWStats;
@@ -0,0 +1,58 @@
+/*
+  MWStats.h - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#ifndef MWStats_h
+#define MWStats_h
+
+#include "Arduino.h"
+
+// Commands with a latency histogram, by (libID, cmdID) in the order they first run
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define MAX_LATENCY_SLOTS 6
+#else
+#define MAX_LATENCY_SLOTS 24
+#endif
+
+// Bucket k counts handler times below LATENCY_FIRST_BOUND * 4^k microseconds, the last
+// bucket everything above: <16, <64, <256, <1024, <4096, <16384, <65536, more
+#define NUM_LATENCY_BUCKETS 8
+#define LATENCY_FIRST_BOUND 16
+
+#define STATS_BASE_LIBRARY 0xFF // libID of base commands in the histograms
+#define STATS_RESET        0x01 // getStats flag: start over once the statistics are read
+
+// Response of getStats, msb first: elapsed milliseconds (4), loop passes (4), longest pass in
+// microseconds (4), RX and TX buffer peaks (2 each), TX stalls (2), unrecorded commands (2),
+// NUM_LATENCY_BUCKETS, numSlots, then per slot: libID, cmdID, longest and total microseconds
+// (4 each), bucket counts (2 each)
+#define STATS_HEADER_SIZE 22
+#define STATS_SLOT_SIZE   (10 + 2*NUM_LATENCY_BUCKETS)
+#define STATS_REPORT_SIZE (STATS_HEADER_SIZE + MAX_LATENCY_SLOTS*STATS_SLOT_SIZE)
+
+// Runtime statistics
+// Every command dispatch is timed with micros() around its handler and counted in a fixed
+// bucket histogram of its (library, cmdID); commands that find all slots taken are only
+// counted as unrecorded. Batches and scripts count as the batch command and again per
+// command they run. The main loop counts its passes and the longest one; the RX peak is the
+// most bytes found waiting in the serial receive buffer at the start of a pass, the TX peak the
+// fullest the response ring buffer got before it was drained, and TX stalls the bytes that
+// had to wait for the UART because the ring buffer was full. Counters saturate.
+class MWStatsClass
+{
+public:
+    MWStatsClass();
+    void reset();
+    void command(byte libID, byte cmdID, unsigned long micros);
+    void loop(unsigned long micros);
+    void buffers(unsigned int rxBytes, unsigned int txBytes);
+    void txStall();
+    unsigned int report(byte* val);
+};
+
+extern MWStatsClass MWStats;
+
+#endif // MWStats.h
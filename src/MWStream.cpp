@@ -0,0 +1,385 @@
+/*
+  MWStream.cpp - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+ 
+  See file LICENSE.txt for licensing terms.
+*/
+
+#include "MWArduino.h"
+#include "MWStream.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <util/atomic.h>
+#else
+// accesses to the 32-bit ring buffer indices are atomic
+#define ATOMIC_BLOCK(type) for(byte atomicOnce = 1; atomicOnce; atomicOnce = 0)
+#define ATOMIC_RESTORESTATE
+#endif
+
+// Sample timer
+// AVR boards use Timer2 in CTC mode, which takes over PWM on the Timer2 pins and tone()
+// while streaming. Due uses TC2 channel 2. Other boards fall back to micros() polling
+// from update().
+//
+// Timer2 is no auto trigger source of the ADC, so its interrupt reads the digital
+// channels and starts the conversion of the first analog channel; ADC_vect (see
+// MWAnalogScan.cpp) stores each result and starts the next channel. Neither interrupt
+// waits for a conversion.
+#if defined(ARDUINO_ARCH_AVR) && defined(TIMER2_COMPB_vect)
+#define STREAM_USE_TIMER2
+#elif defined(ARDUINO_ARCH_SAM)
+#define STREAM_USE_TC8
+#endif
+
+byte streamNumChannels = 0;
+byte streamNumDigital = 0;
+byte streamPins[MAX_STREAM_CHANNELS];
+byte streamTypes[MAX_STREAM_CHANNELS];
+byte streamSampleSize = 0;        // bytes per sample
+byte streamSamplesPerFrame = 0;
+byte streamFrameCounter = 0;
+unsigned int streamCapacity = 0;  // samples the ring buffer can hold
+
+byte streamBuffer[STREAM_BUFFER_SIZE];
+volatile unsigned int streamHead = 0; // next sample slot to write, owned by the timer
+volatile unsigned int streamTail = 0; // next sample to send, owned by update()
+volatile byte streamOverruns = 0;     // samples dropped because the buffer was full
+volatile byte isStreamRunning = 0;
+volatile byte isStreamSampling = 0;  // a sample is being converted
+
+#if defined(STREAM_USE_ADC_INTERRUPT)
+byte* streamSampleValue;              // slot of the sample being converted
+byte streamValueIndex = 0;            // next byte of the slot to fill
+byte streamChannel = 0;               // channel being converted
+#endif
+
+#if defined(STREAM_USE_TIMER2)
+volatile byte streamPostscale = 1;
+volatile byte streamPostscaleCount = 0;
+
+ISR(TIMER2_COMPB_vect){
+    if(++streamPostscaleCount < streamPostscale){
+        return;
+    }
+    streamPostscaleCount = 0;
+    MWStream.sample();
+}
+
+static void startStreamTimer(unsigned long periodMicros){
+    static const unsigned int prescalers[] = {1, 8, 32, 64, 128, 256, 1024};
+    unsigned long ticks = (F_CPU / 1000000UL) * periodMicros;
+    
+    // periods beyond the 8-bit counter range are split into equal sub-periods
+    unsigned long postscale = ticks / (1024UL * 256UL) + 1;
+    if(postscale > 255){
+        postscale = 255;
+    }
+    ticks /= postscale;
+    byte cs = 1;
+    while(cs < 7 && ticks / prescalers[cs-1] > 256){
+        cs++;
+    }
+    
+    streamPostscale = postscale;
+    streamPostscaleCount = 0;
+    TCCR2B = 0;
+    TCCR2A = _BV(WGM21); // CTC, TOP = OCR2A
+    TCNT2 = 0;
+    OCR2A = ticks / prescalers[cs-1] - 1;
+    OCR2B = 0;
+    TIFR2 = _BV(OCF2B);
+    TIMSK2 |= _BV(OCIE2B);
+    TCCR2B = cs;
+}
+
+static void stopStreamTimer(){
+    TIMSK2 &= ~_BV(OCIE2B);
+    // restore the phase correct PWM setup done by init()
+    TCCR2A = _BV(WGM20);
+    TCCR2B = _BV(CS22);
+}
+
+#elif defined(STREAM_USE_TC8)
+void TC8_Handler(){
+    TC_GetStatus(TC2, 2);
+    MWStream.sample();
+}
+
+static void startStreamTimer(unsigned long periodMicros){
+    pmc_set_writeprotect(false);
+    pmc_enable_periph_clk(ID_TC8);
+    TC_Configure(TC2, 2, TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_TCCLKS_TIMER_CLOCK1); // MCK/2
+    TC_SetRC(TC2, 2, (VARIANT_MCK / 2 / 1000000UL) * periodMicros);
+    TC_Start(TC2, 2);
+    TC2->TC_CHANNEL[2].TC_IER = TC_IER_CPCS;
+    TC2->TC_CHANNEL[2].TC_IDR = ~TC_IER_CPCS;
+    NVIC_EnableIRQ(TC8_IRQn);
+}
+
+static void stopStreamTimer(){
+    NVIC_DisableIRQ(TC8_IRQn);
+    TC_Stop(TC2, 2);
+}
+
+#else
+unsigned long streamPeriod = 0;
+unsigned long nextSampleTime = 0;
+
+static void startStreamTimer(unsigned long periodMicros){
+    streamPeriod = periodMicros;
+    nextSampleTime = micros() + periodMicros;
+}
+
+static void stopStreamTimer(){
+}
+#endif
+
+#if defined(STREAM_USE_ADC_INTERRUPT)
+static void startConversion(byte pin){
+// Same pin to channel mapping as analogRead, with the reference left at DEFAULT like MWAnalogScan
+    if(pin >= A0){
+        pin -= A0;
+    }
+    #if defined(analogPinToChannel)
+    pin = analogPinToChannel(pin);
+    #endif
+    #if defined(MUX5)
+    ADCSRB = (ADCSRB & ~_BV(MUX5)) | ((pin & 0x08) ? _BV(MUX5) : 0);
+    #endif
+    ADMUX = (DEFAULT << 6) | (pin & 0x07);
+    ADCSRA = (ADCSRA & ~_BV(ADATE)) | _BV(ADEN) | _BV(ADSC) | _BV(ADIF) | _BV(ADIE);
+}
+
+static bool startNextConversion(byte channel){
+// Convert the first analog channel from channel on, false if there is none
+    for(; channel < streamNumChannels; ++channel){
+        if(streamTypes[channel] == STREAM_CHANNEL_ANALOG){
+            streamChannel = channel;
+            startConversion(streamPins[channel]);
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+static void waitForSample(){
+// Let the conversions of a sample in progress finish
+    #if defined(STREAM_USE_ADC_INTERRUPT)
+    while(isStreamSampling){
+    }
+    #endif
+}
+
+static void commitSample(){
+// Make the sample at streamHead visible to update()
+    unsigned int next = streamHead + 1;
+    streamHead = (next == streamCapacity) ? 0 : next;
+}
+
+static unsigned int streamAvailable(){
+    unsigned int head;
+    unsigned int tail;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        head = streamHead;
+        tail = streamTail;
+    }
+    return (head >= tail) ? (head - tail) : (head + streamCapacity - tail);
+}
+
+// MWStream class
+//
+MWStreamClass::MWStreamClass()
+{
+}
+
+bool MWStreamClass::start(byte numChannels, byte* pins, byte* types, unsigned long periodMicros, byte samplesPerFrame)
+{
+    stop();
+    if(numChannels == 0 || numChannels > MAX_STREAM_CHANNELS || periodMicros == 0 || samplesPerFrame == 0){
+        return false;
+    }
+    
+    streamNumDigital = 0;
+    byte numAnalog = 0;
+    for(byte i = 0; i < numChannels; ++i){
+        streamPins[i] = pins[i];
+        streamTypes[i] = types[i];
+        if(types[i] == STREAM_CHANNEL_ANALOG){
+            numAnalog++;
+        }
+        else{
+            streamNumDigital++;
+        }
+    }
+    streamNumChannels = numChannels;
+    streamSampleSize = (streamNumDigital > 0 ? 1 : 0) + 2 * numAnalog;
+    
+    // a frame has to fit into one event message and leave room in the ring buffer
+    streamCapacity = STREAM_BUFFER_SIZE / streamSampleSize;
+    byte maxSamplesPerFrame = (MAX_STREAM_FRAME_SIZE - 3) / streamSampleSize;
+    if(maxSamplesPerFrame > streamCapacity / 2){
+        maxSamplesPerFrame = streamCapacity / 2;
+    }
+    streamSamplesPerFrame = samplesPerFrame < maxSamplesPerFrame ? samplesPerFrame : maxSamplesPerFrame;
+    
+    streamHead = 0;
+    streamTail = 0;
+    streamOverruns = 0;
+    streamFrameCounter = 0;
+    isStreamRunning = 1;
+    startStreamTimer(periodMicros);
+    return true;
+}
+
+void MWStreamClass::stop()
+{
+    if(isStreamRunning){
+        stopStreamTimer();
+        waitForSample();
+        isStreamRunning = 0;
+    }
+}
+
+bool MWStreamClass::isRunning()
+{
+    return isStreamRunning;
+}
+
+void MWStreamClass::lock()
+{
+// Keep the sample timer from using the ADC while the main loop converts
+    #if defined(STREAM_USE_TIMER2)
+    if(isStreamRunning){
+        TIMSK2 &= ~_BV(OCIE2B);
+        waitForSample();
+    }
+    #elif defined(STREAM_USE_TC8)
+    if(isStreamRunning){
+        NVIC_DisableIRQ(TC8_IRQn);
+    }
+    #endif
+}
+
+void MWStreamClass::unlock()
+{
+// A compare match during the lock stays pending, so the sample is delayed rather than lost
+    #if defined(STREAM_USE_TIMER2)
+    if(isStreamRunning){
+        TIMSK2 |= _BV(OCIE2B);
+    }
+    #elif defined(STREAM_USE_TC8)
+    if(isStreamRunning){
+        NVIC_EnableIRQ(TC8_IRQn);
+    }
+    #endif
+}
+
+void MWStreamClass::sample()
+{
+// Called from the sample timer, so the Arduino core is used directly instead of the traced calls
+    unsigned int next = streamHead + 1;
+    if(next == streamCapacity){
+        next = 0;
+    }
+    if(isStreamSampling || next == streamTail){
+        // previous sample still converting or buffer full
+        if(streamOverruns < 255){
+            streamOverruns++;
+        }
+        return;
+    }
+    
+    byte* value = &streamBuffer[streamHead * streamSampleSize];
+    byte digitalBits = 0;
+    byte digitalIndex = 0;
+    byte count = (streamNumDigital > 0) ? 1 : 0;
+    for(byte i = 0; i < streamNumChannels; ++i){
+        if(streamTypes[i] != STREAM_CHANNEL_ANALOG){
+            if(::digitalRead(streamPins[i])){
+                digitalBits |= (1 << digitalIndex);
+            }
+            digitalIndex++;
+        }
+        #if !defined(STREAM_USE_ADC_INTERRUPT)
+        else{
+            int analogValue = ::analogRead(streamPins[i]);
+            value[count++] = (analogValue >> 8) & 0x03; // msb
+            value[count++] = analogValue & 0xff;        // lsb
+        }
+        #endif
+    }
+    if(streamNumDigital > 0){
+        value[0] = digitalBits;
+    }
+    
+    #if defined(STREAM_USE_ADC_INTERRUPT)
+    streamSampleValue = value;
+    streamValueIndex = count;
+    isStreamSampling = 1;
+    if(startNextConversion(0)){
+        return; // committed by the last conversionComplete
+    }
+    isStreamSampling = 0;
+    #endif
+    commitSample();
+}
+
+bool MWStreamClass::isConverting()
+{
+    return isStreamSampling;
+}
+
+void MWStreamClass::conversionComplete(unsigned int analogValue)
+{
+// Called from ADC_vect for the channels of a sample
+    #if defined(STREAM_USE_ADC_INTERRUPT)
+    streamSampleValue[streamValueIndex++] = (analogValue >> 8) & 0x03; // msb
+    streamSampleValue[streamValueIndex++] = analogValue & 0xff;        // lsb
+    if(startNextConversion(streamChannel + 1)){
+        return;
+    }
+    ADCSRA &= ~_BV(ADIE); // analogRead polls for its conversions
+    commitSample();
+    isStreamSampling = 0;
+    #endif
+}
+
+void MWStreamClass::update()
+{
+    if(!isStreamRunning){
+        return;
+    }
+    
+    #if !defined(STREAM_USE_TIMER2) && !defined(STREAM_USE_TC8)
+    byte numCatchUp = 0;
+    while((long)(micros() - nextSampleTime) >= 0 && numCatchUp++ < streamSamplesPerFrame){
+        sample();
+        nextSampleTime += streamPeriod;
+    }
+    #endif
+    
+    while(streamAvailable() >= streamSamplesPerFrame){
+        byte frame[MAX_STREAM_FRAME_SIZE];
+        byte count = 0;
+        frame[count++] = streamFrameCounter++;
+        frame[count++] = streamSamplesPerFrame;
+        noInterrupts();
+        frame[count++] = streamOverruns;
+        streamOverruns = 0;
+        interrupts();
+        for(byte i = 0; i < streamSamplesPerFrame; ++i){
+            byte* value = &streamBuffer[streamTail * streamSampleSize];
+            for(byte j = 0; j < streamSampleSize; ++j){
+                frame[count++] = value[j];
+            }
+            unsigned int next = streamTail + 1;
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+                streamTail = (next == streamCapacity) ? 0 : next;
+            }
+        }
+        sendEventMsg(0x40, count, frame);
+    }
+}
+
+MWStreamClass MWStream;
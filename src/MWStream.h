@@ -0,0 +1,55 @@
+/*
+  MWStream.h - MathWorks Arduino library
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+
+#ifndef MWStream_h
+#define MWStream_h
+
+#include "Arduino.h"
+
+#define MAX_STREAM_CHANNELS 8
+#define STREAM_CHANNEL_DIGITAL 0x00
+#define STREAM_CHANNEL_ANALOG  0x01
+
+// AVR boards convert the analog channels of a sample from ADC_vect, started by the sample timer
+#if defined(ARDUINO_ARCH_AVR) && defined(TIMER2_COMPB_vect) && defined(ADC_vect)
+#define STREAM_USE_ADC_INTERRUPT
+#endif
+
+// Sample ring buffer size in bytes and maximum payload of one sample frame
+#if defined(ARDUINO_ARCH_AVR) && (RAMEND <= 0x8FF) // boards with 2KB SRAM, e.g. Uno
+#define STREAM_BUFFER_SIZE 128
+#define MAX_STREAM_FRAME_SIZE 48
+#else
+#define STREAM_BUFFER_SIZE 1024
+#define MAX_STREAM_FRAME_SIZE 240
+#endif
+
+// Continuous acquisition
+// Pins are sampled from a hardware timer into a ring buffer, and update() sends full
+// sample frames to the host as unsolicited event messages.
+//
+// Sample layout: one byte with the digital channels packed LSB first (if any digital
+// channel is configured), followed by one 10-bit value (msb, lsb) per analog channel.
+// Frame payload: frameCounter, numSamples, numOverruns, samples.
+class MWStreamClass
+{
+public:
+    MWStreamClass();
+    bool start(byte numChannels, byte* pins, byte* types, unsigned long periodMicros, byte samplesPerFrame);
+    void stop();
+    void update();
+    bool isRunning();
+    void lock();
+    void unlock();
+    void sample();
+    bool isConverting();
+    void conversionComplete(unsigned int analogValue);
+};
+
+extern MWStreamClass MWStream;
+
+#endif // MWStream.h
@@ -0,0 +1,385 @@
+/*
+  Benchmark.cpp - protocol throughput benchmark for the host build of ArduinoServer
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+
+  Replays recorded command streams through the unmodified server main loop and
+  reports commands/sec, bytes/sec and per-command latency.
+
+  Usage: ArduinoServerBench [-n repeat] [-v] recording...
+
+  Recording format: one command per line, as the hex bytes the host sends (a sysex
+  message F0 ... F7 or a COBS frame ending in 00), optionally preceded by a label
+  ("readVoltage: F0 00 ...") and followed by the expected response after "=>", as
+  the hex bytes cmdID, payload_size msb, lsb, value ("=> 30 00 02 02 06"); "??"
+  matches any byte. Text after '#' is a comment. A line "wait ms" lets ms of
+  simulated time pass before the next command, e.g. for a debounce time to expire,
+  while the main loop keeps running. Commands are sent one at a time;
+  the next one goes out when the response to the previous one has arrived, or after
+  IDLE_LOOPS passes of the main loop without a response. A response that differs
+  from the expected one, or to a base command with another cmdID, is counted as
+  mismatched and makes the run fail.
+*/
+
+#include "MWArduino.h"
+#include "MockCore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#define IDLE_LOOPS 1000 // main loop passes before a command is counted as unanswered
+#define WAIT_STEP  100  // us of simulated time added per main loop pass during a wait
+
+int ArduinoServerMain(void); // main() of ArduinoServer.cpp, renamed by the Makefile
+
+typedef std::chrono::steady_clock Clock;
+
+#define ANY_BYTE -1 // "??" in an expected response
+
+struct RecordedCommand {
+    std::string label;
+    std::vector<uint8_t> bytes;
+    int cmdID;                  // of a base command, ANY_BYTE for library commands
+    std::vector<int> expected;  // response, empty if not recorded
+    unsigned long wait;         // ms to wait before the command is sent
+};
+
+struct CommandStats {
+    std::vector<double> latencies; // microseconds
+    unsigned long unanswered;
+    unsigned long mismatched;
+    CommandStats() : unanswered(0), mismatched(0) {}
+};
+
+std::vector<RecordedCommand> recording;
+std::map<std::string, CommandStats> statsByLabel;
+std::vector<std::string> labelOrder;
+unsigned long repeat = 1;
+bool verbose = false;
+
+// Replay state
+unsigned long pass = 0;
+size_t nextCommand = 0;
+bool inFlight = false;
+Clock::time_point sentTime;
+Clock::time_point startTime;
+unsigned long idleLoops = 0;
+bool isWaiting = false;
+unsigned long waitEnd;          // mockMicros at the end of the wait
+size_t txParsed = 0;
+unsigned long long bytesIn = 0;
+unsigned long long bytesOut = 0;
+unsigned long numCommands = 0;
+unsigned long numMismatched = 0;
+std::vector<uint8_t> response; // cmdID, payload_size and value of the first response to the command in flight
+
+bool parseBytes(const std::string& text, std::vector<int>* bytes){
+// Hex bytes separated by white space, "??" as ANY_BYTE
+    std::istringstream byteStream(text);
+    std::string token;
+    while(byteStream >> token){
+        if(token == "??"){
+            bytes->push_back(ANY_BYTE);
+            continue;
+        }
+        char* end;
+        unsigned long value = strtoul(token.c_str(), &end, 16);
+        if(*end != '\0' || value > 0xFF){
+            return false;
+        }
+        bytes->push_back((int)value);
+    }
+    return true;
+}
+
+bool commandID(const std::vector<uint8_t>& bytes, int* cmdID){
+// The cmdID of a sysex message or COBS frame, which its response carries. Where a library
+// command keeps its cmdID is up to the library, so only base commands are resolved.
+    std::vector<uint8_t> message; // header, sequence_ID, payload_size (2 bytes), cmdID/libID, params
+    if(bytes.front() == 0xF0){
+        message.assign(bytes.begin() + 1, bytes.end());
+    }
+    else{
+        size_t index = 0;
+        while(index < bytes.size() && bytes[index] != 0){
+            uint8_t code = bytes[index++];
+            for(uint8_t i = 1; i < code && index < bytes.size(); ++i){
+                message.push_back(bytes[index++]);
+            }
+            if(code < 0xFF && index < bytes.size() && bytes[index] != 0){
+                message.push_back(0);
+            }
+        }
+    }
+    if(message.size() < 5){
+        return false;
+    }
+    *cmdID = (message[0] == 0) ? message[4] : ANY_BYTE;
+    return true;
+}
+
+bool matchesRecording(const RecordedCommand& command){
+    if(response.empty() || (command.cmdID != ANY_BYTE && response[0] != command.cmdID)){
+        return false;
+    }
+    if(command.expected.empty()){
+        return true;
+    }
+    if(response.size() != command.expected.size()){
+        return false;
+    }
+    for(size_t i = 0; i < response.size(); ++i){
+        if(command.expected[i] != ANY_BYTE && command.expected[i] != response[i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadRecording(const char* filename){
+    std::ifstream file(filename);
+    if(!file){
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return false;
+    }
+    std::string line;
+    unsigned int lineNumber = 0;
+    unsigned long wait = 0;
+    while(std::getline(file, line)){
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream waitStream(line);
+        std::string keyword;
+        if(waitStream >> keyword && keyword == "wait"){
+            unsigned long ms;
+            if(!(waitStream >> ms)){
+                fprintf(stderr, "%s:%u: invalid wait\n", filename, lineNumber);
+                return false;
+            }
+            wait += ms;
+            continue;
+        }
+        RecordedCommand command;
+        command.wait = wait;
+        size_t colon = line.find(':');
+        if(colon != std::string::npos){
+            std::istringstream labelStream(line.substr(0, colon));
+            labelStream >> command.label;
+            line = line.substr(colon + 1);
+        }
+        size_t arrow = line.find("=>");
+        std::vector<int> bytes;
+        if(!parseBytes(line.substr(0, arrow), &bytes) || 
+            (arrow != std::string::npos && !parseBytes(line.substr(arrow + 2), &command.expected))){
+            fprintf(stderr, "%s:%u: invalid byte\n", filename, lineNumber);
+            return false;
+        }
+        if(bytes.empty()){
+            continue;
+        }
+        if(std::find(bytes.begin(), bytes.end(), ANY_BYTE) != bytes.end()){
+            fprintf(stderr, "%s:%u: wildcard in a command\n", filename, lineNumber);
+            return false;
+        }
+        command.bytes.assign(bytes.begin(), bytes.end());
+        if(!commandID(command.bytes, &command.cmdID)){
+            fprintf(stderr, "%s:%u: not a sysex message or COBS frame\n", filename, lineNumber);
+            return false;
+        }
+        if(command.label.empty()){
+            std::ostringstream labelStream;
+            labelStream << filename << ":" << lineNumber;
+            command.label = labelStream.str();
+        }
+        if(statsByLabel.find(command.label) == statsByLabel.end()){
+            statsByLabel[command.label] = CommandStats();
+            labelOrder.push_back(command.label);
+        }
+        recording.push_back(command);
+        wait = 0;
+    }
+    return true;
+}
+
+size_t parseMessage(size_t start, bool* isResponse){
+// Length of the complete server message at mockTx[start], 0 if it is still incomplete.
+// The value of a response starts 2 bytes in, or 3 with a sequence ID.
+    size_t available = mockTx.size() - start;
+    if(available < 3){
+        return 0;
+    }
+    size_t length;
+    switch(mockTx[start+1]){
+        case 0: // 0, 0, cmdID, payload_size, value
+        case 3: // 0, 3, eventID, payload_size, value
+            if(available < 5){
+                return 0;
+            }
+            length = 5 + ((mockTx[start+3] << 8) | mockTx[start+4]);
+            break;
+        case 2: // 0, 2, sequenceID, cmdID, payload_size, value
+            if(available < 6){
+                return 0;
+            }
+            length = 6 + ((mockTx[start+4] << 8) | mockTx[start+5]);
+            break;
+        case 1: // 0, 1, count, text
+            length = 3 + mockTx[start+2];
+            break;
+        default: // out of sync, skip the byte
+            *isResponse = false;
+            return 1;
+    }
+    if(available < length){
+        return 0;
+    }
+    *isResponse = (mockTx[start+1] == 0 || mockTx[start+1] == 2);
+    return length;
+}
+
+bool hasResponse(){
+// Consume the messages written since the last call, true if one of them is a response
+    bool found = false;
+    size_t length;
+    bool isResponse;
+    while((length = parseMessage(txParsed, &isResponse)) > 0){
+        if(verbose){
+            for(size_t i = 0; i < length; ++i){
+                printf("%02X ", mockTx[txParsed+i]);
+            }
+            printf("\n");
+        }
+        if(isResponse && !found){
+            size_t valueStart = txParsed + (mockTx[txParsed+1] == 2 ? 3 : 2);
+            response.assign(mockTx.begin() + valueStart, mockTx.begin() + txParsed + length);
+        }
+        txParsed += length;
+        found = found || isResponse;
+    }
+    return found;
+}
+
+double percentile(std::vector<double>& values, double p){
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+void printReport(){
+    double elapsed = std::chrono::duration<double>(Clock::now() - startTime).count();
+    printf("%lu commands in %.3f s: %.0f commands/sec, %.0f bytes/sec (%llu in, %llu out)\n",
+        numCommands, elapsed, numCommands / elapsed, (bytesIn + bytesOut) / elapsed, bytesIn, bytesOut);
+    printf("\n%-24s %8s %10s %10s %10s %10s %10s\n", "latency (us)", "count", "min", "mean", "p50", "p99", "max");
+    std::vector<double> all;
+    for(size_t i = 0; i < labelOrder.size(); ++i){
+        CommandStats& stats = statsByLabel[labelOrder[i]];
+        std::vector<double>& values = stats.latencies;
+        if(!values.empty()){
+            std::sort(values.begin(), values.end());
+            double sum = 0;
+            for(size_t j = 0; j < values.size(); ++j){
+                sum += values[j];
+            }
+            printf("%-24s %8lu %10.3f %10.3f %10.3f %10.3f %10.3f\n", labelOrder[i].c_str(), (unsigned long)values.size(),
+                values.front(), sum / values.size(), percentile(values, 0.5), percentile(values, 0.99), values.back());
+            all.insert(all.end(), values.begin(), values.end());
+        }
+        if(stats.unanswered > 0){
+            printf("%-24s %8lu unanswered\n", labelOrder[i].c_str(), stats.unanswered);
+        }
+        if(stats.mismatched > 0){
+            printf("%-24s %8lu mismatched\n", labelOrder[i].c_str(), stats.mismatched);
+        }
+    }
+    if(!all.empty()){
+        std::sort(all.begin(), all.end());
+        double sum = 0;
+        for(size_t j = 0; j < all.size(); ++j){
+            sum += all[j];
+        }
+        printf("%-24s %8lu %10.3f %10.3f %10.3f %10.3f %10.3f\n", "all", (unsigned long)all.size(),
+            all.front(), sum / all.size(), percentile(all, 0.5), percentile(all, 0.99), all.back());
+    }
+}
+
+void benchmarkStep(){
+// Called by the server main loop after every MWArduino.update()
+    if(inFlight){
+        bool answered = hasResponse();
+        if(!answered && ++idleLoops < IDLE_LOOPS){
+            return;
+        }
+        const RecordedCommand& command = recording[nextCommand];
+        CommandStats& stats = statsByLabel[command.label];
+        if(answered){
+            stats.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sentTime).count());
+            if(!matchesRecording(command)){
+                stats.mismatched++;
+                numMismatched++;
+            }
+        }
+        else{
+            stats.unanswered++;
+        }
+        inFlight = false;
+        numCommands++;
+        if(++nextCommand == recording.size()){
+            nextCommand = 0;
+            pass++;
+        }
+    }
+
+    // responses of earlier commands are parsed, drop them
+    bytesOut += txParsed;
+    mockTx.erase(mockTx.begin(), mockTx.begin() + txParsed);
+    txParsed = 0;
+
+    if(pass == repeat){
+        printReport();
+        exit(numMismatched > 0 ? 1 : 0);
+    }
+    const RecordedCommand& command = recording[nextCommand];
+    if(command.wait > 0 && !isWaiting){
+        isWaiting = true;
+        waitEnd = mockMicros + command.wait * 1000;
+    }
+    if(isWaiting){
+        if(mockMicros < waitEnd){
+            mockMicros += WAIT_STEP;
+            return;
+        }
+        isWaiting = false;
+    }
+    mockRx.insert(mockRx.end(), command.bytes.begin(), command.bytes.end());
+    bytesIn += command.bytes.size();
+    idleLoops = 0;
+    inFlight = true;
+    response.clear();
+    sentTime = Clock::now();
+}
+
+int main(int argc, char** argv){
+    for(int i = 1; i < argc; ++i){
+        if(strcmp(argv[i], "-n") == 0 && i+1 < argc){
+            repeat = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-v") == 0){
+            verbose = true;
+        }
+        else if(!loadRecording(argv[i])){
+            return 1;
+        }
+    }
+    if(recording.empty() || repeat == 0){
+        fprintf(stderr, "Usage: %s [-n repeat] [-v] recording...\n", argv[0]);
+        return 1;
+    }
+
+    serialEventRun = benchmarkStep;
+    startTime = Clock::now();
+    return ArduinoServerMain();
+}
@@ -0,0 +1,110 @@
+/*
+  PtyServer.cpp - host build of ArduinoServer on a pseudo terminal
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+
+  Runs the unmodified server main loop with the mock Serial connected to a pty, so
+  that host clients (client/ArduinoClient, ArduinoClientBench, MATLAB through the C
+  API) talk to it as to a board on a serial port. Prints the path of the slave side
+  of the pty and serves until it is killed. While no input is waiting, the loop
+  sleeps on the pty and the simulated time follows the wall clock.
+
+  Usage: ArduinoPtyServer [-l link]   (-l also makes link a symbolic link to the pty)
+*/
+
+#include "MWArduino.h"
+#include "MockCore.h"
+
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define IDLE_WAIT 1 // ms the main loop sleeps on the pty while there is nothing to do
+
+int ArduinoServerMain(void); // main() of ArduinoServer.cpp, renamed by the Makefile
+
+typedef std::chrono::steady_clock Clock;
+
+int master = -1;
+int slave = -1; // kept open so that the master side does not see a hangup between clients
+const char* linkPath = NULL;
+
+void ptyStep(){
+// Called by the server main loop after every MWArduino.update()
+    bool busy = false;
+    if(!mockTx.empty()){
+        ssize_t count = write(master, mockTx.data(), mockTx.size());
+        if(count > 0){
+            mockTx.erase(mockTx.begin(), mockTx.begin() + count);
+            busy = true;
+        }
+    }
+    uint8_t data[256];
+    ssize_t count = read(master, data, sizeof(data));
+    if(count > 0){
+        mockRx.insert(mockRx.end(), data, data + count);
+        busy = true;
+    }
+    if(!busy && mockRx.empty()){
+        struct pollfd pfd = {master, (short)(POLLIN | (mockTx.empty() ? 0 : POLLOUT)), 0};
+        Clock::time_point start = Clock::now();
+        poll(&pfd, 1, IDLE_WAIT);
+        mockMicros += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    }
+}
+
+void stop(int){
+    if(linkPath){
+        unlink(linkPath);
+    }
+    _exit(0);
+}
+
+int main(int argc, char** argv){
+    for(int i = 1; i < argc; ++i){
+        if(strcmp(argv[i], "-l") == 0 && i+1 < argc){
+            linkPath = argv[++i];
+        }
+        else{
+            fprintf(stderr, "Usage: %s [-l link]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+        perror("posix_openpt");
+        return 1;
+    }
+    const char* slavePath = ptsname(master);
+    slave = open(slavePath, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if(slave < 0 || tcgetattr(slave, &tio) != 0){
+        perror(slavePath);
+        return 1;
+    }
+    // no echo or line editing before a client has configured the line
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    if(linkPath){
+        unlink(linkPath);
+        if(symlink(slavePath, linkPath) != 0){
+            perror(linkPath);
+            return 1;
+        }
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    printf("%s\n", slavePath);
+    fflush(stdout);
+
+    serialEventRun = ptyStep;
+    return ArduinoServerMain();
+}
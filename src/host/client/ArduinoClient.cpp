@@ -0,0 +1,740 @@
+/*
+  ArduinoClient.cpp - native host client of ArduinoServer
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+#include "ArduinoClient.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <system_error>
+
+#define RX_BUFFER_SIZE      4096
+#define BANNER_SIZE         56   // bytes of the firmware report, as read by SerialHostTransportLayer.openConnection
+#define MAX_MAILBOX_SIZE    16   // uncollected untagged responses; older ones are dropped like a flushed line
+#define MAX_QUEUED_EVENTS   1024
+#define MAX_DEBUG_TEXT      4096
+
+namespace arduinoio {
+
+static size_t payloadSize(const uint8_t* data){
+    return (data[0] << 8) | data[1];
+}
+
+static speed_t toSpeed(unsigned long baudRate){
+    switch(baudRate){
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:
+            throw std::invalid_argument("unsupported baud rate " + std::to_string(baudRate));
+    }
+}
+
+std::vector<uint8_t> Response::value() const{
+    std::vector<uint8_t> value;
+    value.reserve(3 + payload.size());
+    value.push_back(cmdID);
+    value.push_back((uint8_t)(payload.size() >> 8));
+    value.push_back((uint8_t)payload.size());
+    value.insert(value.end(), payload.begin(), payload.end());
+    return value;
+}
+
+size_t FrameParser::messageLength(const uint8_t* data, size_t size){
+    if(data[0] != 0){
+        return 1; // not a server message, e.g. the firmware report
+    }
+    if(size < 3){
+        return 0;
+    }
+    size_t length;
+    switch(data[1]){
+        case MESSAGE_RESPONSE:
+        case MESSAGE_EVENT:
+            if(size < 5){
+                return 0;
+            }
+            length = 5 + payloadSize(data + 3);
+            break;
+        case MESSAGE_TAGGED_RESPONSE:
+            if(size < 6){
+                return 0;
+            }
+            length = 6 + payloadSize(data + 4);
+            break;
+        case MESSAGE_DEBUG:
+            length = 3 + data[2];
+            break;
+        default: // out of sync
+            return 1;
+    }
+    return size < length ? 0 : length;
+}
+
+size_t FrameParser::requiredLength(const uint8_t* data, size_t size){
+    if(size < 6){
+        return size + 1;
+    }
+    switch(data[1]){
+        case MESSAGE_RESPONSE:
+        case MESSAGE_EVENT:
+            return 5 + payloadSize(data + 3);
+        case MESSAGE_TAGGED_RESPONSE:
+            return 6 + payloadSize(data + 4);
+        case MESSAGE_DEBUG:
+            return 3 + data[2];
+        default:
+            return 1;
+    }
+}
+
+bool FrameParser::toView(const uint8_t* data, size_t length, MessageView* message){
+    if(length == 1){
+        return false;
+    }
+    message->type = (MessageType)data[1];
+    message->sequenceID = 0;
+    switch(data[1]){
+        case MESSAGE_RESPONSE:
+        case MESSAGE_EVENT:
+            message->id = data[2];
+            message->payload = data + 5;
+            message->size = length - 5;
+            break;
+        case MESSAGE_TAGGED_RESPONSE:
+            message->sequenceID = data[2];
+            message->id = data[3];
+            message->payload = data + 6;
+            message->size = length - 6;
+            break;
+        default: // MESSAGE_DEBUG
+            message->id = 0;
+            message->payload = data + 3;
+            message->size = length - 3;
+            break;
+    }
+    return true;
+}
+
+std::vector<uint8_t> cobsEncode(const uint8_t* data, size_t size){
+// Same encoding as +arduinoio/+internal/cobsEncode.m
+    std::vector<uint8_t> output(size + size / 254 + 1);
+    size_t codeIndex = 0;
+    size_t outIndex = 1;
+    uint8_t code = 1;
+    for(size_t i = 0; i < size; ++i){
+        if(data[i] == 0){
+            output[codeIndex] = code;
+            codeIndex = outIndex++;
+            code = 1;
+        }
+        else{
+            output[outIndex++] = data[i];
+            if(++code == 0xFF){ // maximum block length, start a new block without an encoded zero
+                output[codeIndex] = code;
+                codeIndex = outIndex++;
+                code = 1;
+            }
+        }
+    }
+    output[codeIndex] = code;
+    output.resize(outIndex);
+    return output;
+}
+
+static bool frameSequenceID(const uint8_t* frame, size_t size, uint8_t* sequenceID){
+// Sequence ID of a sysex message, [F0; header; sequenceID; ...], or of a COBS frame, decoded
+// only up to the sequenceID after the header
+    if(size >= 3 && frame[0] == CLIENT_SYSEX_START){
+        *sequenceID = frame[2];
+        return true;
+    }
+    size_t decoded = 0;
+    size_t index = 0;
+    while(index < size && frame[index] != 0){
+        uint8_t code = frame[index++];
+        for(uint8_t i = 1; i < code; ++i, ++index){
+            if(index >= size || frame[index] == 0){
+                return false;
+            }
+            if(decoded++ == 1){
+                *sequenceID = frame[index];
+                return true;
+            }
+        }
+        if(code < 0xFF && decoded++ == 1){
+            *sequenceID = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+ArduinoClient::ArduinoClient() :
+    fd(-1), epollFd(-1), wakeFd(-1), rxBuffer(RX_BUFFER_SIZE), rxLength(0),
+    tagged(false), binary(false), lost(false), sequenceID(0), outstanding(0), outstandingLimit(1) {}
+
+ArduinoClient::~ArduinoClient(){
+    close();
+}
+
+void ArduinoClient::open(const std::string& port, unsigned long baudRate, Timeout bannerTimeout){
+    if(fd >= 0){
+        throw std::logic_error("client is already open");
+    }
+    speed_t speed = toSpeed(baudRate);
+    fd = ::open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0){
+        throw std::system_error(errno, std::generic_category(), "cannot open " + port);
+    }
+    try{
+        struct termios tio;
+        if(tcgetattr(fd, &tio) != 0){
+            throw std::system_error(errno, std::generic_category(), port);
+        }
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        if(tcsetattr(fd, TCSANOW, &tio) != 0){
+            throw std::system_error(errno, std::generic_category(), port);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tagged = false;
+            binary = false;
+            lost = false;
+            lostReason.clear();
+            sequenceID = 0;
+            outstanding = 0;
+            outstandingLimit = 1;
+            taggedMailbox.clear();
+            untaggedMailbox.clear();
+            events.clear();
+            debugText.clear();
+        }
+        rxLength = 0;
+        if(bannerTimeout.count() > 0){
+            readBanner(bannerTimeout);
+        }
+        else{
+            tcflush(fd, TCIFLUSH);
+        }
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if(epollFd < 0 || wakeFd < 0){
+            throw std::system_error(errno, std::generic_category(), "epoll");
+        }
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0){
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+        event.data.fd = wakeFd;
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) != 0){
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+        reader = std::thread(&ArduinoClient::readerLoop, this);
+    }
+    catch(...){
+        close();
+        throw;
+    }
+}
+
+void ArduinoClient::readBanner(Timeout timeout){
+// Wait for the firmware report and check it like SerialHostTransportLayer.openConnection
+    std::string banner;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    while(banner.size() < BANNER_SIZE){
+        long remaining = std::chrono::duration_cast<Timeout>(deadline - std::chrono::steady_clock::now()).count();
+        if(remaining <= 0){
+            break;
+        }
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if(poll(&pfd, 1, (int)remaining) <= 0){
+            continue;
+        }
+        char data[BANNER_SIZE];
+        ssize_t count = ::read(fd, data, BANNER_SIZE - banner.size());
+        if(count > 0){
+            banner.append(data, count);
+        }
+        else if(count == 0 || (errno != EAGAIN && errno != EINTR)){
+            break;
+        }
+    }
+    if(banner.find(std::string("I\0O\0", 4)) == std::string::npos){
+        throw ConnectionLost("invalid server init response");
+    }
+}
+
+void ArduinoClient::close(){
+    checkNotReader("close");
+    if(reader.joinable()){
+        uint64_t one = 1;
+        ssize_t written = ::write(wakeFd, &one, sizeof(one));
+        (void)written;
+        reader.join();
+    }
+    if(wakeFd >= 0){
+        ::close(wakeFd);
+        wakeFd = -1;
+    }
+    if(epollFd >= 0){
+        ::close(epollFd);
+        epollFd = -1;
+    }
+    if(fd >= 0){
+        ::close(fd);
+        fd = -1;
+        failPending("connection is closed");
+    }
+}
+
+bool ArduinoClient::isOpen() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return fd >= 0 && !lost;
+}
+
+void ArduinoClient::configureProtocol(bool taggedResponses, bool binaryFraming, Timeout timeout){
+    uint8_t options = 0;
+    if(taggedResponses){
+        options |= CLIENT_PROTOCOL_TAGGED_RESPONSES;
+    }
+    if(binaryFraming){
+        options |= CLIENT_PROTOCOL_BINARY_FRAMING;
+    }
+
+    // tagged responses apply to the reply of this command already
+    bool oldTagged;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        oldTagged = tagged;
+        tagged = taggedResponses;
+    }
+    Response response;
+    try{
+        response = transact(CLIENT_NON_LIB_HEADER, std::vector<uint8_t>{CLIENT_CONFIGURE_PROTOCOL, options}, timeout);
+        if(response.cmdID != CLIENT_CONFIGURE_PROTOCOL || response.payload.size() < 2 || response.payload[1] == 0){
+            throw ConnectionLost("unexpected response to configureProtocol");
+        }
+    }
+    catch(...){
+        std::lock_guard<std::mutex> lock(mutex);
+        tagged = oldTagged;
+        throw;
+    }
+    // the new framing applies from the next command on
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        binary = binaryFraming;
+        outstandingLimit = response.payload[1];
+    }
+    changed.notify_all();
+}
+
+bool ArduinoClient::taggedResponses() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return tagged;
+}
+
+bool ArduinoClient::binaryFraming() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return binary;
+}
+
+size_t ArduinoClient::maxOutstanding() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return outstandingLimit;
+}
+
+std::future<Response> ArduinoClient::request(uint8_t header, const std::vector<uint8_t>& body, uint8_t* sequenceID){
+    std::shared_ptr<Pending> pending = std::make_shared<Pending>();
+    std::future<Response> response = pending->promise.get_future();
+    submit(header, body, pending);
+    if(sequenceID){
+        *sequenceID = pending->sequenceID;
+    }
+    return response;
+}
+
+void ArduinoClient::request(uint8_t header, const std::vector<uint8_t>& body, ResponseCallback callback){
+    std::shared_ptr<Pending> pending = std::make_shared<Pending>();
+    pending->callback = callback;
+    submit(header, body, pending);
+}
+
+Response ArduinoClient::transact(uint8_t header, const std::vector<uint8_t>& body, Timeout timeout){
+    std::shared_ptr<Pending> pending = std::make_shared<Pending>();
+    std::future<Response> response = pending->promise.get_future();
+    submit(header, body, pending);
+    if(response.wait_for(timeout) == std::future_status::timeout && cancel(pending)){
+        throw RequestTimeout("no response to request " + std::to_string(pending->sequenceID));
+    }
+    return response.get();
+}
+
+std::vector<uint8_t> ArduinoClient::buildFrame(uint8_t header, const std::vector<uint8_t>& body, uint8_t sequenceID) const{
+// Same frames as buildFrame in Firmata.m; called with mutex held
+    std::vector<uint8_t> frame;
+    if(binary){
+        frame.reserve(4 + body.size());
+        frame.push_back(header);
+        frame.push_back(sequenceID);
+        frame.push_back((uint8_t)(body.size() >> 8));
+        frame.push_back((uint8_t)body.size());
+        frame.insert(frame.end(), body.begin(), body.end());
+        frame = cobsEncode(frame.data(), frame.size());
+        frame.push_back(0);
+    }
+    else{
+        frame.reserve(6 + body.size());
+        frame.push_back(CLIENT_SYSEX_START);
+        frame.push_back(header);
+        frame.push_back(sequenceID);
+        frame.push_back(1); // unused payload_size
+        frame.push_back(1);
+        frame.insert(frame.end(), body.begin(), body.end());
+        frame.push_back(CLIENT_SYSEX_END);
+    }
+    return frame;
+}
+
+void ArduinoClient::submit(uint8_t header, const std::vector<uint8_t>& body, std::shared_ptr<Pending> pending){
+    // requests are registered and written in the same order, so that untagged responses match
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+    std::vector<uint8_t> frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(outstanding >= outstandingLimit){
+            // only the reader thread can make room
+            checkNotReader("request with a full window");
+        }
+        changed.wait(lock, [this]{ return lost || fd < 0 || outstanding < outstandingLimit; });
+        checkConnection();
+        pending->sequenceID = sequenceID;
+        sequenceID = (sequenceID == CLIENT_MAX_SEQUENCE_ID) ? 0 : sequenceID + 1;
+        // a late response to an earlier request with this sequence ID, e.g. one that
+        // transact gave up on, must not answer this one
+        taggedMailbox.erase(pending->sequenceID);
+        if(tagged){
+            taggedPending[pending->sequenceID] = pending;
+        }
+        else{
+            untaggedPending.push_back(pending);
+        }
+        outstanding++;
+        frame = buildFrame(header, body, pending->sequenceID);
+    }
+    try{
+        write(frame.data(), frame.size());
+    }
+    catch(const ConnectionLost& e){
+        // a partly written frame may or may not be answered, so nothing in flight can be matched
+        failPending(e.what());
+        throw;
+    }
+}
+
+void ArduinoClient::checkNotReader(const char* operation) const{
+// Throws std::logic_error on the reader thread, for operations that would wait for it
+    if(std::this_thread::get_id() == reader.get_id()){
+        throw std::logic_error(std::string(operation) + " from a callback would deadlock the reader thread");
+    }
+}
+
+bool ArduinoClient::cancel(const std::shared_ptr<Pending>& pending){
+// Forget a request that is still waiting for its response, false if it has been answered
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<uint8_t, std::shared_ptr<Pending> >::iterator tag = taggedPending.find(pending->sequenceID);
+    if(tag != taggedPending.end() && tag->second == pending){
+        taggedPending.erase(tag);
+    }
+    else{
+        std::deque<std::shared_ptr<Pending> >::iterator position = std::find(untaggedPending.begin(), untaggedPending.end(), pending);
+        if(position == untaggedPending.end() || pending->cancelled){
+            return false;
+        }
+        // keep its place, so that its late response does not complete the next request
+        pending->cancelled = true;
+    }
+    outstanding--;
+    changed.notify_all();
+    return true;
+}
+
+void ArduinoClient::write(const uint8_t* data, size_t size){
+// Called with writeMutex held
+    while(size > 0){
+        ssize_t count = ::write(fd, data, size);
+        if(count > 0){
+            data += count;
+            size -= count;
+        }
+        else if(count < 0 && errno == EAGAIN){
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, -1);
+        }
+        else if(count < 0 && errno != EINTR){
+            throw ConnectionLost(std::string("connection is lost: ") + strerror(errno));
+        }
+    }
+}
+
+void ArduinoClient::writeFrame(const uint8_t* frame, size_t size){
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        checkConnection();
+        uint8_t frameID;
+        if(frameSequenceID(frame, size, &frameID)){
+            taggedMailbox.erase(frameID); // as in submit
+        }
+    }
+    write(frame, size);
+}
+
+void ArduinoClient::setTaggedResponses(bool enable){
+    std::lock_guard<std::mutex> lock(mutex);
+    tagged = enable;
+}
+
+bool ArduinoClient::nextResponse(Response* response, Timeout timeout){
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, timeout, [this]{ return lost || !untaggedMailbox.empty(); });
+    if(untaggedMailbox.empty()){
+        return false;
+    }
+    *response = std::move(untaggedMailbox.front());
+    untaggedMailbox.pop_front();
+    return true;
+}
+
+bool ArduinoClient::waitResponse(uint8_t sequenceID, Timeout timeout){
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, timeout, [this, sequenceID]{ return lost || taggedMailbox.count(sequenceID) > 0; }) &&
+        taggedMailbox.count(sequenceID) > 0;
+}
+
+bool ArduinoClient::collectResponse(uint8_t sequenceID, Response* response, Timeout timeout){
+    if(!waitResponse(sequenceID, timeout)){
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<uint8_t, Response>::iterator position = taggedMailbox.find(sequenceID);
+    *response = std::move(position->second);
+    taggedMailbox.erase(position);
+    return true;
+}
+
+void ArduinoClient::setEventCallback(MessageCallback callback){
+    std::lock_guard<std::mutex> lock(mutex);
+    eventCallback = callback;
+}
+
+std::vector<Event> ArduinoClient::readEvents(uint8_t eventID){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Event> matches;
+    std::deque<Event> others;
+    for(size_t i = 0; i < events.size(); ++i){
+        if(events[i].eventID == eventID){
+            matches.push_back(std::move(events[i]));
+        }
+        else{
+            others.push_back(std::move(events[i]));
+        }
+    }
+    events.swap(others);
+    return matches;
+}
+
+std::string ArduinoClient::readDebugText(){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string text;
+    text.swap(debugText);
+    return text;
+}
+
+void ArduinoClient::readerLoop(){
+    for(;;){
+        struct epoll_event ready[2];
+        int count = epoll_wait(epollFd, ready, 2, -1);
+        if(count < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            failPending(std::string("connection is lost: ") + strerror(errno));
+            return;
+        }
+        bool hangup = false;
+        for(int i = 0; i < count; ++i){
+            if(ready[i].data.fd == wakeFd){
+                return;
+            }
+            hangup = hangup || (ready[i].events & (EPOLLHUP | EPOLLERR));
+        }
+
+        // drain the tty, parsing in place; only a trailing partial message is moved
+        for(;;){
+            ssize_t received = ::read(fd, &rxBuffer[rxLength], rxBuffer.size() - rxLength);
+            if(received < 0 && errno == EINTR){
+                continue;
+            }
+            if(received < 0 && errno == EAGAIN){
+                break;
+            }
+            if(received <= 0){
+                if(received == 0 && !hangup){
+                    break;
+                }
+                failPending(received < 0 ? std::string("connection is lost: ") + strerror(errno) : "connection is lost");
+                return;
+            }
+            rxLength += received;
+            size_t consumed = parser.parse(rxBuffer.data(), rxLength, [this](const MessageView& message){ dispatch(message); });
+            if(consumed > 0){
+                memmove(&rxBuffer[0], &rxBuffer[consumed], rxLength - consumed);
+                rxLength -= consumed;
+            }
+            if(rxLength == rxBuffer.size()){
+                rxBuffer.resize(std::max(2 * rxBuffer.size(), FrameParser::requiredLength(rxBuffer.data(), rxLength)));
+            }
+        }
+    }
+}
+
+void ArduinoClient::dispatch(const MessageView& message){
+// Called on the reader thread for every message
+    std::shared_ptr<Pending> pending;
+    std::unique_lock<std::mutex> lock(mutex);
+    switch(message.type){
+        case MESSAGE_RESPONSE:
+            if(!untaggedPending.empty()){
+                pending = untaggedPending.front();
+                untaggedPending.pop_front();
+                if(pending->cancelled){
+                    return; // already counted out of the window by cancel
+                }
+            }
+            else{
+                if(untaggedMailbox.size() == MAX_MAILBOX_SIZE){
+                    untaggedMailbox.pop_front();
+                }
+                untaggedMailbox.push_back(Response());
+                untaggedMailbox.back().cmdID = message.id;
+                untaggedMailbox.back().payload.assign(message.payload, message.payload + message.size);
+            }
+            break;
+        case MESSAGE_TAGGED_RESPONSE: {
+            std::map<uint8_t, std::shared_ptr<Pending> >::iterator tag = taggedPending.find(message.sequenceID);
+            if(tag != taggedPending.end()){
+                pending = tag->second;
+                taggedPending.erase(tag);
+            }
+            else{
+                Response& response = taggedMailbox[message.sequenceID];
+                response.cmdID = message.id;
+                response.payload.assign(message.payload, message.payload + message.size);
+            }
+            break;
+        }
+        case MESSAGE_EVENT:
+            if(eventCallback){
+                MessageCallback callback = eventCallback;
+                lock.unlock();
+                callback(message);
+                return;
+            }
+            if(events.size() == MAX_QUEUED_EVENTS){
+                events.pop_front();
+            }
+            events.push_back(Event());
+            events.back().eventID = message.id;
+            events.back().payload.assign(message.payload, message.payload + message.size);
+            return;
+        case MESSAGE_DEBUG:
+            if(debugText.size() + message.size > MAX_DEBUG_TEXT){
+                debugText.clear();
+            }
+            debugText.append((const char*)message.payload, message.size);
+            return;
+    }
+    if(pending){
+        outstanding--;
+    }
+    lock.unlock();
+    changed.notify_all();
+    if(pending){
+        complete(pending, message);
+    }
+}
+
+void ArduinoClient::complete(std::shared_ptr<Pending> pending, const MessageView& message){
+    Response response;
+    response.cmdID = message.id;
+    response.payload.assign(message.payload, message.payload + message.size);
+    if(pending->callback){
+        pending->callback(response);
+    }
+    else{
+        pending->promise.set_value(std::move(response));
+    }
+}
+
+void ArduinoClient::failPending(const std::string& reason){
+    std::vector<std::shared_ptr<Pending> > failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!lost){
+            lost = true;
+            lostReason = reason;
+        }
+        for(std::map<uint8_t, std::shared_ptr<Pending> >::iterator tag = taggedPending.begin(); tag != taggedPending.end(); ++tag){
+            failed.push_back(tag->second);
+        }
+        failed.insert(failed.end(), untaggedPending.begin(), untaggedPending.end());
+        taggedPending.clear();
+        untaggedPending.clear();
+        outstanding = 0;
+    }
+    changed.notify_all();
+    for(size_t i = 0; i < failed.size(); ++i){
+        if(!failed[i]->callback){
+            failed[i]->promise.set_exception(std::make_exception_ptr(ConnectionLost(reason)));
+        }
+    }
+}
+
+void ArduinoClient::checkConnection(){
+// Called with mutex held
+    if(fd < 0){
+        throw ConnectionLost("connection is not open");
+    }
+    if(lost){
+        throw ConnectionLost(lostReason);
+    }
+}
+
+} // namespace arduinoio
@@ -0,0 +1,221 @@
+/*
+  ArduinoClient.h - native host client of ArduinoServer
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+
+  Speaks the frame format of +arduinoio/+internal/Firmata.m over a serial port or
+  pty. A reader thread waits on the tty with epoll, parses server messages in
+  place in its receive buffer and completes the request they answer: by sequence
+  ID once tagged responses are enabled, in send order otherwise.
+
+  Response and event callbacks run on the reader thread, which has to return to
+  complete further requests. A callback may call request() while fewer than
+  maxOutstanding() requests are in flight; request() with a full window and
+  close() throw std::logic_error there instead of deadlocking, and transact() or
+  the response reads only return once their timeout expires.
+*/
+#ifndef ArduinoClient_h
+#define ArduinoClient_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace arduinoio {
+
+// Same values as Firmata.m and MWArduino.h
+#define CLIENT_SYSEX_START              0xF0
+#define CLIENT_SYSEX_END                0xF7
+#define CLIENT_NON_LIB_HEADER           0x00
+#define CLIENT_LIB_HEADER               0x01
+#define CLIENT_CONFIGURE_PROTOCOL       0x05
+#define CLIENT_PROTOCOL_TAGGED_RESPONSES 0x01
+#define CLIENT_PROTOCOL_BINARY_FRAMING  0x02
+#define CLIENT_MAX_SEQUENCE_ID          127
+
+// Message types, the byte after the leading 0 of every server message
+enum MessageType {
+    MESSAGE_RESPONSE        = 0, // 0, 0, cmdID, payload_size, value
+    MESSAGE_DEBUG           = 1, // 0, 1, count, text
+    MESSAGE_TAGGED_RESPONSE = 2, // 0, 2, sequenceID, cmdID, payload_size, value
+    MESSAGE_EVENT           = 3  // 0, 3, eventID, payload_size, value
+};
+
+// A server message as found in the receive buffer; only valid during the call it is passed to
+struct MessageView {
+    MessageType type;
+    uint8_t sequenceID;     // tagged responses only
+    uint8_t id;             // cmdID of responses, eventID of events
+    const uint8_t* payload; // value, or the text of debug messages
+    size_t size;
+};
+
+struct Response {
+    uint8_t cmdID;
+    std::vector<uint8_t> payload;
+    Response() : cmdID(0) {}
+    std::vector<uint8_t> value() const; // [cmdID; payload_size; payload] as SerialHostTransportLayer returns it
+};
+
+struct Event {
+    uint8_t eventID;
+    std::vector<uint8_t> payload;
+};
+
+class ConnectionLost : public std::runtime_error {
+public:
+    explicit ConnectionLost(const std::string& what) : std::runtime_error(what) {}
+};
+
+class RequestTimeout : public std::runtime_error {
+public:
+    explicit RequestTimeout(const std::string& what) : std::runtime_error(what) {}
+};
+
+class FrameParser {
+// Splits the server byte stream into messages without copying them
+public:
+    // Calls handler(const MessageView&) for every complete message in data and returns
+    // the number of bytes consumed; a trailing partial message is left for the next call.
+    // Bytes that cannot start a message are skipped.
+    template<class Handler>
+    size_t parse(const uint8_t* data, size_t size, Handler handler) const {
+        size_t start = 0;
+        while(start < size){
+            size_t length = messageLength(data + start, size - start);
+            if(length == 0){
+                break;
+            }
+            MessageView message;
+            if(toView(data + start, length, &message)){
+                handler(message);
+            }
+            start += length;
+        }
+        return start;
+    }
+
+    // Length of the message at data, 0 if it is still incomplete, 1 for a byte to skip
+    static size_t messageLength(const uint8_t* data, size_t size);
+
+    // Bytes needed to hold the message at data; at least size + 1 if its header is incomplete
+    static size_t requiredLength(const uint8_t* data, size_t size);
+
+private:
+    static bool toView(const uint8_t* data, size_t length, MessageView* message);
+};
+
+std::vector<uint8_t> cobsEncode(const uint8_t* data, size_t size); // without the 0x00 delimiter
+
+class ArduinoClient {
+public:
+    typedef std::function<void(const Response&)> ResponseCallback;
+    typedef std::function<void(const MessageView&)> MessageCallback;
+    typedef std::chrono::milliseconds Timeout;
+
+    ArduinoClient();
+    ~ArduinoClient();
+
+    // Opens the tty in raw mode and starts the reader thread. With a banner timeout, first
+    // waits for the firmware report the server sends when the board resets, as
+    // SerialHostTransportLayer.openConnection does. Throws std::system_error or ConnectionLost.
+    void open(const std::string& port, unsigned long baudRate = 115200, Timeout bannerTimeout = Timeout(0));
+    void close(); // not from a callback, see above
+    bool isOpen() const; // false once the connection is lost
+
+    // Negotiates tagged responses and binary framing with the server, see configureProtocol in Firmata.m.
+    // The server reports how many requests its serial receive buffer holds; until then one is in flight.
+    void configureProtocol(bool taggedResponses, bool binaryFraming, Timeout timeout = Timeout(5000));
+    bool taggedResponses() const;
+    bool binaryFraming() const;
+    size_t maxOutstanding() const;
+
+    // Requests built from a header (CLIENT_NON_LIB_HEADER or CLIENT_LIB_HEADER) and a body
+    // already encoded for the current framing, i.e. [cmdID; params] or [libID; cmdID; params].
+    // Blocks while maxOutstanding() requests are in flight, or throws std::logic_error if
+    // called from a callback then. Futures of requests pending when the connection is lost
+    // hold ConnectionLost; callbacks are not called for them.
+    // Untagged responses are matched in send order; a request that transact gave up on keeps
+    // its place and its late response is discarded.
+    std::future<Response> request(uint8_t header, const std::vector<uint8_t>& body, uint8_t* sequenceID = NULL);
+    void request(uint8_t header, const std::vector<uint8_t>& body, ResponseCallback callback);
+    Response transact(uint8_t header, const std::vector<uint8_t>& body, Timeout timeout = Timeout(5000)); // throws RequestTimeout
+
+    // Complete frames as Firmata.m builds them; the caller keeps the sequence IDs and the
+    // window. Their responses are kept until read with nextResponse or collectResponse, or
+    // until a request reuses their sequence ID.
+    void writeFrame(const uint8_t* frame, size_t size);
+    void setTaggedResponses(bool enable); // after a configureProtocol sent with writeFrame
+    bool nextResponse(Response* response, Timeout timeout);
+    bool waitResponse(uint8_t sequenceID, Timeout timeout);
+    bool collectResponse(uint8_t sequenceID, Response* response, Timeout timeout);
+
+    // Events are passed to the callback on the reader thread if one is set, queued otherwise
+    void setEventCallback(MessageCallback callback);
+    std::vector<Event> readEvents(uint8_t eventID);
+    std::string readDebugText();
+
+private:
+    struct Pending {
+        std::promise<Response> promise;
+        ResponseCallback callback;
+        uint8_t sequenceID;
+        bool cancelled; // untagged, waiting only to swallow its response
+        Pending() : sequenceID(0), cancelled(false) {}
+    };
+
+    std::vector<uint8_t> buildFrame(uint8_t header, const std::vector<uint8_t>& body, uint8_t sequenceID) const;
+    void submit(uint8_t header, const std::vector<uint8_t>& body, std::shared_ptr<Pending> pending);
+    bool cancel(const std::shared_ptr<Pending>& pending);
+    void write(const uint8_t* data, size_t size);
+    void readBanner(Timeout timeout);
+    void readerLoop();
+    void dispatch(const MessageView& message);
+    void complete(std::shared_ptr<Pending> pending, const MessageView& message);
+    void failPending(const std::string& reason);
+    void checkConnection();
+    void checkNotReader(const char* operation) const;
+
+    int fd;
+    int epollFd;
+    int wakeFd;
+    std::thread reader;
+    FrameParser parser;
+    std::vector<uint8_t> rxBuffer;
+    size_t rxLength;
+
+    mutable std::mutex mutex;       // everything below
+    std::condition_variable changed;
+    bool tagged;
+    bool binary;
+    bool lost;
+    std::string lostReason;
+    uint8_t sequenceID;
+    size_t outstanding;
+    size_t outstandingLimit;
+    std::map<uint8_t, std::shared_ptr<Pending> > taggedPending;
+    std::deque<std::shared_ptr<Pending> > untaggedPending;
+    std::map<uint8_t, Response> taggedMailbox;
+    std::deque<Response> untaggedMailbox;
+    std::deque<Event> events;
+    std::string debugText;
+    MessageCallback eventCallback;
+    std::mutex writeMutex;
+};
+
+} // namespace arduinoio
+
+#endif
@@ -0,0 +1,272 @@
+/*
+  ArduinoClientAPI.cpp - C interface of the native host client
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+*/
+#include "ArduinoClientAPI.h"
+#include "ArduinoClient.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+using namespace arduinoio;
+
+struct ArduinoClientHandle {
+    ArduinoClient client;
+    std::mutex mutex;                                   // everything below
+    std::map<int, std::future<Response> > results;      // of arduinoClientSubmit, by sequence ID
+    std::deque<Event> events;                           // read from the client, not yet returned
+    std::string debugText;
+};
+
+static thread_local std::string lastError;
+
+template<class Function>
+static int guard(Function function){
+// Run function, turning exceptions into status codes
+    try{
+        return function();
+    }
+    catch(const RequestTimeout& e){
+        lastError = e.what();
+        return ARDUINOCLIENT_TIMEOUT;
+    }
+    catch(const std::invalid_argument& e){
+        lastError = e.what();
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    catch(const std::exception& e){
+        lastError = e.what();
+        return ARDUINOCLIENT_CONNECTION_LOST;
+    }
+}
+
+static int copyOut(const std::vector<uint8_t>& data, unsigned char* buffer, size_t capacity){
+    if(data.size() > capacity){
+        lastError = "buffer too small";
+        return ARDUINOCLIENT_BUFFER_TOO_SMALL;
+    }
+    if(!data.empty()){
+        memcpy(buffer, data.data(), data.size());
+    }
+    return (int)data.size();
+}
+
+static int notReceived(ArduinoClientHandle* client){
+    if(client->client.isOpen()){
+        lastError = "no response within the timeout";
+        return ARDUINOCLIENT_TIMEOUT;
+    }
+    lastError = "connection is lost";
+    return ARDUINOCLIENT_CONNECTION_LOST;
+}
+
+static bool validHandle(const ArduinoClientHandle* client){
+    if(client == NULL){
+        lastError = "invalid client handle";
+        return false;
+    }
+    return true;
+}
+
+static bool validSequenceID(int sequenceID){
+    if(sequenceID < 0 || sequenceID > CLIENT_MAX_SEQUENCE_ID){
+        lastError = "invalid sequence ID";
+        return false;
+    }
+    return true;
+}
+
+ArduinoClientHandle* arduinoClientOpen(const char* port, unsigned long baudRate, int bannerTimeout, int* status){
+    ArduinoClientHandle* client = new ArduinoClientHandle;
+    int result = ARDUINOCLIENT_OPEN_FAILED;
+    try{
+        client->client.open(port, baudRate, ArduinoClient::Timeout(bannerTimeout));
+        result = 0;
+    }
+    catch(const ConnectionLost& e){
+        lastError = e.what();
+        result = ARDUINOCLIENT_NO_SERVER;
+    }
+    catch(const std::invalid_argument& e){
+        lastError = e.what();
+        result = ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    catch(const std::exception& e){
+        lastError = e.what();
+    }
+    if(status){
+        *status = result;
+    }
+    if(result != 0){
+        delete client;
+        return NULL;
+    }
+    return client;
+}
+
+void arduinoClientClose(ArduinoClientHandle* client){
+    delete client;
+}
+
+const char* arduinoClientLastError(void){
+    return lastError.c_str();
+}
+
+int arduinoClientWrite(ArduinoClientHandle* client, const unsigned char* frame, size_t size){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    return guard([&]{
+        client->client.writeFrame(frame, size);
+        return 0;
+    });
+}
+
+int arduinoClientSetTaggedResponses(ArduinoClientHandle* client, int enable){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    client->client.setTaggedResponses(enable != 0);
+    return 0;
+}
+
+int arduinoClientReadResponse(ArduinoClientHandle* client, int timeout, unsigned char* value, size_t capacity){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    Response response;
+    if(!client->client.nextResponse(&response, ArduinoClient::Timeout(timeout))){
+        return notReceived(client);
+    }
+    return copyOut(response.value(), value, capacity);
+}
+
+int arduinoClientWaitResponse(ArduinoClientHandle* client, int sequenceID, int timeout){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    if(!validSequenceID(sequenceID)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    if(!client->client.waitResponse((uint8_t)sequenceID, ArduinoClient::Timeout(timeout))){
+        return notReceived(client);
+    }
+    return 0;
+}
+
+int arduinoClientCollectResponse(ArduinoClientHandle* client, int sequenceID, int timeout, unsigned char* value, size_t capacity){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    if(!validSequenceID(sequenceID)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    Response response;
+    if(!client->client.collectResponse((uint8_t)sequenceID, &response, ArduinoClient::Timeout(timeout))){
+        return notReceived(client);
+    }
+    return copyOut(response.value(), value, capacity);
+}
+
+int arduinoClientConfigureProtocol(ArduinoClientHandle* client, int taggedResponses, int binaryFraming, int timeout){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    return guard([&]{
+        client->client.configureProtocol(taggedResponses != 0, binaryFraming != 0, ArduinoClient::Timeout(timeout));
+        return 0;
+    });
+}
+
+int arduinoClientSubmit(ArduinoClientHandle* client, int header, const unsigned char* body, size_t size){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    return guard([&]{
+        if(header != CLIENT_NON_LIB_HEADER && header != CLIENT_LIB_HEADER){
+            throw std::invalid_argument("invalid header");
+        }
+        uint8_t sequenceID;
+        std::future<Response> response = client->client.request((uint8_t)header, std::vector<uint8_t>(body, body + size), &sequenceID);
+        std::lock_guard<std::mutex> lock(client->mutex);
+        client->results[sequenceID] = std::move(response);
+        return (int)sequenceID;
+    });
+}
+
+int arduinoClientResult(ArduinoClientHandle* client, int sequenceID, int timeout, unsigned char* value, size_t capacity){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    std::future<Response> response;
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        std::map<int, std::future<Response> >::iterator result = client->results.find(sequenceID);
+        if(result == client->results.end()){
+            lastError = "no request with this sequence ID";
+            return ARDUINOCLIENT_INVALID_ARGUMENT;
+        }
+        response = std::move(result->second);
+        client->results.erase(result);
+    }
+    if(response.wait_for(ArduinoClient::Timeout(timeout)) == std::future_status::timeout){
+        std::lock_guard<std::mutex> lock(client->mutex);
+        client->results[sequenceID] = std::move(response); // can be collected later
+        lastError = "no response within the timeout";
+        return ARDUINOCLIENT_TIMEOUT;
+    }
+    return guard([&]{
+        return copyOut(response.get().value(), value, capacity);
+    });
+}
+
+int arduinoClientTransact(ArduinoClientHandle* client, int header, const unsigned char* body, size_t size,
+    int timeout, unsigned char* value, size_t capacity){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    return guard([&]{
+        if(header != CLIENT_NON_LIB_HEADER && header != CLIENT_LIB_HEADER){
+            throw std::invalid_argument("invalid header");
+        }
+        Response response = client->client.transact((uint8_t)header, std::vector<uint8_t>(body, body + size),
+            ArduinoClient::Timeout(timeout));
+        return copyOut(response.value(), value, capacity);
+    });
+}
+
+int arduinoClientReadEvent(ArduinoClientHandle* client, int eventID, unsigned char* event, size_t capacity){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    std::lock_guard<std::mutex> lock(client->mutex);
+    std::vector<Event> received = client->client.readEvents((uint8_t)eventID);
+    client->events.insert(client->events.end(), received.begin(), received.end());
+    for(std::deque<Event>::iterator position = client->events.begin(); position != client->events.end(); ++position){
+        if(position->eventID == eventID){
+            std::vector<uint8_t> data(1, position->eventID);
+            data.insert(data.end(), position->payload.begin(), position->payload.end());
+            int result = copyOut(data, event, capacity);
+            if(result > 0){
+                client->events.erase(position);
+            }
+            return result;
+        }
+    }
+    return 0;
+}
+
+int arduinoClientReadDebug(ArduinoClientHandle* client, char* text, size_t capacity){
+    if(!validHandle(client)){
+        return ARDUINOCLIENT_INVALID_ARGUMENT;
+    }
+    std::lock_guard<std::mutex> lock(client->mutex);
+    client->debugText += client->client.readDebugText();
+    size_t count = std::min(capacity, client->debugText.size());
+    memcpy(text, client->debugText.data(), count);
+    client->debugText.erase(0, count);
+    return (int)count;
+}
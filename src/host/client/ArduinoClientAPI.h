@@ -0,0 +1,58 @@
+/*
+  ArduinoClientAPI.h - C interface of the native host client, for loadlibrary in MATLAB
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+
+  Frames are written as Firmata.m builds them. Responses are returned as
+  [cmdID; payload_size; value] and events as [eventID; value], the layout of
+  SerialHostTransportLayer. Functions returning int give a length or a count on
+  success and one of the negative ARDUINOCLIENT_* codes on failure, e.g.
+  ARDUINOCLIENT_INVALID_ARGUMENT for a NULL client handle.
+*/
+#ifndef ArduinoClientAPI_h
+#define ArduinoClientAPI_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARDUINOCLIENT_TIMEOUT           -1 // no response within the timeout
+#define ARDUINOCLIENT_CONNECTION_LOST   -2
+#define ARDUINOCLIENT_BUFFER_TOO_SMALL  -3
+#define ARDUINOCLIENT_INVALID_ARGUMENT  -4
+#define ARDUINOCLIENT_NO_SERVER         -5 // the firmware report of the server was not received
+#define ARDUINOCLIENT_OPEN_FAILED       -6
+
+typedef struct ArduinoClientHandle ArduinoClientHandle;
+
+/* Opens port; bannerTimeout (ms) > 0 waits for the server's firmware report first. NULL on failure, with *status set */
+ArduinoClientHandle* arduinoClientOpen(const char* port, unsigned long baudRate, int bannerTimeout, int* status);
+void arduinoClientClose(ArduinoClientHandle* client); /* does nothing for NULL */
+const char* arduinoClientLastError(void); /* message of the last failure on the calling thread */
+
+/* Raw frames, as SerialHostTransportLayer.writeMessage sends them */
+int arduinoClientWrite(ArduinoClientHandle* client, const unsigned char* frame, size_t size);
+int arduinoClientSetTaggedResponses(ArduinoClientHandle* client, int enable);
+int arduinoClientReadResponse(ArduinoClientHandle* client, int timeout, unsigned char* value, size_t capacity);
+int arduinoClientWaitResponse(ArduinoClientHandle* client, int sequenceID, int timeout); /* 0 once it has arrived */
+int arduinoClientCollectResponse(ArduinoClientHandle* client, int sequenceID, int timeout, unsigned char* value, size_t capacity);
+
+/* Requests framed by the client, see ArduinoClient::request */
+int arduinoClientConfigureProtocol(ArduinoClientHandle* client, int taggedResponses, int binaryFraming, int timeout);
+int arduinoClientSubmit(ArduinoClientHandle* client, int header, const unsigned char* body, size_t size); /* sequence ID */
+int arduinoClientResult(ArduinoClientHandle* client, int sequenceID, int timeout, unsigned char* value, size_t capacity);
+int arduinoClientTransact(ArduinoClientHandle* client, int header, const unsigned char* body, size_t size,
+    int timeout, unsigned char* value, size_t capacity);
+
+/* Queued messages, without waiting; 0 if there is none */
+int arduinoClientReadEvent(ArduinoClientHandle* client, int eventID, unsigned char* event, size_t capacity);
+int arduinoClientReadDebug(ArduinoClientHandle* client, char* text, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
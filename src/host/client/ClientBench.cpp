@@ -0,0 +1,355 @@
+/*
+  ClientBench.cpp - round trip benchmark of the native host client
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  See file LICENSE.txt for licensing terms.
+
+  Replays the recordings of ArduinoServerBench through ArduinoClient against a
+  server on a serial port, normally ArduinoPtyServer, and reports commands/sec and
+  per-command round trip latency. Recorded frames are unpacked into header and body
+  and sent with ArduinoClient::request, so a recorded configureProtocol switches
+  the client's framing as well. With a window above 1, tagged responses are enabled
+  and up to that many requests are in flight, at most as many as the server
+  reports. Responses are checked like in
+  ArduinoServerBench: against the expected response of the recording, and base
+  commands against their cmdID; mismatches make the run fail. A recorded "wait ms"
+  waits for all requests in flight and then sleeps for ms; the server follows the
+  wall clock.
+
+  Usage: ArduinoClientBench [-n repeat] [-w window] [-v] port recording...
+*/
+
+#include "ArduinoClient.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#define RESPONSE_TIMEOUT 2000 // ms before a command is counted as unanswered and the run stops
+#define ANY_BYTE -1           // "??" in an expected response
+
+using namespace arduinoio;
+
+typedef std::chrono::steady_clock Clock;
+
+struct RecordedCommand {
+    std::string label;
+    uint8_t header;
+    std::vector<uint8_t> body;
+    std::vector<int> expected; // response, empty if not recorded
+    unsigned long wait;        // ms to wait before the command is sent
+};
+
+struct Received {
+    Clock::time_point time;
+    bool matched;
+};
+
+struct InFlight {
+    size_t label;
+    Clock::time_point sent;
+    std::future<Received> received;
+};
+
+std::vector<RecordedCommand> recording;
+std::vector<std::string> labelOrder;
+std::vector<std::vector<double> > latencies; // microseconds, by label
+std::vector<unsigned long> mismatches;       // by label
+unsigned long repeat = 1;
+size_t window = 1;
+bool verbose = false;
+
+bool unpackFrame(const std::vector<uint8_t>& frame, RecordedCommand* command){
+// Header and body of a recorded sysex message or COBS frame
+    if(frame.size() >= 6 && frame.front() == CLIENT_SYSEX_START && frame.back() == CLIENT_SYSEX_END){
+        command->header = frame[1];
+        command->body.assign(frame.begin() + 5, frame.end() - 1);
+        return true;
+    }
+    if(frame.size() < 2 || frame.back() != 0){
+        return false;
+    }
+    std::vector<uint8_t> decoded;
+    size_t index = 0;
+    while(index < frame.size() - 1){
+        uint8_t code = frame[index++];
+        if(code == 0 || index + code - 1 > frame.size() - 1){
+            return false;
+        }
+        decoded.insert(decoded.end(), frame.begin() + index, frame.begin() + index + code - 1);
+        index += code - 1;
+        if(code < 0xFF && index < frame.size() - 1){
+            decoded.push_back(0);
+        }
+    }
+    if(decoded.size() < 4){
+        return false;
+    }
+    command->header = decoded[0];
+    command->body.assign(decoded.begin() + 4, decoded.end());
+    return true;
+}
+
+bool parseBytes(const std::string& text, std::vector<int>* bytes){
+// Hex bytes separated by white space, "??" as ANY_BYTE
+    std::istringstream byteStream(text);
+    std::string token;
+    while(byteStream >> token){
+        if(token == "??"){
+            bytes->push_back(ANY_BYTE);
+            continue;
+        }
+        char* end;
+        unsigned long value = strtoul(token.c_str(), &end, 16);
+        if(*end != '\0' || value > 0xFF){
+            return false;
+        }
+        bytes->push_back((int)value);
+    }
+    return true;
+}
+
+bool matchesRecording(const RecordedCommand& command, const std::vector<uint8_t>& value){
+// Where a library command keeps its cmdID is up to the library, so only base commands
+// are checked without an expected response
+    if(command.header == CLIENT_NON_LIB_HEADER && !command.body.empty() && value[0] != command.body[0]){
+        return false;
+    }
+    if(command.expected.empty()){
+        return true;
+    }
+    if(value.size() != command.expected.size()){
+        return false;
+    }
+    for(size_t i = 0; i < value.size(); ++i){
+        if(command.expected[i] != ANY_BYTE && command.expected[i] != value[i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadRecording(const char* filename){
+    std::ifstream file(filename);
+    if(!file){
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return false;
+    }
+    std::string line;
+    unsigned int lineNumber = 0;
+    unsigned long wait = 0;
+    while(std::getline(file, line)){
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream waitStream(line);
+        std::string keyword;
+        if(waitStream >> keyword && keyword == "wait"){
+            unsigned long ms;
+            if(!(waitStream >> ms)){
+                fprintf(stderr, "%s:%u: invalid wait\n", filename, lineNumber);
+                return false;
+            }
+            wait += ms;
+            continue;
+        }
+        std::string label;
+        size_t colon = line.find(':');
+        if(colon != std::string::npos){
+            std::istringstream labelStream(line.substr(0, colon));
+            labelStream >> label;
+            line = line.substr(colon + 1);
+        }
+        size_t arrow = line.find("=>");
+        std::vector<int> bytes;
+        RecordedCommand command;
+        if(!parseBytes(line.substr(0, arrow), &bytes) ||
+            (arrow != std::string::npos && !parseBytes(line.substr(arrow + 2), &command.expected))){
+            fprintf(stderr, "%s:%u: invalid byte\n", filename, lineNumber);
+            return false;
+        }
+        if(bytes.empty()){
+            continue;
+        }
+        if(std::find(bytes.begin(), bytes.end(), ANY_BYTE) != bytes.end()){
+            fprintf(stderr, "%s:%u: wildcard in a command\n", filename, lineNumber);
+            return false;
+        }
+        std::vector<uint8_t> frame(bytes.begin(), bytes.end());
+        if(!unpackFrame(frame, &command)){
+            fprintf(stderr, "%s:%u: not a sysex message or COBS frame\n", filename, lineNumber);
+            return false;
+        }
+        if(label.empty()){
+            std::ostringstream labelStream;
+            labelStream << filename << ":" << lineNumber;
+            label = labelStream.str();
+        }
+        command.label = label;
+        command.wait = wait;
+        recording.push_back(command);
+        wait = 0;
+        if(std::find(labelOrder.begin(), labelOrder.end(), label) == labelOrder.end()){
+            labelOrder.push_back(label);
+        }
+    }
+    return true;
+}
+
+size_t labelIndex(const std::string& label){
+    return std::find(labelOrder.begin(), labelOrder.end(), label) - labelOrder.begin();
+}
+
+double percentile(std::vector<double>& values, double p){
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+void printLatencies(const char* label, std::vector<double>& values){
+    std::sort(values.begin(), values.end());
+    double sum = 0;
+    for(size_t j = 0; j < values.size(); ++j){
+        sum += values[j];
+    }
+    printf("%-24s %8lu %10.3f %10.3f %10.3f %10.3f %10.3f\n", label, (unsigned long)values.size(),
+        values.front(), sum / values.size(), percentile(values, 0.5), percentile(values, 0.99), values.back());
+}
+
+bool retire(std::deque<InFlight>& inFlight){
+// Wait for the oldest request in flight and record its latency
+    InFlight& oldest = inFlight.front();
+    if(oldest.received.wait_for(std::chrono::milliseconds(RESPONSE_TIMEOUT)) == std::future_status::timeout){
+        fprintf(stderr, "%s unanswered\n", labelOrder[oldest.label].c_str());
+        return false;
+    }
+    Received received = oldest.received.get();
+    latencies[oldest.label].push_back(std::chrono::duration<double, std::micro>(received.time - oldest.sent).count());
+    if(!received.matched){
+        mismatches[oldest.label]++;
+    }
+    inFlight.pop_front();
+    return true;
+}
+
+int main(int argc, char** argv){
+    const char* port = NULL;
+    for(int i = 1; i < argc; ++i){
+        if(strcmp(argv[i], "-n") == 0 && i+1 < argc){
+            repeat = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-w") == 0 && i+1 < argc){
+            window = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-v") == 0){
+            verbose = true;
+        }
+        else if(!port){
+            port = argv[i];
+        }
+        else if(!loadRecording(argv[i])){
+            return 1;
+        }
+    }
+    if(recording.empty() || repeat == 0 || window == 0){
+        fprintf(stderr, "Usage: %s [-n repeat] [-w window] [-v] port recording...\n", argv[0]);
+        return 1;
+    }
+    latencies.resize(labelOrder.size());
+    mismatches.resize(labelOrder.size());
+
+    ArduinoClient client;
+    std::atomic<unsigned long> numEvents(0);
+    try{
+        client.open(port);
+        client.setEventCallback([&numEvents](const MessageView&){ ++numEvents; });
+        if(window > 1){
+            client.configureProtocol(true, false);
+            window = std::min(window, client.maxOutstanding());
+        }
+
+        std::deque<InFlight> inFlight;
+        Clock::time_point startTime = Clock::now();
+        for(unsigned long pass = 0; pass < repeat; ++pass){
+            for(size_t i = 0; i < recording.size(); ++i){
+                const RecordedCommand& command = recording[i];
+                while(inFlight.size() >= window || (command.wait > 0 && !inFlight.empty())){
+                    if(!retire(inFlight)){
+                        return 1;
+                    }
+                }
+                if(command.wait > 0){
+                    std::this_thread::sleep_for(std::chrono::milliseconds(command.wait));
+                }
+                if(command.header == CLIENT_NON_LIB_HEADER && command.body.size() == 2 && command.body[0] == CLIENT_CONFIGURE_PROTOCOL){
+                    // keep the window's tagged responses on, let the recording choose the framing
+                    while(!inFlight.empty()){
+                        if(!retire(inFlight)){
+                            return 1;
+                        }
+                    }
+                    Clock::time_point sent = Clock::now();
+                    client.configureProtocol(window > 1, (command.body[1] & CLIENT_PROTOCOL_BINARY_FRAMING) != 0);
+                    latencies[labelIndex(command.label)].push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+                    continue;
+                }
+                std::shared_ptr<std::promise<Received> > received = std::make_shared<std::promise<Received> >();
+                InFlight request;
+                request.label = labelIndex(command.label);
+                request.received = received->get_future();
+                request.sent = Clock::now();
+                client.request(command.header, command.body, [received, &command](const Response& response){
+                    Clock::time_point time = Clock::now();
+                    std::vector<uint8_t> value = response.value();
+                    received->set_value(Received{time, matchesRecording(command, value)});
+                    if(verbose){
+                        for(size_t j = 0; j < value.size(); ++j){
+                            printf("%02X ", value[j]);
+                        }
+                        printf("\n");
+                    }
+                });
+                inFlight.push_back(std::move(request));
+            }
+        }
+        while(!inFlight.empty()){
+            if(!retire(inFlight)){
+                return 1;
+            }
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - startTime).count();
+        // the server keeps its protocol options across connections, leave it as after a reset
+        if(client.taggedResponses() || client.binaryFraming()){
+            client.configureProtocol(false, false);
+        }
+        client.close();
+
+        unsigned long numCommands = repeat * recording.size();
+        printf("%lu commands in %.3f s: %.0f commands/sec, window %lu, %lu events\n",
+            numCommands, elapsed, numCommands / elapsed, (unsigned long)window, numEvents.load());
+        printf("\n%-24s %8s %10s %10s %10s %10s %10s\n", "round trip (us)", "count", "min", "mean", "p50", "p99", "max");
+        std::vector<double> all;
+        unsigned long numMismatched = 0;
+        for(size_t i = 0; i < labelOrder.size(); ++i){
+            all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+            printLatencies(labelOrder[i].c_str(), latencies[i]);
+            if(mismatches[i] > 0){
+                printf("%-24s %8lu mismatched\n", labelOrder[i].c_str(), mismatches[i]);
+                numMismatched += mismatches[i];
+            }
+        }
+        printLatencies("all", all);
+        if(numMismatched > 0){
+            return 1;
+        }
+    }
+    catch(const std::exception& e){
+        fprintf(stderr, "%s: %s\n", port, e.what());
+        return 1;
+    }
+    return 0;
+}
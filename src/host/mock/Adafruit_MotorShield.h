@@ -0,0 +1,65 @@
+/*
+  Adafruit_MotorShield.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef _Adafruit_MotorShield_h_
+#define _Adafruit_MotorShield_h_
+#include "Arduino.h"
+#include "Adafruit_PWMServoDriver.h"
+#define MICROSTEPS 16
+#define FORWARD 1
+#define BACKWARD 2
+#define BRAKE 3
+#define RELEASE 4
+#define SINGLE 1
+#define DOUBLE 2
+#define INTERLEAVE 3
+#define MICROSTEP 4
+class Adafruit_MotorShield;
+class Adafruit_DCMotor {
+public:
+    Adafruit_DCMotor(void);
+    friend class Adafruit_MotorShield;
+    void run(uint8_t);
+    void setSpeed(uint8_t);
+private:
+    uint8_t PWMpin, IN1pin, IN2pin;
+    Adafruit_MotorShield *MC;
+    uint8_t motornum;
+};
+class Adafruit_StepperMotor {
+public:
+    Adafruit_StepperMotor(void);
+    friend class Adafruit_MotorShield;
+    void step(uint16_t steps, uint8_t dir, uint8_t style = SINGLE);
+    void setSpeed(uint16_t);
+    uint8_t onestep(uint8_t dir, uint8_t style);
+    void release(void);
+    uint32_t usperstep;
+private:
+    uint8_t PWMApin, AIN1pin, AIN2pin;
+    uint8_t PWMBpin, BIN1pin, BIN2pin;
+    uint16_t revsteps;
+    uint8_t currentstep;
+    Adafruit_MotorShield *MC;
+    uint8_t steppernum;
+};
+class Adafruit_MotorShield {
+public:
+    Adafruit_MotorShield(uint8_t addr = 0x60);
+    friend class Adafruit_DCMotor;
+    void begin(uint16_t freq = 1600);
+    void setPWM(uint8_t pin, uint16_t val);
+    void setPin(uint8_t pin, boolean val);
+    Adafruit_DCMotor *getMotor(uint8_t n);
+    Adafruit_StepperMotor *getStepper(uint16_t steps, uint8_t n);
+private:
+    uint8_t _addr;
+    uint16_t _freq;
+    Adafruit_DCMotor dcmotors[4];
+    Adafruit_StepperMotor steppers[2];
+    Adafruit_PWMServoDriver _pwm;
+};
+#endif
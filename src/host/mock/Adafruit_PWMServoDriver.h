@@ -0,0 +1,20 @@
+/*
+  Adafruit_PWMServoDriver.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef _ADAFRUIT_PWMServoDriver_H
+#define _ADAFRUIT_PWMServoDriver_H
+#include "Arduino.h"
+class Adafruit_PWMServoDriver {
+public:
+    Adafruit_PWMServoDriver(uint8_t addr = 0x40);
+    void begin(void);
+    void reset(void);
+    void setPWMFreq(float freq);
+    void setPWM(uint8_t num, uint16_t on, uint16_t off);
+private:
+    uint8_t _i2caddr;
+};
+#endif
@@ -0,0 +1,68 @@
+/*
+  Arduino.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+typedef uint8_t byte;
+typedef bool boolean;
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+#define NUM_DIGITAL_PINS 20
+#define NUM_ANALOG_INPUTS 6
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+
+// AVR style port registers: PINx, DDRx and PORTx of a port at consecutive addresses,
+// 8 pins per port, port numbers start at 1
+#define NOT_A_PIN 0
+#define NUM_PORTS ((NUM_DIGITAL_PINS + 7) / 8 + 1)
+extern volatile uint8_t mockPortRegisters[NUM_PORTS][3];
+#define digitalPinToPort(p) ((p) < NUM_DIGITAL_PINS ? (p) / 8 + 1 : NOT_A_PIN)
+#define digitalPinToBitMask(p) (1 << ((p) % 8))
+#define portInputRegister(port) (&mockPortRegisters[port][0])
+#define portModeRegister(port) (&mockPortRegisters[port][1])
+#define portOutputRegister(port) (&mockPortRegisters[port][2])
+extern uint8_t SREG;
+#define cli()
+#define sei()
+#ifndef RAMEND
+#define RAMEND 0x8FF // 2KB SRAM like the Uno, override with -DRAMEND to build the larger configuration
+#endif
+void init();
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+int analogRead(uint8_t);
+void analogWrite(uint8_t, int);
+void tone(uint8_t, unsigned int, unsigned long = 0);
+void noTone(uint8_t);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void attachInterrupt(uint8_t, void (*)(void), int);
+void detachInterrupt(uint8_t);
+void noInterrupts();
+void interrupts();
+char *itoa(int value, char *str, int base);
+extern void (*serialEventRun)(void);
+#include "HardwareSerial.h"
+#endif
@@ -0,0 +1,38 @@
+/*
+  Boards.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef Firmata_Boards_h
+#define Firmata_Boards_h
+#include "Arduino.h"
+#define TOTAL_ANALOG_PINS       6
+#define TOTAL_PINS              20
+#define TOTAL_PORTS             3
+#define VERSION_BLINK_PIN       13
+#define IS_PIN_DIGITAL(p)       ((p) >= 2 && (p) <= 19)
+#define IS_PIN_ANALOG(p)        ((p) >= 14 && (p) < 14 + TOTAL_ANALOG_PINS)
+#define IS_PIN_PWM(p)           ((p) == 3 || (p) == 5 || (p) == 6 || (p) == 9 || (p) == 10 || (p) == 11)
+#define PIN_TO_DIGITAL(p)       (p)
+#define PIN_TO_ANALOG(p)        ((p) - 14)
+#define PIN_TO_PWM(p)           PIN_TO_DIGITAL(p)
+
+static inline unsigned char readPort(byte port, byte bitmask)
+{
+    unsigned char out = 0, pin = port * 8;
+    for (byte i = 0; i < 8; ++i) {
+        if (IS_PIN_DIGITAL(pin + i) && (bitmask & (1 << i)) && digitalRead(PIN_TO_DIGITAL(pin + i))) out |= (1 << i);
+    }
+    return out;
+}
+
+static inline unsigned char writePort(byte port, byte value, byte bitmask)
+{
+    byte pin = port * 8;
+    for (byte i = 0; i < 8; ++i) {
+        if ((bitmask & (1 << i)) && IS_PIN_DIGITAL(pin + i)) digitalWrite(PIN_TO_DIGITAL(pin + i), (value >> i) & 1);
+    }
+    return 1;
+}
+#endif
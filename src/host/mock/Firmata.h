@@ -0,0 +1,33 @@
+/*
+  Firmata.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef Firmata_h
+#define Firmata_h
+#include "Boards.h"
+#define FIRMATA_MAJOR_VERSION   2
+#define FIRMATA_MINOR_VERSION   3
+#define MAX_DATA_BYTES          32
+#define START_SYSEX             0xF0
+#define END_SYSEX               0xF7
+extern "C" {
+    typedef void (*sysexCallbackFunction)(byte command, byte argc, byte*argv);
+}
+class FirmataClass {
+public:
+    FirmataClass();
+    void begin(long);
+    void setFirmwareNameAndVersion(const char *name, byte major, byte minor);
+    int available();
+    void processInput();
+    void attach(byte command, sysexCallbackFunction newFunction);
+private:
+    sysexCallbackFunction currentSysexCallback;
+    bool parsingSysex;
+    int sysexBytesRead;
+    byte storedInputData[MAX_DATA_BYTES];
+};
+extern FirmataClass Firmata;
+#endif
@@ -0,0 +1,25 @@
+/*
+  HardwareSerial.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+#include <stdint.h>
+#include <stddef.h>
+#define SERIAL_RX_BUFFER_SIZE 64
+class HardwareSerial {
+public:
+    void begin(unsigned long);
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t);
+    size_t write(const uint8_t*, size_t);
+    size_t print(const char*);
+};
+extern HardwareSerial Serial;
+#endif
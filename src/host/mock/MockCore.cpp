@@ -0,0 +1,143 @@
+/*
+  MockCore.cpp - host build stub of the Arduino core and libraries
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Serial reads from mockRx and writes to mockTx, pins are plain memory, time is
+  simulated, and the Wire/SPI/Servo/motor shield devices answer with fixed patterns.
+*/
+#include "Arduino.h"
+#include "Firmata.h"
+#include "Wire.h"
+#include "SPI.h"
+#include "Servo.h"
+#include "Adafruit_MotorShield.h"
+#include "MockCore.h"
+
+std::deque<uint8_t> mockRx;
+std::vector<uint8_t> mockTx;
+volatile uint8_t mockPortRegisters[NUM_PORTS][3];
+uint8_t SREG;
+unsigned long mockMicros = 0;
+int __heap_start;
+int *__brkval;
+void (*serialEventRun)(void) = 0;
+
+void init() {}
+void mockUpdatePins() {
+    // every pin reads back its output latch, like a loopback on each pin
+    for (int port = 0; port < NUM_PORTS; ++port) mockPortRegisters[port][0] = mockPortRegisters[port][2];
+}
+static void setBit(volatile uint8_t *reg, uint8_t mask, bool value) { if (value) *reg |= mask; else *reg &= ~mask; }
+void pinMode(uint8_t p, uint8_t m) {
+    uint8_t port = digitalPinToPort(p);
+    if (port == NOT_A_PIN) return;
+    setBit(portModeRegister(port), digitalPinToBitMask(p), m == OUTPUT);
+    if (m != OUTPUT) setBit(portOutputRegister(port), digitalPinToBitMask(p), m == INPUT_PULLUP);
+}
+void digitalWrite(uint8_t p, uint8_t v) {
+    uint8_t port = digitalPinToPort(p);
+    if (port != NOT_A_PIN) setBit(portOutputRegister(port), digitalPinToBitMask(p), v != LOW);
+}
+int digitalRead(uint8_t p) {
+    uint8_t port = digitalPinToPort(p);
+    mockUpdatePins();
+    return port != NOT_A_PIN && (*portInputRegister(port) & digitalPinToBitMask(p)) ? HIGH : LOW;
+}
+int analogRead(uint8_t p) {
+    // an analog pin configured as an output reads back its level, others a fixed pattern
+    uint8_t port = digitalPinToPort(p);
+    if (port != NOT_A_PIN && (*portModeRegister(port) & digitalPinToBitMask(p))) return digitalRead(p) ? 1023 : 0;
+    return (p * 37) & 0x3FF;
+}
+void analogWrite(uint8_t p, int v) { digitalWrite(p, v >= 128); } // PWM output seen as its majority level
+void tone(uint8_t, unsigned int, unsigned long) {}
+void noTone(uint8_t) {}
+unsigned long millis() { return mockMicros / 1000; }
+unsigned long micros() { mockUpdatePins(); mockMicros += 4; return mockMicros; }
+void delay(unsigned long ms) { mockMicros += ms * 1000; }
+void delayMicroseconds(unsigned int us) { mockMicros += us; }
+void attachInterrupt(uint8_t, void (*)(void), int) {}
+void detachInterrupt(uint8_t) {}
+void noInterrupts() {}
+void interrupts() {}
+char *itoa(int value, char *str, int base) { sprintf(str, base == 16 ? "%x" : "%d", value); return str; }
+
+HardwareSerial Serial;
+void HardwareSerial::begin(unsigned long) {}
+int HardwareSerial::available() { mockUpdatePins(); return mockRx.size(); }
+int HardwareSerial::read() { if (mockRx.empty()) return -1; int c = mockRx.front(); mockRx.pop_front(); return c; }
+int HardwareSerial::peek() { return mockRx.empty() ? -1 : mockRx.front(); }
+int HardwareSerial::availableForWrite() { return 63; }
+void HardwareSerial::flush() {}
+size_t HardwareSerial::write(uint8_t c) { mockTx.push_back(c); return 1; }
+size_t HardwareSerial::write(const uint8_t *b, size_t n) { mockTx.insert(mockTx.end(), b, b + n); return n; }
+size_t HardwareSerial::print(const char *s) { return write((const uint8_t*)s, strlen(s)); }
+
+FirmataClass Firmata;
+FirmataClass::FirmataClass() : currentSysexCallback(0), parsingSysex(false), sysexBytesRead(0) {}
+void FirmataClass::begin(long) {}
+void FirmataClass::setFirmwareNameAndVersion(const char *, byte, byte) {}
+int FirmataClass::available() { return Serial.available(); }
+void FirmataClass::attach(byte, sysexCallbackFunction f) { currentSysexCallback = f; }
+void FirmataClass::processInput() {
+    int c = Serial.read();
+    if (c < 0) return;
+    if (parsingSysex) {
+        if (c == END_SYSEX) {
+            parsingSysex = false;
+            if (currentSysexCallback) currentSysexCallback(storedInputData[0], sysexBytesRead - 1, storedInputData + 1);
+        } else if (sysexBytesRead < MAX_DATA_BYTES) {
+            storedInputData[sysexBytesRead++] = c;
+        }
+    } else if (c == START_SYSEX) {
+        parsingSysex = true;
+        sysexBytesRead = 0;
+    }
+}
+
+TwoWire Wire;
+void TwoWire::begin() {}
+void TwoWire::setClock(uint32_t) {}
+void TwoWire::beginTransmission(int) {}
+uint8_t TwoWire::endTransmission(uint8_t) { return 0; }
+uint8_t TwoWire::requestFrom(int, int q, int) { return q; }
+int TwoWire::available() { return 1; }
+int TwoWire::read() { return 0x5A; }
+size_t TwoWire::write(uint8_t) { return 1; }
+size_t TwoWire::write(const uint8_t *, size_t n) { return n; }
+
+SPIClass SPI;
+byte SPIClass::transfer(byte b) { return b ^ 0xFF; }
+void SPIClass::begin() {}
+void SPIClass::end() {}
+void SPIClass::setBitOrder(uint8_t) {}
+void SPIClass::setDataMode(uint8_t) {}
+void SPIClass::setClockDivider(uint8_t) {}
+
+Servo::Servo() : pin(-1), angle(90) {}
+uint8_t Servo::attach(int p, int, int) { pin = p; return 0; }
+void Servo::detach() { pin = -1; }
+void Servo::write(int v) { angle = v; }
+void Servo::writeMicroseconds(int) {}
+int Servo::read() { return angle; }
+bool Servo::attached() { return pin >= 0; }
+
+Adafruit_PWMServoDriver::Adafruit_PWMServoDriver(uint8_t a) : _i2caddr(a) {}
+void Adafruit_PWMServoDriver::begin() {}
+void Adafruit_PWMServoDriver::reset() {}
+void Adafruit_PWMServoDriver::setPWMFreq(float) {}
+void Adafruit_PWMServoDriver::setPWM(uint8_t, uint16_t, uint16_t) {}
+Adafruit_DCMotor::Adafruit_DCMotor() : MC(0), motornum(0) {}
+void Adafruit_DCMotor::run(uint8_t) {}
+void Adafruit_DCMotor::setSpeed(uint8_t) {}
+Adafruit_StepperMotor::Adafruit_StepperMotor() : usperstep(0), revsteps(0), currentstep(0), MC(0), steppernum(0) {}
+void Adafruit_StepperMotor::step(uint16_t, uint8_t, uint8_t) {}
+void Adafruit_StepperMotor::setSpeed(uint16_t) {}
+uint8_t Adafruit_StepperMotor::onestep(uint8_t, uint8_t) { return 0; }
+void Adafruit_StepperMotor::release() {}
+Adafruit_MotorShield::Adafruit_MotorShield(uint8_t a) : _addr(a), _freq(1600), _pwm(a) {}
+void Adafruit_MotorShield::begin(uint16_t f) { _freq = f; }
+void Adafruit_MotorShield::setPWM(uint8_t, uint16_t) {}
+void Adafruit_MotorShield::setPin(uint8_t, boolean) {}
+Adafruit_DCMotor *Adafruit_MotorShield::getMotor(uint8_t n) { return &dcmotors[n - 1]; }
+Adafruit_StepperMotor *Adafruit_MotorShield::getStepper(uint16_t s, uint8_t n) { steppers[n - 1].revsteps = s; return &steppers[n - 1]; }
@@ -0,0 +1,20 @@
+/*
+  MockCore.h - host build stub of the Arduino core
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  State of the simulated board, shared with the benchmark driver.
+*/
+#ifndef MockCore_h
+#define MockCore_h
+
+#include "Arduino.h"
+#include "Boards.h"
+#include <deque>
+#include <vector>
+
+extern std::deque<uint8_t> mockRx;   // bytes waiting to be read from Serial
+extern std::vector<uint8_t> mockTx;  // bytes written to Serial
+void mockUpdatePins(); // input registers follow the output latches, called whenever the core is entered
+extern unsigned long mockMicros;     // simulated time, advances on every micros() call
+
+#endif // MockCore.h
@@ -0,0 +1,31 @@
+/*
+  SPI.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+#include "Arduino.h"
+#define SPI_CLOCK_DIV4 0x00
+#define SPI_CLOCK_DIV16 0x01
+#define SPI_CLOCK_DIV64 0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2 0x04
+#define SPI_CLOCK_DIV8 0x05
+#define SPI_CLOCK_DIV32 0x06
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+class SPIClass {
+public:
+    static byte transfer(byte);
+    static void begin();
+    static void end();
+    static void setBitOrder(uint8_t);
+    static void setDataMode(uint8_t);
+    static void setClockDivider(uint8_t);
+};
+extern SPIClass SPI;
+#endif
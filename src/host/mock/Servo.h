@@ -0,0 +1,24 @@
+/*
+  Servo.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef Servo_h
+#define Servo_h
+#include "Arduino.h"
+#define MAX_SERVOS 12
+class Servo {
+public:
+    Servo();
+    uint8_t attach(int pin, int min, int max);
+    void detach();
+    void write(int value);
+    void writeMicroseconds(int value);
+    int read();
+    bool attached();
+private:
+    int pin;
+    int angle;
+};
+#endif
@@ -0,0 +1,24 @@
+/*
+  Wire.h - host build stub of the Arduino core/library header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use.
+*/
+#ifndef TwoWire_h
+#define TwoWire_h
+#include "Arduino.h"
+#define BUFFER_LENGTH 32
+class TwoWire {
+public:
+    void begin();
+    void setClock(uint32_t);
+    void beginTransmission(int);
+    uint8_t endTransmission(uint8_t = true);
+    uint8_t requestFrom(int, int, int = true);
+    int available();
+    int read();
+    size_t write(uint8_t);
+    size_t write(const uint8_t *, size_t);
+};
+extern TwoWire Wire;
+#endif
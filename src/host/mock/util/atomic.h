@@ -0,0 +1,12 @@
+/*
+  atomic.h - host build stub of the avr-libc header of the same name
+  Copyright (C) 2014 MathWorks.  All rights reserved.
+
+  Only declares what the server and the library wrappers use. The host build has no
+  interrupts, so the block runs once without masking anything.
+*/
+#ifndef atomic_h
+#define atomic_h
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) for(unsigned char atomicOnce = 1; atomicOnce; atomicOnce = 0)
+#endif